@@ -0,0 +1,173 @@
+-- Packs images in texture atlas pages, and writes the atlas file naming their regions, which texture.loadAtlas reads
+-- (see texture.c for the format). Each region is named after its image file, without the directory and extension.
+-- Usage: ./ctruLua-host atlasconv.lua [-s maxSize] [-p padding] [-f format] output.atlas image...
+-- The pages are written next to the atlas file, as output-1.tex, output-2.tex...; they are at most maxSize pixels wide
+-- and high (default 1024), with padding pixels between the regions (default 1) and in the given format (default
+-- RGBA8, see texconv.lua).
+
+local texture = require("ctr.gfx.texture")
+
+local USAGE = "usage: atlasconv.lua [-s maxSize (<= 1024)] [-p padding] [-f format] output.atlas image..."
+
+local maxSize, padding, formatName = 1024, 1, "RGBA8"
+local i = 1
+while arg[i] and arg[i]:match("^%-") do
+	local option, value = arg[i], arg[i+1] or error(USAGE, 0)
+	if option == "-s" then maxSize = tonumber(value)
+	elseif option == "-p" then padding = tonumber(value)
+	elseif option == "-f" then formatName = value:upper()
+	else error(USAGE, 0) end
+	i = i + 2
+end
+local output = arg[i]
+local format = texture["FORMAT_" .. formatName]
+
+if not (output and arg[i+1] and maxSize and padding and format) or maxSize > 1024 then
+	error(USAGE, 0)
+end
+
+local images = {}
+for j = i + 1, #arg do
+	local path = arg[j]
+	local tex = assert(texture.load(path, texture.PLACE_RAM))
+	local w, h = tex:getSize()
+	if w + padding > maxSize or h + padding > maxSize then
+		error(("%s: %dx%d, bigger than the pages"):format(path, w, h), 0)
+	end
+	images[#images+1] = { name = path:match("([^/]*)$"):gsub("%.[^.]*$", ""), texture = tex, w = w, h = h }
+end
+
+-- Skyline bottom-left packing: the skyline is the top of the packed images, as segments from left to right; an image
+-- goes where its bottom is the highest, then the leftmost
+local function newPage()
+	return { skyline = { { x = 0, y = 0, w = maxSize } }, width = 0, height = 0, images = {} }
+end
+
+local function fit(skyline, i, w, h)
+	local x = skyline[i].x
+	if x + w > maxSize then return nil end
+	local y, remaining = 0, w
+	while remaining > 0 do
+		local node = skyline[i]
+		y = math.max(y, node.y)
+		if y + h > maxSize then return nil end
+		remaining, i = remaining - node.w, i + 1
+	end
+	return y
+end
+
+local function insert(page, w, h)
+	local skyline = page.skyline
+	local best, bestX, bestY
+	for i = 1, #skyline do
+		local y = fit(skyline, i, w, h)
+		if y and (not best or y < bestY or (y == bestY and skyline[i].x < bestX)) then
+			best, bestX, bestY = i, skyline[i].x, y
+		end
+	end
+	if not best then return nil end
+
+	-- The new segment covers the ones under the image
+	table.insert(skyline, best, { x = bestX, y = bestY + h, w = w })
+	local i = best + 1
+	while i <= #skyline do
+		local node, right = skyline[i], bestX + w
+		if node.x >= right then break end
+		if node.x + node.w <= right then
+			table.remove(skyline, i)
+		else
+			node.w, node.x = node.x + node.w - right, right
+			break
+		end
+	end
+	-- Merge the segments at the same height
+	i = 1
+	while i < #skyline do
+		if skyline[i].y == skyline[i+1].y then
+			skyline[i].w = skyline[i].w + skyline[i+1].w
+			table.remove(skyline, i + 1)
+		else
+			i = i + 1
+		end
+	end
+	return bestX, bestY
+end
+
+-- Tallest images first, then widest
+table.sort(images, function(a, b)
+	if a.h ~= b.h then return a.h > b.h end
+	if a.w ~= b.w then return a.w > b.w end
+	return a.name < b.name
+end)
+
+local pages = { newPage() }
+for _, image in ipairs(images) do
+	local w, h = image.w + padding, image.h + padding
+	local index, x, y = 1
+	while true do
+		if not pages[index] then pages[index] = newPage() end
+		x, y = insert(pages[index], w, h)
+		if x then break end
+		index = index + 1
+	end
+	local page = pages[index]
+	image.page, image.x, image.y = index, x, y
+	page.images[#page.images+1] = image
+	page.width = math.max(page.width, x + image.w)
+	page.height = math.max(page.height, y + image.h)
+end
+
+-- Pages
+local base = output:gsub("%.atlas$", "")
+local pageNames = {}
+for i, page in ipairs(pages) do
+	local tex = texture.new(page.width, page.height, texture.PLACE_RAM)
+	for _, image in ipairs(page.images) do
+		for y = 0, image.h - 1 do
+			for x = 0, image.w - 1 do
+				tex:setPixel(image.x + x, image.y + y, image.texture:getPixel(x, y))
+			end
+		end
+	end
+	if format ~= texture.FORMAT_RGBA8 then
+		-- Converted on load, like texconv.lua
+		local tmp = os.tmpname()
+		assert(tex:save(tmp, texture.TYPE_PNG))
+		tex = assert(texture.load(tmp, texture.PLACE_RAM, texture.TYPE_TEX, format))
+		os.remove(tmp)
+	end
+	local path = ("%s-%d.tex"):format(base, i)
+	assert(tex:save(path, texture.TYPE_TEX))
+	pageNames[i] = path:match("[^/]*$")
+end
+
+-- Atlas file: header, page name offsets, regions sorted by name, names
+table.sort(images, function(a, b) return a.name < b.name end)
+for i = 2, #images do
+	if images[i].name == images[i-1].name then error("two images named " .. images[i].name, 0) end
+end
+
+local names, namesSize = {}, 0
+local function addName(name)
+	names[#names+1] = name .. "\0"
+	namesSize = namesSize + #name + 1
+	return namesSize - #name - 1
+end
+
+local pageOffsets, regions = {}, {}
+for i, image in ipairs(images) do
+	regions[i] = string.pack("<I2I2I2I2I2I2I4", image.page - 1, image.x, image.y, image.w, image.h, 0, addName(image.name))
+end
+for i, name in ipairs(pageNames) do
+	pageOffsets[i] = string.pack("<I4", addName(name))
+end
+
+local file = assert(io.open(output, "wb"))
+file:write(string.pack("<c4I2I2I4I4", "LATL", 1, #pages, #images, namesSize))
+file:write(table.concat(pageOffsets), table.concat(regions), table.concat(names))
+file:close()
+
+for i, page in ipairs(pages) do
+	print(("%s: %dx%d, %d images"):format(pageNames[i], page.width, page.height, #page.images))
+end
+print(("%s: %d regions in %d pages"):format(output, #images, #pages))
@@ -0,0 +1,83 @@
+-- Measures the time the main thread spends loading textures while frames go on: texture.load in the
+-- frame loop, against texture.loadAsync with a :ready() check per frame. Also checks that both load
+-- the same pixels.
+-- Usage: ./ctruLua-host bench/asyncload.lua [image [count]]
+
+local ctr = require("ctr")
+local texture = require("ctr.gfx.texture")
+
+local IMAGE = arg[1] or (arg[0]:match("(.*/)") or "./") .. "../../libs/sfillib/sample/data/3dbrew.png"
+local COUNT = tonumber(arg[2]) or 16
+local FRAME_US = 16667
+
+-- Wait for the end of the frame, like the VBlank wait of the console
+local function endFrame(start)
+	while ctr.utime() - start < FRAME_US do end
+end
+
+local function report(name, frames, total, max)
+	print(("%-6s %3d textures in %3d frames, main thread: %9.3f ms total, %8.3f ms max per frame"):format(
+		name, COUNT, frames, total / 1000, max / 1000))
+end
+
+-- One texture.load per frame
+local sync = {}
+local frames, total, max = 0, 0, 0
+while #sync < COUNT do
+	local start = ctr.utime()
+	sync[#sync+1] = assert(texture.load(IMAGE))
+	local time = ctr.utime() - start
+	total, max, frames = total + time, math.max(max, time), frames + 1
+	endFrame(start)
+end
+report("load", frames, total, max)
+
+-- Everything queued on the first frame, the textures created as they're decoded
+local handles, async, loaded = {}, {}, 0
+frames, total, max = 0, 0, 0
+while loaded < COUNT do
+	local start = ctr.utime()
+	while #handles < COUNT do
+		handles[#handles+1] = assert(texture.loadAsync(IMAGE))
+	end
+	for i, handle in ipairs(handles) do
+		if not async[i] and handle:ready() then
+			async[i] = assert(handle:get())
+			loaded = loaded + 1
+		end
+	end
+	local time = ctr.utime() - start
+	total, max, frames = total + time, math.max(max, time), frames + 1
+	endFrame(start)
+end
+report("async", frames, total, max)
+
+-- Same pixels
+local w, h = sync[1]:getSize()
+for i = 1, COUNT do
+	assert(async[i]:getSize() == w)
+	for y = 0, h - 1, 7 do
+		for x = 0, w - 1, 5 do
+			assert(sync[i]:getPixel(x, y) == async[i]:getPixel(x, y), "different pixel")
+		end
+	end
+end
+
+-- Errors and the queue bound
+local missing = assert(texture.loadAsync("/nonexistent.png"))
+local ok, err = missing:get()
+assert(ok == nil and err)
+-- Loads over the bound of the queue fail instead of blocking, unless the thread keeps up
+local queued, refused = {}, 0
+for i = 1, 64 do
+	local handle, err = texture.loadAsync(IMAGE)
+	if handle then
+		queued[#queued+1] = handle
+	else
+		assert(err == "Too many pending loads", err)
+		refused = refused + 1
+	end
+end
+for _, handle in ipairs(queued) do assert(handle:get()) end
+print(("%d of 64 loads queued at once"):format(#queued))
+print("checks passed")
@@ -0,0 +1,106 @@
+-- Packs generated sprites in an atlas with atlasconv.lua, checks the regions against the sprites, then measures the draw
+-- calls and time of a frame drawing them from separate textures against drawing them from the atlas.
+-- Usage: ./ctruLua-host bench/atlas.lua [sprites [draws]]
+
+local ctr = require("ctr")
+local gfx = require("ctr.gfx")
+local texture = require("ctr.gfx.texture")
+
+local SPRITES = tonumber(arg[1]) or 64
+local DRAWS = tonumber(arg[2]) or 2000
+local SCRIPT_DIR = (arg[0]:match("(.*/)") or "./") .. "../"
+local DIR = os.tmpname()
+os.remove(DIR)
+assert(os.execute(("mkdir '%s'"):format(DIR)))
+
+-- Sprites of various sizes, each with its own colors
+local sprites = {}
+for i = 1, SPRITES do
+	local w, h = 8 + (i * 7) % 41, 8 + (i * 13) % 29
+	local tex = texture.new(w, h, texture.PLACE_RAM)
+	for y = 0, h - 1 do
+		for x = 0, w - 1 do
+			tex:setPixel(x, y, (i * 0x1F3D5B00 + x * 0x40000 + y * 0x400) & 0xFFFFFF00 | 0xFF)
+		end
+	end
+	local name = ("sprite%03d"):format(i)
+	assert(tex:save(("%s/%s.png"):format(DIR, name)))
+	sprites[i] = { name = name, w = w, h = h }
+end
+
+local start = ctr.utime()
+local args = arg
+arg = { [0] = SCRIPT_DIR .. "atlasconv.lua", "-s", "256", DIR .. "/sprites.atlas" }
+for i, sprite in ipairs(sprites) do arg[#arg+1] = ("%s/%s.png"):format(DIR, sprite.name) end
+dofile(arg[0])
+arg = args
+print(("packed in %.3f ms"):format((ctr.utime() - start) / 1000))
+
+-- Same sizes and pixels, by name and by index
+local atlas = assert(texture.loadAtlas(DIR .. "/sprites.atlas"))
+assert(atlas:getRegionCount() == SPRITES)
+for i, sprite in ipairs(sprites) do
+	local tex = assert(texture.load(("%s/%s.png"):format(DIR, sprite.name)))
+	sprite.texture = tex
+	local index = assert(atlas:getIndex(sprite.name))
+	assert(atlas:getName(index) == sprite.name)
+	local w, h = atlas:getSize(sprite.name)
+	assert(w == sprite.w and h == sprite.h, "wrong region size")
+	sprite.index = index
+end
+assert(atlas:getIndex("nonexistent") == nil)
+assert(not pcall(atlas.draw, atlas, "nonexistent", 0, 0))
+assert(not pcall(atlas.draw, atlas, SPRITES + 1, 0, 0))
+
+-- The pages hold the sprites where the regions say
+local file = assert(io.open(DIR .. "/sprites.atlas", "rb"))
+local data = file:read("a")
+file:close()
+local magic, version, pageCount, regionCount, namesSize, pos = string.unpack("<c4I2I2I4I4", data)
+assert(magic == "LATL" and version == 1 and regionCount == SPRITES)
+local names = data:sub(pos + pageCount * 4 + regionCount * 16)
+local pages = {}
+for i = 1, pageCount do
+	local offset = string.unpack("<I4", data, pos + (i - 1) * 4)
+	pages[i] = assert(texture.load(DIR .. "/" .. string.unpack("z", names, offset + 1)))
+end
+for i = 1, regionCount do
+	local page, x, y, w, h, _, name = string.unpack("<I2I2I2I2I2I2I4", data, pos + pageCount * 4 + (i - 1) * 16)
+	local sprite = sprites[tonumber(string.unpack("z", names, name + 1):match("%d+"))]
+	assert(sprite.index == i)
+	for sy = 0, h - 1 do
+		for sx = 0, w - 1 do
+			assert(pages[page + 1]:getPixel(x + sx, y + sy) == sprite.texture:getPixel(sx, sy), "wrong region pixels")
+		end
+	end
+end
+print(("%d sprites in %d pages"):format(regionCount, pageCount))
+
+-- Frame drawing the sprites in turn
+local function frame(draw)
+	gfx.start(gfx.TOP)
+	local start = ctr.utime()
+	for i = 1, DRAWS do
+		draw(sprites[(i - 1) % SPRITES + 1], (i * 37) % 400, (i * 23) % 240)
+	end
+	local time = ctr.utime() - start
+	gfx.stop()
+	gfx.render()
+	return gfx.getStats(), time
+end
+
+local function report(name, stats, time)
+	print(("%-14s %5d draws: %5d draw calls, %8.3f ms"):format(name, DRAWS, stats.drawCalls, time / 1000))
+	return stats
+end
+
+local textures = report("textures", frame(function(sprite, x, y) sprite.texture:draw(x, y) end))
+local byName = report("atlas by name", frame(function(sprite, x, y) atlas:draw(sprite.name, x, y) end))
+local byIndex = report("atlas by index", frame(function(sprite, x, y) atlas:draw(sprite.index, x, y) end))
+assert(textures.drawCalls == DRAWS)
+assert(byIndex.drawCalls <= byName.drawCalls and byIndex.drawCalls < textures.drawCalls)
+assert(byIndex.quads == DRAWS)
+
+atlas:unload()
+os.execute(("rm -r '%s'"):format(DIR))
+print("checks passed")
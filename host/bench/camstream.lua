@@ -0,0 +1,134 @@
+-- Measures the time the main thread spends getting camera frames: cam.takePicture for each frame, against a stream
+-- updated each frame (cam.startStream), with the frames received and shown. Also checks the pixels of the frames.
+-- Usage: ./ctruLua-host bench/camstream.lua [seconds]
+-- or, to check the frames read from files: ./ctruLua-host -c /tmp/frame%d.raw bench/camstream.lua [seconds] /tmp/frame%d.raw
+
+local ctr = require("ctr")
+local gfx = require("ctr.gfx")
+local cam = require("ctr.cam")
+
+local SECONDS = tonumber(arg[1]) or 1
+local PATTERN = arg[2]
+local W, H = 400, 240
+local FILES = 3
+
+local function expand(v, bits)
+	return (v << (8 - bits)) | (v >> (2 * bits - 8))
+end
+
+local function rgb565(r, g, b)
+	return expand(r, 5) << 24 | expand(g, 6) << 16 | expand(b, 5) << 8 | 0xFF
+end
+
+-- Frames read from files: frame i is filled with a color of its own
+local function fileColor(i)
+	return (i * 5 + 3) & 31, (i * 13 + 7) & 63, (i * 3 + 11) & 31
+end
+
+if PATTERN then
+	for i = 0, FILES - 1 do
+		local r, g, b = fileColor(i)
+		local file = assert(io.open(PATTERN:format(i), "wb"))
+		file:write(string.pack("<I2", r << 11 | g << 5 | b):rep(W * H))
+		file:close()
+	end
+end
+
+-- Frame of the generated ones (see 3ds.h of the sf2dlib host backend) or of the files, checked on a grid of texels
+local function checkFrame(tex)
+	local w, h = tex:getSize()
+	assert(w == W and h == H, "wrong frame size")
+	if PATTERN then
+		local first = tex:getPixel(0, 0)
+		local found = false
+		for i = 0, FILES - 1 do
+			if first == rgb565(fileColor(i)) then found = true end
+		end
+		assert(found, ("frame not read from the files (%08x)"):format(first))
+		for y = 0, H - 1, 17 do
+			for x = 0, W - 1, 13 do
+				assert(tex:getPixel(x, y) == first, "wrong texel")
+			end
+		end
+		return
+	end
+	local frame = tex:getPixel(0, 0) >> 27 -- red of (0, 0): the frame number modulo 32, all the texels depend on
+	for y = 0, H - 1, 17 do
+		for x = 0, W - 1, 13 do
+			local expected = rgb565((x + frame) & 31, (y + 2 * frame) & 63, (frame + cam.PORT_CAM1) & 31)
+			local got = tex:getPixel(x, y)
+			assert(got == expected, ("wrong texel at %d,%d: %08x, expected %08x"):format(x, y, got, expected))
+		end
+	end
+end
+
+assert(cam.init())
+cam.activate(cam.SELECT_OUT1)
+cam.setFrameRate(cam.SELECT_OUT1, cam.FRAME_RATE_30)
+
+local function frame(tex)
+	gfx.start(gfx.TOP)
+	tex:draw(0, 0)
+	gfx.stop()
+	gfx.render()
+end
+
+-- A picture each frame: waits for the camera
+local pictures, main = 0, 0
+local start = ctr.utime()
+while ctr.utime() - start < SECONDS * 1000000 do
+	local t = ctr.utime()
+	local picture = assert(cam.takePicture(cam.PORT_CAM1, W, H))
+	main = main + ctr.utime() - t
+	frame(picture)
+	checkFrame(picture)
+	picture:unload()
+	pictures = pictures + 1
+end
+print(("takePicture: %4d frames in %.1f s, %4d pictures, %8.3f ms per frame on the main thread"):format(
+	pictures, SECONDS, pictures, main / pictures / 1000))
+
+-- Stream, updated each frame
+local stream = assert(cam.startStream(cam.PORT_CAM1, W, H))
+local preview = stream:getTexture()
+assert(preview == stream:getTexture())
+assert(preview:getPixel(10, 10) == 0x000000FF, "not black before the first frame")
+local frames, updates, updateTime, maxTime = 0, 0, 0, 0
+start = ctr.utime()
+while ctr.utime() - start < SECONDS * 1000000 do
+	local t = ctr.utime()
+	local new = stream:update()
+	t = ctr.utime() - t
+	updateTime = updateTime + t
+	if new then
+		updates = updates + 1
+		maxTime = math.max(maxTime, t)
+		checkFrame(preview)
+	end
+	frame(preview)
+	frames = frames + 1
+end
+local received, converted = stream:getFrameCount()
+print(("stream:      %4d frames in %.1f s, %4d pictures, %8.3f ms per frame on the main thread (max %.3f ms)"):format(
+	frames, SECONDS, updates, updateTime / frames / 1000, maxTime / 1000))
+print(("stream:      %d frames received, %d put in the texture"):format(received, converted))
+assert(converted == updates and converted <= received and updates > 0)
+
+-- The texture keeps the last frame after stop (the last frame received is still put in it), and stays valid as long
+-- as it's used
+stream:stop()
+stream:update()
+assert(not stream:update())
+checkFrame(preview)
+stream = nil
+collectgarbage()
+frame(preview)
+checkFrame(preview)
+preview = nil
+collectgarbage()
+
+cam.shutdown()
+if PATTERN then
+	for i = 0, FILES - 1 do os.remove(PATTERN:format(i)) end
+end
+print("checks passed")
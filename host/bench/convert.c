@@ -0,0 +1,417 @@
+// Checks the kernels of sf2d_convert.h against per-channel reference conversions, bit for bit: exhaustively for the
+// 8 and 16-bit formats and for YUV422, on random pixels for the others, with unaligned rows of all lengths, and the
+// conversions to and from tiled buffers. Then measures the kernels against the reference, and the tiled outputs
+// against the previous path of converting to RGBA8 first.
+// Usage: make bench, then ./build/bench_convert
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include <sf2d.h>
+#include <sf2d_tile.h>
+#include <sf2d_convert.h>
+
+#define RUNS 20
+
+static const struct {
+	const char *name;
+	sf2d_pixel_format format;
+} formats[] = {
+	{ "RGBA8",    SF2D_PIXEL_RGBA8    },
+	{ "ABGR8",    SF2D_PIXEL_ABGR8    },
+	{ "RGB8",     SF2D_PIXEL_RGB8     },
+	{ "BGR8",     SF2D_PIXEL_BGR8     },
+	{ "RGB565",   SF2D_PIXEL_RGB565   },
+	{ "RGB5A1",   SF2D_PIXEL_RGB5A1   },
+	{ "RGBA4",    SF2D_PIXEL_RGBA4    },
+	{ "AI8",      SF2D_PIXEL_AI8      },
+	{ "I8",       SF2D_PIXEL_I8       },
+	{ "A8",       SF2D_PIXEL_A8       },
+	{ "IA4",      SF2D_PIXEL_IA4      },
+	{ "COVERAGE", SF2D_PIXEL_COVERAGE },
+	{ "MONO",     SF2D_PIXEL_MONO     },
+	{ "YUV422",   SF2D_PIXEL_YUV422   },
+};
+
+#define FORMAT_COUNT (int)(sizeof(formats) / sizeof(*formats))
+
+static double now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { if (!(cond)) { printf("FAIL: " __VA_ARGS__); printf("\n"); failures++; } } while (0)
+
+static int source_only(sf2d_pixel_format format)
+{
+	return format == SF2D_PIXEL_MONO || format == SF2D_PIXEL_YUV422;
+}
+
+static void fill_random(u8 *buf, size_t size)
+{
+	size_t i;
+	for (i = 0; i < size; i++)
+		buf[i] = rand();
+}
+
+/*
+ * Reference conversions, a channel at a time: the formulas of the previous
+ * per-texel code of sf2d_tile.c, and of sf2d_convert.h for YUV422
+ */
+
+static u8 from_bits(unsigned v, int n)
+{
+	return n == 4 ? v * 17 : (v << (8 - n)) | (v >> (2 * n - 8));
+}
+
+static u8 clamp(int v)
+{
+	return v < 0 ? 0 : v > 255 ? 255 : v;
+}
+
+// Rounded to the nearest, halves up, with a floor division
+static int fixed_round(long v)
+{
+	return (int)floor((v + 32768) / 65536.0);
+}
+
+static void ref_to_rgba8(sf2d_pixel_format format, const u8 *row, int i, u8 *p)
+{
+	const u8 *s = row + i * sf2d_pixel_bits(format) / 8;
+	unsigned v = sf2d_pixel_bits(format) == 16 ? s[0] | s[1] << 8 : 0;
+	int y, u, w;
+
+	p[3] = 255;
+	switch (format) {
+	case SF2D_PIXEL_RGBA8: p[0] = s[0]; p[1] = s[1]; p[2] = s[2]; p[3] = s[3]; break;
+	case SF2D_PIXEL_ABGR8: p[0] = s[3]; p[1] = s[2]; p[2] = s[1]; p[3] = s[0]; break;
+	case SF2D_PIXEL_RGB8: p[0] = s[0]; p[1] = s[1]; p[2] = s[2]; break;
+	case SF2D_PIXEL_BGR8: p[0] = s[2]; p[1] = s[1]; p[2] = s[0]; break;
+	case SF2D_PIXEL_RGB565:
+		p[0] = from_bits(v >> 11, 5); p[1] = from_bits((v >> 5) & 0x3F, 6); p[2] = from_bits(v & 0x1F, 5);
+		break;
+	case SF2D_PIXEL_RGB5A1:
+		p[0] = from_bits(v >> 11, 5); p[1] = from_bits((v >> 6) & 0x1F, 5);
+		p[2] = from_bits((v >> 1) & 0x1F, 5); p[3] = (v & 1) * 255;
+		break;
+	case SF2D_PIXEL_RGBA4:
+		p[0] = from_bits(v >> 12, 4); p[1] = from_bits((v >> 8) & 0xF, 4);
+		p[2] = from_bits((v >> 4) & 0xF, 4); p[3] = from_bits(v & 0xF, 4);
+		break;
+	case SF2D_PIXEL_AI8: p[0] = p[1] = p[2] = s[1]; p[3] = s[0]; break;
+	case SF2D_PIXEL_I8: p[0] = p[1] = p[2] = s[0]; break;
+	case SF2D_PIXEL_A8: p[0] = p[1] = p[2] = 0; p[3] = s[0]; break;
+	case SF2D_PIXEL_IA4: p[0] = p[1] = p[2] = from_bits(s[0] >> 4, 4); p[3] = from_bits(s[0] & 0xF, 4); break;
+	case SF2D_PIXEL_COVERAGE: p[0] = p[1] = p[2] = 255; p[3] = s[0]; break;
+	case SF2D_PIXEL_MONO:
+		p[0] = p[1] = p[2] = 255;
+		p[3] = (row[i / 8] >> (7 - i % 8)) & 1 ? 255 : 0;
+		break;
+	case SF2D_PIXEL_YUV422:
+		s = row + i / 2 * 4;
+		y = s[i % 2 * 2];
+		u = s[1] - 128;
+		w = s[3] - 128;
+		p[0] = clamp(y + fixed_round(91881L * w));
+		p[1] = clamp(y + fixed_round(-22554L * u - 46802L * w));
+		p[2] = clamp(y + fixed_round(116130L * u));
+		break;
+	default:
+		break;
+	}
+}
+
+#define TO_BITS(v, n) (((v) * ((1 << (n)) - 1) + 127) / 255)
+#define LUMINANCE(p) (((p)[0] * 77 + (p)[1] * 150 + (p)[2] * 29 + 128) >> 8)
+
+// Writes the pixel in d, returns its size in bytes
+static int ref_from_rgba8(sf2d_pixel_format format, const u8 *p, u8 *d)
+{
+	unsigned v;
+	switch (format) {
+	case SF2D_PIXEL_RGBA8: d[0] = p[0]; d[1] = p[1]; d[2] = p[2]; d[3] = p[3]; return 4;
+	case SF2D_PIXEL_ABGR8: d[0] = p[3]; d[1] = p[2]; d[2] = p[1]; d[3] = p[0]; return 4;
+	case SF2D_PIXEL_RGB8: d[0] = p[0]; d[1] = p[1]; d[2] = p[2]; return 3;
+	case SF2D_PIXEL_BGR8: d[0] = p[2]; d[1] = p[1]; d[2] = p[0]; return 3;
+	case SF2D_PIXEL_RGB565:
+		v = TO_BITS(p[0], 5) << 11 | TO_BITS(p[1], 6) << 5 | TO_BITS(p[2], 5);
+		d[0] = v; d[1] = v >> 8;
+		return 2;
+	case SF2D_PIXEL_RGB5A1:
+		v = TO_BITS(p[0], 5) << 11 | TO_BITS(p[1], 5) << 6 | TO_BITS(p[2], 5) << 1 | (p[3] >> 7);
+		d[0] = v; d[1] = v >> 8;
+		return 2;
+	case SF2D_PIXEL_RGBA4:
+		v = TO_BITS(p[0], 4) << 12 | TO_BITS(p[1], 4) << 8 | TO_BITS(p[2], 4) << 4 | TO_BITS(p[3], 4);
+		d[0] = v; d[1] = v >> 8;
+		return 2;
+	case SF2D_PIXEL_AI8: d[0] = p[3]; d[1] = LUMINANCE(p); return 2;
+	case SF2D_PIXEL_I8: d[0] = LUMINANCE(p); return 1;
+	case SF2D_PIXEL_A8: d[0] = p[3]; return 1;
+	case SF2D_PIXEL_IA4: d[0] = TO_BITS(LUMINANCE(p), 4) << 4 | TO_BITS(p[3], 4); return 1;
+	case SF2D_PIXEL_COVERAGE: d[0] = p[3]; return 1;
+	default: return 0;
+	}
+}
+
+static void ref_convert_row(u8 *dst, sf2d_pixel_format dst_format, const u8 *src, sf2d_pixel_format src_format, int n)
+{
+	u8 p[4];
+	int i;
+	for (i = 0; i < n; i++) {
+		ref_to_rgba8(src_format, src, i, p);
+		dst += ref_from_rgba8(dst_format, p, dst);
+	}
+}
+
+// Source rows: all the values of the 8 and 16-bit formats, random pixels for the others
+static void make_source(u8 *src, sf2d_pixel_format format, int *n)
+{
+	int bits = sf2d_pixel_bits(format), i;
+	if (bits == 16 && format != SF2D_PIXEL_YUV422) {
+		*n = 65536;
+		for (i = 0; i < *n; i++) {
+			src[i * 2] = i;
+			src[i * 2 + 1] = i >> 8;
+		}
+	} else if (bits == 8 || bits == 1) {
+		*n = 256 * 8 / bits;
+		for (i = 0; i < 256; i++)
+			src[i] = i;
+	} else {
+		*n = 65536;
+		fill_random(src, *n * bits / 8);
+		memset(src, 0, 8);
+		memset(src + 8, 0xFF, 8);
+	}
+}
+
+static void check_rows(void)
+{
+	static u8 src[65536 * 4 + 1], dst[65536 * 4 + 1], expected[65536 * 4];
+	int s, d, n, len, offset;
+
+	for (s = 0; s < FORMAT_COUNT; s++) {
+		sf2d_pixel_format sf = formats[s].format;
+		for (d = 0; d < FORMAT_COUNT; d++) {
+			sf2d_pixel_format df = formats[d].format;
+			if (source_only(df)) {
+				CHECK(sf == df || !sf2d_convert_row(dst, df, src, sf, 1), "%s to %s converted", formats[s].name, formats[d].name);
+				continue;
+			}
+
+			// The whole row, aligned and not
+			for (offset = 0; offset < 2; offset++) {
+				make_source(src + offset, sf, &n);
+				ref_convert_row(expected, df, src + offset, sf, n);
+				size_t size = (size_t)n * sf2d_pixel_bits(df) / 8;
+				memset(dst, 0xAA, sizeof(dst));
+				CHECK(sf2d_convert_row(dst + offset, df, src + offset, sf, n), "%s to %s not converted", formats[s].name, formats[d].name);
+				CHECK(!memcmp(dst + offset, expected, size), "%s to %s, offset %d", formats[s].name, formats[d].name, offset);
+			}
+
+			// Short rows, for the ends of the word loops, without writing past them; MONO rows are whole bytes
+			for (len = 0; len < 20; len++) {
+				int start = sf == SF2D_PIXEL_MONO ? 8 : sf == SF2D_PIXEL_YUV422 ? 2 : 1;
+				size_t size = (size_t)len * sf2d_pixel_bits(df) / 8;
+				ref_convert_row(expected, df, src + start * sf2d_pixel_bits(sf) / 8, sf, len);
+				memset(dst, 0xAA, size + 8);
+				sf2d_convert_row(dst + 1, df, src + start * sf2d_pixel_bits(sf) / 8, sf, len);
+				CHECK(!memcmp(dst + 1, expected, size) && dst[0] == 0xAA && dst[size + 1] == 0xAA,
+					"%s to %s, %d pixels", formats[s].name, formats[d].name, len);
+			}
+		}
+	}
+}
+
+// Every Y, U and V, to the formats of the direct kernels; also checks the rounding against the float formulas
+static void check_yuv(void)
+{
+	static u8 src[65536 * 2], dst[65536 * 4], expected[65536 * 4];
+	const sf2d_pixel_format targets[] = { SF2D_PIXEL_RGBA8, SF2D_PIXEL_ABGR8, SF2D_PIXEL_RGB565 };
+	double max_error = 0;
+	int u, v, y, t;
+
+	for (u = 0; u < 256; u++) {
+		for (v = 0; v < 256; v++) {
+			for (y = 0; y < 256; y += 2) {
+				u8 *pair = src + (v * 128 + y / 2) * 4;
+				pair[0] = y; pair[1] = u; pair[2] = y + 1; pair[3] = v;
+			}
+		}
+		for (t = 0; t < 3; t++) {
+			size_t size = 65536 * sf2d_pixel_bits(targets[t]) / 8;
+			sf2d_convert_row(dst, targets[t], src, SF2D_PIXEL_YUV422, 65536);
+			ref_convert_row(expected, targets[t], src, SF2D_PIXEL_YUV422, 65536);
+			CHECK(!memcmp(dst, expected, size), "YUV422 to format %d, U = %d", targets[t], u);
+		}
+		for (v = 0; v < 256; v++) {
+			y = (u * 7 + v * 13) & 0xFF;
+			double r = y + 1.402 * (v - 128), g = y - 0.344136 * (u - 128) - 0.714136 * (v - 128), b = y + 1.772 * (u - 128);
+			u8 p[4], pair[4] = { y, u, y, v };
+			ref_to_rgba8(SF2D_PIXEL_YUV422, pair, 0, p);
+			double e = fmax(fabs(p[0] - clamp(lround(r))), fmax(fabs(p[1] - clamp(lround(g))), fabs(p[2] - clamp(lround(b)))));
+			if (e > max_error) max_error = e;
+		}
+	}
+	CHECK(max_error <= 1, "YUV422 off by %.0f from the float formulas", max_error);
+}
+
+// Tiled outputs and inputs against the row conversions followed by the tiling, and the other way
+static void check_tiled(void)
+{
+	const sf2d_texfmt textures[] = { TEXFMT_RGBA8, TEXFMT_RGB8, TEXFMT_RGB565, TEXFMT_RGBA4, TEXFMT_IA8, TEXFMT_A8 };
+	enum { W = 64, H = 64, RX = 3, RY = 5, RW = 58, RH = 37 };
+	static u8 src[W * H * 4], texels[W * H * 4], tiled[W * H * 4], expected[W * H * 4], back[W * H * 4];
+	int t, s, y;
+
+	for (t = 0; t < sizeof(textures) / sizeof(*textures); t++) {
+		sf2d_pixel_format tf = sf2d_convert_texel_format(textures[t]);
+		int bpp = sf2d_tile_bytes_per_texel(textures[t]);
+		for (s = 0; s < FORMAT_COUNT; s++) {
+			sf2d_pixel_format sf = formats[s].format;
+			// MONO rows of whole bytes: the pitch is W bits
+			int pitch = W * sf2d_pixel_bits(sf) / 8;
+			fill_random(src, sizeof(src));
+			fill_random(tiled, sizeof(tiled));
+			memcpy(expected, tiled, sizeof(tiled));
+
+			for (y = 0; y < RH; y++)
+				ref_convert_row(texels + y * RW * bpp, tf, src + y * pitch, sf, RW);
+			sf2d_tile_rect(expected, W, H, textures[t], RX, RY, RW, RH, texels, RW * bpp, 0);
+			sf2d_tile_convert_rect(tiled, W, H, textures[t], RX, RY, RW, RH, src, pitch, sf);
+			CHECK(!memcmp(tiled, expected, W * H * bpp), "%s to tiled format %d", formats[s].name, textures[t]);
+
+			if (source_only(sf))
+				continue;
+			sf2d_untile_rect(tiled, W, H, textures[t], RX, RY, RW, RH, texels, RW * bpp, 0);
+			for (y = 0; y < RH; y++)
+				ref_convert_row(expected + y * pitch, sf, texels + y * RW * bpp, tf, RW);
+			sf2d_untile_convert_rect(tiled, W, H, textures[t], RX, RY, RW, RH, back, pitch, sf);
+			for (y = 0; y < RH; y++)
+				CHECK(!memcmp(back + y * pitch, expected + y * pitch, RW * sf2d_pixel_bits(sf) / 8),
+					"tiled format %d to %s, row %d", textures[t], formats[s].name, y);
+		}
+	}
+}
+
+static const struct {
+	const char *use;
+	sf2d_pixel_format src, dst;
+} pairs[] = {
+	{ "texture:save",   SF2D_PIXEL_ABGR8,    SF2D_PIXEL_RGBA8  },
+	{ "JPEG rows",      SF2D_PIXEL_RGB8,     SF2D_PIXEL_ABGR8  },
+	{ "screenshots",    SF2D_PIXEL_BGR8,     SF2D_PIXEL_RGBA8  },
+	{ "camera",         SF2D_PIXEL_RGB565,   SF2D_PIXEL_RGBA8  },
+	{ "camera",         SF2D_PIXEL_YUV422,   SF2D_PIXEL_RGB565 },
+	{ "camera",         SF2D_PIXEL_YUV422,   SF2D_PIXEL_ABGR8  },
+	{ "glyphs",         SF2D_PIXEL_COVERAGE, SF2D_PIXEL_ABGR8  },
+	{ "glyphs",         SF2D_PIXEL_MONO,     SF2D_PIXEL_COVERAGE },
+	{ "textures",       SF2D_PIXEL_RGBA8,    SF2D_PIXEL_RGB565 },
+	{ "textures",       SF2D_PIXEL_RGBA8,    SF2D_PIXEL_RGBA4  },
+	{ "textures",       SF2D_PIXEL_RGB5A1,   SF2D_PIXEL_RGBA8  },
+	{ "texture formats", SF2D_PIXEL_RGB565,  SF2D_PIXEL_IA4    },
+};
+
+static const char *format_name(sf2d_pixel_format format)
+{
+	int i;
+	for (i = 0; i < FORMAT_COUNT; i++)
+		if (formats[i].format == format) return formats[i].name;
+	return "?";
+}
+
+// Pixels per second of the kernels against the reference, for rows of 512x512 pixels
+static void bench_rows(void)
+{
+	enum { N = 512 * 512 };
+	u8 *src = malloc(N * 4), *dst = malloc(N * 4);
+	int p, run;
+
+	fill_random(src, N * 4);
+	printf("%-17s %-22s %12s %12s\n", "use", "conversion", "Mpixels/s", "reference");
+	for (p = 0; p < sizeof(pairs) / sizeof(*pairs); p++) {
+		double start, t_kernel = 0, t_ref = 0;
+		char name[32];
+		for (run = 0; run < RUNS; run++) {
+			start = now();
+			sf2d_convert_row(dst, pairs[p].dst, src, pairs[p].src, N);
+			t_kernel += now() - start;
+			start = now();
+			ref_convert_row(dst, pairs[p].dst, src, pairs[p].src, N);
+			t_ref += now() - start;
+		}
+		snprintf(name, sizeof(name), "%s to %s", format_name(pairs[p].src), format_name(pairs[p].dst));
+		printf("%-17s %-22s %12.1f %12.1f\n", pairs[p].use, name, N * RUNS / t_kernel / 1e6, N * RUNS / t_ref / 1e6);
+	}
+	free(src);
+	free(dst);
+}
+
+// Texture uploads: straight to the tiles, against converting the whole image to RGBA8 first (the previous path)
+static void bench_tiled(void)
+{
+	const struct {
+		const char *use;
+		sf2d_pixel_format src;
+		sf2d_texfmt texture;
+	} uploads[] = {
+		{ "JPEG",           SF2D_PIXEL_RGB8,     TEXFMT_RGBA8  },
+		{ "camera",         SF2D_PIXEL_RGB565,   TEXFMT_RGB565 },
+		{ "camera",         SF2D_PIXEL_YUV422,   TEXFMT_RGB565 },
+		{ "glyphs",         SF2D_PIXEL_COVERAGE, TEXFMT_RGBA8  },
+		{ "glyphs",         SF2D_PIXEL_COVERAGE, TEXFMT_A8     },
+		{ "RGBA8 textures", SF2D_PIXEL_RGBA8,    TEXFMT_RGBA8  },
+	};
+	enum { W = 512, H = 512 };
+	u8 *src = malloc(W * H * 4), *rgba = malloc(W * H * 4), *tiled = malloc(W * H * 4);
+	int u, run;
+
+	fill_random(src, W * H * 4);
+	printf("\n%-17s %-22s %12s %12s\n", "upload", "512x512", "direct", "via RGBA8");
+	for (u = 0; u < sizeof(uploads) / sizeof(*uploads); u++) {
+		int pitch = W * sf2d_pixel_bits(uploads[u].src) / 8;
+		double start, t_direct = 0, t_rgba = 0;
+		char name[32];
+		for (run = 0; run < RUNS; run++) {
+			start = now();
+			sf2d_tile_convert_rect(tiled, W, H, uploads[u].texture, 0, 0, W, H, src, pitch, uploads[u].src);
+			t_direct += now() - start;
+			start = now();
+			ref_convert_row(rgba, SF2D_PIXEL_RGBA8, src, uploads[u].src, W * H);
+			sf2d_tile_rect(tiled, W, H, uploads[u].texture, 0, 0, W, H, rgba, W * 4, SF2D_TILE_CONVERT_RGBA8);
+			t_rgba += now() - start;
+		}
+		snprintf(name, sizeof(name), "%s to %s", format_name(uploads[u].src),
+			format_name(sf2d_convert_texel_format(uploads[u].texture)));
+		printf("%-17s %-22s %9.1f MP/s %7.1f MP/s\n", uploads[u].use, name,
+			W * H * RUNS / t_direct / 1e6, W * H * RUNS / t_rgba / 1e6);
+	}
+	free(src);
+	free(rgba);
+	free(tiled);
+}
+
+int main()
+{
+	srand(42);
+	check_rows();
+	check_yuv();
+	check_tiled();
+	if (failures) {
+		printf("%d conversion checks failed\n", failures);
+		return 1;
+	}
+	printf("Conversion checks passed\n\n");
+
+	bench_rows();
+	bench_tiled();
+	return 0;
+}
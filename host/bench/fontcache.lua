@@ -0,0 +1,69 @@
+-- Measures the cost of the first frame drawing a menu with a new font: with the glyphs rasterized
+-- as they're drawn, preloaded with font:preload, or loaded from a glyph cache file (font:saveCache).
+-- Usage: ./ctruLua-host -f 3 bench/fontcache.lua
+
+local ctr = require("ctr")
+local gfx = require("ctr.gfx")
+local font = require("ctr.gfx.font")
+
+local FONT = (arg[0]:match("(.*/)") or "./") .. "../../data/vera.ttf"
+local CACHE = os.tmpname()
+local SIZES = { 12, 16, 24 }
+
+local charset = {}
+for c = 32, 126 do charset[#charset+1] = string.char(c) end
+charset = table.concat(charset)
+
+local menu = {
+	"New game", "Continue", "Options", "Controls: A to jump, B to run", "Credits",
+	"The quick brown fox jumps over the lazy dog", "THE QUICK BROWN FOX JUMPS OVER THE LAZY DOG",
+	"0123456789 !\"#$%&'()*+,-./:;<=>?@[\\]^_`{|}~",
+}
+
+local function ms(f)
+	local start = os.clock()
+	local result = f()
+	return (os.clock() - start) * 1000, result
+end
+
+-- Time the text calls of the first frame
+local function firstFrame(f)
+	ctr.run()
+	gfx.start(gfx.TOP)
+	local time = ms(function()
+		for i, size in ipairs(SIZES) do
+			for j, line in ipairs(menu) do
+				gfx.text(0, (i-1)*80 + j*size % 80, line, size, nil, f)
+			end
+		end
+	end)
+	gfx.stop()
+	gfx.render()
+	return time
+end
+
+local function report(name, load, frame, f)
+	local stats = f:getCacheStats()
+	print(("%-12s %8.3f ms to load, %8.3f ms first frame, %4d glyphs rasterized in the frame"):format(name, load, frame, stats.misses))
+end
+
+-- Rasterized while drawing
+local f = assert(font.load(FONT))
+report("cold", 0, firstFrame(f), f)
+
+-- Preloaded
+f = assert(font.load(FONT))
+local load, missing = ms(function() return f:preload(charset, SIZES) end)
+assert(missing == 0)
+report("preload", load, firstFrame(f), f)
+assert(f:saveCache(CACHE))
+
+-- Glyph cache file
+f = assert(font.load(FONT))
+local loaded
+load, loaded = ms(function() return assert(f:loadCache(CACHE)) end)
+assert(loaded == f:getCacheStats().glyphs)
+report("cache file", load, firstFrame(f), f)
+assert(font.load(FONT, CACHE):getCacheStats().glyphs == loaded)
+
+os.remove(CACHE)
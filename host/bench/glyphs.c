@@ -0,0 +1,167 @@
+// Measures the glyph uploads of the font atlas: the tiled writes of texture_atlas with a flush of
+// the written rows, against the previous path (sf2d_set_pixel per texel and a flush of the whole page).
+// Both paths pack, write and index every glyph, starting again with an empty page once it's full.
+// Usage: make bench, then ./build/bench_glyphs
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <sf2d.h>
+#include <sf2d_host.h>
+
+#include "texture_atlas.h"
+#include "skyline_packer.h"
+#include "int_htab.h"
+
+#define ATLAS_SIZE 512
+#define GLYPHS 20000
+#define MAX_GLYPH_SIZE 48
+
+typedef struct {
+	const char *name;
+	int min_w, max_w, min_h, max_h;
+} size_dist;
+
+static const size_dist dists[] = {
+	{ "glyphs 9-16px",  2, 12,  4, 16 },
+	{ "glyphs 20-32px", 6, 28, 10, 32 },
+	{ "glyphs mixed",   2, 40,  4, 48 },
+};
+
+// Glyphs are flushed one by one (a new character in a drawn string), or by strings of 32
+static const int batches[] = { 1, 32 };
+
+static double now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static unsigned char coverage[MAX_GLYPH_SIZE * MAX_GLYPH_SIZE];
+
+static bp2d_size random_size(const size_dist *dist)
+{
+	bp2d_size size;
+	size.w = dist->min_w + rand() % (dist->max_w - dist->min_w + 1);
+	size.h = dist->min_h + rand() % (dist->max_h - dist->min_h + 1);
+	return size;
+}
+
+// The upload path of the atlas; returns the number of uploaded glyphs
+static int upload_tiled(const size_dist *dist, int batch, double *time, u64 *flushed)
+{
+	texture_atlas *atlas = texture_atlas_create(ATLAS_SIZE, ATLAS_SIZE, TEXFMT_RGBA8, SF2D_PLACE_RAM, 1);
+	sf2d_host_stats stats;
+	double start;
+	int i;
+
+	sf2d_host_reset_stats();
+	*time = 0;
+	for (i = 0; i < GLYPHS; i++) {
+		bp2d_size size = random_size(dist);
+
+		start = now();
+		atlas_htab_entry *entry = texture_atlas_insert(atlas, i, coverage, size.w, size.w, size.h, 0, 0, 0, 0, 16, 1);
+		if (!entry) {
+			// The page is full: start again with an empty one
+			texture_atlas_flush(atlas);
+			*time += now() - start;
+			texture_atlas_free(atlas);
+			atlas = texture_atlas_create(ATLAS_SIZE, ATLAS_SIZE, TEXFMT_RGBA8, SF2D_PLACE_RAM, 1);
+			start = now();
+			entry = texture_atlas_insert(atlas, i, coverage, size.w, size.w, size.h, 0, 0, 0, 0, 16, 1);
+		}
+		if ((i + 1) % batch == 0)
+			texture_atlas_flush(atlas);
+		*time += now() - start;
+	}
+	texture_atlas_flush(atlas);
+	texture_atlas_free(atlas);
+
+	sf2d_host_get_stats(&stats);
+	*flushed = stats.flushed_bytes;
+	return GLYPHS;
+}
+
+// The previous upload path: one sf2d_set_pixel per texel, and the whole texture flushed
+static int upload_per_pixel(const size_dist *dist, int batch, double *time, u64 *flushed)
+{
+	sf2d_texture *tex = sf2d_create_texture(ATLAS_SIZE, ATLAS_SIZE, TEXFMT_RGBA8, SF2D_PLACE_RAM);
+	skyline_packer *packer = skyline_create(ATLAS_SIZE, ATLAS_SIZE);
+	int_htab *htab = int_htab_create(256);
+	sf2d_host_stats stats;
+	bp2d_position pos;
+	double start;
+	int i, x, y;
+
+	sf2d_host_reset_stats();
+	*time = 0;
+	for (i = 0; i < GLYPHS; i++) {
+		bp2d_size size = random_size(dist);
+
+		start = now();
+		if (!skyline_insert(packer, &size, &pos)) {
+			// The page is full: start again with an empty one, as the atlas does
+			GSPGPU_FlushDataCache(tex->data, tex->data_size);
+			*time += now() - start;
+			skyline_reset(packer);
+			int_htab_free(htab);
+			htab = int_htab_create(256);
+			start = now();
+			skyline_insert(packer, &size, &pos);
+		}
+		for (y = 0; y < size.h; y++) {
+			for (x = 0; x < size.w; x++) {
+				sf2d_set_pixel(tex, pos.x + x, pos.y + y, RGBA8(0xFF, 0xFF, 0xFF, coverage[y*size.w + x]));
+			}
+		}
+
+		// The same glyph entry as the atlas
+		atlas_htab_entry *entry = malloc(sizeof(*entry));
+		entry->rect.x = pos.x;
+		entry->rect.y = pos.y;
+		entry->rect.w = size.w;
+		entry->rect.h = size.h;
+		int_htab_insert(htab, i, entry);
+
+		if ((i + 1) % batch == 0)
+			GSPGPU_FlushDataCache(tex->data, tex->data_size);
+		*time += now() - start;
+	}
+
+	sf2d_host_get_stats(&stats);
+	*flushed = stats.flushed_bytes;
+	int_htab_free(htab);
+	skyline_free(packer);
+	sf2d_free_texture(tex);
+	return GLYPHS;
+}
+
+int main()
+{
+	int d, b, i;
+	for (i = 0; i < sizeof(coverage); i++)
+		coverage[i] = rand();
+
+	printf("Uploading %d glyphs to a %dx%d RGBA8 atlas page, flushed every <batch> glyphs:\n", GLYPHS, ATLAS_SIZE, ATLAS_SIZE);
+	printf("%-15s %5s %-10s %12s %14s\n", "sizes", "batch", "path", "glyphs/s", "flushed/glyph");
+	for (d = 0; d < sizeof(dists)/sizeof(*dists); d++) {
+		for (b = 0; b < sizeof(batches)/sizeof(*batches); b++) {
+			double time;
+			u64 flushed;
+			int count;
+
+			srand(42);
+			count = upload_per_pixel(&dists[d], batches[b], &time, &flushed);
+			printf("%-15s %5d %-10s %12.0f %14.0f\n", dists[d].name, batches[b], "per-pixel", count / time, flushed / (double)count);
+
+			srand(42);
+			count = upload_tiled(&dists[d], batches[b], &time, &flushed);
+			printf("%-15s %5d %-10s %12.0f %14.0f\n", dists[d].name, batches[b], "tiled", count / time, flushed / (double)count);
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,230 @@
+// Loads a 2048x1536 photo-like JPEG and PNG in full, then scaled down to fit in 400x240 and cut to a region with
+// the sfil_load_*_file_options functions: load time, and peak memory (heap, and linear memory of the texture).
+// Also checks the scaled textures against a box filter of the full ones, and the regions against the full ones.
+// Usage: make bench, then ./build/bench_imagescale
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <malloc.h>
+
+#include <jpeglib.h>
+#include <png.h>
+
+#include <sf2d.h>
+#include <sfil.h>
+
+#define WIDTH 2048
+#define HEIGHT 1536
+#define RUNS 5
+
+static size_t heap_used = 0, heap_peak = 0;
+
+// Heap use, counted by replacing malloc, including the allocations of libjpeg and libpng; not with AddressSanitizer,
+// which replaces it too
+#ifndef __SANITIZE_ADDRESS__
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+static void *counted(void *ptr)
+{
+	if (ptr) {
+		heap_used += malloc_usable_size(ptr);
+		if (heap_used > heap_peak) heap_peak = heap_used;
+	}
+	return ptr;
+}
+
+void *malloc(size_t size) { return counted(__libc_malloc(size)); }
+void *calloc(size_t n, size_t size) { return counted(__libc_calloc(n, size)); }
+
+void free(void *ptr)
+{
+	if (ptr) heap_used -= malloc_usable_size(ptr);
+	__libc_free(ptr);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	if (ptr) heap_used -= malloc_usable_size(ptr);
+	return counted(__libc_realloc(ptr, size));
+}
+#endif
+
+static double now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { if (!(cond)) { printf("FAIL: " __VA_ARGS__); printf("\n"); failures++; } } while (0)
+
+// Smooth gradients with some texture, like a photo
+static unsigned char *make_image()
+{
+	unsigned char *rgb = malloc(WIDTH * HEIGHT * 3);
+	unsigned int seed = 1;
+	for (int y = 0; y < HEIGHT; y++) {
+		for (int x = 0; x < WIDTH; x++) {
+			seed = seed * 1103515245 + 12345;
+			int noise = (seed >> 24) % 16;
+			unsigned char *p = rgb + (y * WIDTH + x) * 3;
+			p[0] = x * 200 / WIDTH + noise;
+			p[1] = y * 200 / HEIGHT + noise;
+			p[2] = ((x / 64 + y / 64) % 2) * 128 + noise;
+		}
+	}
+	return rgb;
+}
+
+static void write_jpeg(const char *path, const unsigned char *rgb)
+{
+	FILE *file = fopen(path, "wb");
+	struct jpeg_compress_struct cinfo;
+	struct jpeg_error_mgr jerr;
+	cinfo.err = jpeg_std_error(&jerr);
+	jpeg_create_compress(&cinfo);
+	jpeg_stdio_dest(&cinfo, file);
+	cinfo.image_width = WIDTH;
+	cinfo.image_height = HEIGHT;
+	cinfo.input_components = 3;
+	cinfo.in_color_space = JCS_RGB;
+	jpeg_set_defaults(&cinfo);
+	jpeg_set_quality(&cinfo, 90, TRUE);
+	jpeg_start_compress(&cinfo, TRUE);
+	while (cinfo.next_scanline < HEIGHT) {
+		JSAMPROW row = (JSAMPROW)rgb + cinfo.next_scanline * WIDTH * 3;
+		jpeg_write_scanlines(&cinfo, &row, 1);
+	}
+	jpeg_finish_compress(&cinfo);
+	jpeg_destroy_compress(&cinfo);
+	fclose(file);
+}
+
+static void write_png(const char *path, const unsigned char *rgb)
+{
+	png_image image;
+	memset(&image, 0, sizeof(image));
+	image.version = PNG_IMAGE_VERSION;
+	image.width = WIDTH;
+	image.height = HEIGHT;
+	image.format = PNG_FORMAT_RGB;
+	png_image_write_to_file(&image, path, 0, rgb, 0, NULL);
+}
+
+typedef sf2d_texture *(*loader)(const char *path, sf2d_place place, const sfil_load_options *options);
+
+static sf2d_texture *load_full(const char *path, sf2d_place place, const sfil_load_options *options)
+{
+	(void)options;
+	return strstr(path, ".png") ? sfil_load_PNG_file(path, place) : sfil_load_JPEG_file(path, place);
+}
+
+static sf2d_texture *load_options(const char *path, sf2d_place place, const sfil_load_options *options)
+{
+	return strstr(path, ".png") ? sfil_load_PNG_file_options(path, place, options) : sfil_load_JPEG_file_options(path, place, options);
+}
+
+static sf2d_texture *measure(const char *name, const char *path, loader load, const sfil_load_options *options)
+{
+	sf2d_texture *texture = NULL;
+	double time = 0;
+	size_t peak = 0;
+	for (int run = 0; run < RUNS; run++) {
+		if (texture) sf2d_free_texture(texture);
+		size_t used = heap_used;
+		heap_peak = heap_used;
+		double start = now();
+		texture = load(path, SF2D_PLACE_RAM, options);
+		time += now() - start;
+		peak = heap_peak - used;
+	}
+	if (!texture) {
+		CHECK(0, "%s: not loaded", name);
+		return NULL;
+	}
+	printf("  %-22s %4dx%-4d %9.3f ms, heap peak %8zu bytes, texture %8d bytes\n", name, texture->width, texture->height,
+		time / RUNS * 1000, peak, texture->data_size);
+	return texture;
+}
+
+// Mean difference of the channels of a scaled texture against the full one, scaled with a box filter
+static double scale_error(sf2d_texture *full, sf2d_texture *scaled)
+{
+	double total = 0;
+	for (int y = 0; y < scaled->height; y++) {
+		for (int x = 0; x < scaled->width; x++) {
+			int x0 = x * full->width / scaled->width, x1 = (x + 1) * full->width / scaled->width;
+			int y0 = y * full->height / scaled->height, y1 = (y + 1) * full->height / scaled->height;
+			u32 sum[3] = { 0, 0, 0 };
+			for (int sy = y0; sy < y1; sy++) {
+				for (int sx = x0; sx < x1; sx++) {
+					u32 p = sf2d_get_pixel(full, sx, sy);
+					for (int c = 0; c < 3; c++) sum[c] += (p >> (c * 8)) & 0xFF;
+				}
+			}
+			u32 count = (x1 - x0) * (y1 - y0), p = sf2d_get_pixel(scaled, x, y);
+			for (int c = 0; c < 3; c++) total += abs((int)(sum[c] / count) - (int)((p >> (c * 8)) & 0xFF));
+		}
+	}
+	return total / (scaled->width * scaled->height * 3);
+}
+
+int main()
+{
+	const char *paths[] = { "/tmp/bench_imagescale.jpg", "/tmp/bench_imagescale.png" };
+	unsigned char *rgb = make_image();
+	write_jpeg(paths[0], rgb);
+	write_png(paths[1], rgb);
+	free(rgb);
+
+	sfil_load_options fit = { .max_width = 400, .max_height = 240 };
+	sfil_load_options region = { .region_x = 1000, .region_y = 700, .region_w = 300, .region_h = 200 };
+	sfil_load_options both = { .max_width = 400, .max_height = 240, .region_x = 512, .region_y = 256, .region_w = 1024, .region_h = 1024 };
+
+	for (int i = 0; i < 2; i++) {
+		printf("%s, %dx%d:\n", paths[i], WIDTH, HEIGHT);
+		sf2d_texture *full = measure("full", paths[i], load_full, NULL);
+		sf2d_texture *scaled = measure("fit in 400x240", paths[i], load_options, &fit);
+		sf2d_texture *part = measure("region 300x200", paths[i], load_options, &region);
+		sf2d_texture *both_tex = measure("region, fit in 400x240", paths[i], load_options, &both);
+		if (!full || !scaled || !part || !both_tex) continue;
+
+		CHECK(scaled->width == 320 && scaled->height == 240, "scaled to %dx%d", scaled->width, scaled->height);
+		CHECK(both_tex->width == 240 && both_tex->height == 240, "region scaled to %dx%d", both_tex->width, both_tex->height);
+		// The JPEG is decoded at a smaller scale first: close, not the same
+		double error = scale_error(full, scaled);
+		printf("  scaled texture: mean error %.2f against a box filter of the full image\n", error);
+		CHECK(error < (i == 0 ? 4.0 : 0.5), "scaled texture too different (%.2f)", error);
+
+		int different = 0;
+		for (int y = 0; y < part->height; y++)
+			for (int x = 0; x < part->width; x++)
+				different += sf2d_get_pixel(part, x, y) != sf2d_get_pixel(full, region.region_x + x, region.region_y + y);
+		CHECK(part->width == 300 && part->height == 200 && different == 0, "region differs in %d texels", different);
+
+		sf2d_free_texture(full);
+		sf2d_free_texture(scaled);
+		sf2d_free_texture(part);
+		sf2d_free_texture(both_tex);
+	}
+
+	sfil_load_options outside = { .region_x = WIDTH, .region_w = 10, .region_h = 10 };
+	CHECK(sfil_load_JPEG_file_options(paths[0], SF2D_PLACE_RAM, &outside) == NULL, "region out of the image loaded");
+	CHECK(sfil_load_PNG_file_options(paths[1], SF2D_PLACE_RAM, &outside) == NULL, "region out of the image loaded");
+
+	remove(paths[0]);
+	remove(paths[1]);
+	if (failures) {
+		printf("%d checks failed\n", failures);
+		return 1;
+	}
+	printf("checks passed\n");
+	return 0;
+}
@@ -0,0 +1,97 @@
+-- Compares the map spatial queries with the equivalent Lua code using map:getTile.
+-- Usage: ./ctruLua-host bench/mapquery.lua
+
+local texture = require("ctr.gfx.texture")
+local mapm = require("ctr.gfx.map")
+
+local TILE = 16
+local SIZE = 256 -- in tiles
+local ACTORS = 500
+local FRAMES = 60
+
+-- Random map with 20% of solid tiles (tile 1)
+math.randomseed(42)
+local t = {}
+for y = 1, SIZE do
+	t[y] = {}
+	for x = 1, SIZE do t[y][x] = math.random() < 0.2 and 1 or 0 end
+end
+local tileset = texture.new(TILE*2, TILE, texture.PLACE_RAM)
+local map = assert(mapm.load(t, tileset, TILE, TILE))
+map:setTileFlags(1, mapm.SOLID)
+local solid = { [1] = true }
+
+local actors = {}
+for i = 1, ACTORS do
+	actors[i] = { x = math.random(0, SIZE*TILE - 24), y = math.random(0, SIZE*TILE - 24), w = 12 + math.random(12), h = 12 + math.random(12) }
+end
+
+local function luaQueryRect(a)
+	local count = 0
+	for ty = a.y // TILE, (a.y + a.h - 1) // TILE do
+		for tx = a.x // TILE, (a.x + a.w - 1) // TILE do
+			if solid[map:getTile(tx, ty)] then count = count + 1 end
+		end
+	end
+	return count
+end
+
+local function luaRaycast(x0, y0, x1, y1)
+	-- Same walk as map:raycast, in Lua
+	local sx, sy = x0 / TILE, y0 / TILE
+	local dx, dy = (x1 - x0) / TILE, (y1 - y0) / TILE
+	local tx, ty = math.floor(sx), math.floor(sy)
+	local stepX, stepY = dx > 0 and 1 or -1, dy > 0 and 1 or -1
+	local nextX = dx ~= 0 and (dx > 0 and tx + 1 - sx or sx - tx) / math.abs(dx) or math.huge
+	local nextY = dy ~= 0 and (dy > 0 and ty + 1 - sy or sy - ty) / math.abs(dy) or math.huge
+	local deltaX, deltaY = dx ~= 0 and 1 / math.abs(dx) or math.huge, dy ~= 0 and 1 / math.abs(dy) or math.huge
+	local t = 0
+	while t <= 1 do
+		if tx >= 0 and ty >= 0 and tx < SIZE and ty < SIZE and solid[map:getTile(tx, ty)] then return tx, ty end
+		if nextX < nextY then t, nextX, tx = nextX, nextX + deltaX, tx + stepX
+		else t, nextY, ty = nextY, nextY + deltaY, ty + stepY end
+	end
+end
+
+local function bench(name, f)
+	local start = os.clock()
+	local result = 0
+	for _ = 1, FRAMES do result = f() end
+	local ms = (os.clock() - start) * 1000 / FRAMES
+	print(("%-28s %8.3f ms/frame (result %d)"):format(name, ms, result))
+	return ms, result
+end
+
+print(("%d actors on a %dx%d map, %d frames"):format(ACTORS, SIZE, SIZE, FRAMES))
+
+local luaRect, luaRectResult = bench("rect overlap, Lua getTile", function()
+	local n = 0
+	for _, a in ipairs(actors) do n = n + luaQueryRect(a) end
+	return n
+end)
+local cRect, cRectResult = bench("rect overlap, map:queryRect", function()
+	local n = 0
+	for _, a in ipairs(actors) do n = n + select(2, map:queryRect(a.x, a.y, a.w, a.h, mapm.SOLID)) end
+	return n
+end)
+assert(luaRectResult == cRectResult, "queryRect results differ")
+
+local luaRay, luaRayResult = bench("raycast 128px, Lua getTile", function()
+	local n = 0
+	for _, a in ipairs(actors) do
+		local tx, ty = luaRaycast(a.x + 0.5, a.y + 0.5, a.x + 128.5, a.y + 64.5)
+		if tx then n = n + tx + ty end
+	end
+	return n
+end)
+local cRay, cRayResult = bench("raycast 128px, map:raycast", function()
+	local n = 0
+	for _, a in ipairs(actors) do
+		local _, _, tx, ty = map:raycast(a.x + 0.5, a.y + 0.5, a.x + 128.5, a.y + 64.5)
+		if tx then n = n + tx + ty end
+	end
+	return n
+end)
+assert(luaRayResult == cRayResult, "raycast results differ")
+
+print(("speedup: queryRect x%.1f, raycast x%.1f"):format(luaRect / cRect, luaRay / cRay))
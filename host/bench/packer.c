@@ -0,0 +1,209 @@
+// Compares the glyph atlas packers: the guillotine tree (bin_packing_2d) and the skyline (skyline_packer).
+// Usage: make bench, then ./build/bench_packer
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "bin_packing_2d.h"
+#include "skyline_packer.h"
+
+#define ATLAS_SIZE 512
+#define RUNS 50
+#define CHURN_GLYPHS 4000
+#define CHURN_WINDOW 600
+#define CHURN_LOOKUPS 200000
+#define CHURN_MAX_RELEASES 16 // like the glyph atlas
+
+typedef struct {
+	const char *name;
+	int min_w, max_w, min_h, max_h;
+} size_dist;
+
+// Glyph bitmaps: small, medium and mixed font sizes; and sprites
+static const size_dist dists[] = {
+	{ "glyphs 9-16px",  2, 12,  4, 16 },
+	{ "glyphs 20-32px", 6, 28, 10, 32 },
+	{ "glyphs mixed",   2, 40,  4, 48 },
+	{ "sprites",       16, 64, 16, 64 },
+};
+
+static double now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static bp2d_size random_size(const size_dist *dist)
+{
+	bp2d_size size;
+	size.w = dist->min_w + rand() % (dist->max_w - dist->min_w + 1);
+	size.h = dist->min_h + rand() % (dist->max_h - dist->min_h + 1);
+	return size;
+}
+
+// Insert until the first failure, return the number of inserted rectangles
+static int fill_bp2d(const size_dist *dist, int *area)
+{
+	bp2d_rectangle rect = { 0, 0, ATLAS_SIZE, ATLAS_SIZE };
+	bp2d_node *root = bp2d_create(&rect);
+	bp2d_position pos;
+	int count = 0;
+	*area = 0;
+	while (1) {
+		bp2d_size size = random_size(dist);
+		if (!bp2d_insert(root, &size, &pos))
+			break;
+		*area += size.w * size.h;
+		count++;
+	}
+	bp2d_free(root);
+	return count;
+}
+
+static int fill_skyline(const size_dist *dist, int *area)
+{
+	skyline_packer *packer = skyline_create(ATLAS_SIZE, ATLAS_SIZE);
+	bp2d_position pos;
+	int count = 0;
+	while (1) {
+		bp2d_size size = random_size(dist);
+		if (!skyline_insert(packer, &size, &pos))
+			break;
+		count++;
+	}
+	*area = packer->used_area;
+	skyline_free(packer);
+	return count;
+}
+
+// A set of glyphs drawn with a moving working set, inserted on a miss. When the atlas is full,
+// the skyline releases the least recently used glyphs until the new one fits (emptying the atlas
+// after CHURN_MAX_RELEASES), while the guillotine tree can only be emptied entirely.
+typedef struct {
+	bp2d_size size;
+	bp2d_rectangle rect;
+	int placed;
+	unsigned int last_used;
+} churn_glyph;
+
+static void churn(const size_dist *dist, int use_skyline, int *misses, float *occupancy)
+{
+	churn_glyph *glyphs = malloc(CHURN_GLYPHS * sizeof(*glyphs));
+	int i;
+	for (i = 0; i < CHURN_GLYPHS; i++) {
+		glyphs[i].size = random_size(dist);
+		glyphs[i].placed = 0;
+	}
+
+	bp2d_rectangle full = { 0, 0, ATLAS_SIZE, ATLAS_SIZE };
+	skyline_packer *packer = skyline_create(ATLAS_SIZE, ATLAS_SIZE);
+	bp2d_node *root = bp2d_create(&full);
+	int used_area = 0;
+	double total_occupancy = 0;
+
+	*misses = 0;
+	unsigned int t;
+	for (t = 0; t < CHURN_LOOKUPS; t++) {
+		int window_start = (t / 50) % (CHURN_GLYPHS - CHURN_WINDOW);
+		churn_glyph *glyph = &glyphs[window_start + rand() % CHURN_WINDOW];
+		glyph->last_used = t;
+
+		if (!glyph->placed) {
+			bp2d_position pos;
+			(*misses)++;
+			if (use_skyline) {
+				int released = 0;
+				while (!skyline_insert(packer, &glyph->size, &pos)) {
+					if (released++ == CHURN_MAX_RELEASES) {
+						skyline_reset(packer);
+						for (i = 0; i < CHURN_GLYPHS; i++) glyphs[i].placed = 0;
+						continue;
+					}
+					churn_glyph *lru = NULL;
+					for (i = 0; i < CHURN_GLYPHS; i++) {
+						if (glyphs[i].placed && &glyphs[i] != glyph && (!lru || glyphs[i].last_used < lru->last_used))
+							lru = &glyphs[i];
+					}
+					skyline_release(packer, &lru->rect);
+					lru->placed = 0;
+				}
+			} else {
+				if (!bp2d_insert(root, &glyph->size, &pos)) {
+					bp2d_free(root);
+					root = bp2d_create(&full);
+					used_area = 0;
+					for (i = 0; i < CHURN_GLYPHS; i++) glyphs[i].placed = 0;
+					bp2d_insert(root, &glyph->size, &pos);
+				}
+				used_area += glyph->size.w * glyph->size.h;
+			}
+			bp2d_rectangle rect = { pos.x, pos.y, glyph->size.w, glyph->size.h };
+			glyph->rect = rect;
+			glyph->placed = 1;
+		}
+
+		total_occupancy += use_skyline ? skyline_occupancy(packer) : used_area / (float)(ATLAS_SIZE * ATLAS_SIZE);
+	}
+	*occupancy = total_occupancy / CHURN_LOOKUPS;
+
+	bp2d_free(root);
+	skyline_free(packer);
+	free(glyphs);
+}
+
+int main()
+{
+	int d;
+	printf("Filling a %dx%d atlas until the first failure:\n", ATLAS_SIZE, ATLAS_SIZE);
+	printf("%-15s %-9s %9s %9s %12s\n", "sizes", "packer", "rects", "occupancy", "ns/insert");
+	for (d = 0; d < sizeof(dists)/sizeof(*dists); d++) {
+		const size_dist *dist = &dists[d];
+		int run, count, area;
+		long total_count, total_area;
+		double start;
+
+		srand(42);
+		total_count = total_area = 0;
+		start = now();
+		for (run = 0; run < RUNS; run++) {
+			total_count += count = fill_bp2d(dist, &area);
+			total_area += area;
+		}
+		double bp2d_time = now() - start;
+		printf("%-15s %-9s %9.1f %8.1f%% %12.1f\n", dist->name, "bp2d", total_count / (double)RUNS,
+			100.0 * total_area / ((double)RUNS * ATLAS_SIZE * ATLAS_SIZE), bp2d_time * 1e9 / total_count);
+
+		srand(42);
+		total_count = total_area = 0;
+		start = now();
+		for (run = 0; run < RUNS; run++) {
+			total_count += count = fill_skyline(dist, &area);
+			total_area += area;
+		}
+		double skyline_time = now() - start;
+		printf("%-15s %-9s %9.1f %8.1f%% %12.1f\n", dist->name, "skyline", total_count / (double)RUNS,
+			100.0 * total_area / ((double)RUNS * ATLAS_SIZE * ATLAS_SIZE), skyline_time * 1e9 / total_count);
+
+	}
+
+	printf("\n%d lookups in a working set of %d out of %d glyphs, inserted on a miss; when full, the\n"
+		"guillotine tree is emptied and the skyline releases up to %d least recently used glyphs first:\n",
+		CHURN_LOOKUPS, CHURN_WINDOW, CHURN_GLYPHS, CHURN_MAX_RELEASES);
+	printf("%-15s %-9s %9s %9s\n", "sizes", "packer", "misses", "occupancy");
+	for (d = 0; d < sizeof(dists)/sizeof(*dists); d++) {
+		int misses;
+		float occupancy;
+
+		srand(42);
+		churn(&dists[d], 0, &misses, &occupancy);
+		printf("%-15s %-9s %9d %8.1f%%\n", dists[d].name, "bp2d", misses, 100.0 * occupancy);
+
+		srand(42);
+		churn(&dists[d], 1, &misses, &occupancy);
+		printf("%-15s %-9s %9d %8.1f%%\n", dists[d].name, "skyline", misses, 100.0 * occupancy);
+	}
+
+	return 0;
+}
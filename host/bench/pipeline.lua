@@ -0,0 +1,73 @@
+-- Measures the overlap of the CPU and the GPU: the time of a frame that only keeps the GPU busy, of one that only keeps
+-- the CPU busy, and of one that does both, with the time the CPU waited for the GPU (cpuWait of gfx.getStats). Also
+-- checks that a frame still rendering isn't changed by the next one, which is drawn meanwhile.
+-- Usage: ./ctruLua-host bench/pipeline.lua [frames [layers]]
+
+local ctr = require("ctr")
+local gfx = require("ctr.gfx")
+
+local FRAMES = tonumber(arg[1]) or 20
+local LAYERS = tonumber(arg[2]) or 4
+
+-- Translucent layers over the whole top screen, the vertices in the temporary pool of the frame
+local function gpuWork(color)
+	for i = 1, LAYERS do
+		gfx.rectangle(0, 0, 400, 240, 0, 0x20000000 | color)
+	end
+end
+
+local cpuIterations = 0
+local function cpuWork()
+	local x = 0
+	for i = 1, cpuIterations do x = (x * 31 + i) % 1000003 end
+	return x
+end
+
+local function run(gpu, cpu)
+	local wait = 0
+	gfx.render()
+	local start = ctr.utime()
+	for i = 1, FRAMES do
+		if cpu then cpuWork() end
+		gfx.start(gfx.TOP)
+		if gpu then gpuWork(0xFF) end
+		gfx.stop()
+		gfx.render()
+		wait = wait + gfx.getStats().cpuWait
+	end
+	return (ctr.utime() - start) / FRAMES / 1000, wait / FRAMES
+end
+
+-- As much CPU work as GPU work
+local gpuTime = run(true, false)
+local t = ctr.utime()
+cpuIterations = 1000000
+cpuWork()
+cpuIterations = math.floor(cpuIterations * gpuTime * 1000 / (ctr.utime() - t))
+
+local gpuOnly, gpuWait = run(true, false)
+local cpuOnly, cpuWait = run(false, true)
+local both, bothWait = run(true, true)
+print(("GPU only  %8.3f ms/frame, CPU waited %8.3f ms/frame"):format(gpuOnly, gpuWait))
+print(("CPU only  %8.3f ms/frame, CPU waited %8.3f ms/frame"):format(cpuOnly, cpuWait))
+print(("both      %8.3f ms/frame, CPU waited %8.3f ms/frame (%8.3f ms/frame without overlap)"):format(
+	both, bothWait, gpuOnly + cpuOnly))
+
+-- Each frame draws in a target of its own with a color of its own, while the GPU renders the previous frame; the targets
+-- are read at the end, reading one waits for the GPU
+local targets = {}
+for i = 1, FRAMES do
+	targets[i] = assert(gfx.target(64, 64))
+	targets[i]:clear(0xFF000000)
+end
+local function color(i) return (i * 37) & 0xFF end
+for i = 1, FRAMES do
+	gfx.start(targets[i])
+	for j = 1, LAYERS do gfx.rectangle(0, 0, 64, 64, 0, 0xFF000000 | color(i)) end
+	gfx.stop()
+end
+for i = 1, FRAMES do
+	local pixel = targets[i].texture:getPixel(10, 10)
+	assert(pixel == color(i) << 24 | 0xFF, ("frame %d: wrong pixel %08x"):format(i, pixel))
+end
+print("checks passed")
@@ -0,0 +1,111 @@
+-- Measures the time the main thread spends saving 400x240 and 1024x1024 images: texture:save, against texture:saveAsync
+-- (copy of the texture, then encoded by the background thread) for a few PNG compression settings, with the sizes of
+-- the files. Also checks that the files load back the same pixels, and gfx.screenshot.
+-- Usage: ./ctruLua-host bench/screenshot.lua [runs]
+
+local ctr = require("ctr")
+local gfx = require("ctr.gfx")
+local texture = require("ctr.gfx.texture")
+
+local RUNS = tonumber(arg[1]) or 3
+local FILE = os.tmpname()
+
+local SETTINGS = {
+	{ "level 1, no filter", 1, texture.FILTER_NONE },
+	{ "level 6, all filters", 6, texture.FILTER_ALL },
+	{ "level 9, all filters", 9, texture.FILTER_ALL },
+}
+
+local function fileSize(path)
+	local file = assert(io.open(path, "rb"))
+	local size = file:seek("end")
+	file:close()
+	return size
+end
+
+-- Gradients, with a noisy part, like a game screen
+local function makeImage(w, h)
+	local tex = texture.new(w, h, texture.PLACE_RAM)
+	local seed = 1
+	for y = 0, h - 1 do
+		for x = 0, w - 1 do
+			local noise = 0
+			if x > w // 2 then
+				seed = (seed * 1103515245 + 12345) & 0x7FFFFFFF
+				noise = seed >> 24
+			end
+			tex:setPixel(x, y, ((x * 255 // w) << 24 | (y * 255 // h) << 16 | noise << 8 | 0xFF) & 0xFFFFFFFF)
+		end
+	end
+	return tex
+end
+
+local function checkFile(path, tex)
+	local loaded = assert(texture.load(path))
+	local w, h = tex:getSize()
+	local lw, lh = loaded:getSize()
+	assert(lw == w and lh == h, "wrong size")
+	for y = 0, h - 1, 7 do
+		for x = 0, w - 1, 3 do
+			assert(loaded:getPixel(x, y) == tex:getPixel(x, y), ("wrong pixel at %d,%d"):format(x, y))
+		end
+	end
+	loaded:unload()
+end
+
+for _, size in ipairs({ { 400, 240 }, { 1024, 1024 } }) do
+	local w, h = size[1], size[2]
+	local tex = makeImage(w, h)
+	print(("%dx%d:"):format(w, h))
+	for _, setting in ipairs(SETTINGS) do
+		local name, level, filters = setting[1], setting[2], setting[3]
+		local sync, main, total = 0, 0, 0
+		for run = 1, RUNS do
+			local start = ctr.utime()
+			assert(tex:save(FILE, texture.TYPE_PNG, level, filters))
+			sync = sync + ctr.utime() - start
+
+			start = ctr.utime()
+			local handle = assert(tex:saveAsync(FILE, texture.TYPE_PNG, level, filters))
+			main = main + ctr.utime() - start
+			assert(handle:wait())
+			total = total + ctr.utime() - start
+		end
+		print(("  %-22s save %9.3f ms, saveAsync %7.3f ms on the main thread (%9.3f ms in total), %8d bytes"):format(
+			name, sync / RUNS / 1000, main / RUNS / 1000, total / RUNS / 1000, fileSize(FILE)))
+		checkFile(FILE, tex)
+	end
+
+	local handle = assert(tex:saveAsync(FILE, texture.TYPE_BMP))
+	assert(handle:wait())
+	checkFile(FILE, tex)
+	tex:unload()
+end
+
+-- Screenshot of the frame just drawn
+gfx.start(gfx.TOP)
+gfx.rectangle(10, 20, 30, 40, 0, 0xFF0000FF)
+gfx.stop()
+local start = ctr.utime()
+local handle = assert(gfx.screenshot(FILE))
+local main = ctr.utime() - start
+gfx.render()
+while not handle:ready() do end
+assert(handle:wait() and handle:wait())
+print(("screenshot: %.3f ms on the main thread"):format(main / 1000))
+local shot = assert(texture.load(FILE))
+assert(shot:getSize() == 400)
+assert(shot:getPixel(10, 20) == 0xFF0000FF and shot:getPixel(39, 59) == 0xFF0000FF, "rectangle not in the screenshot")
+assert(shot:getPixel(9, 20) ~= 0xFF0000FF and shot:getPixel(40, 60) ~= 0xFF0000FF)
+shot:unload()
+
+-- Errors; a save keeps going after its object is collected
+local ok, err = assert(texture.new(8, 8, texture.PLACE_RAM):saveAsync("/nonexistent/file.png")):wait()
+assert(ok == false and err)
+assert(not pcall(gfx.screenshot, FILE, gfx.TOP, gfx.LEFT, texture.TYPE_TEX))
+os.remove(FILE)
+texture.new(8, 8, texture.PLACE_RAM):saveAsync(FILE)
+collectgarbage()
+assert(texture.loadAsync(FILE):get(), "abandoned save not written")
+os.remove(FILE)
+print("checks passed")
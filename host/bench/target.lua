@@ -0,0 +1,71 @@
+-- Measures a render target used for a per-frame effect: cleared, drawn to, then drawn on the screen every frame. Also
+-- checks the clear colors, the orientation of what's drawn in targets that aren't square, and the target texture.
+-- Usage: ./ctruLua-host bench/target.lua [size [frames]]
+
+local ctr = require("ctr")
+local gfx = require("ctr.gfx")
+
+local SIZE = tonumber(arg[1]) or 512
+local FRAMES = tonumber(arg[2]) or 100
+
+-- Clear colors are RGBA8 (0xAABBGGRR), the texture pixels 0xRRGGBBAA
+local function rgba8ToPixel(color)
+	return (color & 0xFF) << 24 | (color >> 8 & 0xFF) << 16 | (color >> 16 & 0xFF) << 8 | (color >> 24 & 0xFF)
+end
+
+for _, size in ipairs({ { 64, 32 }, { 32, 128 }, { 64, 64 } }) do
+	local w, h = size[1], size[2]
+	local target = assert(gfx.target(w, h))
+	local texture = target.texture
+	for _, color in ipairs({ 0xFF0000FF, 0x80402010, 0x00000000, 0x12345678 }) do
+		target:clear(color)
+		assert(texture:getPixel(0, 0) == rgba8ToPixel(color) and texture:getPixel(w - 1, h - 1) == rgba8ToPixel(color),
+			("wrong clear color %08x"):format(color))
+	end
+
+	-- Drawn at the same place as on a screen
+	target:clear(0xFF000000)
+	gfx.start(target)
+	gfx.rectangle(3, 5, 7, 2, 0, 0xFFFF0000)
+	gfx.stop()
+	for y = 0, h - 1 do
+		for x = 0, w - 1 do
+			local inside = x >= 3 and x < 10 and y >= 5 and y < 7
+			assert(texture:getPixel(x, y) == (inside and 0x0000FFFF or 0x000000FF), ("wrong pixel at %d,%d in %dx%d"):format(x, y, w, h))
+		end
+	end
+
+	-- The texture keeps the target alive; destroying the target twice is fine
+	target = nil
+	collectgarbage()
+	assert(texture:getPixel(3, 5) == 0x0000FFFF)
+	texture:unload()
+	texture = nil
+	collectgarbage()
+end
+local target = assert(gfx.target(8, 8))
+target:destroy()
+target:destroy()
+assert(target.texture == nil)
+assert(not pcall(target.clear, target))
+
+-- Per-frame effect
+target = assert(gfx.target(SIZE, SIZE))
+local texture = target.texture
+local clear, draw = 0, 0
+for i = 1, FRAMES do
+	local start = ctr.utime()
+	target:clear(0xFF000000 | i)
+	clear = clear + ctr.utime() - start
+	start = ctr.utime()
+	gfx.start(target)
+	gfx.circle(i % SIZE, SIZE // 2, 16, 0xFFFFFFFF)
+	gfx.stop()
+	gfx.start(gfx.TOP)
+	texture:draw(0, 0)
+	gfx.stop()
+	gfx.render()
+	draw = draw + ctr.utime() - start
+end
+print(("%dx%d target, %d frames: clear %8.3f ms/frame, draw %8.3f ms/frame"):format(SIZE, SIZE, FRAMES, clear / FRAMES / 1000, draw / FRAMES / 1000))
+print("checks passed")
@@ -0,0 +1,90 @@
+-- Measures texture.loadCached against texture.load for a scene that loads the same images again, like
+-- a level reloaded, then checks the budget eviction and the move of the often drawn textures to VRAM.
+-- Usage: ./ctruLua-host bench/texcache.lua [image...]
+
+local gfx = require("ctr.gfx")
+local texture = require("ctr.gfx.texture")
+
+local DIR = (arg[0]:match("(.*/)") or "./") .. "../../"
+local IMAGES = #arg > 0 and arg or { DIR .. "icon.png", DIR .. "libs/sfillib/sample/data/3dbrew.png" }
+local RELOADS = 20
+
+local function ms(f)
+	local start = os.clock()
+	f()
+	return (os.clock() - start) * 1000
+end
+
+local function frame(textures)
+	gfx.start(gfx.TOP)
+	for _, tex in ipairs(textures) do tex:draw(0, 0) end
+	gfx.stop()
+	gfx.render()
+end
+
+-- Scene loaded again and again
+local function loadScene(load, place)
+	local scene = {}
+	for i, path in ipairs(IMAGES) do scene[i] = assert(load(path, place)) end
+	return scene
+end
+
+local uncached = ms(function() for i = 1, RELOADS do loadScene(texture.load, texture.PLACE_RAM) collectgarbage() end end)
+local cached = ms(function() for i = 1, RELOADS do loadScene(texture.loadCached, texture.PLACE_RAM) collectgarbage() end end)
+local stats = texture.cacheStats()
+print(("%d loads of %d images: load %8.3f ms, loadCached %8.3f ms (%d hits, %d misses)"):format(
+	RELOADS, #IMAGES, uncached, cached, stats.hits, stats.misses))
+assert(stats.misses == #IMAGES and stats.hits == (RELOADS - 1) * #IMAGES)
+
+-- Shared texture, and a different one for other options
+local a, b = texture.loadCached(IMAGES[1], texture.PLACE_RAM), texture.loadCached(IMAGES[1], texture.PLACE_RAM)
+a:setPixel(0, 0, 0x12345678)
+assert(b:getPixel(0, 0) == 0x12345678, "not shared")
+local c = texture.loadCached(IMAGES[1], texture.PLACE_VRAM)
+assert(c:getPixel(0, 0) ~= 0x12345678, "shared between places")
+a:unload() b:unload() c:unload()
+assert(select(2, texture.loadCached(IMAGES[1], texture.PLACE_TEMP)))
+assert(select(2, texture.loadCached("/nonexistent.png")))
+
+-- Eviction: unused textures go over a budget only until the next load
+collectgarbage()
+texture.setCacheBudget(0, 0)
+stats = texture.cacheStats()
+assert(stats.textures == 0 and stats.ramBytes == 0 and stats.vramBytes == 0, "unused textures kept over budget")
+local kept = loadScene(texture.loadCached, texture.PLACE_RAM)
+assert(texture.cacheStats().textures == #IMAGES, "used textures evicted")
+kept = nil
+collectgarbage()
+assert(texture.cacheStats().textures == 0, "released textures kept over budget")
+texture.setCacheBudget(16*1024*1024, 3*1024*1024)
+
+-- Automatic placement: RAM first, VRAM once drawn in enough frames
+local scene = loadScene(texture.loadCached)
+stats = texture.cacheStats()
+assert(stats.ramBytes > 0 and stats.vramBytes == 0)
+for i = 1, 20 do frame(scene) end
+stats = texture.cacheStats()
+print(("after 20 frames: %d promotions, %d bytes in RAM, %d in VRAM"):format(stats.promotions, stats.ramBytes, stats.vramBytes))
+assert(stats.promotions == #IMAGES and stats.ramBytes == 0 and stats.vramBytes > 0)
+assert(scene[1]:getPixel(1, 1) == assert(texture.load(IMAGES[1])):getPixel(1, 1), "changed by the move")
+
+-- A texture drawn in this frame isn't evicted before the frame is over
+frame({}) -- the GPU is done with the frames above once this one is sent
+scene = loadScene(texture.loadCached)
+gfx.start(gfx.TOP)
+scene[1]:draw(0, 0)
+local drawn = scene[1]
+scene = nil
+collectgarbage()
+drawn:unload()
+texture.setCacheBudget(0, 0)
+local evictions = texture.cacheStats().evictions
+assert(texture.cacheStats().textures == 1, "texture in use by the GPU evicted")
+gfx.stop()
+gfx.render()
+frame({}) -- the next frame doesn't use it
+texture.setCacheBudget(0, 0)
+assert(texture.cacheStats().textures == 0)
+assert(texture.cacheStats().evictions == evictions + 1)
+
+print("checks passed")
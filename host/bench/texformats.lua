@@ -0,0 +1,121 @@
+-- Loads an image in each texture format: memory, load time, and error against the RGBA8 texture (PSNR). Also checks
+-- that the texture files (texture:save with TYPE_TEX) load the same texels, and with a dump directory that the GPU
+-- draws the same colors as getPixel, including for the ETC1 textures.
+-- Usage: ./ctruLua-host [-o dir] bench/texformats.lua [image [dir]]
+
+local ctr = require("ctr")
+local gfx = require("ctr.gfx")
+local texture = require("ctr.gfx.texture")
+
+local IMAGE = arg[1] ~= "" and arg[1] or (arg[0]:match("(.*/)") or "./") .. "../../libs/sfillib/sample/data/3dbrew.png"
+local DUMP_DIR = arg[2]
+local FILE = os.tmpname()
+
+local formats = {
+	{ "RGBA8", 32 }, { "RGB8", 24 }, { "RGB5A1", 16 }, { "RGB565", 16 }, { "RGBA4", 16 },
+	{ "IA8", 16 }, { "I8", 8 }, { "A8", 8 }, { "IA4", 8 }, { "ETC1", 4 }, { "ETC1A4", 8 },
+}
+
+local function nextPow2(v)
+	local p = 32 -- smallest texture size of sf2d
+	while p < v do p = p * 2 end
+	return p
+end
+
+local function channels(color)
+	return (color >> 24) & 0xFF, (color >> 16) & 0xFF, (color >> 8) & 0xFF, color & 0xFF
+end
+
+-- PSNR of the colors (and of the alpha) of a texture against the reference
+local function psnr(tex, ref, w, h, alphaOnly)
+	local sum, n = 0, 0
+	for y = 0, h - 1 do
+		for x = 0, w - 1 do
+			local r1, g1, b1, a1 = channels(tex:getPixel(x, y))
+			local r2, g2, b2, a2 = channels(ref:getPixel(x, y))
+			if alphaOnly then
+				sum, n = sum + (a1 - a2)^2, n + 1
+			else
+				sum, n = sum + (r1 - r2)^2 + (g1 - g2)^2 + (b1 - b2)^2, n + 3
+			end
+		end
+	end
+	if sum == 0 then return math.huge end
+	return 10 * math.log(255^2 / (sum / n), 10)
+end
+
+local frame = 0
+gfx.color.setBackground(0xFF000000)
+ctr.run()
+
+local ref = assert(texture.load(IMAGE, texture.PLACE_RAM, 4))
+local w, h = ref:getSize()
+print(("%s: %dx%d"):format(IMAGE, w, h))
+print(("%-7s %9s %10s %10s %9s"):format("format", "bytes", "load ms", "file ms", "PSNR dB"))
+
+for _, f in ipairs(formats) do
+	local name, bits = f[1], f[2]
+	local format = texture["FORMAT_" .. name]
+
+	local start = os.clock()
+	local tex = assert(texture.load(IMAGE, texture.PLACE_RAM, 4, format))
+	local load = (os.clock() - start) * 1000
+	assert(tex:getFormat() == format)
+
+	-- Texture file: the same texels, without decoding
+	assert(tex:save(FILE, texture.TYPE_TEX))
+	start = os.clock()
+	local saved = assert(texture.load(FILE))
+	local fileLoad = (os.clock() - start) * 1000
+	assert(saved:getFormat() == format and select(1, saved:getSize()) == w)
+	for y = 0, h - 1, 3 do
+		for x = 0, w - 1, 3 do
+			assert(saved:getPixel(x, y) == tex:getPixel(x, y), name .. ": texture file differs")
+		end
+	end
+
+	local quality = psnr(tex, ref, w, h, name == "A8")
+	print(("%-7s %9d %10.3f %10.3f %9.2f"):format(name, nextPow2(w) * nextPow2(h) * bits // 8, load, fileLoad, quality))
+
+	-- getPixel on a texture converted from the RGBA8 texels gives the same colors
+	if not name:match("ETC") then
+		local copy = texture.new(w, h, texture.PLACE_RAM, format)
+		for y = 0, h - 1, 5 do
+			for x = 0, w - 1, 5 do
+				copy:setPixel(x, y, ref:getPixel(x, y))
+				assert(copy:getPixel(x, y) == tex:getPixel(x, y), name .. ": setPixel differs from the conversion")
+			end
+		end
+	end
+
+	-- What the GPU draws is what getPixel returns, for the opaque texels drawn over black
+	if DUMP_DIR then
+		gfx.start(gfx.TOP)
+		tex:draw(0, 0)
+		gfx.stop()
+		gfx.render()
+		ctr.run()
+		frame = frame + 1
+		local screen = assert(texture.load(("%s/frame%04d_top.png"):format(DUMP_DIR, frame), texture.PLACE_RAM, 4))
+		for y = 0, math.min(h, 240) - 1 do
+			for x = 0, math.min(w, 400) - 1 do
+				local r1, g1, b1, a = channels(tex:getPixel(x, y))
+				local r2, g2, b2 = channels(screen:getPixel(x, y))
+				if a == 255 then
+					assert(math.abs(r1 - r2) <= 1 and math.abs(g1 - g2) <= 1 and math.abs(b1 - b2) <= 1,
+						("%s: drawn 0x%06x at (%d, %d) instead of 0x%06x"):format(name, screen:getPixel(x, y) >> 8, x, y, tex:getPixel(x, y) >> 8))
+				end
+			end
+		end
+	end
+end
+
+-- Unsupported formats and files
+assert(not pcall(texture.load, IMAGE, texture.PLACE_RAM, nil, 6))
+local file = assert(io.open(FILE, "wb"))
+file:write("LTEX\1\0")
+file:close()
+assert(texture.load(FILE) == nil, "truncated texture file loaded")
+os.remove(FILE)
+
+print("checks passed")
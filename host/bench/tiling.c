@@ -0,0 +1,243 @@
+// Checks the tiling functions of sf2d_tile.h against the per-texel Morton offsets, then measures
+// them against the previous paths: the per-pixel sf2d_texture_tile32 with a copy of the whole
+// texture, and the sf2d_get_pixel loop of texture:save.
+// Usage: make bench, then ./build/bench_tiling
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <sf2d.h>
+#include <sf2d_tile.h>
+
+#define RUNS 20
+
+static const struct {
+	const char *name;
+	sf2d_texfmt format;
+} formats[] = {
+	{ "RGBA8",  TEXFMT_RGBA8  },
+	{ "RGB8",   TEXFMT_RGB8   },
+	{ "RGB565", TEXFMT_RGB565 },
+	{ "RGBA4",  TEXFMT_RGBA4  },
+	{ "A8",     TEXFMT_A8     },
+};
+
+static const int sizes[][2] = { { 32, 32 }, { 64, 256 }, { 512, 512 }, { 1024, 512 } };
+
+static double now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { if (!(cond)) { printf("FAIL: " __VA_ARGS__); printf("\n"); failures++; } } while (0)
+
+// Reference: the Morton offset of each texel, as computed by the previous per-pixel code
+static u32 morton_index(int x, int y, int pow2_w, int pow2_h)
+{
+	u32 i = (x & 7) | ((y & 7) << 8);
+	i = (i ^ (i << 2)) & 0x1313;
+	i = (i ^ (i << 1)) & 0x1515;
+	i = (i | (i >> 7)) & 0x3F;
+	return (y & ~7) * pow2_w + (x & ~7) * 8 + i;
+}
+
+static void fill_random(u8 *buf, size_t size)
+{
+	size_t i;
+	for (i = 0; i < size; i++)
+		buf[i] = rand();
+}
+
+// Reverses the texel bytes if swap and bpp == 4
+static void copy_texel(u8 *dst, const u8 *src, int bpp, int swap)
+{
+	int i;
+	for (i = 0; i < bpp; i++)
+		dst[i] = src[swap ? bpp - 1 - i : i];
+}
+
+static void check_format(const char *name, sf2d_texfmt format, int w, int h, u32 flags)
+{
+	int bpp = sf2d_tile_bytes_per_texel(format);
+	int swap = bpp == 4 && (flags & SF2D_TILE_SWAP_RGBA8);
+	size_t size = w * h * bpp;
+	u8 *linear = malloc(size), *tiled = malloc(size), *expected = malloc(size), *back = malloc(size);
+	int x, y, rx, ry, rw, rh;
+
+	fill_random(linear, size);
+	for (y = 0; y < h; y++) {
+		for (x = 0; x < w; x++) {
+			u32 i = morton_index(x, h - 1 - y, w, h);
+			copy_texel(expected + i * bpp, linear + (y * w + x) * bpp, bpp, swap);
+			CHECK(sf2d_tile_texel_index(x, y, w, h) == i, "%s %dx%d: index of (%d, %d)", name, w, h, x, y);
+		}
+	}
+
+	// Whole buffer
+	sf2d_tile_rect(tiled, w, h, format, 0, 0, w, h, linear, w * bpp, flags);
+	CHECK(!memcmp(tiled, expected, size), "%s %dx%d: tile_rect", name, w, h);
+	sf2d_untile_rect(tiled, w, h, format, 0, 0, w, h, back, w * bpp, flags);
+	CHECK(!memcmp(back, linear, size), "%s %dx%d: untile_rect", name, w, h);
+
+	// In place
+	memcpy(back, linear, size);
+	CHECK(sf2d_tile_inplace(back, w, h, format, flags), "%s %dx%d: tile_inplace failed", name, w, h);
+	CHECK(!memcmp(back, expected, size), "%s %dx%d: tile_inplace", name, w, h);
+	CHECK(sf2d_untile_inplace(back, w, h, format, flags), "%s %dx%d: untile_inplace failed", name, w, h);
+	CHECK(!memcmp(back, linear, size), "%s %dx%d: untile_inplace", name, w, h);
+
+	// Unaligned rectangles, read back from the tiled buffer and written over a cleared one
+	for (ry = 0; ry < 11; ry += 3) {
+		for (rx = 0; rx < 13; rx += 5) {
+			rw = w - rx - 3 > 0 ? (w - rx) / 2 + 3 : w - rx;
+			rh = h - ry - 5 > 0 ? (h - ry) / 3 + 5 : h - ry;
+
+			memset(back, 0, size);
+			sf2d_untile_rect(tiled, w, h, format, rx, ry, rw, rh, back, w * bpp, flags);
+			for (y = 0; y < rh; y++)
+				CHECK(!memcmp(back + y * w * bpp, linear + ((ry + y) * w + rx) * bpp, rw * bpp),
+					"%s %dx%d: untile_rect at (%d, %d) %dx%d", name, w, h, rx, ry, rw, rh);
+
+			memset(back, 0, size);
+			sf2d_tile_rect(back, w, h, format, rx, ry, rw, rh, linear + (ry * w + rx) * bpp, w * bpp, flags);
+			for (y = 0; y < h; y++) {
+				for (x = 0; x < w; x++) {
+					u32 i = morton_index(x, h - 1 - y, w, h) * bpp;
+					int inside = x >= rx && x < rx + rw && y >= ry && y < ry + rh;
+					u8 zero[4] = { 0 };
+					CHECK(!memcmp(back + i, inside ? expected + i : zero, bpp),
+						"%s %dx%d: tile_rect at (%d, %d) %dx%d, texel (%d, %d)", name, w, h, rx, ry, rw, rh, x, y);
+				}
+			}
+		}
+	}
+
+	free(linear);
+	free(tiled);
+	free(expected);
+	free(back);
+}
+
+// The previous sf2d_texture_tile32, for RGBA8 only
+static void tile32_per_pixel(sf2d_texture *texture)
+{
+	u8 *tmp = linearAlloc(texture->pow2_w * texture->pow2_h * 4);
+	int i, j;
+	for (j = 0; j < texture->pow2_h; j++) {
+		for (i = 0; i < texture->pow2_w; i++) {
+			u32 v = ((u32 *)texture->data)[i + (texture->pow2_h - 1 - j)*texture->pow2_w];
+			((u32 *)tmp)[morton_index(i, j, texture->pow2_w, texture->pow2_h)] = __builtin_bswap32(v);
+		}
+	}
+	memcpy(texture->data, tmp, texture->pow2_w*texture->pow2_h*4);
+	linearFree(tmp);
+	texture->tiled = 1;
+}
+
+static void bench_rgba8(int w, int h)
+{
+	sf2d_texture *tex = sf2d_create_texture(w, h, TEXFMT_RGBA8, SF2D_PLACE_RAM);
+	size_t size = tex->pow2_w * tex->pow2_h * 4;
+	u8 *image = malloc(size), *reference = malloc(size);
+	u32 *rows = malloc(size);
+	double start, t_old = 0, t_new = 0, t_get = 0, t_untile = 0;
+	int run, x, y;
+
+	fill_random(image, size);
+	for (run = 0; run < RUNS; run++) {
+		memcpy(tex->data, image, size);
+		tex->tiled = 0;
+		start = now();
+		tile32_per_pixel(tex);
+		t_old += now() - start;
+		memcpy(reference, tex->data, size);
+
+		memcpy(tex->data, image, size);
+		tex->tiled = 0;
+		start = now();
+		sf2d_texture_tile32(tex);
+		t_new += now() - start;
+		CHECK(!memcmp(reference, tex->data, size), "sf2d_texture_tile32 %dx%d", w, h);
+
+		// Reading the image back for texture:save
+		start = now();
+		for (y = 0; y < h; y++)
+			for (x = 0; x < w; x++)
+				rows[y * w + x] = __builtin_bswap32(sf2d_get_pixel(tex, x, y));
+		t_get += now() - start;
+		memcpy(reference, rows, w * h * 4);
+
+		start = now();
+		sf2d_untile_rect(tex->data, tex->pow2_w, tex->pow2_h, TEXFMT_RGBA8, 0, 0, w, h, rows, w * 4, SF2D_TILE_SWAP_RGBA8);
+		t_untile += now() - start;
+		CHECK(!memcmp(reference, rows, w * h * 4), "sf2d_untile_rect %dx%d", w, h);
+	}
+
+	printf("%-6s %4dx%-4d %-26s %9.1f\n", "RGBA8", w, h, "tile32 per-pixel", size * RUNS / t_old / 1e6);
+	printf("%-6s %4dx%-4d %-26s %9.1f\n", "RGBA8", w, h, "tile32 in place", size * RUNS / t_new / 1e6);
+	printf("%-6s %4dx%-4d %-26s %9.1f\n", "RGBA8", w, h, "read back sf2d_get_pixel", w * h * 4.0 * RUNS / t_get / 1e6);
+	printf("%-6s %4dx%-4d %-26s %9.1f\n", "RGBA8", w, h, "read back untile_rect", w * h * 4.0 * RUNS / t_untile / 1e6);
+
+	free(image);
+	free(reference);
+	free(rows);
+	sf2d_free_texture(tex);
+}
+
+static void bench_format(const char *name, sf2d_texfmt format, int w, int h)
+{
+	int bpp = sf2d_tile_bytes_per_texel(format);
+	size_t size = w * h * bpp;
+	u8 *linear = malloc(size), *tiled = malloc(size);
+	double start, t_tile = 0, t_untile = 0;
+	int run;
+
+	fill_random(linear, size);
+	for (run = 0; run < RUNS; run++) {
+		start = now();
+		sf2d_tile_rect(tiled, w, h, format, 0, 0, w, h, linear, w * bpp, 0);
+		t_tile += now() - start;
+		start = now();
+		sf2d_untile_rect(tiled, w, h, format, 0, 0, w, h, linear, w * bpp, 0);
+		t_untile += now() - start;
+	}
+
+	printf("%-6s %4dx%-4d %-26s %9.1f\n", name, w, h, "tile_rect", size * RUNS / t_tile / 1e6);
+	printf("%-6s %4dx%-4d %-26s %9.1f\n", name, w, h, "untile_rect", size * RUNS / t_untile / 1e6);
+
+	free(linear);
+	free(tiled);
+}
+
+int main()
+{
+	int f, s;
+
+	srand(42);
+	for (f = 0; f < sizeof(formats)/sizeof(*formats); f++) {
+		for (s = 0; s < sizeof(sizes)/sizeof(*sizes); s++) {
+			check_format(formats[f].name, formats[f].format, sizes[s][0], sizes[s][1], 0);
+			if (formats[f].format == TEXFMT_RGBA8)
+				check_format("RGBA8 swapped", formats[f].format, sizes[s][0], sizes[s][1], SF2D_TILE_SWAP_RGBA8);
+		}
+	}
+	if (failures) {
+		printf("%d round-trip checks failed\n", failures);
+		return 1;
+	}
+	printf("Round-trip checks passed\n\n");
+
+	printf("%-6s %-9s %-26s %9s\n", "format", "size", "path", "MB/s");
+	bench_rgba8(512, 512);
+	bench_rgba8(1024, 512);
+	for (f = 0; f < sizeof(formats)/sizeof(*formats); f++)
+		bench_format(formats[f].name, formats[f].format, 512, 512);
+
+	return 0;
+}
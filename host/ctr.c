@@ -0,0 +1,147 @@
+/*
+Host version of the `ctr` module: only the gfx, hid and cam subtables are
+available. ctr.run() counts the frames, measures the CPU time spent on each
+of them and dumps the screens rendered since the previous call.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <3ds.h>
+#include <sf2d.h>
+#include <sf2d_host.h>
+
+#include <lua.h>
+#include <lauxlib.h>
+
+#include "host.h"
+
+void load_gfx_lib(lua_State *L);
+void load_hid_lib(lua_State *L);
+void load_cam_lib(lua_State *L);
+
+typedef struct {
+	u64 cpu_ticks;
+	sf2d_host_stats gpu;
+} frame_stats;
+
+static int frames = 0;
+static u64 last_tick = 0;
+static frame_stats total;
+static u64 min_ticks = ~0ULL;
+static u64 max_ticks = 0;
+
+static void dump_frame(int frame)
+{
+	char path[1024];
+
+	snprintf(path, sizeof(path), "%s/frame%04d_top.png", options.dump_dir, frame);
+	sf2d_host_save_screen(GFX_TOP, GFX_LEFT, path);
+	snprintf(path, sizeof(path), "%s/frame%04d_bottom.png", options.dump_dir, frame);
+	sf2d_host_save_screen(GFX_BOTTOM, GFX_LEFT, path);
+}
+
+static int ctr_run(lua_State *L) {
+	u64 now = svcGetSystemTick();
+
+	if (last_tick != 0) {
+		sf2d_host_stats gpu;
+		u64 ticks = now - last_tick;
+
+		sf2d_host_get_stats(&gpu);
+		total.cpu_ticks += ticks;
+		total.gpu.draw_calls += gpu.draw_calls;
+		total.gpu.vertices += gpu.vertices;
+		total.gpu.triangles += gpu.triangles;
+		total.gpu.fragments += gpu.fragments;
+		total.gpu.cmd_words += gpu.cmd_words;
+		total.gpu.display_transfers += gpu.display_transfers;
+		total.gpu.memory_fills += gpu.memory_fills;
+		total.gpu.texture_copies += gpu.texture_copies;
+		total.gpu.flushed_bytes += gpu.flushed_bytes;
+		if (ticks < min_ticks) min_ticks = ticks;
+		if (ticks > max_ticks) max_ticks = ticks;
+
+		frames++;
+		if (options.dump_dir) {
+			sf2d_wait_gpu(); // the screens are updated once the GPU is done
+			dump_frame(frames);
+		}
+	}
+
+	lua_pushboolean(L, options.max_frames == 0 || frames < options.max_frames);
+
+	sf2d_host_reset_stats();
+	last_tick = svcGetSystemTick();
+
+	return 1;
+}
+
+void host_print_report(void) {
+	if (frames == 0) return;
+
+	double ms = 1000.0 / SYSCLOCK_ARM11;
+	fprintf(stderr, "frames: %d\n", frames);
+	fprintf(stderr, "cpu ms/frame: avg %.3f, min %.3f, max %.3f\n",
+		total.cpu_ticks * ms / frames, min_ticks * ms, max_ticks * ms);
+	fprintf(stderr, "per frame: %.1f draw calls, %.1f vertices, %.1f triangles, %.0f fragments, %.0f cmd words\n",
+		(double)total.gpu.draw_calls / frames, (double)total.gpu.vertices / frames,
+		(double)total.gpu.triangles / frames, (double)total.gpu.fragments / frames,
+		(double)total.gpu.cmd_words / frames);
+	fprintf(stderr, "per frame: %.1f display transfers, %.1f memory fills, %.1f texture copies, %.0f bytes flushed\n",
+		(double)total.gpu.display_transfers / frames, (double)total.gpu.memory_fills / frames,
+		(double)total.gpu.texture_copies / frames, (double)total.gpu.flushed_bytes / frames);
+}
+
+static int ctr_time(lua_State *L) {
+	lua_pushinteger(L, osGetTime());
+
+	return 1;
+}
+
+static int ctr_utime(lua_State *L) {
+	lua_pushinteger(L, (u64)(svcGetSystemTick()/268.123480)); // wraps around with 32-bit integers, differences stay valid
+
+	return 1;
+}
+
+// Functions
+static const struct luaL_Reg ctr_lib[] = {
+	{ "run",   ctr_run  },
+	{ "time",  ctr_time },
+	{ "utime", ctr_utime},
+	{ NULL, NULL }
+};
+
+// Subtables
+struct { char *name; void (*load)(lua_State *L); } ctr_libs[] = {
+	{ "gfx", load_gfx_lib },
+	{ "hid", load_hid_lib },
+	{ "cam", load_cam_lib },
+	{ NULL, NULL }
+};
+
+int luaopen_ctr_lib(lua_State *L) {
+	luaL_newlib(L, ctr_lib);
+
+	for (int i = 0; ctr_libs[i].name; i++) {
+		ctr_libs[i].load(L);
+		lua_setfield(L, -2, ctr_libs[i].name);
+	}
+
+	lua_pushstring(L, "host");
+	lua_setfield(L, -2, "version");
+	lua_pushstring(L, "host");
+	lua_setfield(L, -2, "build");
+
+	char buff[1024];
+	if (getcwd(buff, sizeof(buff)) == NULL) buff[0] = '\0';
+	lua_pushfstring(L, "%s/", buff);
+	lua_setfield(L, -2, "root");
+
+	return 1;
+}
+
+void load_ctr_lib(lua_State *L) {
+	luaL_requiref(L, "ctr", luaopen_ctr_lib, 0);
+}
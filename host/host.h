@@ -0,0 +1,17 @@
+#ifndef HOST_H
+#define HOST_H
+
+#include <3ds/types.h>
+
+// Options of the host runner, set from the command line
+typedef struct {
+	int max_frames;        // ctr.run() returns false after this many frames, 0 for no limit
+	const char *dump_dir;  // where to save every frame as PNG, or NULL
+} host_options;
+
+extern host_options options;
+
+// Prints the per-frame timings and GPU counters gathered by ctr.run()
+void host_print_report(void);
+
+#endif
@@ -0,0 +1,99 @@
+/*
+Headless host runner: runs a ctrµLua script on the desktop, with the gfx
+module rendered by the software GPU of the sf2dlib host backend.
+
+Usage: ctruLua-host [-r<root>] [-f<frames>] [-o<dump dir>] [-c<camera frames>] script.lua
+The camera frames are raw RGB565 files, named by a printf pattern taking the
+frame number (e.g. frames/%03d.raw); the cameras generate frames without it.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <lua.h>
+#include <lauxlib.h>
+#include <lualib.h>
+
+#include <3ds.h>
+#include <sf2d.h>
+#include <sftd.h>
+
+#include "host.h"
+
+void load_ctr_lib(lua_State *L);
+
+host_options options = { 1, NULL };
+
+int main(int argc, char** argv) {
+	const char *mainFile = "main.lua";
+	int scriptArg = argc; // index of the script in argv, the following arguments are its own
+
+	for (int i = 1; i < argc; i++) {
+		if (argv[i][0] == '-' && argv[i][1] != '\0') {
+			char option = argv[i][1];
+			const char *value = argv[i][2] != '\0' ? &argv[i][2] : (i + 1 < argc ? argv[++i] : NULL);
+			if (value == NULL) {
+				fprintf(stderr, "Missing value for -%c\n", option);
+				return 1;
+			}
+			switch (option) {
+				case 'r': // root directory replacement
+					if (chdir(value)) {
+						fprintf(stderr, "No such root path: %s\n", value);
+						return 1;
+					}
+					break;
+				case 'f': // number of frames to run, 0 for no limit
+					options.max_frames = atoi(value);
+					break;
+				case 'o': // dump every frame to this directory
+					options.dump_dir = value;
+					break;
+				case 'c': // camera frames
+					camHostSetFrameSource(value);
+					break;
+				default:
+					fprintf(stderr, "Unknown option: -%c\n", option);
+					return 1;
+			}
+		} else {
+			mainFile = argv[i];
+			scriptArg = i;
+			break;
+		}
+	}
+
+	lua_State *L = luaL_newstate();
+	if (L == NULL) {
+		fprintf(stderr, "Memory allocation error while creating a new Lua state\n");
+		return 1;
+	}
+
+	luaL_openlibs(L);
+	load_ctr_lib(L);
+
+	// Script arguments, like the standalone Lua interpreter: arg[0] is the script
+	lua_createtable(L, argc - scriptArg, 1);
+	for (int i = scriptArg; i < argc; i++) {
+		lua_pushstring(L, argv[i]);
+		lua_rawseti(L, -2, i - scriptArg);
+	}
+	lua_setglobal(L, "arg");
+
+	int ret = 0;
+	if (luaL_dofile(L, mainFile)) {
+		fprintf(stderr, "%s\n", lua_tostring(L, -1));
+		ret = 1;
+	}
+
+	host_print_report();
+
+	// Close the state before the libraries, so the fonts and textures the
+	// script still references are collected while sftd and sf2d are up
+	lua_close(L);
+	camExit();
+	sftd_fini();
+	sf2d_fini();
+
+	return ret;
+}
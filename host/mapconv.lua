@@ -0,0 +1,28 @@
+-- Converts a map to the binary map format (see map:save), which map.load reads without any parsing.
+-- The input is a CSV map, or a Lua file returning a map table (see map.load).
+-- Usage: ./ctruLua-host mapconv.lua input.csv|input.lua output.map tileWidth tileHeight [-z]
+-- -z compresses the tiles with zlib.
+
+local texture = require("ctr.gfx.texture")
+local map = require("ctr.gfx.map")
+
+local input, output = arg[1], arg[2]
+local tileWidth, tileHeight = tonumber(arg[3]), tonumber(arg[4])
+local compress = arg[5] == "-z"
+
+if not (input and output and tileWidth and tileHeight) then
+	error("usage: mapconv.lua input.csv|input.lua output.map tileWidth tileHeight [-z]", 0)
+end
+
+local source = input
+if input:match("%.lua$") then
+	source = assert(dofile(input), "the Lua file must return a map table")
+end
+
+-- The tileset isn't stored in the map file, any texture will do
+local tileset = texture.new(tileWidth, tileHeight, texture.PLACE_RAM)
+local m = assert(map.load(source, tileset, tileWidth, tileHeight))
+assert(m:save(output, compress))
+
+local width, height = m:getSize()
+print(("%s: %dx%d tiles"):format(output, width, height))
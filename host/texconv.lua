@@ -0,0 +1,23 @@
+-- Converts an image to a texture file (see texture:save) in a given pixel format, which texture.load reads straight
+-- into the texture, without decoding or converting it: the way to use ETC1 textures, slow to encode.
+-- Usage: ./ctruLua-host texconv.lua input.png output.tex [format]
+-- The format is one of RGBA8, RGB8, RGB5A1, RGB565, RGBA4, IA8, I8, A8, IA4, ETC1 (default) and ETC1A4.
+
+local texture = require("ctr.gfx.texture")
+
+local input, output, formatName = arg[1], arg[2], (arg[3] or "ETC1"):upper()
+local format = texture["FORMAT_" .. formatName]
+
+if not (input and output and format) then
+	error("usage: texconv.lua input.png output.tex [RGBA8|RGB8|RGB5A1|RGB565|RGBA4|IA8|I8|A8|IA4|ETC1|ETC1A4]", 0)
+end
+
+local start = os.clock()
+local tex = assert(texture.load(input, texture.PLACE_RAM, nil, format))
+assert(tex:save(output, texture.TYPE_TEX))
+
+local width, height = tex:getSize()
+local file = assert(io.open(output, "rb"))
+local size = file:seek("end")
+file:close()
+print(("%s: %dx%d %s, %d bytes, converted in %.3f s"):format(output, width, height, formatName, size, os.clock() - start))
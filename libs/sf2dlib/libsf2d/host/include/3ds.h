@@ -0,0 +1,746 @@
+/**
+ * @file 3ds.h
+ * @brief Host stand-in for the parts of ctrulib used by sf2dlib, sftdlib,
+ *        sfillib and the ctrµLua gfx and cam modules.
+ *
+ * Only the declarations needed to build those libraries on a desktop are
+ * provided. The GPU functions are implemented by a software rasterizer
+ * (see gpu_host.c), the cameras by cam_host.c, everything else by ctru_host.c.
+ */
+#ifndef HOST_3DS_H
+#define HOST_3DS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Types
+
+typedef uint8_t  u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+
+typedef int8_t  s8;
+typedef int16_t s16;
+typedef int32_t s32;
+typedef int64_t s64;
+
+typedef volatile u8  vu8;
+typedef volatile u16 vu16;
+typedef volatile u32 vu32;
+typedef volatile u64 vu64;
+
+typedef s32 Result;
+typedef u32 Handle;
+
+#define BIT(n) (1U<<(n))
+#define U64_MAX UINT64_MAX
+
+#define SYSCLOCK_ARM11 (268111856)
+
+// OS
+
+u64 osGetTime(void);
+u64 svcGetSystemTick(void);
+void svcSleepThread(s64 ns);
+float osGet3DSliderState(void);
+
+/**
+ * @brief On the host, "physical" addresses are the virtual ones.
+ * @note Returns a pointer-sized integer instead of a u32 so that 64-bit
+ *       addresses survive the (u32 *) casts done by the callers.
+ */
+uintptr_t osConvertVirtToPhys(const void *addr);
+
+// Threads and synchronization, with pthreads
+
+#define CUR_THREAD_HANDLE 0xFFFF8000
+
+typedef struct Thread_tag *Thread;
+typedef void (*ThreadFunc)(void *);
+
+Thread threadCreate(ThreadFunc entrypoint, void *arg, size_t stack_size, int prio, int affinity, bool detached);
+Result threadJoin(Thread thread, u64 timeout_ns);
+void threadFree(Thread thread);
+Result svcGetThreadPriority(s32 *out, Handle handle);
+
+typedef pthread_mutex_t LightLock;
+
+void LightLock_Init(LightLock *lock);
+void LightLock_Lock(LightLock *lock);
+void LightLock_Unlock(LightLock *lock);
+
+typedef enum {
+	RESET_ONESHOT = 0,
+	RESET_STICKY  = 1,
+	RESET_PULSE   = 2,
+} ResetType;
+
+Result svcCreateEvent(Handle *event, ResetType reset_type);
+Result svcSignalEvent(Handle handle);
+Result svcClearEvent(Handle handle);
+Result svcWaitSynchronization(Handle handle, s64 nanoseconds);
+Result svcCloseHandle(Handle handle);
+
+// Memory
+
+void *linearAlloc(size_t size);
+void *linearMemAlign(size_t size, size_t alignment);
+void linearFree(void *mem);
+u32 linearSpaceFree(void);
+
+void *vramAlloc(size_t size);
+void *vramMemAlign(size_t size, size_t alignment);
+void vramFree(void *mem);
+u32 vramSpaceFree(void);
+
+// APT
+
+typedef enum {
+	APTHOOK_ONSUSPEND = 0,
+	APTHOOK_ONRESTORE,
+	APTHOOK_ONSLEEP,
+	APTHOOK_ONWAKEUP,
+	APTHOOK_ONEXIT,
+	APTHOOK_COUNT,
+} APT_HookType;
+
+typedef void (*aptHookFn)(APT_HookType hook, void *param);
+
+typedef struct tag_aptHookCookie {
+	struct tag_aptHookCookie *next;
+	aptHookFn callback;
+	void *param;
+} aptHookCookie;
+
+void aptHook(aptHookCookie *cookie, aptHookFn callback, void *param);
+void aptUnhook(aptHookCookie *cookie);
+bool aptMainLoop(void);
+
+// GSP
+
+typedef enum {
+	GSP_RGBA8_OES   = 0,
+	GSP_BGR8_OES    = 1,
+	GSP_RGB565_OES  = 2,
+	GSP_RGB5_A1_OES = 3,
+	GSP_RGBA4_OES   = 4,
+} GSPGPU_FramebufferFormats;
+
+typedef enum {
+	GSPGPU_EVENT_PSC0 = 0,
+	GSPGPU_EVENT_PSC1,
+	GSPGPU_EVENT_VBlank0,
+	GSPGPU_EVENT_VBlank1,
+	GSPGPU_EVENT_PPF,
+	GSPGPU_EVENT_P3D,
+	GSPGPU_EVENT_DMA,
+	GSPGPU_EVENT_MAX,
+} GSPGPU_Event;
+
+void gspWaitForEvent(GSPGPU_Event id, bool nextEvent);
+
+#define gspWaitForPSC0()    gspWaitForEvent(GSPGPU_EVENT_PSC0, false)
+#define gspWaitForPSC1()    gspWaitForEvent(GSPGPU_EVENT_PSC1, false)
+#define gspWaitForVBlank()  gspWaitForVBlank0()
+#define gspWaitForVBlank0() gspWaitForEvent(GSPGPU_EVENT_VBlank0, true)
+#define gspWaitForVBlank1() gspWaitForEvent(GSPGPU_EVENT_VBlank1, true)
+#define gspWaitForPPF()     gspWaitForEvent(GSPGPU_EVENT_PPF, false)
+#define gspWaitForP3D()     gspWaitForEvent(GSPGPU_EVENT_P3D, false)
+#define gspWaitForDMA()     gspWaitForEvent(GSPGPU_EVENT_DMA, false)
+
+Result GSPGPU_FlushDataCache(const void *adr, u32 size);
+Result GSPGPU_InvalidateDataCache(const void *adr, u32 size);
+
+// GFX
+
+typedef enum {
+	GFX_TOP = 0,
+	GFX_BOTTOM = 1
+} gfxScreen_t;
+
+typedef enum {
+	GFX_LEFT = 0,
+	GFX_RIGHT = 1,
+} gfx3dSide_t;
+
+void gfxInitDefault(void);
+void gfxExit(void);
+void gfxSet3D(bool enable);
+void gfxSetScreenFormat(gfxScreen_t screen, GSPGPU_FramebufferFormats format);
+void gfxSetDoubleBuffering(gfxScreen_t screen, bool doubleBuffering);
+u8 *gfxGetFramebuffer(gfxScreen_t screen, gfx3dSide_t side, u16 *width, u16 *height);
+void gfxFlushBuffers(void);
+void gfxSwapBuffers(void);
+void gfxSwapBuffersGpu(void);
+
+// Console
+
+typedef struct PrintConsole PrintConsole;
+
+typedef enum {
+	debugDevice_NULL,
+	debugDevice_3DMOO,
+	debugDevice_CONSOLE,
+} debugDevice;
+
+PrintConsole *consoleInit(gfxScreen_t screen, PrintConsole *console);
+void consoleDebugInit(debugDevice device);
+void consoleClear(void);
+
+// HID
+
+enum {
+	KEY_A       = BIT(0),
+	KEY_B       = BIT(1),
+	KEY_SELECT  = BIT(2),
+	KEY_START   = BIT(3),
+	KEY_DRIGHT  = BIT(4),
+	KEY_DLEFT   = BIT(5),
+	KEY_DUP     = BIT(6),
+	KEY_DDOWN   = BIT(7),
+	KEY_R       = BIT(8),
+	KEY_L       = BIT(9),
+	KEY_X       = BIT(10),
+	KEY_Y       = BIT(11),
+	KEY_ZL      = BIT(14),
+	KEY_ZR      = BIT(15),
+	KEY_TOUCH   = BIT(20),
+	KEY_CSTICK_RIGHT = BIT(24),
+	KEY_CSTICK_LEFT  = BIT(25),
+	KEY_CSTICK_UP    = BIT(26),
+	KEY_CSTICK_DOWN  = BIT(27),
+	KEY_CPAD_RIGHT = BIT(28),
+	KEY_CPAD_LEFT  = BIT(29),
+	KEY_CPAD_UP    = BIT(30),
+	KEY_CPAD_DOWN  = BIT(31),
+
+	KEY_UP    = KEY_DUP    | KEY_CPAD_UP,
+	KEY_DOWN  = KEY_DDOWN  | KEY_CPAD_DOWN,
+	KEY_LEFT  = KEY_DLEFT  | KEY_CPAD_LEFT,
+	KEY_RIGHT = KEY_DRIGHT | KEY_CPAD_RIGHT,
+};
+
+typedef struct {
+	u16 px;
+	u16 py;
+} touchPosition;
+
+typedef struct {
+	s16 dx;
+	s16 dy;
+} circlePosition;
+
+typedef struct {
+	s16 x;
+	s16 y;
+	s16 z;
+} accelVector;
+
+typedef struct {
+	s16 x;
+	s16 z;
+	s16 y;
+} angularRate;
+
+/**
+ * @brief Sets the keys reported as held by the next hidScanInput() calls.
+ * @note Host only, lets a runner script the input of a headless session.
+ */
+void hidHostSetKeys(u32 keys);
+
+void hidScanInput(void);
+u32 hidKeysHeld(void);
+u32 hidKeysDown(void);
+u32 hidKeysUp(void);
+void hidTouchRead(touchPosition *pos);
+void hidCircleRead(circlePosition *pos);
+void hidAccelRead(accelVector *vector);
+void hidGyroRead(angularRate *rate);
+void irrstCstickRead(circlePosition *pos);
+Result HIDUSER_EnableAccelerometer(void);
+Result HIDUSER_DisableAccelerometer(void);
+Result HIDUSER_EnableGyroscope(void);
+Result HIDUSER_DisableGyroscope(void);
+Result HIDUSER_GetSoundVolume(u8 *volume);
+
+// Camera
+
+typedef enum {
+	PORT_NONE = 0x0,
+	PORT_CAM1 = BIT(0),
+	PORT_CAM2 = BIT(1),
+	PORT_BOTH = PORT_CAM1 | PORT_CAM2,
+} CAMU_Port;
+
+typedef enum {
+	SELECT_NONE      = 0x0,
+	SELECT_OUT1      = BIT(0),
+	SELECT_IN1       = BIT(1),
+	SELECT_OUT2      = BIT(2),
+	SELECT_IN1_OUT1  = SELECT_OUT1 | SELECT_IN1,
+	SELECT_OUT1_OUT2 = SELECT_OUT1 | SELECT_OUT2,
+	SELECT_IN1_OUT2  = SELECT_IN1 | SELECT_OUT2,
+	SELECT_ALL       = SELECT_OUT1 | SELECT_IN1 | SELECT_OUT2,
+} CAMU_CameraSelect;
+
+typedef enum {
+	CONTEXT_NONE = 0x0,
+	CONTEXT_A    = BIT(0),
+	CONTEXT_B    = BIT(1),
+	CONTEXT_BOTH = CONTEXT_A | CONTEXT_B,
+} CAMU_Context;
+
+typedef enum {
+	FLIP_NONE       = 0x0,
+	FLIP_HORIZONTAL = 0x1,
+	FLIP_VERTICAL   = 0x2,
+	FLIP_REVERSE    = 0x3,
+} CAMU_Flip;
+
+typedef enum {
+	SIZE_VGA            = 0x0,
+	SIZE_QVGA           = 0x1,
+	SIZE_QQVGA          = 0x2,
+	SIZE_CIF            = 0x3,
+	SIZE_QCIF           = 0x4,
+	SIZE_DS_LCD         = 0x5,
+	SIZE_DS_LCDx4       = 0x6,
+	SIZE_CTR_TOP_LCD    = 0x7,
+	SIZE_CTR_BOTTOM_LCD = SIZE_QVGA,
+} CAMU_Size;
+
+typedef enum {
+	FRAME_RATE_15       = 0x0,
+	FRAME_RATE_15_TO_5  = 0x1,
+	FRAME_RATE_15_TO_2  = 0x2,
+	FRAME_RATE_10       = 0x3,
+	FRAME_RATE_8_5      = 0x4,
+	FRAME_RATE_5        = 0x5,
+	FRAME_RATE_20       = 0x6,
+	FRAME_RATE_20_TO_5  = 0x7,
+	FRAME_RATE_30       = 0x8,
+	FRAME_RATE_30_TO_5  = 0x9,
+	FRAME_RATE_15_TO_10 = 0xA,
+	FRAME_RATE_20_TO_10 = 0xB,
+	FRAME_RATE_30_TO_10 = 0xC,
+} CAMU_FrameRate;
+
+typedef enum {
+	WHITE_BALANCE_AUTO  = 0x0,
+	WHITE_BALANCE_3200K = 0x1,
+	WHITE_BALANCE_4150K = 0x2,
+	WHITE_BALANCE_5200K = 0x3,
+	WHITE_BALANCE_6000K = 0x4,
+	WHITE_BALANCE_7000K = 0x5,
+
+	WHITE_BALANCE_NORMAL                  = WHITE_BALANCE_AUTO,
+	WHITE_BALANCE_TUNGSTEN                = WHITE_BALANCE_3200K,
+	WHITE_BALANCE_WHITE_FLUORESCENT_LIGHT = WHITE_BALANCE_4150K,
+	WHITE_BALANCE_DAYLIGHT                = WHITE_BALANCE_5200K,
+	WHITE_BALANCE_CLOUDY                  = WHITE_BALANCE_6000K,
+	WHITE_BALANCE_HORIZON                 = WHITE_BALANCE_6000K,
+	WHITE_BALANCE_SHADE                   = WHITE_BALANCE_7000K,
+} CAMU_WhiteBalance;
+
+typedef enum {
+	PHOTO_MODE_NORMAL    = 0x0,
+	PHOTO_MODE_PORTRAIT  = 0x1,
+	PHOTO_MODE_LANDSCAPE = 0x2,
+	PHOTO_MODE_NIGHTVIEW = 0x3,
+	PHOTO_MODE_LETTER    = 0x4,
+} CAMU_PhotoMode;
+
+typedef enum {
+	EFFECT_NONE     = 0x0,
+	EFFECT_MONO     = 0x1,
+	EFFECT_SEPIA    = 0x2,
+	EFFECT_NEGATIVE = 0x3,
+	EFFECT_NEGAFILM = 0x4,
+	EFFECT_SEPIA01  = 0x5,
+} CAMU_Effect;
+
+typedef enum {
+	CONTRAST_PATTERN_01 = 0x0,
+	CONTRAST_PATTERN_02 = 0x1,
+	CONTRAST_PATTERN_03 = 0x2,
+	CONTRAST_PATTERN_04 = 0x3,
+	CONTRAST_PATTERN_05 = 0x4,
+	CONTRAST_PATTERN_06 = 0x5,
+	CONTRAST_PATTERN_07 = 0x6,
+	CONTRAST_PATTERN_08 = 0x7,
+	CONTRAST_PATTERN_09 = 0x8,
+	CONTRAST_PATTERN_10 = 0x9,
+	CONTRAST_PATTERN_11 = 0xA,
+
+	CONTRAST_LOW    = CONTRAST_PATTERN_05,
+	CONTRAST_NORMAL = CONTRAST_PATTERN_06,
+	CONTRAST_HIGH   = CONTRAST_PATTERN_07,
+} CAMU_Contrast;
+
+typedef enum {
+	LENS_CORRECTION_OFF   = 0x0,
+	LENS_CORRECTION_ON_70 = 0x1,
+	LENS_CORRECTION_ON_90 = 0x2,
+
+	LENS_CORRECTION_DARK   = LENS_CORRECTION_OFF,
+	LENS_CORRECTION_NORMAL = LENS_CORRECTION_ON_70,
+	LENS_CORRECTION_BRIGHT = LENS_CORRECTION_ON_90,
+} CAMU_LensCorrection;
+
+typedef enum {
+	INPUT_YUV422   = 0x0,
+	OUTPUT_YUV_422 = INPUT_YUV422,
+	INPUT_RGB565   = 0x1,
+	OUTPUT_RGB_565 = INPUT_RGB565,
+} CAMU_OutputFormat;
+
+typedef enum {
+	SHUTTER_SOUND_TYPE_NORMAL    = 0x0,
+	SHUTTER_SOUND_TYPE_MOVIE     = 0x1,
+	SHUTTER_SOUND_TYPE_MOVIE_END = 0x2,
+} CAMU_ShutterSoundType;
+
+/**
+ * @brief Sets where the host cameras read their frames from.
+ * @param pattern printf pattern of the frame files, taking the frame number
+ *        (from 0, e.g. "frames/%03d.raw"); each file holds a raw RGB565
+ *        frame of the transfer size, the frames start over from 0 at the
+ *        first missing file. NULL for the generated frames (the default).
+ * @note Host only. The generated frames of port p, frame n have the texel
+ *       (x, y) of red (x + n) & 31, green (y + 2n) & 63 and blue (n + p) & 31.
+ */
+void camHostSetFrameSource(const char *pattern);
+
+Result camInit(void);
+void camExit(void);
+Result CAMU_StartCapture(u32 port);
+Result CAMU_StopCapture(u32 port);
+Result CAMU_ClearBuffer(u32 port);
+Result CAMU_SetReceiving(Handle *event, void *dst, u32 port, u32 imageSize, s16 transferUnit);
+Result CAMU_IsFinishedReceiving(bool *finishedReceiving, u32 port);
+Result CAMU_SetTransferBytes(u32 port, u32 bytes, s16 width, s16 height);
+Result CAMU_GetMaxBytes(u32 *maxBytes, s16 width, s16 height);
+Result CAMU_Activate(u32 select);
+Result CAMU_SetExposure(u32 select, s8 exposure);
+Result CAMU_SetWhiteBalance(u32 select, CAMU_WhiteBalance whiteBalance);
+Result CAMU_SetSharpness(u32 select, s8 sharpness);
+Result CAMU_SetAutoExposure(u32 select, bool autoExposure);
+Result CAMU_IsAutoExposure(bool *autoExposure, u32 select);
+Result CAMU_SetAutoWhiteBalance(u32 select, bool autoWhiteBalance);
+Result CAMU_IsAutoWhiteBalance(bool *autoWhiteBalance, u32 select);
+Result CAMU_SetContrast(u32 select, CAMU_Contrast contrast);
+Result CAMU_SetLensCorrection(u32 select, CAMU_LensCorrection lensCorrection);
+Result CAMU_SetAutoExposureWindow(u32 select, s16 x, s16 y, s16 width, s16 height);
+Result CAMU_SetAutoWhiteBalanceWindow(u32 select, s16 x, s16 y, s16 width, s16 height);
+Result CAMU_SetNoiseFilter(u32 select, bool noiseFilter);
+Result CAMU_PlayShutterSound(CAMU_ShutterSoundType sound);
+Result CAMU_SetSize(u32 select, CAMU_Size size, CAMU_Context context);
+Result CAMU_SetEffect(u32 select, CAMU_Effect effect, CAMU_Context context);
+Result CAMU_SetFrameRate(u32 select, CAMU_FrameRate frameRate);
+Result CAMU_SetOutputFormat(u32 select, CAMU_OutputFormat format, CAMU_Context context);
+
+// GPU enums
+
+#define GPU_TEXTURE_MAG_FILTER(v) (((v)&0x1)<<1)
+#define GPU_TEXTURE_MIN_FILTER(v) (((v)&0x1)<<2)
+#define GPU_TEXTURE_WRAP_S(v)     (((v)&0x3)<<12)
+#define GPU_TEXTURE_WRAP_T(v)     (((v)&0x3)<<8)
+
+typedef enum {
+	GPU_NEAREST = 0x0,
+	GPU_LINEAR  = 0x1,
+} GPU_TEXTURE_FILTER_PARAM;
+
+typedef enum {
+	GPU_CLAMP_TO_EDGE   = 0x0,
+	GPU_CLAMP_TO_BORDER = 0x1,
+	GPU_REPEAT          = 0x2,
+	GPU_MIRRORED_REPEAT = 0x3,
+} GPU_TEXTURE_WRAP_PARAM;
+
+typedef enum {
+	GPU_TEXUNIT0 = 0x1,
+	GPU_TEXUNIT1 = 0x2,
+	GPU_TEXUNIT2 = 0x4,
+} GPU_TEXUNIT;
+
+typedef enum {
+	GPU_RGBA8    = 0x0,
+	GPU_RGB8     = 0x1,
+	GPU_RGBA5551 = 0x2,
+	GPU_RGB565   = 0x3,
+	GPU_RGBA4    = 0x4,
+	GPU_LA8      = 0x5,
+	GPU_HILO8    = 0x6,
+	GPU_L8       = 0x7,
+	GPU_A8       = 0x8,
+	GPU_LA4      = 0x9,
+	GPU_L4       = 0xA,
+	GPU_A4       = 0xB,
+	GPU_ETC1     = 0xC,
+	GPU_ETC1A4   = 0xD,
+} GPU_TEXCOLOR;
+
+typedef enum {
+	GPU_NEVER    = 0,
+	GPU_ALWAYS   = 1,
+	GPU_EQUAL    = 2,
+	GPU_NOTEQUAL = 3,
+	GPU_LESS     = 4,
+	GPU_LEQUAL   = 5,
+	GPU_GREATER  = 6,
+	GPU_GEQUAL   = 7,
+} GPU_TESTFUNC;
+
+typedef enum {
+	GPU_WRITE_RED   = 0x01,
+	GPU_WRITE_GREEN = 0x02,
+	GPU_WRITE_BLUE  = 0x04,
+	GPU_WRITE_ALPHA = 0x08,
+	GPU_WRITE_DEPTH = 0x10,
+	GPU_WRITE_COLOR = 0x0F,
+	GPU_WRITE_ALL   = 0x1F,
+} GPU_WRITEMASK;
+
+typedef enum {
+	GPU_SCISSOR_DISABLE = 0,
+	GPU_SCISSOR_INVERT  = 1,
+	GPU_SCISSOR_NORMAL  = 3,
+} GPU_SCISSORMODE;
+
+typedef enum {
+	GPU_STENCIL_KEEP      = 0,
+	GPU_STENCIL_ZERO      = 1,
+	GPU_STENCIL_REPLACE   = 2,
+	GPU_STENCIL_INCR      = 3,
+	GPU_STENCIL_DECR      = 4,
+	GPU_STENCIL_INVERT    = 5,
+	GPU_STENCIL_INCR_WRAP = 6,
+	GPU_STENCIL_DECR_WRAP = 7,
+} GPU_STENCILOP;
+
+typedef enum {
+	GPU_BLEND_ADD              = 0,
+	GPU_BLEND_SUBTRACT         = 1,
+	GPU_BLEND_REVERSE_SUBTRACT = 2,
+	GPU_BLEND_MIN              = 3,
+	GPU_BLEND_MAX              = 4,
+} GPU_BLENDEQUATION;
+
+typedef enum {
+	GPU_ZERO                     = 0,
+	GPU_ONE                      = 1,
+	GPU_SRC_COLOR                = 2,
+	GPU_ONE_MINUS_SRC_COLOR      = 3,
+	GPU_DST_COLOR                = 4,
+	GPU_ONE_MINUS_DST_COLOR      = 5,
+	GPU_SRC_ALPHA                = 6,
+	GPU_ONE_MINUS_SRC_ALPHA      = 7,
+	GPU_DST_ALPHA                = 8,
+	GPU_ONE_MINUS_DST_ALPHA      = 9,
+	GPU_CONSTANT_COLOR           = 10,
+	GPU_ONE_MINUS_CONSTANT_COLOR = 11,
+	GPU_CONSTANT_ALPHA           = 12,
+	GPU_ONE_MINUS_CONSTANT_ALPHA = 13,
+	GPU_SRC_ALPHA_SATURATE       = 14,
+} GPU_BLENDFACTOR;
+
+typedef enum {
+	GPU_CULL_NONE      = 0,
+	GPU_CULL_FRONT_CCW = 1,
+	GPU_CULL_BACK_CCW  = 2,
+} GPU_CULLMODE;
+
+typedef enum {
+	GPU_PRIMARY_COLOR            = 0x00,
+	GPU_FRAGMENT_PRIMARY_COLOR   = 0x01,
+	GPU_FRAGMENT_SECONDARY_COLOR = 0x02,
+	GPU_TEXTURE0                 = 0x03,
+	GPU_TEXTURE1                 = 0x04,
+	GPU_TEXTURE2                 = 0x05,
+	GPU_TEXTURE3                 = 0x06,
+	GPU_PREVIOUS_BUFFER          = 0x0D,
+	GPU_CONSTANT                 = 0x0E,
+	GPU_PREVIOUS                 = 0x0F,
+} GPU_TEVSRC;
+
+typedef enum {
+	GPU_TEVOP_RGB_SRC_COLOR           = 0x00,
+	GPU_TEVOP_RGB_ONE_MINUS_SRC_COLOR = 0x01,
+	GPU_TEVOP_RGB_SRC_ALPHA           = 0x02,
+	GPU_TEVOP_RGB_ONE_MINUS_SRC_ALPHA = 0x03,
+	GPU_TEVOP_RGB_SRC_R               = 0x04,
+	GPU_TEVOP_RGB_ONE_MINUS_SRC_R     = 0x05,
+	GPU_TEVOP_RGB_SRC_G               = 0x08,
+	GPU_TEVOP_RGB_ONE_MINUS_SRC_G     = 0x09,
+	GPU_TEVOP_RGB_SRC_B               = 0x0C,
+	GPU_TEVOP_RGB_ONE_MINUS_SRC_B     = 0x0D,
+} GPU_TEVOP_RGB;
+
+typedef enum {
+	GPU_TEVOP_A_SRC_ALPHA           = 0x00,
+	GPU_TEVOP_A_ONE_MINUS_SRC_ALPHA = 0x01,
+	GPU_TEVOP_A_SRC_R               = 0x02,
+	GPU_TEVOP_A_ONE_MINUS_SRC_R     = 0x03,
+	GPU_TEVOP_A_SRC_G               = 0x04,
+	GPU_TEVOP_A_ONE_MINUS_SRC_G     = 0x05,
+	GPU_TEVOP_A_SRC_B               = 0x06,
+	GPU_TEVOP_A_ONE_MINUS_SRC_B     = 0x07,
+} GPU_TEVOP_A;
+
+typedef enum {
+	GPU_REPLACE      = 0x00,
+	GPU_MODULATE     = 0x01,
+	GPU_ADD          = 0x02,
+	GPU_ADD_SIGNED   = 0x03,
+	GPU_INTERPOLATE  = 0x04,
+	GPU_SUBTRACT     = 0x05,
+	GPU_DOT3_RGB     = 0x06,
+} GPU_COMBINEFUNC;
+
+#define GPU_TEVSOURCES(a,b,c)  (((a))|((b)<<4)|((c)<<8))
+#define GPU_TEVOPERANDS(a,b,c) (((a))|((b)<<4)|((c)<<8))
+
+typedef enum {
+	GPU_TRIANGLES      = 0x0000,
+	GPU_TRIANGLE_STRIP = 0x0100,
+	GPU_TRIANGLE_FAN   = 0x0200,
+	GPU_GEOMETRY_PRIM  = 0x0300,
+} GPU_Primitive_t;
+
+typedef enum {
+	GPU_VERTEX_SHADER   = 0x0,
+	GPU_GEOMETRY_SHADER = 0x1,
+} GPU_SHADER_TYPE;
+
+typedef enum {
+	GPU_BYTE          = 0,
+	GPU_UNSIGNED_BYTE = 1,
+	GPU_SHORT         = 2,
+	GPU_FLOAT         = 3,
+} GPU_FORMATS;
+
+#define GPU_ATTRIBFMT(i, n, f) (((((n)-1)<<2)|((f)&3))<<((i)*4))
+
+#define GPUREG_EARLYDEPTH_TEST1  0x0062
+#define GPUREG_EARLYDEPTH_TEST2  0x0118
+#define GPUREG_ATTRIBBUFFERS_LOC 0x0200
+
+// GPU functions
+
+void GPU_Init(Handle *gsphandle);
+void GPU_Reset(u32 *gxbuf, u32 *gpuBuf, u32 gpuBufSize);
+
+void GPUCMD_SetBuffer(u32 *adr, u32 size, u32 offset);
+void GPUCMD_SetBufferOffset(u32 offset);
+void GPUCMD_GetBuffer(u32 **adr, u32 *size, u32 *offset);
+void GPUCMD_AddSingleParam(u32 header, u32 param);
+void GPUCMD_Run(void);
+void GPUCMD_FlushAndRun(void);
+void GPUCMD_Finalize(void);
+
+#define GPUCMD_AddWrite(reg, val)             GPUCMD_AddSingleParam(0x000F0000|(reg), (val))
+#define GPUCMD_AddMaskedWrite(reg, mask, val) GPUCMD_AddSingleParam(((mask)<<16)|(reg), (val))
+
+void GPU_SetFloatUniform(GPU_SHADER_TYPE type, u32 startreg, u32 *data, u32 numreg);
+void GPU_SetViewport(u32 *depthBuffer, u32 *colorBuffer, u32 x, u32 y, u32 w, u32 h);
+void GPU_SetScissorTest(GPU_SCISSORMODE mode, u32 left, u32 bottom, u32 right, u32 top);
+void GPU_DepthMap(float zScale, float zOffset);
+void GPU_SetAlphaTest(bool enable, GPU_TESTFUNC function, u8 ref);
+void GPU_SetDepthTestAndWriteMask(bool enable, GPU_TESTFUNC function, GPU_WRITEMASK writemask);
+void GPU_SetStencilTest(bool enable, GPU_TESTFUNC function, u8 ref, u8 input_mask, u8 write_mask);
+void GPU_SetStencilOp(GPU_STENCILOP sfail, GPU_STENCILOP dfail, GPU_STENCILOP pass);
+void GPU_SetFaceCulling(GPU_CULLMODE mode);
+void GPU_SetAlphaBlending(GPU_BLENDEQUATION colorEquation, GPU_BLENDEQUATION alphaEquation,
+	GPU_BLENDFACTOR colorSrc, GPU_BLENDFACTOR colorDst,
+	GPU_BLENDFACTOR alphaSrc, GPU_BLENDFACTOR alphaDst);
+void GPU_SetBlendingColor(u8 r, u8 g, u8 b, u8 a);
+void GPU_SetAttributeBuffers(u8 totalAttributes, u32 *baseAddress, u64 attributeFormats,
+	u16 attributeMask, u64 attributePermutation, u8 numBuffers,
+	u32 bufferOffsets[], u64 bufferPermutations[], u8 bufferNumAttributes[]);
+void GPU_SetTextureEnable(GPU_TEXUNIT units);
+void GPU_SetTexture(GPU_TEXUNIT unit, u32 *data, u16 width, u16 height, u32 param, GPU_TEXCOLOR colorType);
+void GPU_SetTextureBorderColor(GPU_TEXUNIT unit, u32 borderColor);
+void GPU_SetTexEnv(u8 id, u16 rgbSources, u16 alphaSources, u16 rgbOperands, u16 alphaOperands,
+	GPU_COMBINEFUNC rgbCombine, GPU_COMBINEFUNC alphaCombine, u32 constantColor);
+void GPU_DrawArray(GPU_Primitive_t primitive, u32 first, u32 count);
+void GPU_DrawElements(GPU_Primitive_t primitive, u32 *indexArray, u32 n);
+void GPU_FinishDrawing(void);
+
+// GX
+
+#define GX_BUFFER_DIM(w, h) (((h)<<16)|((w)&0xFFFF))
+
+typedef enum {
+	GX_TRANSFER_FMT_RGBA8  = 0,
+	GX_TRANSFER_FMT_RGB8   = 1,
+	GX_TRANSFER_FMT_RGB565 = 2,
+	GX_TRANSFER_FMT_RGB5A1 = 3,
+	GX_TRANSFER_FMT_RGBA4  = 4,
+} GX_TRANSFER_FORMAT;
+
+typedef enum {
+	GX_TRANSFER_SCALE_NO = 0,
+	GX_TRANSFER_SCALE_X  = 1,
+	GX_TRANSFER_SCALE_XY = 2,
+} GX_TRANSFER_SCALE;
+
+typedef enum {
+	GX_FILL_TRIGGER     = 0x001,
+	GX_FILL_FINISHED    = 0x002,
+	GX_FILL_16BIT_DEPTH = 0x000,
+	GX_FILL_24BIT_DEPTH = 0x100,
+	GX_FILL_32BIT_DEPTH = 0x200,
+} GX_FILL_CONTROL;
+
+#define GX_TRANSFER_FLIP_VERT(x)  ((x)<<0)
+#define GX_TRANSFER_OUT_TILED(x)  ((x)<<1)
+#define GX_TRANSFER_RAW_COPY(x)   ((x)<<3)
+#define GX_TRANSFER_IN_FORMAT(x)  ((x)<<8)
+#define GX_TRANSFER_OUT_FORMAT(x) ((x)<<12)
+#define GX_TRANSFER_SCALING(x)    ((x)<<24)
+
+Result GX_DisplayTransfer(u32 *inadr, u32 indim, u32 *outadr, u32 outdim, u32 flags);
+Result GX_TextureCopy(u32 *inadr, u32 indim, u32 *outadr, u32 outdim, u32 size, u32 flags);
+Result GX_MemoryFill(u32 *buf0a, u32 buf0v, u32 *buf0e, u16 control0, u32 *buf1a, u32 buf1v, u32 *buf1e, u16 control1);
+
+// Shaders
+
+typedef struct {
+	u32 type;
+} DVLE_s;
+
+typedef struct {
+	u32 numDVLE;
+	DVLE_s *DVLE;
+} DVLB_s;
+
+typedef struct {
+	DVLE_s *dvle;
+} shaderInstance_s;
+
+typedef struct {
+	shaderInstance_s *vertexShader;
+	shaderInstance_s *geometryShader;
+} shaderProgram_s;
+
+DVLB_s *DVLB_ParseFile(u32 *shbinData, u32 shbinSize);
+void DVLB_Free(DVLB_s *dvlb);
+Result shaderProgramInit(shaderProgram_s *sp);
+Result shaderProgramFree(shaderProgram_s *sp);
+Result shaderProgramSetVsh(shaderProgram_s *sp, DVLE_s *dvle);
+Result shaderProgramUse(shaderProgram_s *sp);
+s8 shaderInstanceGetUniformLocation(shaderInstance_s *si, const char *name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
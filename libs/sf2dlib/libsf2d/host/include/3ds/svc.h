@@ -0,0 +1,2 @@
+// Forwards to the single host stand-in header
+#include <3ds.h>
@@ -0,0 +1,53 @@
+/**
+ * @file sf2d_host.h
+ * @brief Host-only extensions of the software sf2d backend
+ */
+#ifndef SF2D_HOST_H
+#define SF2D_HOST_H
+
+#include <3ds.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Work done by the emulated GPU since the last reset
+ */
+typedef struct {
+	u32 draw_calls;         /**< GPU_DrawArray/GPU_DrawElements calls */
+	u32 vertices;           /**< Vertices processed by the vertex shader */
+	u32 triangles;          /**< Triangles sent to the rasterizer */
+	u64 fragments;          /**< Fragments that reached the per-fragment tests */
+	u32 cmd_words;          /**< Approximate GPU command list words emitted */
+	u32 display_transfers;  /**< GX_DisplayTransfer calls */
+	u32 memory_fills;       /**< GX_MemoryFill calls */
+	u32 texture_copies;     /**< GX_TextureCopy calls */
+	u64 flushed_bytes;      /**< Bytes passed to GSPGPU_FlushDataCache */
+} sf2d_host_stats;
+
+/**
+ * @brief Copies the GPU counters into stats
+ * @param stats where to store the counters
+ */
+void sf2d_host_get_stats(sf2d_host_stats *stats);
+
+/**
+ * @brief Resets the GPU counters to zero
+ */
+void sf2d_host_reset_stats(void);
+
+/**
+ * @brief Saves the content of a LCD framebuffer as an upright PNG
+ * @param screen the screen to save
+ * @param side the side of the top screen to save
+ * @param path the file to write
+ * @return 1 on success, 0 on error
+ */
+int sf2d_host_save_screen(gfxScreen_t screen, gfx3dSide_t side, const char *path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,10 @@
+// Host stand-in for the header bin2o generates from data/shader.vsh.
+// The vertex shader itself is emulated by gpu_host.c.
+#ifndef SHADER_VSH_SHBIN_H
+#define SHADER_VSH_SHBIN_H
+
+extern const unsigned char shader_vsh_shbin[];
+extern const unsigned char shader_vsh_shbin_end[];
+extern const unsigned int shader_vsh_shbin_size;
+
+#endif
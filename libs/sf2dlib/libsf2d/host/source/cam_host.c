@@ -0,0 +1,277 @@
+/*
+ * Host stand-in for the camera service. While a camera is active, a sensor
+ * thread makes a frame for each capturing port at the frame rate of the
+ * cameras, copies it to the buffer given to CAMU_SetReceiving, if any (the
+ * frame is lost otherwise, like on the console), and signals the event of
+ * the transfer. The frames are RGB565, read from raw files (see
+ * camHostSetFrameSource) or generated.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "host_private.h"
+
+#define CAM_PORTS 2
+#define MAX_TRANSFER_BYTES 5120
+
+typedef struct {
+	s16 width;
+	s16 height;
+	bool capturing;
+	u8 *dst;        // buffer of the transfer, NULL if nothing is received
+	u32 size;       // size of the transfer, in bytes
+	Handle event;   // signaled at the end of the transfer
+	u32 frame;      // number of the next frame of the sensor
+} host_cam_port;
+
+static pthread_mutex_t cam_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t cam_thread;
+static bool cam_running = false;
+static host_cam_port cam_ports[CAM_PORTS];
+static char *cam_pattern = NULL;
+static u32 cam_active = SELECT_NONE;
+static CAMU_FrameRate cam_rate = FRAME_RATE_15;
+static bool cam_auto_exposure = true;
+static bool cam_auto_white_balance = true;
+
+// Frames per second of each CAMU_FrameRate, the highest of the variable ones
+static const int frame_rates[] = { 15, 15, 15, 10, 8, 5, 20, 20, 30, 30, 15, 20, 30 };
+
+// Reads the next frame file, starting over from the first one after the last one; black if there's none
+static void read_frame(host_cam_port *port, u32 frame)
+{
+	char path[1024];
+	FILE *file;
+
+	snprintf(path, sizeof(path), cam_pattern, frame);
+	file = fopen(path, "rb");
+	if (file == NULL && frame != 0) {
+		port->frame = 1;
+		snprintf(path, sizeof(path), cam_pattern, 0);
+		file = fopen(path, "rb");
+	}
+
+	size_t read = 0;
+	if (file != NULL) {
+		read = fread(port->dst, 1, port->size, file);
+		fclose(file);
+	}
+	memset(port->dst + read, 0, port->size - read);
+}
+
+static void make_frame(host_cam_port *port, int index, u32 frame)
+{
+	u16 *dst = (u16 *)port->dst;
+	int x, y;
+
+	for (y = 0; y < port->height; y++) {
+		for (x = 0; x < port->width; x++) {
+			if ((u32)(y * port->width + x) >= port->size / 2) return;
+			*dst++ = ((x + frame) & 31) << 11 | ((y + 2 * frame) & 63) << 5 | ((frame + index) & 31);
+		}
+	}
+}
+
+static void *cam_sensor(void *arg)
+{
+	struct timespec next;
+	int i;
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	pthread_mutex_lock(&cam_mutex);
+	while (cam_running) {
+		long period = 1000000000L / frame_rates[cam_rate];
+		next.tv_nsec += period;
+		next.tv_sec += next.tv_nsec / 1000000000L;
+		next.tv_nsec %= 1000000000L;
+		pthread_mutex_unlock(&cam_mutex);
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+		pthread_mutex_lock(&cam_mutex);
+
+		for (i = 0; i < CAM_PORTS; i++) {
+			host_cam_port *port = &cam_ports[i];
+			if (!port->capturing || cam_active == SELECT_NONE) continue;
+			u32 frame = port->frame++;
+			if (port->dst == NULL) continue;
+
+			if (cam_pattern != NULL) read_frame(port, frame);
+			else make_frame(port, i + 1, frame);
+			port->dst = NULL;
+			svcSignalEvent(port->event);
+		}
+	}
+	pthread_mutex_unlock(&cam_mutex);
+	return NULL;
+}
+
+void camHostSetFrameSource(const char *pattern)
+{
+	pthread_mutex_lock(&cam_mutex);
+	free(cam_pattern);
+	cam_pattern = pattern ? strdup(pattern) : NULL;
+	pthread_mutex_unlock(&cam_mutex);
+}
+
+Result camInit(void)
+{
+	pthread_mutex_lock(&cam_mutex);
+	if (cam_running) {
+		pthread_mutex_unlock(&cam_mutex);
+		return 0;
+	}
+	memset(cam_ports, 0, sizeof(cam_ports));
+	cam_active = SELECT_NONE;
+	cam_running = true;
+	if (pthread_create(&cam_thread, NULL, cam_sensor, NULL) != 0) {
+		cam_running = false;
+		pthread_mutex_unlock(&cam_mutex);
+		return -1;
+	}
+	pthread_mutex_unlock(&cam_mutex);
+	return 0;
+}
+
+void camExit(void)
+{
+	pthread_mutex_lock(&cam_mutex);
+	if (!cam_running) {
+		pthread_mutex_unlock(&cam_mutex);
+		return;
+	}
+	cam_running = false;
+	pthread_mutex_unlock(&cam_mutex);
+	pthread_join(cam_thread, NULL);
+}
+
+// Capture and transfers
+
+Result CAMU_StartCapture(u32 port)
+{
+	int i;
+	pthread_mutex_lock(&cam_mutex);
+	for (i = 0; i < CAM_PORTS; i++)
+		if (port & BIT(i)) cam_ports[i].capturing = true;
+	pthread_mutex_unlock(&cam_mutex);
+	return 0;
+}
+
+Result CAMU_StopCapture(u32 port)
+{
+	int i;
+	pthread_mutex_lock(&cam_mutex);
+	for (i = 0; i < CAM_PORTS; i++) {
+		if (port & BIT(i)) {
+			cam_ports[i].capturing = false;
+			cam_ports[i].dst = NULL;
+		}
+	}
+	pthread_mutex_unlock(&cam_mutex);
+	return 0;
+}
+
+Result CAMU_ClearBuffer(u32 port)
+{
+	return 0;
+}
+
+Result CAMU_SetReceiving(Handle *event, void *dst, u32 port, u32 imageSize, s16 transferUnit)
+{
+	int i = port == PORT_CAM2 ? 1 : 0;
+	Result ret = svcCreateEvent(event, RESET_ONESHOT);
+	if (ret) return ret;
+
+	pthread_mutex_lock(&cam_mutex);
+	cam_ports[i].dst = dst;
+	cam_ports[i].size = imageSize;
+	cam_ports[i].event = *event;
+	pthread_mutex_unlock(&cam_mutex);
+	return 0;
+}
+
+Result CAMU_IsFinishedReceiving(bool *finishedReceiving, u32 port)
+{
+	pthread_mutex_lock(&cam_mutex);
+	*finishedReceiving = cam_ports[port == PORT_CAM2 ? 1 : 0].dst == NULL;
+	pthread_mutex_unlock(&cam_mutex);
+	return 0;
+}
+
+Result CAMU_SetTransferBytes(u32 port, u32 bytes, s16 width, s16 height)
+{
+	int i;
+	pthread_mutex_lock(&cam_mutex);
+	for (i = 0; i < CAM_PORTS; i++) {
+		if (port & BIT(i)) {
+			cam_ports[i].width = width;
+			cam_ports[i].height = height;
+		}
+	}
+	pthread_mutex_unlock(&cam_mutex);
+	return 0;
+}
+
+Result CAMU_GetMaxBytes(u32 *maxBytes, s16 width, s16 height)
+{
+	// The biggest multiple of 256 bytes up to 5 KiB that divides the image
+	u32 size = width * height * 2, bytes;
+	for (bytes = MAX_TRANSFER_BYTES; bytes > 256 && size % bytes != 0; bytes -= 256);
+	*maxBytes = bytes;
+	return 0;
+}
+
+// Camera settings; only the ones that change the frames are kept
+
+Result CAMU_Activate(u32 select)
+{
+	pthread_mutex_lock(&cam_mutex);
+	cam_active = select;
+	pthread_mutex_unlock(&cam_mutex);
+	return 0;
+}
+
+Result CAMU_SetFrameRate(u32 select, CAMU_FrameRate frameRate)
+{
+	if ((u32)frameRate >= sizeof(frame_rates) / sizeof(frame_rates[0])) return -1;
+	pthread_mutex_lock(&cam_mutex);
+	cam_rate = frameRate;
+	pthread_mutex_unlock(&cam_mutex);
+	return 0;
+}
+
+Result CAMU_SetAutoExposure(u32 select, bool autoExposure)
+{
+	cam_auto_exposure = autoExposure;
+	return 0;
+}
+
+Result CAMU_IsAutoExposure(bool *autoExposure, u32 select)
+{
+	*autoExposure = cam_auto_exposure;
+	return 0;
+}
+
+Result CAMU_SetAutoWhiteBalance(u32 select, bool autoWhiteBalance)
+{
+	cam_auto_white_balance = autoWhiteBalance;
+	return 0;
+}
+
+Result CAMU_IsAutoWhiteBalance(bool *autoWhiteBalance, u32 select)
+{
+	*autoWhiteBalance = cam_auto_white_balance;
+	return 0;
+}
+
+Result CAMU_SetExposure(u32 select, s8 exposure) { return 0; }
+Result CAMU_SetWhiteBalance(u32 select, CAMU_WhiteBalance whiteBalance) { return 0; }
+Result CAMU_SetSharpness(u32 select, s8 sharpness) { return 0; }
+Result CAMU_SetContrast(u32 select, CAMU_Contrast contrast) { return 0; }
+Result CAMU_SetLensCorrection(u32 select, CAMU_LensCorrection lensCorrection) { return 0; }
+Result CAMU_SetAutoExposureWindow(u32 select, s16 x, s16 y, s16 width, s16 height) { return 0; }
+Result CAMU_SetAutoWhiteBalanceWindow(u32 select, s16 x, s16 y, s16 width, s16 height) { return 0; }
+Result CAMU_SetNoiseFilter(u32 select, bool noiseFilter) { return 0; }
+Result CAMU_PlayShutterSound(CAMU_ShutterSoundType sound) { return 0; }
+Result CAMU_SetSize(u32 select, CAMU_Size size, CAMU_Context context) { return 0; }
+Result CAMU_SetEffect(u32 select, CAMU_Effect effect, CAMU_Context context) { return 0; }
+Result CAMU_SetOutputFormat(u32 select, CAMU_OutputFormat format, CAMU_Context context) { return 0; }
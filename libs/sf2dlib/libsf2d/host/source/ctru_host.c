@@ -0,0 +1,761 @@
+/*
+ * Host implementation of the ctrulib services used by sf2dlib & co:
+ * linear/VRAM heaps, time, threads and events, APT hooks, LCD framebuffers,
+ * HID and the GX engine (DisplayTransfer, MemoryFill, TextureCopy).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include "host_private.h"
+
+#include <png.h>
+
+#define LINEAR_HEAP_SIZE (32*1024*1024)
+#define VRAM_SIZE        (6*1024*1024)
+
+// Memory
+
+/*
+ * Every allocation is mapped in the low 4 GiB when the system allows it, so
+ * that "physical" addresses fit in the 32 bits GPU registers like on the
+ * console (osConvertVirtToPhys is the identity).
+ */
+typedef struct {
+	void *base;
+	size_t size;
+	size_t mapped;
+} alloc_header;
+
+static size_t linear_used = 0;
+static size_t vram_used = 0;
+
+static void *host_memalign(size_t *used, size_t total, size_t size, size_t alignment)
+{
+	int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#ifdef MAP_32BIT
+	flags |= MAP_32BIT;
+#endif
+
+	if (alignment < sizeof(alloc_header)) alignment = sizeof(alloc_header);
+	if (size == 0 || *used + size > total) return NULL;
+
+	size_t mapped = size + alignment + sizeof(alloc_header);
+	u8 *base = mmap(NULL, mapped, PROT_READ | PROT_WRITE, flags, -1, 0);
+	if (base == MAP_FAILED) return NULL;
+
+	uintptr_t addr = ((uintptr_t)base + sizeof(alloc_header) + alignment - 1) & ~(uintptr_t)(alignment - 1);
+	alloc_header *header = (alloc_header *)addr - 1;
+	header->base = base;
+	header->size = size;
+	header->mapped = mapped;
+	*used += size;
+
+	return (void *)addr;
+}
+
+static void host_free(size_t *used, void *mem)
+{
+	if (!mem) return;
+	alloc_header *header = (alloc_header *)mem - 1;
+	*used -= header->size;
+	munmap(header->base, header->mapped);
+}
+
+void *linearMemAlign(size_t size, size_t alignment)
+{
+	return host_memalign(&linear_used, LINEAR_HEAP_SIZE, size, alignment);
+}
+
+void *linearAlloc(size_t size)
+{
+	return linearMemAlign(size, 0x80);
+}
+
+void linearFree(void *mem)
+{
+	host_free(&linear_used, mem);
+}
+
+u32 linearSpaceFree(void)
+{
+	return LINEAR_HEAP_SIZE - linear_used;
+}
+
+void *vramMemAlign(size_t size, size_t alignment)
+{
+	return host_memalign(&vram_used, VRAM_SIZE, size, alignment);
+}
+
+void *vramAlloc(size_t size)
+{
+	return vramMemAlign(size, 0x80);
+}
+
+void vramFree(void *mem)
+{
+	host_free(&vram_used, mem);
+}
+
+u32 vramSpaceFree(void)
+{
+	return VRAM_SIZE - vram_used;
+}
+
+uintptr_t osConvertVirtToPhys(const void *addr)
+{
+	return (uintptr_t)addr;
+}
+
+// Time
+
+u64 osGetTime(void)
+{
+	// Milliseconds since 1st Jan 1900, like the 3DS
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (ts.tv_sec + 2208988800ULL) * 1000ULL + ts.tv_nsec / 1000000;
+}
+
+u64 svcGetSystemTick(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64)((ts.tv_sec * 1000000000ULL + ts.tv_nsec) * (SYSCLOCK_ARM11 / 1e9));
+}
+
+void svcSleepThread(s64 ns)
+{
+	struct timespec ts = { ns / 1000000000, ns % 1000000000 };
+	nanosleep(&ts, NULL);
+}
+
+float osGet3DSliderState(void)
+{
+	return 0.0f;
+}
+
+// Threads
+
+struct Thread_tag {
+	pthread_t thread;
+	ThreadFunc entrypoint;
+	void *arg;
+	bool detached;
+};
+
+static void *host_thread_entry(void *arg)
+{
+	Thread thread = arg;
+	thread->entrypoint(thread->arg);
+	if (thread->detached) free(thread);
+	return NULL;
+}
+
+Thread threadCreate(ThreadFunc entrypoint, void *arg, size_t stack_size, int prio, int affinity, bool detached)
+{
+	Thread thread = malloc(sizeof(*thread));
+	if (!thread) return NULL;
+
+	thread->entrypoint = entrypoint;
+	thread->arg = arg;
+	thread->detached = detached;
+	if (pthread_create(&thread->thread, NULL, host_thread_entry, thread) != 0) {
+		free(thread);
+		return NULL;
+	}
+	if (detached) pthread_detach(thread->thread);
+	return thread;
+}
+
+Result threadJoin(Thread thread, u64 timeout_ns)
+{
+	// The timeout is ignored: only used to wait for the end of a thread
+	return pthread_join(thread->thread, NULL) == 0 ? 0 : -1;
+}
+
+void threadFree(Thread thread)
+{
+	if (thread && !thread->detached) free(thread);
+}
+
+Result svcGetThreadPriority(s32 *out, Handle handle)
+{
+	*out = 0x30; // the main thread of an application
+	return 0;
+}
+
+void LightLock_Init(LightLock *lock)
+{
+	pthread_mutex_init(lock, NULL);
+}
+
+void LightLock_Lock(LightLock *lock)
+{
+	pthread_mutex_lock(lock);
+}
+
+void LightLock_Unlock(LightLock *lock)
+{
+	pthread_mutex_unlock(lock);
+}
+
+// Events, handles 0x100 + their index in this table
+
+#define HOST_EVENTS 32
+#define HOST_EVENT_HANDLE 0x100
+#define RESULT_TIMEOUT 0x09401BFE
+
+typedef struct {
+	bool used;
+	bool signaled;
+	ResetType reset_type;
+	pthread_cond_t cond;
+} host_event;
+
+static pthread_mutex_t events_mutex = PTHREAD_MUTEX_INITIALIZER;
+static host_event events[HOST_EVENTS];
+
+static host_event *get_event(Handle handle)
+{
+	if (handle < HOST_EVENT_HANDLE || handle >= HOST_EVENT_HANDLE + HOST_EVENTS) return NULL;
+	host_event *event = &events[handle - HOST_EVENT_HANDLE];
+	return event->used ? event : NULL;
+}
+
+Result svcCreateEvent(Handle *handle, ResetType reset_type)
+{
+	int i;
+	pthread_mutex_lock(&events_mutex);
+	for (i = 0; i < HOST_EVENTS && events[i].used; i++);
+	if (i == HOST_EVENTS) {
+		pthread_mutex_unlock(&events_mutex);
+		return -1;
+	}
+	events[i].used = true;
+	events[i].signaled = false;
+	events[i].reset_type = reset_type;
+	pthread_cond_init(&events[i].cond, NULL);
+	pthread_mutex_unlock(&events_mutex);
+
+	*handle = HOST_EVENT_HANDLE + i;
+	return 0;
+}
+
+Result svcSignalEvent(Handle handle)
+{
+	pthread_mutex_lock(&events_mutex);
+	host_event *event = get_event(handle);
+	if (event) {
+		event->signaled = true;
+		pthread_cond_broadcast(&event->cond);
+		// A pulse only wakes up the threads already waiting
+		if (event->reset_type == RESET_PULSE) event->signaled = false;
+	}
+	pthread_mutex_unlock(&events_mutex);
+	return event ? 0 : -1;
+}
+
+Result svcClearEvent(Handle handle)
+{
+	pthread_mutex_lock(&events_mutex);
+	host_event *event = get_event(handle);
+	if (event) event->signaled = false;
+	pthread_mutex_unlock(&events_mutex);
+	return event ? 0 : -1;
+}
+
+Result svcWaitSynchronization(Handle handle, s64 nanoseconds)
+{
+	Result result = 0;
+	struct timespec deadline;
+
+	if (nanoseconds >= 0) {
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_sec += nanoseconds / 1000000000 + (deadline.tv_nsec + nanoseconds % 1000000000) / 1000000000;
+		deadline.tv_nsec = (deadline.tv_nsec + nanoseconds % 1000000000) % 1000000000;
+	}
+
+	pthread_mutex_lock(&events_mutex);
+	host_event *event = get_event(handle);
+	if (!event) {
+		pthread_mutex_unlock(&events_mutex);
+		return -1;
+	}
+	while (!event->signaled && result == 0) {
+		if (nanoseconds < 0)
+			pthread_cond_wait(&event->cond, &events_mutex);
+		else if (pthread_cond_timedwait(&event->cond, &events_mutex, &deadline) == ETIMEDOUT)
+			result = RESULT_TIMEOUT;
+	}
+	if (result == 0 && event->reset_type == RESET_ONESHOT) event->signaled = false;
+	pthread_mutex_unlock(&events_mutex);
+	return result;
+}
+
+Result svcCloseHandle(Handle handle)
+{
+	pthread_mutex_lock(&events_mutex);
+	host_event *event = get_event(handle);
+	if (event) {
+		pthread_cond_destroy(&event->cond);
+		event->used = false;
+	}
+	pthread_mutex_unlock(&events_mutex);
+	return event ? 0 : -1;
+}
+
+// APT
+
+static aptHookCookie *apt_hooks = NULL;
+
+void aptHook(aptHookCookie *cookie, aptHookFn callback, void *param)
+{
+	cookie->callback = callback;
+	cookie->param = param;
+	cookie->next = apt_hooks;
+	apt_hooks = cookie;
+}
+
+void aptUnhook(aptHookCookie *cookie)
+{
+	aptHookCookie **c;
+	for (c = &apt_hooks; *c; c = &(*c)->next) {
+		if (*c == cookie) {
+			*c = cookie->next;
+			break;
+		}
+	}
+}
+
+bool aptMainLoop(void)
+{
+	return true;
+}
+
+// GSP
+
+void gspWaitForEvent(GSPGPU_Event id, bool nextEvent)
+{
+	// Only the command lists run in the background; the GX engine runs
+	// synchronously, and a headless session has no VBlank to wait for
+	if (id == GSPGPU_EVENT_P3D) host_gpu_wait();
+}
+
+Result GSPGPU_FlushDataCache(const void *adr, u32 size)
+{
+	host_stats.flushed_bytes += size;
+	return 0;
+}
+
+Result GSPGPU_InvalidateDataCache(const void *adr, u32 size)
+{
+	return 0;
+}
+
+// GFX
+
+static u8 fb_top_left[400*240*3];
+static u8 fb_top_right[400*240*3];
+static u8 fb_bottom[320*240*3];
+static bool stereo_enabled = false;
+
+void gfxInitDefault(void)
+{
+	memset(fb_top_left, 0, sizeof(fb_top_left));
+	memset(fb_top_right, 0, sizeof(fb_top_right));
+	memset(fb_bottom, 0, sizeof(fb_bottom));
+}
+
+void gfxExit(void)
+{
+}
+
+void gfxSet3D(bool enable)
+{
+	stereo_enabled = enable;
+}
+
+void gfxSetScreenFormat(gfxScreen_t screen, GSPGPU_FramebufferFormats format)
+{
+}
+
+void gfxSetDoubleBuffering(gfxScreen_t screen, bool doubleBuffering)
+{
+}
+
+u8 *gfxGetFramebuffer(gfxScreen_t screen, gfx3dSide_t side, u16 *width, u16 *height)
+{
+	if (width) *width = 240;
+	if (screen == GFX_TOP) {
+		if (height) *height = 400;
+		return (side == GFX_RIGHT && stereo_enabled) ? fb_top_right : fb_top_left;
+	}
+	if (height) *height = 320;
+	return fb_bottom;
+}
+
+int sf2d_host_save_screen(gfxScreen_t screen, gfx3dSide_t side, const char *path)
+{
+	u16 fb_w, fb_h;
+	const u8 *fb = gfxGetFramebuffer(screen, side, &fb_w, &fb_h);
+	int width = fb_h, height = fb_w;
+	int x, y;
+
+	u8 *rgb = malloc(width * height * 3);
+	if (!rgb) return 0;
+
+	// The LCD framebuffers are BGR8 columns, from the bottom to the top of the screen
+	for (y = 0; y < height; y++) {
+		for (x = 0; x < width; x++) {
+			const u8 *src = fb + (x * fb_w + (fb_w - 1 - y)) * 3;
+			u8 *dst = rgb + (y * width + x) * 3;
+			dst[0] = src[2];
+			dst[1] = src[1];
+			dst[2] = src[0];
+		}
+	}
+
+	png_image image;
+	memset(&image, 0, sizeof(image));
+	image.version = PNG_IMAGE_VERSION;
+	image.width = width;
+	image.height = height;
+	image.format = PNG_FORMAT_RGB;
+
+	int ret = png_image_write_to_file(&image, path, 0, rgb, width * 3, NULL);
+	free(rgb);
+
+	return ret != 0;
+}
+
+void gfxFlushBuffers(void)
+{
+}
+
+void gfxSwapBuffers(void)
+{
+}
+
+void gfxSwapBuffersGpu(void)
+{
+}
+
+// Console
+
+PrintConsole *consoleInit(gfxScreen_t screen, PrintConsole *console)
+{
+	return console;
+}
+
+void consoleDebugInit(debugDevice device)
+{
+}
+
+void consoleClear(void)
+{
+}
+
+// HID
+
+static u32 keys_next = 0;
+static u32 keys_held = 0;
+static u32 keys_old = 0;
+
+void hidHostSetKeys(u32 keys)
+{
+	keys_next = keys;
+}
+
+void hidScanInput(void)
+{
+	keys_old = keys_held;
+	keys_held = keys_next;
+}
+
+u32 hidKeysHeld(void)
+{
+	return keys_held;
+}
+
+u32 hidKeysDown(void)
+{
+	return keys_held & ~keys_old;
+}
+
+u32 hidKeysUp(void)
+{
+	return ~keys_held & keys_old;
+}
+
+void hidTouchRead(touchPosition *pos)
+{
+	pos->px = pos->py = 0;
+}
+
+void hidCircleRead(circlePosition *pos)
+{
+	pos->dx = pos->dy = 0;
+}
+
+void hidAccelRead(accelVector *vector)
+{
+	vector->x = vector->y = vector->z = 0;
+}
+
+void hidGyroRead(angularRate *rate)
+{
+	rate->x = rate->y = rate->z = 0;
+}
+
+void irrstCstickRead(circlePosition *pos)
+{
+	pos->dx = pos->dy = 0;
+}
+
+Result HIDUSER_EnableAccelerometer(void) { return 0; }
+Result HIDUSER_DisableAccelerometer(void) { return 0; }
+Result HIDUSER_EnableGyroscope(void) { return 0; }
+Result HIDUSER_DisableGyroscope(void) { return 0; }
+
+Result HIDUSER_GetSoundVolume(u8 *volume)
+{
+	*volume = 0;
+	return 0;
+}
+
+// Shaders, only sf2d's shader exists and gpu_host.c runs its equivalent
+
+const unsigned char shader_vsh_shbin[] = { 0 };
+const unsigned char shader_vsh_shbin_end[] = { 0 };
+const unsigned int shader_vsh_shbin_size = sizeof(shader_vsh_shbin);
+
+DVLB_s *DVLB_ParseFile(u32 *shbinData, u32 shbinSize)
+{
+	DVLB_s *dvlb = calloc(1, sizeof(*dvlb));
+	dvlb->numDVLE = 1;
+	dvlb->DVLE = calloc(1, sizeof(DVLE_s));
+	return dvlb;
+}
+
+void DVLB_Free(DVLB_s *dvlb)
+{
+	if (!dvlb) return;
+	free(dvlb->DVLE);
+	free(dvlb);
+}
+
+Result shaderProgramInit(shaderProgram_s *sp)
+{
+	sp->vertexShader = NULL;
+	sp->geometryShader = NULL;
+	return 0;
+}
+
+Result shaderProgramFree(shaderProgram_s *sp)
+{
+	free(sp->vertexShader);
+	sp->vertexShader = NULL;
+	return 0;
+}
+
+Result shaderProgramSetVsh(shaderProgram_s *sp, DVLE_s *dvle)
+{
+	if (!sp->vertexShader) sp->vertexShader = malloc(sizeof(shaderInstance_s));
+	sp->vertexShader->dvle = dvle;
+	return 0;
+}
+
+Result shaderProgramUse(shaderProgram_s *sp)
+{
+	host_cmd_words(64); // code and operand descriptor upload
+	return 0;
+}
+
+s8 shaderInstanceGetUniformLocation(shaderInstance_s *si, const char *name)
+{
+	return strcmp(name, "projection") == 0 ? 0 : -1;
+}
+
+// GX
+
+static u32 gx_bytes_per_pixel(u32 format)
+{
+	switch (format) {
+	case GX_TRANSFER_FMT_RGBA8:
+		return 4;
+	case GX_TRANSFER_FMT_RGB8:
+		return 3;
+	default:
+		return 2;
+	}
+}
+
+static void gx_decode(const u8 *p, u32 format, u8 rgba[4])
+{
+	u16 v = p[0] | (p[1] << 8);
+	switch (format) {
+	case GX_TRANSFER_FMT_RGBA8:
+		rgba[0] = p[3]; rgba[1] = p[2]; rgba[2] = p[1]; rgba[3] = p[0];
+		break;
+	case GX_TRANSFER_FMT_RGB8:
+		rgba[0] = p[2]; rgba[1] = p[1]; rgba[2] = p[0]; rgba[3] = 255;
+		break;
+	case GX_TRANSFER_FMT_RGB565:
+		rgba[0] = ((v >> 11) & 0x1F) * 255 / 31;
+		rgba[1] = ((v >>  5) & 0x3F) * 255 / 63;
+		rgba[2] = ((v >>  0) & 0x1F) * 255 / 31;
+		rgba[3] = 255;
+		break;
+	case GX_TRANSFER_FMT_RGB5A1:
+		rgba[0] = ((v >> 11) & 0x1F) * 255 / 31;
+		rgba[1] = ((v >>  6) & 0x1F) * 255 / 31;
+		rgba[2] = ((v >>  1) & 0x1F) * 255 / 31;
+		rgba[3] = (v & 1) * 255;
+		break;
+	default:
+		rgba[0] = ((v >> 12) & 0xF) * 17;
+		rgba[1] = ((v >>  8) & 0xF) * 17;
+		rgba[2] = ((v >>  4) & 0xF) * 17;
+		rgba[3] = ((v >>  0) & 0xF) * 17;
+		break;
+	}
+}
+
+static void gx_encode(u8 *p, u32 format, const u8 rgba[4])
+{
+	u16 v;
+	switch (format) {
+	case GX_TRANSFER_FMT_RGBA8:
+		p[3] = rgba[0]; p[2] = rgba[1]; p[1] = rgba[2]; p[0] = rgba[3];
+		return;
+	case GX_TRANSFER_FMT_RGB8:
+		p[2] = rgba[0]; p[1] = rgba[1]; p[0] = rgba[2];
+		return;
+	case GX_TRANSFER_FMT_RGB565:
+		v = ((rgba[0] >> 3) << 11) | ((rgba[1] >> 2) << 5) | (rgba[2] >> 3);
+		break;
+	case GX_TRANSFER_FMT_RGB5A1:
+		v = ((rgba[0] >> 3) << 11) | ((rgba[1] >> 3) << 6) | ((rgba[2] >> 3) << 1) | (rgba[3] >> 7);
+		break;
+	default:
+		v = ((rgba[0] >> 4) << 12) | ((rgba[1] >> 4) << 8) | ((rgba[2] >> 4) << 4) | (rgba[3] >> 4);
+		break;
+	}
+	p[0] = v & 0xFF;
+	p[1] = v >> 8;
+}
+
+Result GX_DisplayTransfer(u32 *inadr, u32 indim, u32 *outadr, u32 outdim, u32 flags)
+{
+	u32 in_w = indim & 0xFFFF, in_h = indim >> 16;
+	u32 out_w = outdim & 0xFFFF, out_h = outdim >> 16;
+	u32 in_fmt = (flags >> 8) & 7, out_fmt = (flags >> 12) & 7;
+	u32 in_bpp = gx_bytes_per_pixel(in_fmt), out_bpp = gx_bytes_per_pixel(out_fmt);
+	u32 scaling = (flags >> 24) & 3;
+	u32 hs = scaling != GX_TRANSFER_SCALE_NO;
+	u32 vs = scaling == GX_TRANSFER_SCALE_XY;
+	bool flip = flags & GX_TRANSFER_FLIP_VERT(1);
+	bool out_tiled = flags & GX_TRANSFER_OUT_TILED(1);
+	const u8 *in = (const u8 *)inadr;
+	u8 *out = (u8 *)outadr;
+	u32 x, y, sx, sy;
+
+	host_stats.display_transfers++;
+
+	if (flags & GX_TRANSFER_RAW_COPY(1)) {
+		memcpy(out, in, in_w * in_h * in_bpp);
+		return 0;
+	}
+
+	for (y = 0; y < out_h && (y << vs) < in_h; y++) {
+		u32 out_y = flip ? out_h - 1 - y : y;
+		for (x = 0; x < out_w && (x << hs) < in_w; x++) {
+			u32 acc[4] = {0, 0, 0, 0};
+			u8 rgba[4];
+			for (sy = 0; sy <= vs; sy++) {
+				for (sx = 0; sx <= hs; sx++) {
+					u32 in_x = (x << hs) + sx, in_y = (y << vs) + sy;
+					u32 src = out_tiled ? in_x + in_y * in_w : host_tiled_index(in_x, in_y, in_w);
+					gx_decode(in + src * in_bpp, in_fmt, rgba);
+					acc[0] += rgba[0]; acc[1] += rgba[1]; acc[2] += rgba[2]; acc[3] += rgba[3];
+				}
+			}
+			u32 shift = hs + vs;
+			rgba[0] = acc[0] >> shift; rgba[1] = acc[1] >> shift;
+			rgba[2] = acc[2] >> shift; rgba[3] = acc[3] >> shift;
+
+			u32 dst = out_tiled ? host_tiled_index(x, out_y, out_w) : x + out_y * out_w;
+			gx_encode(out + dst * out_bpp, out_fmt, rgba);
+		}
+	}
+
+	return 0;
+}
+
+Result GX_TextureCopy(u32 *inadr, u32 indim, u32 *outadr, u32 outdim, u32 size, u32 flags)
+{
+	// Dimensions are line width and gap, in 16 bytes units
+	u32 in_line = (indim & 0xFFFF) * 16, in_gap = (indim >> 16) * 16;
+	u32 out_line = (outdim & 0xFFFF) * 16, out_gap = (outdim >> 16) * 16;
+	const u8 *in = (const u8 *)inadr;
+	u8 *out = (u8 *)outadr;
+	u32 in_pos = 0, out_pos = 0, copied = 0;
+
+	host_stats.texture_copies++;
+
+	if (in_line == 0) in_line = size;
+	if (out_line == 0) out_line = size;
+
+	while (copied < size) {
+		u32 n = size - copied;
+		if (n > in_line - in_pos % in_line) n = in_line - in_pos % in_line;
+		if (n > out_line - out_pos % out_line) n = out_line - out_pos % out_line;
+
+		memcpy(out + out_pos / out_line * (out_line + out_gap) + out_pos % out_line,
+			in + in_pos / in_line * (in_line + in_gap) + in_pos % in_line, n);
+
+		in_pos += n;
+		out_pos += n;
+		copied += n;
+	}
+
+	return 0;
+}
+
+static void memory_fill(u32 *start, u32 value, u32 *end, u16 control)
+{
+	if (!start || !(control & GX_FILL_TRIGGER)) return;
+
+	u8 *p = (u8 *)start;
+	u8 *e = (u8 *)end;
+	u32 width = (control & GX_FILL_32BIT_DEPTH) ? 4 : (control & GX_FILL_24BIT_DEPTH) ? 3 : 2;
+
+	if (width == 4) {
+		// Copies the filled part over the rest, doubling it each time
+		size_t size = (e - p) & ~3, done = 4;
+		if (size == 0) return;
+		memcpy(p, &value, 4);
+		while (done < size) {
+			size_t n = done < size - done ? done : size - done;
+			memcpy(p + done, p, n);
+			done += n;
+		}
+	} else {
+		for (; p + width <= e; p += width) {
+			p[0] = value & 0xFF;
+			p[1] = (value >> 8) & 0xFF;
+			if (width == 3) p[2] = (value >> 16) & 0xFF;
+		}
+	}
+}
+
+Result GX_MemoryFill(u32 *buf0a, u32 buf0v, u32 *buf0e, u16 control0, u32 *buf1a, u32 buf1v, u32 *buf1e, u16 control1)
+{
+	host_stats.memory_fills++;
+	memory_fill(buf0a, buf0v, buf0e, control0);
+	memory_fill(buf1a, buf1v, buf1e, control1);
+	return 0;
+}
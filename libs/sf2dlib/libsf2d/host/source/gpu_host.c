@@ -0,0 +1,1165 @@
+/*
+ * Software PICA200 for the host build of sf2dlib.
+ *
+ * The GPU_* calls set the registers, and each draw call is recorded with the
+ * registers it uses. GPUCMD_FlushAndRun hands the recorded draws to the GPU
+ * thread, which runs them while the main thread goes on, like the console's
+ * GPU runs a command list; waiting for the P3D event waits for the thread.
+ * The GPU reads the vertices, indices and textures when it runs the draws.
+ * Vertices are fetched and run through the equivalent of data/shader.vsh,
+ * triangles are rasterized with edge functions and every fragment goes
+ * through the texture units, the six TexEnv stages and the per-fragment
+ * operations, following the conventions of the Citra emulator (tiled
+ * bottom-up buffers, Morton swizzled 8x8 tiles).
+ * Only the command list size is emulated, to keep an idea of its cost.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include "host_private.h"
+#include "sf2d_etc1.h"
+
+#define MAX_ATTRIBUTES 12
+
+typedef struct {
+	u16 rgb_sources, alpha_sources;
+	u16 rgb_operands, alpha_operands;
+	u8 rgb_combine, alpha_combine;
+	u32 constant;
+} tev_stage;
+
+typedef struct {
+	const u8 *data;
+	u32 width, height;
+	u32 param;
+	u32 format;
+	u32 border;
+} texture_unit;
+
+typedef struct {
+	float pos[4];      // window x, y, z, and 1/w
+	float color[4];
+	float texcoord[2];
+} shaded_vertex;
+
+// Command list
+static struct {
+	u32 *buf;
+	u32 size;
+	u32 offset;
+	bool overflow;
+} cmd;
+
+typedef struct {
+	// Framebuffer and viewport
+	u8 *color_buf;
+	u8 *depth_buf;
+	u32 fb_width, fb_height;
+	float vp_x, vp_y, vp_half_w, vp_half_h;
+	float depth_scale, depth_offset;
+
+	// Per-fragment operations
+	GPU_SCISSORMODE scissor_mode;
+	s32 scissor_x1, scissor_y1, scissor_x2, scissor_y2;
+	bool alpha_test;
+	GPU_TESTFUNC alpha_func;
+	u8 alpha_ref;
+	bool depth_test;
+	GPU_TESTFUNC depth_func;
+	u32 write_mask;
+	GPU_BLENDEQUATION blend_eq_rgb, blend_eq_alpha;
+	GPU_BLENDFACTOR blend_src_rgb, blend_dst_rgb, blend_src_alpha, blend_dst_alpha;
+	u8 blend_color[4];
+	GPU_CULLMODE cull;
+
+	// Texturing
+	u32 tex_enabled;
+	texture_unit tex[3];
+	tev_stage tev[6];
+
+	// Vertex input
+	const u8 *attr_base;
+	u64 attr_formats;
+	u64 attr_permutation;
+	u32 attr_count;
+	u32 buf_count;
+	u32 buf_offsets[MAX_ATTRIBUTES];
+	u64 buf_permutations[MAX_ATTRIBUTES];
+	u8 buf_attr_count[MAX_ATTRIBUTES];
+
+	// Vertex shader floating point uniforms, as xyzw
+	float uniforms[96][4];
+} gpu_state;
+
+// Registers set by the GPU_* calls, and the ones of the draw the GPU thread runs
+static gpu_state gpu;
+static gpu_state regs;
+
+// Draw calls of a command list, with the registers they use
+typedef struct {
+	u32 state;          // index in the states of the list
+	GPU_Primitive_t primitive;
+	u32 first, count;   // vertices of GPU_DrawArray
+	u32 *index_array;   // indices of GPU_DrawElements, NULL for GPU_DrawArray
+} recorded_draw;
+
+typedef struct command_list {
+	gpu_state *states;
+	u32 num_states, states_capacity;
+	recorded_draw *draws;
+	u32 num_draws, draws_capacity;
+	struct command_list *next;
+} command_list;
+
+static command_list recording;
+
+// Lists submitted to the GPU thread, run in order
+static pthread_mutex_t gpu_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t gpu_submitted_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t gpu_finished_cond = PTHREAD_COND_INITIALIZER;
+static pthread_once_t gpu_thread_once = PTHREAD_ONCE_INIT;
+static command_list *queue_first = NULL, *queue_last = NULL;
+static u32 lists_submitted = 0, lists_finished = 0;
+
+sf2d_host_stats host_stats;
+// Counters of the GPU thread, added to host_stats at the end of each list
+static sf2d_host_stats exec_stats;
+
+void host_cmd_words(u32 n)
+{
+	host_stats.cmd_words += n;
+	cmd.offset += n;
+	if (cmd.buf && cmd.offset > cmd.size && !cmd.overflow) {
+		fprintf(stderr, "sf2d host: GPU command buffer overflow (%u > %u words)\n", cmd.offset, cmd.size);
+		cmd.overflow = true;
+	}
+}
+
+void sf2d_host_get_stats(sf2d_host_stats *stats)
+{
+	pthread_mutex_lock(&gpu_mutex);
+	*stats = host_stats;
+	pthread_mutex_unlock(&gpu_mutex);
+}
+
+void sf2d_host_reset_stats(void)
+{
+	pthread_mutex_lock(&gpu_mutex);
+	memset(&host_stats, 0, sizeof(host_stats));
+	pthread_mutex_unlock(&gpu_mutex);
+}
+
+// Command list
+
+void GPUCMD_SetBuffer(u32 *adr, u32 size, u32 offset)
+{
+	cmd.buf = adr;
+	cmd.size = size;
+	cmd.offset = offset;
+	cmd.overflow = false;
+}
+
+void GPUCMD_SetBufferOffset(u32 offset)
+{
+	cmd.offset = offset;
+	cmd.overflow = false;
+}
+
+void GPUCMD_GetBuffer(u32 **adr, u32 *size, u32 *offset)
+{
+	if (adr) *adr = cmd.buf;
+	if (size) *size = cmd.size;
+	if (offset) *offset = cmd.offset;
+}
+
+void GPUCMD_AddSingleParam(u32 header, u32 param)
+{
+	// Only the registers sf2d writes directly have an effect
+	switch (header & 0xFFFF) {
+	case GPUREG_ATTRIBBUFFERS_LOC:
+		gpu.attr_base = (const u8 *)((uintptr_t)param << 3);
+		break;
+	}
+
+	host_cmd_words(2);
+}
+
+static void run_list(const command_list *list);
+
+static void *gpu_thread(void *arg)
+{
+	pthread_mutex_lock(&gpu_mutex);
+	for (;;) {
+		while (queue_first == NULL) pthread_cond_wait(&gpu_submitted_cond, &gpu_mutex);
+		command_list *list = queue_first;
+		pthread_mutex_unlock(&gpu_mutex);
+
+		run_list(list);
+
+		pthread_mutex_lock(&gpu_mutex);
+		host_stats.vertices += exec_stats.vertices;
+		host_stats.triangles += exec_stats.triangles;
+		host_stats.fragments += exec_stats.fragments;
+		memset(&exec_stats, 0, sizeof(exec_stats));
+		queue_first = list->next;
+		if (queue_first == NULL) queue_last = NULL;
+		lists_finished++;
+		pthread_cond_broadcast(&gpu_finished_cond);
+
+		free(list->states);
+		free(list->draws);
+		free(list);
+	}
+	return NULL;
+}
+
+static void start_gpu_thread(void)
+{
+	pthread_t thread;
+	if (pthread_create(&thread, NULL, gpu_thread, NULL) != 0) {
+		fprintf(stderr, "sf2d host: can't start the GPU thread\n");
+		abort();
+	}
+	pthread_detach(thread);
+}
+
+void GPUCMD_Run(void)
+{
+	command_list *list = malloc(sizeof(*list));
+	if (list == NULL) {
+		fprintf(stderr, "sf2d host: out of memory for a command list\n");
+		abort();
+	}
+	*list = recording;
+	list->next = NULL;
+	memset(&recording, 0, sizeof(recording));
+
+	pthread_once(&gpu_thread_once, start_gpu_thread);
+	pthread_mutex_lock(&gpu_mutex);
+	if (queue_last) queue_last->next = list;
+	else queue_first = list;
+	queue_last = list;
+	lists_submitted++;
+	pthread_cond_signal(&gpu_submitted_cond);
+	pthread_mutex_unlock(&gpu_mutex);
+}
+
+void GPUCMD_FlushAndRun(void)
+{
+	GPUCMD_Run();
+}
+
+void host_gpu_wait(void)
+{
+	pthread_mutex_lock(&gpu_mutex);
+	while (lists_finished != lists_submitted) pthread_cond_wait(&gpu_finished_cond, &gpu_mutex);
+	pthread_mutex_unlock(&gpu_mutex);
+}
+
+void GPUCMD_Finalize(void)
+{
+	host_cmd_words(4);
+}
+
+// State
+
+void GPU_Init(Handle *gsphandle)
+{
+	memset(&gpu, 0, sizeof(gpu));
+}
+
+void GPU_Reset(u32 *gxbuf, u32 *gpuBuf, u32 gpuBufSize)
+{
+	int i;
+
+	GPUCMD_SetBuffer(gpuBuf, gpuBufSize, 0);
+
+	gpu.scissor_mode = GPU_SCISSOR_DISABLE;
+	gpu.alpha_test = false;
+	gpu.depth_test = false;
+	gpu.write_mask = GPU_WRITE_ALL;
+	gpu.blend_eq_rgb = gpu.blend_eq_alpha = GPU_BLEND_ADD;
+	gpu.blend_src_rgb = gpu.blend_src_alpha = GPU_ONE;
+	gpu.blend_dst_rgb = gpu.blend_dst_alpha = GPU_ZERO;
+	gpu.cull = GPU_CULL_NONE;
+	gpu.tex_enabled = 0;
+	gpu.depth_scale = -1.0f;
+	gpu.depth_offset = 0.0f;
+
+	for (i = 0; i < 6; i++) {
+		gpu.tev[i] = (tev_stage){
+			GPU_TEVSOURCES(i ? GPU_PREVIOUS : GPU_PRIMARY_COLOR, 0, 0),
+			GPU_TEVSOURCES(i ? GPU_PREVIOUS : GPU_PRIMARY_COLOR, 0, 0),
+			0, 0, GPU_REPLACE, GPU_REPLACE, 0xFFFFFFFF
+		};
+	}
+
+	host_cmd_words(128);
+}
+
+void GPU_SetFloatUniform(GPU_SHADER_TYPE type, u32 startreg, u32 *data, u32 numreg)
+{
+	u32 i;
+
+	if (type != GPU_VERTEX_SHADER) return;
+
+	// Each register is uploaded as w, z, y, x
+	for (i = 0; i < numreg && startreg + i < 96; i++) {
+		float *reg = gpu.uniforms[startreg + i];
+		memcpy(&reg[3], &data[i*4 + 0], 4);
+		memcpy(&reg[2], &data[i*4 + 1], 4);
+		memcpy(&reg[1], &data[i*4 + 2], 4);
+		memcpy(&reg[0], &data[i*4 + 3], 4);
+	}
+
+	host_cmd_words(2 + numreg*4);
+}
+
+void GPU_SetViewport(u32 *depthBuffer, u32 *colorBuffer, u32 x, u32 y, u32 w, u32 h)
+{
+	gpu.depth_buf = (u8 *)depthBuffer;
+	gpu.color_buf = (u8 *)colorBuffer;
+	gpu.fb_width = w;
+	gpu.fb_height = h;
+	gpu.vp_x = x;
+	gpu.vp_y = y;
+	gpu.vp_half_w = w / 2.0f;
+	gpu.vp_half_h = h / 2.0f;
+
+	host_cmd_words(32);
+}
+
+void GPU_SetScissorTest(GPU_SCISSORMODE mode, u32 left, u32 bottom, u32 right, u32 top)
+{
+	gpu.scissor_mode = mode;
+	gpu.scissor_x1 = left;
+	gpu.scissor_y1 = bottom;
+	gpu.scissor_x2 = right;
+	gpu.scissor_y2 = top;
+
+	host_cmd_words(6);
+}
+
+void GPU_DepthMap(float zScale, float zOffset)
+{
+	gpu.depth_scale = zScale;
+	gpu.depth_offset = zOffset;
+
+	host_cmd_words(4);
+}
+
+void GPU_SetAlphaTest(bool enable, GPU_TESTFUNC function, u8 ref)
+{
+	gpu.alpha_test = enable;
+	gpu.alpha_func = function;
+	gpu.alpha_ref = ref;
+
+	host_cmd_words(2);
+}
+
+void GPU_SetDepthTestAndWriteMask(bool enable, GPU_TESTFUNC function, GPU_WRITEMASK writemask)
+{
+	gpu.depth_test = enable;
+	gpu.depth_func = function;
+	gpu.write_mask = writemask;
+
+	host_cmd_words(4);
+}
+
+void GPU_SetStencilTest(bool enable, GPU_TESTFUNC function, u8 ref, u8 input_mask, u8 write_mask)
+{
+	// The stencil buffer isn't emulated
+	host_cmd_words(2);
+}
+
+void GPU_SetStencilOp(GPU_STENCILOP sfail, GPU_STENCILOP dfail, GPU_STENCILOP pass)
+{
+	host_cmd_words(2);
+}
+
+void GPU_SetFaceCulling(GPU_CULLMODE mode)
+{
+	gpu.cull = mode;
+
+	host_cmd_words(2);
+}
+
+void GPU_SetAlphaBlending(GPU_BLENDEQUATION colorEquation, GPU_BLENDEQUATION alphaEquation,
+	GPU_BLENDFACTOR colorSrc, GPU_BLENDFACTOR colorDst,
+	GPU_BLENDFACTOR alphaSrc, GPU_BLENDFACTOR alphaDst)
+{
+	gpu.blend_eq_rgb = colorEquation;
+	gpu.blend_eq_alpha = alphaEquation;
+	gpu.blend_src_rgb = colorSrc;
+	gpu.blend_dst_rgb = colorDst;
+	gpu.blend_src_alpha = alphaSrc;
+	gpu.blend_dst_alpha = alphaDst;
+
+	host_cmd_words(4);
+}
+
+void GPU_SetBlendingColor(u8 r, u8 g, u8 b, u8 a)
+{
+	gpu.blend_color[0] = r;
+	gpu.blend_color[1] = g;
+	gpu.blend_color[2] = b;
+	gpu.blend_color[3] = a;
+
+	host_cmd_words(2);
+}
+
+void GPU_SetAttributeBuffers(u8 totalAttributes, u32 *baseAddress, u64 attributeFormats,
+	u16 attributeMask, u64 attributePermutation, u8 numBuffers,
+	u32 bufferOffsets[], u64 bufferPermutations[], u8 bufferNumAttributes[])
+{
+	u32 i;
+
+	gpu.attr_base = (const u8 *)baseAddress;
+	gpu.attr_formats = attributeFormats;
+	gpu.attr_permutation = attributePermutation;
+	gpu.attr_count = totalAttributes;
+	gpu.buf_count = numBuffers > MAX_ATTRIBUTES ? MAX_ATTRIBUTES : numBuffers;
+
+	for (i = 0; i < gpu.buf_count; i++) {
+		gpu.buf_offsets[i] = bufferOffsets[i];
+		gpu.buf_permutations[i] = bufferPermutations[i];
+		gpu.buf_attr_count[i] = bufferNumAttributes[i];
+	}
+
+	host_cmd_words(48);
+}
+
+void GPU_SetTextureEnable(GPU_TEXUNIT units)
+{
+	gpu.tex_enabled = units;
+
+	host_cmd_words(6);
+}
+
+void GPU_SetTexture(GPU_TEXUNIT unit, u32 *data, u16 width, u16 height, u32 param, GPU_TEXCOLOR colorType)
+{
+	int i = unit == GPU_TEXUNIT0 ? 0 : unit == GPU_TEXUNIT1 ? 1 : 2;
+
+	gpu.tex[i].data = (const u8 *)data;
+	gpu.tex[i].width = width;
+	gpu.tex[i].height = height;
+	gpu.tex[i].param = param;
+	gpu.tex[i].format = colorType;
+
+	host_cmd_words(12);
+}
+
+void GPU_SetTextureBorderColor(GPU_TEXUNIT unit, u32 borderColor)
+{
+	int i = unit == GPU_TEXUNIT0 ? 0 : unit == GPU_TEXUNIT1 ? 1 : 2;
+
+	gpu.tex[i].border = borderColor;
+
+	host_cmd_words(2);
+}
+
+void GPU_SetTexEnv(u8 id, u16 rgbSources, u16 alphaSources, u16 rgbOperands, u16 alphaOperands,
+	GPU_COMBINEFUNC rgbCombine, GPU_COMBINEFUNC alphaCombine, u32 constantColor)
+{
+	if (id > 5) return;
+
+	gpu.tev[id] = (tev_stage){
+		rgbSources, alphaSources,
+		rgbOperands, alphaOperands,
+		rgbCombine, alphaCombine,
+		constantColor
+	};
+
+	host_cmd_words(6);
+}
+
+void GPU_FinishDrawing(void)
+{
+	host_cmd_words(6);
+}
+
+// Textures
+
+static inline u8 expand4(u32 v) { return v * 17; }
+static inline u8 expand5(u32 v) { return (v << 3) | (v >> 2); }
+static inline u8 expand6(u32 v) { return (v << 2) | (v >> 4); }
+
+static void decode_texel(const texture_unit *tex, u32 s, u32 t, u8 out[4])
+{
+	// Textures are stored bottom-up
+	u32 index = host_tiled_index(s, tex->height - 1 - t, tex->width);
+	const u8 *p;
+	u16 v;
+
+	switch (tex->format) {
+	case GPU_RGBA8:
+		p = tex->data + index*4;
+		out[0] = p[3]; out[1] = p[2]; out[2] = p[1]; out[3] = p[0];
+		break;
+	case GPU_RGB8:
+		p = tex->data + index*3;
+		out[0] = p[2]; out[1] = p[1]; out[2] = p[0]; out[3] = 255;
+		break;
+	case GPU_RGBA5551:
+		p = tex->data + index*2;
+		v = p[0] | (p[1] << 8);
+		out[0] = expand5((v >> 11) & 0x1F); out[1] = expand5((v >> 6) & 0x1F);
+		out[2] = expand5((v >> 1) & 0x1F); out[3] = (v & 1) * 255;
+		break;
+	case GPU_RGB565:
+		p = tex->data + index*2;
+		v = p[0] | (p[1] << 8);
+		out[0] = expand5((v >> 11) & 0x1F); out[1] = expand6((v >> 5) & 0x3F);
+		out[2] = expand5(v & 0x1F); out[3] = 255;
+		break;
+	case GPU_RGBA4:
+		p = tex->data + index*2;
+		v = p[0] | (p[1] << 8);
+		out[0] = expand4((v >> 12) & 0xF); out[1] = expand4((v >> 8) & 0xF);
+		out[2] = expand4((v >> 4) & 0xF); out[3] = expand4(v & 0xF);
+		break;
+	case GPU_LA8:
+		p = tex->data + index*2;
+		out[0] = out[1] = out[2] = p[1]; out[3] = p[0];
+		break;
+	case GPU_HILO8:
+		p = tex->data + index*2;
+		out[0] = p[1]; out[1] = p[0]; out[2] = 0; out[3] = 255;
+		break;
+	case GPU_L8:
+		p = tex->data + index;
+		out[0] = out[1] = out[2] = p[0]; out[3] = 255;
+		break;
+	case GPU_A8:
+		p = tex->data + index;
+		out[0] = out[1] = out[2] = 0; out[3] = p[0];
+		break;
+	case GPU_LA4:
+		p = tex->data + index;
+		out[0] = out[1] = out[2] = expand4(p[0] >> 4); out[3] = expand4(p[0] & 0xF);
+		break;
+	case GPU_L4:
+		p = tex->data + index/2;
+		out[0] = out[1] = out[2] = expand4((index & 1) ? p[0] >> 4 : p[0] & 0xF); out[3] = 255;
+		break;
+	case GPU_A4:
+		p = tex->data + index/2;
+		out[0] = out[1] = out[2] = 0; out[3] = expand4((index & 1) ? p[0] >> 4 : p[0] & 0xF);
+		break;
+	case GPU_ETC1:
+	case GPU_ETC1A4:
+		sf2d_etc1_decode_texel(tex->data, tex->width, tex->height, tex->format == GPU_ETC1A4, s, t, out);
+		break;
+	default:
+		out[0] = 255; out[1] = 0; out[2] = 255; out[3] = 255;
+		break;
+	}
+}
+
+// Returns false if the coordinate falls on the border
+static bool wrap_coord(s32 *c, u32 size, u32 mode)
+{
+	s32 n = size;
+
+	switch (mode) {
+	case GPU_CLAMP_TO_EDGE:
+		if (*c < 0) *c = 0;
+		if (*c >= n) *c = n - 1;
+		return true;
+	case GPU_CLAMP_TO_BORDER:
+		return *c >= 0 && *c < n;
+	case GPU_REPEAT:
+		*c = ((*c % n) + n) % n;
+		return true;
+	default: { // GPU_MIRRORED_REPEAT
+		s32 m = ((*c % (2*n)) + 2*n) % (2*n);
+		*c = m < n ? m : 2*n - 1 - m;
+		return true;
+	}
+	}
+}
+
+static void fetch_texel(const texture_unit *tex, s32 s, s32 t, u8 out[4])
+{
+	bool inside = wrap_coord(&s, tex->width, (tex->param >> 12) & 3);
+	inside = wrap_coord(&t, tex->height, (tex->param >> 8) & 3) && inside;
+
+	if (inside) {
+		decode_texel(tex, s, t, out);
+	} else {
+		out[0] = tex->border & 0xFF;
+		out[1] = (tex->border >> 8) & 0xFF;
+		out[2] = (tex->border >> 16) & 0xFF;
+		out[3] = tex->border >> 24;
+	}
+}
+
+static void sample_texture(const texture_unit *tex, float u, float v, bool minify, u8 out[4])
+{
+	u32 filter = minify ? (tex->param >> 2) & 1 : (tex->param >> 1) & 1;
+
+	if (!tex->data || tex->width == 0 || tex->height == 0) {
+		out[0] = out[1] = out[2] = out[3] = 0;
+		return;
+	}
+
+	if (filter == GPU_NEAREST) {
+		fetch_texel(tex, floorf(u * tex->width), floorf(v * tex->height), out);
+	} else {
+		float fs = u * tex->width - 0.5f;
+		float ft = v * tex->height - 0.5f;
+		s32 s0 = floorf(fs), t0 = floorf(ft);
+		u32 fx = (fs - s0) * 256, fy = (ft - t0) * 256;
+		u8 t00[4], t10[4], t01[4], t11[4];
+		int i;
+
+		fetch_texel(tex, s0,     t0,     t00);
+		fetch_texel(tex, s0 + 1, t0,     t10);
+		fetch_texel(tex, s0,     t0 + 1, t01);
+		fetch_texel(tex, s0 + 1, t0 + 1, t11);
+
+		for (i = 0; i < 4; i++) {
+			u32 top = t00[i] * (256 - fx) + t10[i] * fx;
+			u32 bottom = t01[i] * (256 - fx) + t11[i] * fx;
+			out[i] = (top * (256 - fy) + bottom * fy) >> 16;
+		}
+	}
+}
+
+// TexEnv
+
+static void tev_source(u32 source, int stage, const u8 primary[4], const u8 texel[3][4],
+	const u8 previous[4], u8 out[4])
+{
+	static const u8 zero[4] = {0, 0, 0, 0};
+	const u8 *src;
+	u8 constant[4];
+
+	switch (source) {
+	case GPU_PRIMARY_COLOR: src = primary; break;
+	case GPU_TEXTURE0: src = texel[0]; break;
+	case GPU_TEXTURE1: src = texel[1]; break;
+	case GPU_TEXTURE2: src = texel[2]; break;
+	case GPU_CONSTANT: {
+		u32 c = regs.tev[stage].constant;
+		constant[0] = c & 0xFF; constant[1] = (c >> 8) & 0xFF;
+		constant[2] = (c >> 16) & 0xFF; constant[3] = c >> 24;
+		src = constant;
+		break;
+	}
+	case GPU_PREVIOUS: src = previous; break;
+	default: src = zero; break; // Lighting and the combiner buffer aren't emulated
+	}
+
+	memcpy(out, src, 4);
+}
+
+static void tev_rgb_operand(u32 op, const u8 in[4], u8 out[3])
+{
+	u8 v;
+	switch (op & ~1) {
+	case GPU_TEVOP_RGB_SRC_COLOR:
+		out[0] = in[0]; out[1] = in[1]; out[2] = in[2];
+		break;
+	case GPU_TEVOP_RGB_SRC_ALPHA: v = in[3]; goto replicate;
+	case GPU_TEVOP_RGB_SRC_R:     v = in[0]; goto replicate;
+	case GPU_TEVOP_RGB_SRC_G:     v = in[1]; goto replicate;
+	case GPU_TEVOP_RGB_SRC_B:     v = in[2]; goto replicate;
+	default:
+		out[0] = out[1] = out[2] = 0;
+		break;
+	replicate:
+		out[0] = out[1] = out[2] = v;
+		break;
+	}
+	if (op & 1) {
+		out[0] = 255 - out[0]; out[1] = 255 - out[1]; out[2] = 255 - out[2];
+	}
+}
+
+static u8 tev_alpha_operand(u32 op, const u8 in[4])
+{
+	static const int component[4] = {3, 0, 1, 2};
+	u8 v = in[component[(op >> 1) & 3]];
+	return (op & 1) ? 255 - v : v;
+}
+
+static inline u8 clamp255(s32 v)
+{
+	return v < 0 ? 0 : v > 255 ? 255 : v;
+}
+
+static u8 tev_combine(u32 func, const u8 a[3], const u8 b[3], const u8 c[3], int i)
+{
+	switch (func) {
+	case GPU_REPLACE:     return a[i];
+	case GPU_MODULATE:    return a[i] * b[i] / 255;
+	case GPU_ADD:         return clamp255(a[i] + b[i]);
+	case GPU_ADD_SIGNED:  return clamp255(a[i] + b[i] - 128);
+	case GPU_INTERPOLATE: return (a[i] * c[i] + b[i] * (255 - c[i])) / 255;
+	case GPU_SUBTRACT:    return clamp255(a[i] - b[i]);
+	case GPU_DOT3_RGB:
+	case 7: { // GPU_DOT3_RGBA
+		s32 dot = 0;
+		int j;
+		for (j = 0; j < 3; j++) dot += (a[j]*2 - 255) * (b[j]*2 - 255);
+		return clamp255(dot / 128 / 4);
+	}
+	case 8:  return clamp255((a[i] * b[i] + 255 * c[i]) / 255); // Multiply then add
+	case 9:  return clamp255(a[i] + b[i]) * c[i] / 255;          // Add then multiply
+	default: return a[i];
+	}
+}
+
+static void run_tev(const u8 primary[4], const u8 texel[3][4], u8 out[4])
+{
+	u8 previous[4] = {0, 0, 0, 0};
+	int stage, k;
+
+	for (stage = 0; stage < 6; stage++) {
+		const tev_stage *tev = &regs.tev[stage];
+		u8 rgb_in[3][3], alpha_in[3][3];
+		u8 result[4];
+
+		for (k = 0; k < 3; k++) {
+			u8 src[4];
+			tev_source((tev->rgb_sources >> (4*k)) & 0xF, stage, primary, texel, previous, src);
+			tev_rgb_operand((tev->rgb_operands >> (4*k)) & 0xF, src, rgb_in[k]);
+
+			tev_source((tev->alpha_sources >> (4*k)) & 0xF, stage, primary, texel, previous, src);
+			alpha_in[k][0] = alpha_in[k][1] = alpha_in[k][2] = tev_alpha_operand((tev->alpha_operands >> (4*k)) & 0xF, src);
+		}
+
+		for (k = 0; k < 3; k++) result[k] = tev_combine(tev->rgb_combine, rgb_in[0], rgb_in[1], rgb_in[2], k);
+		result[3] = tev_combine(tev->alpha_combine, alpha_in[0], alpha_in[1], alpha_in[2], 0);
+
+		memcpy(previous, result, 4);
+	}
+
+	memcpy(out, previous, 4);
+}
+
+// Per-fragment operations
+
+static bool test_func(GPU_TESTFUNC func, u32 value, u32 ref)
+{
+	switch (func) {
+	case GPU_NEVER:    return false;
+	case GPU_ALWAYS:   return true;
+	case GPU_EQUAL:    return value == ref;
+	case GPU_NOTEQUAL: return value != ref;
+	case GPU_LESS:     return value < ref;
+	case GPU_LEQUAL:   return value <= ref;
+	case GPU_GREATER:  return value > ref;
+	default:           return value >= ref;
+	}
+}
+
+static u32 blend_factor(GPU_BLENDFACTOR factor, const u8 src[4], const u8 dst[4], int i)
+{
+	switch (factor) {
+	case GPU_ZERO:                     return 0;
+	case GPU_ONE:                      return 255;
+	case GPU_SRC_COLOR:                return src[i];
+	case GPU_ONE_MINUS_SRC_COLOR:      return 255 - src[i];
+	case GPU_DST_COLOR:                return dst[i];
+	case GPU_ONE_MINUS_DST_COLOR:      return 255 - dst[i];
+	case GPU_SRC_ALPHA:                return src[3];
+	case GPU_ONE_MINUS_SRC_ALPHA:      return 255 - src[3];
+	case GPU_DST_ALPHA:                return dst[3];
+	case GPU_ONE_MINUS_DST_ALPHA:      return 255 - dst[3];
+	case GPU_CONSTANT_COLOR:           return regs.blend_color[i];
+	case GPU_ONE_MINUS_CONSTANT_COLOR: return 255 - regs.blend_color[i];
+	case GPU_CONSTANT_ALPHA:           return regs.blend_color[3];
+	case GPU_ONE_MINUS_CONSTANT_ALPHA: return 255 - regs.blend_color[3];
+	default: // GPU_SRC_ALPHA_SATURATE
+		if (i == 3) return 255;
+		return src[3] < 255 - dst[3] ? src[3] : 255 - dst[3];
+	}
+}
+
+static u8 blend_equation(GPU_BLENDEQUATION eq, u32 src, u32 dst, u32 src_factor, u32 dst_factor)
+{
+	s32 s = src * src_factor / 255;
+	s32 d = dst * dst_factor / 255;
+
+	switch (eq) {
+	case GPU_BLEND_ADD:              return clamp255(s + d);
+	case GPU_BLEND_SUBTRACT:         return clamp255(s - d);
+	case GPU_BLEND_REVERSE_SUBTRACT: return clamp255(d - s);
+	case GPU_BLEND_MIN:              return src < dst ? src : dst;
+	default:                         return src > dst ? src : dst;
+	}
+}
+
+static void write_fragment(s32 x, s32 y, float z, const u8 color[4])
+{
+	// Framebuffers are stored bottom-up, like textures
+	u32 index = host_tiled_index(x, regs.fb_height - 1 - y, regs.fb_width);
+
+	if (regs.alpha_test && !test_func(regs.alpha_func, color[3], regs.alpha_ref)) return;
+
+	if (regs.depth_buf && (regs.depth_test || (regs.write_mask & GPU_WRITE_DEPTH))) {
+		u8 *d = regs.depth_buf + index*4;
+		u32 depth = (u32)((z < 0.0f ? 0.0f : z > 1.0f ? 1.0f : z) * 0xFFFFFF);
+		u32 stored = d[0] | (d[1] << 8) | (d[2] << 16);
+
+		if (regs.depth_test && !test_func(regs.depth_func, depth, stored)) return;
+
+		if (regs.write_mask & GPU_WRITE_DEPTH) {
+			d[0] = depth & 0xFF;
+			d[1] = (depth >> 8) & 0xFF;
+			d[2] = (depth >> 16) & 0xFF;
+		}
+	}
+
+	if (!regs.color_buf || !(regs.write_mask & GPU_WRITE_COLOR)) return;
+
+	u8 *p = regs.color_buf + index*4;
+	u8 dst[4] = {p[3], p[2], p[1], p[0]};
+	u8 out[4];
+	int i;
+
+	for (i = 0; i < 3; i++) {
+		out[i] = blend_equation(regs.blend_eq_rgb, color[i], dst[i],
+			blend_factor(regs.blend_src_rgb, color, dst, i),
+			blend_factor(regs.blend_dst_rgb, color, dst, i));
+	}
+	out[3] = blend_equation(regs.blend_eq_alpha, color[3], dst[3],
+		blend_factor(regs.blend_src_alpha, color, dst, 3),
+		blend_factor(regs.blend_dst_alpha, color, dst, 3));
+
+	if (regs.write_mask & GPU_WRITE_RED)   p[3] = out[0];
+	if (regs.write_mask & GPU_WRITE_GREEN) p[2] = out[1];
+	if (regs.write_mask & GPU_WRITE_BLUE)  p[1] = out[2];
+	if (regs.write_mask & GPU_WRITE_ALPHA) p[0] = out[3];
+}
+
+// Vertex processing
+
+static void fetch_attributes(u32 index, float in[16][4])
+{
+	static const u32 type_size[4] = {1, 1, 2, 4};
+	u32 b, k, i;
+
+	for (i = 0; i < 16; i++) {
+		in[i][0] = in[i][1] = in[i][2] = 0.0f;
+		in[i][3] = 1.0f;
+	}
+
+	for (b = 0; b < regs.buf_count; b++) {
+		const u8 *buf = regs.attr_base + regs.buf_offsets[b];
+		u32 stride = 0, offset = 0;
+
+		for (k = 0; k < regs.buf_attr_count[b]; k++) {
+			u32 a = (regs.buf_permutations[b] >> (4*k)) & 0xF;
+			if (a >= 0xC) {
+				stride += (a - 0xB) * 4;
+			} else {
+				u32 fmt = (regs.attr_formats >> (4*a)) & 0xF;
+				stride += (((fmt >> 2) & 3) + 1) * type_size[fmt & 3];
+			}
+		}
+
+		for (k = 0; k < regs.buf_attr_count[b]; k++) {
+			u32 a = (regs.buf_permutations[b] >> (4*k)) & 0xF;
+			if (a >= 0xC) {
+				offset += (a - 0xB) * 4;
+				continue;
+			}
+
+			u32 fmt = (regs.attr_formats >> (4*a)) & 0xF;
+			u32 type = fmt & 3, count = ((fmt >> 2) & 3) + 1, size = type_size[type];
+			offset = (offset + size - 1) & ~(size - 1);
+
+			const u8 *p = buf + index*stride + offset;
+			float *reg = in[(regs.attr_permutation >> (4*a)) & 0xF];
+			for (i = 0; i < count; i++) {
+				switch (type) {
+				case GPU_BYTE:          reg[i] = ((const s8 *)p)[i]; break;
+				case GPU_UNSIGNED_BYTE: reg[i] = p[i]; break;
+				case GPU_SHORT:         reg[i] = ((const s16 *)p)[i]; break;
+				default:                memcpy(&reg[i], p + i*4, 4); break;
+				}
+			}
+			offset += count * size;
+		}
+	}
+}
+
+// Equivalent of data/shader.vsh followed by the viewport transform
+static void shade_vertex(u32 index, shaded_vertex *out)
+{
+	float in[16][4];
+	float pos[4];
+	int i;
+
+	fetch_attributes(index, in);
+
+	// outpos = projection * inpos (the uniforms are read as .wzyx)
+	for (i = 0; i < 4; i++) {
+		const float *row = regs.uniforms[i];
+		pos[i] = row[3]*in[0][0] + row[2]*in[0][1] + row[1]*in[0][2] + row[0]*in[0][3];
+	}
+
+	// outtc0 = inarg, outclr = inarg / 255
+	out->texcoord[0] = in[1][0];
+	out->texcoord[1] = in[1][1];
+	for (i = 0; i < 4; i++) {
+		float c = in[1][i] * 0.00392156862f;
+		out->color[i] = c < 0.0f ? 0.0f : c > 1.0f ? 1.0f : c;
+	}
+
+	float inv_w = pos[3] != 0.0f ? 1.0f / pos[3] : 1.0f;
+	out->pos[0] = (pos[0] * inv_w + 1.0f) * regs.vp_half_w + regs.vp_x;
+	out->pos[1] = (pos[1] * inv_w + 1.0f) * regs.vp_half_h + regs.vp_y;
+	out->pos[2] = regs.depth_offset + pos[2] * inv_w * regs.depth_scale;
+	out->pos[3] = inv_w;
+
+	exec_stats.vertices++;
+}
+
+// Rasterization
+
+// Window coordinates are snapped to 12.4 fixed point like the PICA rasterizer
+// does, so the edge functions are exact and shared edges never leave gaps
+typedef struct {
+	s32 x, y;
+} fixed_point;
+
+static inline fixed_point to_fixed(const float *pos)
+{
+	fixed_point p = { lrintf(pos[0] * 16.0f), lrintf(pos[1] * 16.0f) };
+	return p;
+}
+
+static inline s64 edge(fixed_point a, fixed_point b, s32 px, s32 py)
+{
+	return (s64)(b.x - a.x) * (py - a.y) - (s64)(b.y - a.y) * (px - a.x);
+}
+
+// Top-left fill rule, for counter-clockwise triangles with y going up
+static inline bool is_top_left(fixed_point a, fixed_point b)
+{
+	s32 dx = b.x - a.x, dy = b.y - a.y;
+	return dy < 0 || (dy == 0 && dx < 0);
+}
+
+static void rasterize_triangle(const shaded_vertex *v0, const shaded_vertex *v1, const shaded_vertex *v2)
+{
+	const shaded_vertex *v[3] = {v0, v1, v2};
+	fixed_point f[3] = {to_fixed(v0->pos), to_fixed(v1->pos), to_fixed(v2->pos)};
+	s64 iarea = edge(f[0], f[1], f[2].x, f[2].y);
+	int i;
+
+	exec_stats.triangles++;
+
+	if (iarea == 0 || !regs.color_buf) return;
+	if (regs.cull == GPU_CULL_FRONT_CCW && iarea > 0) return;
+	if (regs.cull == GPU_CULL_BACK_CCW && iarea < 0) return;
+	if (iarea < 0) {
+		fixed_point tmp = f[1];
+		v[1] = v2;
+		v[2] = v1;
+		f[1] = f[2];
+		f[2] = tmp;
+		iarea = -iarea;
+	}
+	float area = iarea / 256.0f;
+
+	// Bounding box, clipped to the framebuffer and the scissor rectangle
+	s32 minx = f[0].x, maxx = f[0].x, miny = f[0].y, maxy = f[0].y;
+	for (i = 1; i < 3; i++) {
+		if (f[i].x < minx) minx = f[i].x;
+		if (f[i].x > maxx) maxx = f[i].x;
+		if (f[i].y < miny) miny = f[i].y;
+		if (f[i].y > maxy) maxy = f[i].y;
+	}
+	minx = minx < 0 ? 0 : minx >> 4;
+	miny = miny < 0 ? 0 : miny >> 4;
+	maxx = maxx >> 4; if (maxx > regs.fb_width - 1) maxx = regs.fb_width - 1;
+	maxy = maxy >> 4; if (maxy > regs.fb_height - 1) maxy = regs.fb_height - 1;
+
+	if (regs.scissor_mode == GPU_SCISSOR_NORMAL) {
+		if (minx < regs.scissor_x1) minx = regs.scissor_x1;
+		if (miny < regs.scissor_y1) miny = regs.scissor_y1;
+		if (maxx > regs.scissor_x2 - 1) maxx = regs.scissor_x2 - 1;
+		if (maxy > regs.scissor_y2 - 1) maxy = regs.scissor_y2 - 1;
+	}
+	if (minx > maxx || miny > maxy) return;
+
+	// Texture footprint, to choose between the minification and magnification filters
+	bool minify = false;
+	if (regs.tex_enabled & GPU_TEXUNIT0) {
+		const float *p0 = v[0]->pos, *p1 = v[1]->pos, *p2 = v[2]->pos;
+		float dudx = ((v[1]->texcoord[0] - v[0]->texcoord[0]) * (p2[1] - p0[1]) - (v[2]->texcoord[0] - v[0]->texcoord[0]) * (p1[1] - p0[1])) / area;
+		float dudy = ((v[2]->texcoord[0] - v[0]->texcoord[0]) * (p1[0] - p0[0]) - (v[1]->texcoord[0] - v[0]->texcoord[0]) * (p2[0] - p0[0])) / area;
+		float dvdx = ((v[1]->texcoord[1] - v[0]->texcoord[1]) * (p2[1] - p0[1]) - (v[2]->texcoord[1] - v[0]->texcoord[1]) * (p1[1] - p0[1])) / area;
+		float dvdy = ((v[2]->texcoord[1] - v[0]->texcoord[1]) * (p1[0] - p0[0]) - (v[1]->texcoord[1] - v[0]->texcoord[1]) * (p2[0] - p0[0])) / area;
+		float w = regs.tex[0].width, h = regs.tex[0].height;
+		float rx = (dudx*w)*(dudx*w) + (dvdx*h)*(dvdx*h);
+		float ry = (dudy*w)*(dudy*w) + (dvdy*h)*(dvdy*h);
+		minify = fmaxf(rx, ry) > 1.0f;
+	}
+
+	bool tl0 = is_top_left(f[1], f[2]);
+	bool tl1 = is_top_left(f[2], f[0]);
+	bool tl2 = is_top_left(f[0], f[1]);
+	float inv_area = 1.0f / iarea;
+	s32 x, y;
+
+	for (y = miny; y <= maxy; y++) {
+		s32 py = y * 16 + 8;
+		for (x = minx; x <= maxx; x++) {
+			s32 px = x * 16 + 8;
+			s64 e0 = edge(f[1], f[2], px, py);
+			s64 e1 = edge(f[2], f[0], px, py);
+			s64 e2 = edge(f[0], f[1], px, py);
+
+			if (e0 < 0 || e1 < 0 || e2 < 0) continue;
+			if ((e0 == 0 && !tl0) || (e1 == 0 && !tl1) || (e2 == 0 && !tl2)) continue;
+
+			if (regs.scissor_mode == GPU_SCISSOR_INVERT &&
+				x >= regs.scissor_x1 && x < regs.scissor_x2 &&
+				y >= regs.scissor_y1 && y < regs.scissor_y2) continue;
+
+			exec_stats.fragments++;
+
+			float b0 = e0 * inv_area, b1 = e1 * inv_area, b2 = e2 * inv_area;
+			float z = b0*v[0]->pos[2] + b1*v[1]->pos[2] + b2*v[2]->pos[2];
+
+			// Perspective correct interpolation of the other attributes
+			float q0 = b0 * v[0]->pos[3], q1 = b1 * v[1]->pos[3], q2 = b2 * v[2]->pos[3];
+			float inv_q = 1.0f / (q0 + q1 + q2);
+			q0 *= inv_q; q1 *= inv_q; q2 *= inv_q;
+
+			u8 primary[4];
+			for (i = 0; i < 4; i++) {
+				primary[i] = (q0*v[0]->color[i] + q1*v[1]->color[i] + q2*v[2]->color[i]) * 255.0f + 0.5f;
+			}
+
+			u8 texel[3][4] = {{0}};
+			if (regs.tex_enabled) {
+				float u = q0*v[0]->texcoord[0] + q1*v[1]->texcoord[0] + q2*v[2]->texcoord[0];
+				float t = q0*v[0]->texcoord[1] + q1*v[1]->texcoord[1] + q2*v[2]->texcoord[1];
+				for (i = 0; i < 3; i++) {
+					if (regs.tex_enabled & (1 << i)) sample_texture(&regs.tex[i], u, t, minify, texel[i]);
+				}
+			}
+
+			u8 color[4];
+			run_tev(primary, (const u8 (*)[4])texel, color);
+			write_fragment(x, y, z, color);
+		}
+	}
+}
+
+static void draw_primitive(GPU_Primitive_t primitive, const shaded_vertex *vertices, u32 count)
+{
+	u32 i;
+
+	switch (primitive) {
+	case GPU_TRIANGLES:
+		for (i = 0; i + 2 < count; i += 3)
+			rasterize_triangle(&vertices[i], &vertices[i+1], &vertices[i+2]);
+		break;
+	case GPU_TRIANGLE_STRIP:
+		for (i = 0; i + 2 < count; i++) {
+			if (i & 1) rasterize_triangle(&vertices[i+1], &vertices[i], &vertices[i+2]);
+			else rasterize_triangle(&vertices[i], &vertices[i+1], &vertices[i+2]);
+		}
+		break;
+	case GPU_TRIANGLE_FAN:
+		for (i = 1; i + 1 < count; i++)
+			rasterize_triangle(&vertices[0], &vertices[i], &vertices[i+1]);
+		break;
+	default:
+		// Geometry shader primitives aren't supported
+		break;
+	}
+}
+
+// Scratch buffer for the shaded vertices of a draw call
+static shaded_vertex *vertex_buffer(u32 count)
+{
+	static shaded_vertex *vertices = NULL;
+	static u32 capacity = 0;
+
+	if (count > capacity) {
+		capacity = count < 256 ? 256 : count;
+		vertices = realloc(vertices, capacity * sizeof(*vertices));
+	}
+
+	return vertices;
+}
+
+// Records a draw call, with the registers if they changed since the previous one
+static void record_draw(GPU_Primitive_t primitive, u32 first, u32 count, u32 *index_array)
+{
+	command_list *list = &recording;
+
+	if (list->num_states == 0 || memcmp(&list->states[list->num_states - 1], &gpu, sizeof(gpu)) != 0) {
+		if (list->num_states == list->states_capacity) {
+			list->states_capacity = list->states_capacity ? list->states_capacity * 2 : 16;
+			list->states = realloc(list->states, list->states_capacity * sizeof(*list->states));
+		}
+		memcpy(&list->states[list->num_states++], &gpu, sizeof(gpu));
+	}
+
+	if (list->num_draws == list->draws_capacity) {
+		list->draws_capacity = list->draws_capacity ? list->draws_capacity * 2 : 64;
+		list->draws = realloc(list->draws, list->draws_capacity * sizeof(*list->draws));
+	}
+	if (list->states == NULL || list->draws == NULL) {
+		fprintf(stderr, "sf2d host: out of memory for a command list\n");
+		abort();
+	}
+	list->draws[list->num_draws++] = (recorded_draw){ list->num_states - 1, primitive, first, count, index_array };
+}
+
+static void run_draw(const recorded_draw *draw)
+{
+	u32 n = draw->count;
+	shaded_vertex *vertices = vertex_buffer(n);
+	u32 i;
+
+	if (draw->index_array) {
+		// The index array is an offset from the attribute buffers base address
+		const u16 *indices = (const u16 *)(regs.attr_base + (uintptr_t)draw->index_array);
+		for (i = 0; i < n; i++) shade_vertex(indices[i], &vertices[i]);
+	} else {
+		for (i = 0; i < n; i++) shade_vertex(draw->first + i, &vertices[i]);
+	}
+	draw_primitive(draw->primitive, vertices, n);
+}
+
+static void run_list(const command_list *list)
+{
+	u32 state = ~0u;
+	u32 i;
+
+	for (i = 0; i < list->num_draws; i++) {
+		const recorded_draw *draw = &list->draws[i];
+		if (draw->state != state) {
+			state = draw->state;
+			regs = list->states[state];
+		}
+		run_draw(draw);
+	}
+}
+
+void GPU_DrawArray(GPU_Primitive_t primitive, u32 first, u32 count)
+{
+	host_stats.draw_calls++;
+	host_cmd_words(14);
+	record_draw(primitive, first, count, NULL);
+}
+
+void GPU_DrawElements(GPU_Primitive_t primitive, u32 *indexArray, u32 n)
+{
+	host_stats.draw_calls++;
+	host_cmd_words(16);
+	record_draw(primitive, 0, n, indexArray);
+}
@@ -0,0 +1,31 @@
+#ifndef HOST_PRIVATE_H
+#define HOST_PRIVATE_H
+
+#include <3ds.h>
+#include "sf2d_host.h"
+
+extern sf2d_host_stats host_stats;
+
+// Adds n words to the approximate command list size
+void host_cmd_words(u32 n);
+
+// Waits until the GPU thread has run every submitted command list
+void host_gpu_wait(void);
+
+// Morton (Z-order) index of a pixel inside its 8x8 tile, Citra's layout
+static inline u32 host_morton_interleave(u32 x, u32 y)
+{
+	u32 i = (x & 7) | ((y & 7) << 8);
+	i = (i ^ (i << 2)) & 0x1313;
+	i = (i ^ (i << 1)) & 0x1515;
+	i = (i | (i >> 7)) & 0x3F;
+	return i;
+}
+
+// Index (in pixels) of (x, y) in a tiled buffer of the given width
+static inline u32 host_tiled_index(u32 x, u32 y, u32 width)
+{
+	return host_morton_interleave(x, y) + (x & ~7) * 8 + (y & ~7) * width;
+}
+
+#endif
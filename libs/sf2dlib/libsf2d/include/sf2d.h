@@ -148,6 +148,18 @@ typedef struct {
 	float projection[4*4];     /**< Orthographic projection matrix for this target */
 } sf2d_rendertarget;
 
+/**
+ * @brief Rendering statistics of a frame
+ */
+
+typedef struct {
+	u32 draw_calls;        /**< Number of draw commands sent to the GPU */
+	u32 quads;             /**< Number of textured quads submitted */
+	u32 commands_emitted;  /**< Number of GPU state changes sent */
+	u32 commands_skipped;  /**< Number of GPU state changes skipped because the state was already set */
+	u32 cpu_wait_us;       /**< Time the CPU spent waiting for the GPU to finish frames, in microseconds */
+} sf2d_stats;
+
 // Basic functions
 
 /**
@@ -158,8 +170,11 @@ int sf2d_init();
 
 /**
  * @brief Initializates the library (with advanced settings)
- * @param gpucmd_size the size of the GPU FIFO
- * @param temppool_size the size of the temporary pool
+ *
+ * The command list and the temporary pool are allocated twice: a frame is
+ * recorded in one of each while the GPU renders the previous frame.
+ * @param gpucmd_size the size of each GPU FIFO
+ * @param temppool_size the size of each temporary pool
  * @return Whether the initialization has been successful or not
  */
 int sf2d_init_advanced(int gpucmd_size, int temppool_size);
@@ -191,14 +206,26 @@ void sf2d_start_frame_target(sf2d_rendertarget *target);
 
 /**
  * @brief Ends a frame, should be called on pair with sf2d_start_frame
+ *
+ * The frame is sent to the GPU without waiting for it to be rendered: the
+ * previous frame is finished (copied to its screen) first, so the next frame
+ * can be recorded while the GPU renders this one.
  */
 void sf2d_end_frame();
 
 /**
- * @brief Swaps the framebuffers, should be called once after all the frames have been finished
+ * @brief Swaps the framebuffers, should be called once after all the frames have been finished.
+ *        If the GPU is still rendering the last frame, the swap happens when it is finished,
+ *        at the next sf2d_end_frame or sf2d_wait_gpu call.
  */
 void sf2d_swapbuffers();
 
+/**
+ * @brief Waits until the GPU has rendered every ended frame and copied them to
+ *        the screens, e.g. before reading a framebuffer or a render target
+ */
+void sf2d_wait_gpu();
+
 /**
  * @brief Enables or disables the VBlank waiting
  * @param enable whether to enable or disable the VBlank waiting
@@ -212,7 +239,37 @@ void sf2d_set_vblank_wait(int enable);
 float sf2d_get_fps();
 
 /**
- * @brief Allocates memory from a temporary pool. The pool will be emptied after a sf2d_swapbuffers call
+ * @brief Returns the number of frames started so far (sf2d_start_frame and
+ *        sf2d_start_frame_target calls)
+ * @return the number of started frames
+ */
+unsigned int sf2d_get_frame_count();
+
+/**
+ * @brief Returns the number of frames the GPU has finished rendering: what
+ *        was drawn in these frames isn't read by the GPU anymore. The last
+ *        ended frame may still be rendering.
+ * @return the number of rendered frames, at most sf2d_get_frame_count()
+ */
+unsigned int sf2d_get_rendered_frame_count();
+
+/**
+ * @brief Frees memory the GPU may still read, without waiting: it's released
+ *        once the frames started so far are rendered
+ * @param data the memory to free, from linearAlloc or vramAlloc
+ * @param place SF2D_PLACE_RAM for linear memory, SF2D_PLACE_VRAM for VRAM
+ */
+void sf2d_free_deferred(void *data, sf2d_place place);
+
+/**
+ * @brief Returns the rendering statistics of the last frame, i.e. of
+ *        everything drawn between the last two sf2d_swapbuffers calls
+ * @param stats pointer to where the statistics will be stored
+ */
+void sf2d_get_stats(sf2d_stats *stats);
+
+/**
+ * @brief Allocates memory from the temporary pool of the current frame. The pool is emptied when it is used again, two frames later
  * @param size the number of bytes to allocate
  */
 void *sf2d_pool_malloc(u32 size);
@@ -240,7 +297,7 @@ void *sf2d_pool_calloc(u32 nmemb, u32 size);
 unsigned int sf2d_pool_space_free();
 
 /**
- * @brief Empties the temporary pool
+ * @brief Empties the temporary pool of the current frame
  */
 void sf2d_pool_reset();
 
@@ -354,15 +411,17 @@ sf2d_texture *sf2d_create_texture(int width, int height, sf2d_texfmt pixel_forma
  * @param width the width of the texture
  * @param height the height of the texture
  * @return a pointer to the newly created rendertarget
- * @note Before drawing the texture, it needs to be tiled
- *       by calling sf2d_texture_tile32.
+ * @note The texture is rendered to in the tiled layout of the GPU, and stays
+ *       tiled: it can be drawn right after sf2d_end_frame, without
+ *       calling sf2d_texture_tile32.
  *       The default texture params are both min and mag filters
  *       GPU_NEAREST, and both S and T wrappings GPU_CLAMP_TO_BORDER.
  */
 sf2d_rendertarget *sf2d_create_rendertarget(int width, int height);
 
 /**
- * @brief Frees a texture
+ * @brief Frees a texture. Its data is released once the GPU is done with the
+ *        frames that may draw it (see sf2d_free_deferred).
  * @param texture pointer to the texture to freeze
  */
 void sf2d_free_texture(sf2d_texture *texture);
@@ -375,12 +434,20 @@ void sf2d_free_target(sf2d_rendertarget *target);
 
 /**
  * @brief Clears a rendertarget to the specified color
+ *
+ * The texture is filled by the GPU memory fill unit, and stays tiled. If the
+ * GPU is still rendering a frame, which may use the target, the fill is done
+ * once it is finished: before the next frame is sent or sf2d_wait_gpu returns.
  * @param target pointer to the rendertarget to clear
+ * @param color the color to clear to, in RGBA8 (see RGBA8)
  */
 void sf2d_clear_target(sf2d_rendertarget *target, u32 color);
 
 /**
  * @brief Fills an already allocated texture from a RGBA8 source
+ *
+ * Textures in other formats are converted, ETC1 and ETC1A4 ones encoded (see
+ * sf2d_etc1.h), and stay in the tiled layout.
  * @param dst pointer to the destination texture to fill
  * @param rgba8 pointer to the RGBA8 data to fill from
  * @param source_w width (in pixels) of the RGAB8 source
@@ -602,6 +669,24 @@ void sf2d_draw_texture_part_scale(const sf2d_texture *texture, float x, float y,
  */
 void sf2d_draw_texture_part_scale_blend(const sf2d_texture *texture, float x, float y, float tex_x, float tex_y, float tex_w, float tex_h, float x_scale, float y_scale, u32 color);
 
+/**
+ * @brief Draws a part of a signed distance field texture, with scaling.
+ *        The alpha of the texture is the distance to the edge of the shape,
+ *        0.5 on the edge; it's thresholded by the TexEnv stages to a sharp edge.
+ * @param texture the distance field texture
+ * @param x the x coordinate to draw the texture to
+ * @param y the y coordinate to draw the texture to
+ * @param tex_x the starting point (x coordinate) where to start drawing
+ * @param tex_y the starting point (y coordinate) where to start drawing
+ * @param tex_w the width to draw from the starting point
+ * @param tex_h the height to draw from the starting point
+ * @param x_scale the x scale
+ * @param y_scale the y scale
+ * @param color the color of the shape
+ * @param spread the distance from the edge where the field reaches 0, in screen pixels
+ */
+void sf2d_draw_texture_part_scale_sdf(const sf2d_texture *texture, float x, float y, float tex_x, float tex_y, float tex_w, float tex_h, float x_scale, float y_scale, u32 color, float spread);
+
 /**
  * @brief Draws a part of a texture, with rotation and scaling
  * @param texture the texture to draw
@@ -698,12 +783,41 @@ void sf2d_draw_texture_depth_blend(const sf2d_texture *texture, int x, int y, si
 void sf2d_draw_quad_uv(const sf2d_texture *texture, float left, float top, float right, float bottom,
 	float u0, float v0, float u1, float v1, unsigned int params);
 
+/**
+ * @brief Draws textured quads from a vertex buffer kept in linear memory
+ *        by the caller, in a single draw call
+ * @param texture the texture to draw
+ * @param vertices the 4 vertices of each quad (top-left, top-right, bottom-left, bottom-right)
+ * @param indices the 6 indices of each quad (two triangles); they must be
+ *        stored after the vertices in memory
+ * @param quads the number of quads to draw
+ * @param x the X offset added to the vertices positions
+ * @param y the Y offset added to the vertices positions
+ * @param color the color to blend the texture with (0xFFFFFFFF for none)
+ */
+void sf2d_draw_quads(const sf2d_texture *texture, const sf2d_vertex_pos_tex *vertices, const u16 *indices, int quads, float x, float y, u32 color);
+
+/**
+ * @brief Draws quads of a signed distance field texture from a vertex buffer,
+ *        like sf2d_draw_quads (see sf2d_draw_texture_part_scale_sdf)
+ * @param texture the distance field texture
+ * @param vertices the 4 vertices of each quad
+ * @param indices the 6 indices of each quad, stored after the vertices
+ * @param quads the number of quads to draw
+ * @param x the X offset added to the vertices positions
+ * @param y the Y offset added to the vertices positions
+ * @param color the color of the shapes
+ * @param spread the distance from the edge where the field reaches 0, in screen pixels
+ */
+void sf2d_draw_quads_sdf(const sf2d_texture *texture, const sf2d_vertex_pos_tex *vertices, const u16 *indices, int quads, float x, float y, u32 color, float spread);
+
 /**
  * @brief Changes a pixel of the texture
  * @param texture the texture to change the pixel
  * @param x the x coordinate to change the pixel
  * @param y the y coordinate to change the pixel
- * @param new_color the new color to set to the pixel at (x, y)
+ * @param new_color the new color to set to the pixel at (x, y), converted to
+ *        the format of the texture; ETC1 and ETC1A4 textures aren't changed
  */
 void sf2d_set_pixel(sf2d_texture *texture, int x, int y, u32 new_color);
 
@@ -712,7 +826,7 @@ void sf2d_set_pixel(sf2d_texture *texture, int x, int y, u32 new_color);
  * @param texture the texture to get the pixel
  * @param x the x coordinate to get the pixel
  * @param y the y coordinate to get the pixel
- * @return the pixel at (x, y)
+ * @return the pixel at (x, y), as a RGBA8 color for every format
  */
 u32 sf2d_get_pixel(sf2d_texture *texture, int x, int y);
 
@@ -0,0 +1,95 @@
+/**
+ * @file sf2d_convert.h
+ * @brief Conversions between the pixel formats of images, camera frames and textures
+ *
+ * The byte formats are named after the order of their bytes in memory: RGBA8
+ * images are R, G, B, A bytes, while the texels of RGBA8 textures are ABGR8.
+ * The 16-bit formats are little-endian words with the first channel in the
+ * top bits, like the texels of the GPU.
+ *
+ * Converting to a format with fewer bits rounds each channel; I8, AI8 and IA4
+ * get the luminance of the color. The pairs of formats used by the project
+ * have kernels of their own, which work on whole words and give the same
+ * results as going through RGBA8.
+ */
+
+#ifndef SF2D_CONVERT_H
+#define SF2D_CONVERT_H
+
+#include "sf2d.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Pixel formats of the conversions
+ */
+typedef enum {
+	SF2D_PIXEL_NONE,     ///< no format: the ETC1 and 4-bit texture formats
+	SF2D_PIXEL_RGBA8,    ///< R, G, B, A bytes: images of the loaders and of texture:save
+	SF2D_PIXEL_ABGR8,    ///< A, B, G, R bytes: RGBA8 texels
+	SF2D_PIXEL_RGB8,     ///< R, G, B bytes: JPEG rows
+	SF2D_PIXEL_BGR8,     ///< B, G, R bytes: RGB8 texels, framebuffers, 24-bit BMP rows
+	SF2D_PIXEL_RGB565,   ///< 5-6-5 bits: RGB565 texels, camera frames
+	SF2D_PIXEL_RGB5A1,   ///< 5-5-5-1 bits: RGB5A1 texels
+	SF2D_PIXEL_RGBA4,    ///< 4-4-4-4 bits: RGBA4 texels
+	SF2D_PIXEL_AI8,      ///< alpha byte, then intensity byte: IA8 texels
+	SF2D_PIXEL_I8,       ///< intensity byte, opaque: I8 texels
+	SF2D_PIXEL_A8,       ///< alpha byte, black: A8 texels
+	SF2D_PIXEL_IA4,      ///< intensity in the top 4 bits, alpha in the low ones: IA4 texels
+	SF2D_PIXEL_COVERAGE, ///< alpha byte, white: glyph bitmaps
+	SF2D_PIXEL_MONO,     ///< 1 bit, 8 pixels per byte from the top bit, white or transparent: glyph bitmaps (source only)
+	SF2D_PIXEL_YUV422,   ///< Y0, U, Y1, V bytes for two pixels, full range BT.601: camera frames (source only)
+} sf2d_pixel_format;
+
+/**
+ * @brief Returns the size of a pixel in bits
+ * @param format the pixel format
+ * @return 1 to 32, or 0 for SF2D_PIXEL_NONE
+ */
+int sf2d_pixel_bits(sf2d_pixel_format format);
+
+/**
+ * @brief Returns the pixel format of the texels of a texture format
+ * @param format the texture format
+ * @return the pixel format, or SF2D_PIXEL_NONE if the texels can't be converted
+ *         (4-bit and ETC1 formats)
+ */
+sf2d_pixel_format sf2d_convert_texel_format(sf2d_texfmt format);
+
+/**
+ * @brief Converts a row of pixels
+ *
+ * The rows can't overlap, unless they are the same row of two formats with
+ * the same size. The SF2D_PIXEL_MONO and SF2D_PIXEL_YUV422 formats can only be
+ * converted from. Rows of SF2D_PIXEL_YUV422 pixels are whole pairs: for an odd
+ * n, the second pixel of the last pair is skipped.
+ * @param dst the converted row
+ * @param dst_format the pixel format of the converted row
+ * @param src the row to convert
+ * @param src_format the pixel format of the row to convert
+ * @param n the number of pixels
+ * @return 1 on success, 0 if the formats can't be converted
+ */
+int sf2d_convert_row(void *dst, sf2d_pixel_format dst_format, const void *src, sf2d_pixel_format src_format, int n);
+
+/**
+ * @brief Converts a rectangle of pixels, row by row
+ * @param dst the converted image
+ * @param dst_pitch the distance between the rows of the converted image, in bytes
+ * @param dst_format the pixel format of the converted image
+ * @param src the image to convert
+ * @param src_pitch the distance between the rows of the image to convert, in bytes
+ * @param src_format the pixel format of the image to convert
+ * @param w the width of the rectangle
+ * @param h the height of the rectangle
+ * @return 1 on success, 0 if the formats can't be converted
+ */
+int sf2d_convert_rect(void *dst, int dst_pitch, sf2d_pixel_format dst_format, const void *src, int src_pitch, sf2d_pixel_format src_format, int w, int h);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
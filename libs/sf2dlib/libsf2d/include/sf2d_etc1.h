@@ -0,0 +1,48 @@
+/**
+ * @file sf2d_etc1.h
+ * @brief ETC1 and ETC1A4 texture encoding
+ *
+ * ETC1 textures store each 4x4 block of texels in 64 bits (4 bits per texel),
+ * ETC1A4 textures add 64 bits of 4-bit alpha before each block (8 bits per
+ * texel). The blocks are stored by 8x8 tiles of 4 blocks, with the rows of
+ * tiles from the bottom of the image to the top, like the other formats.
+ */
+
+#ifndef SF2D_ETC1_H
+#define SF2D_ETC1_H
+
+#include "sf2d.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Encodes an RGBA8 image in an ETC1 or ETC1A4 texture
+ *
+ * Each block is encoded in every mode the format allows, keeping the one
+ * closest to the image: this is slow, textures are better converted once and
+ * saved. The texture is marked as tiled; the caller flushes the data cache.
+ * @param texture the texture, in TEXFMT_ETC1 or TEXFMT_ETC1A4
+ * @param rgba the image, texture->width x texture->height texels in RGBA bytes
+ * @param pitch the distance between the rows of the image, in bytes
+ */
+void sf2d_etc1_encode_texture(sf2d_texture *texture, const void *rgba, int pitch);
+
+/**
+ * @brief Decodes a texel of ETC1 or ETC1A4 data
+ * @param data the texture data
+ * @param pow2_w the width of the texture
+ * @param pow2_h the height of the texture
+ * @param alpha 1 for ETC1A4 data, 0 for ETC1
+ * @param x the x coordinate of the texel
+ * @param y the y coordinate of the texel, from the top
+ * @param rgba the color of the texel, in RGBA bytes
+ */
+void sf2d_etc1_decode_texel(const void *data, int pow2_w, int pow2_h, int alpha, int x, int y, u8 rgba[4]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
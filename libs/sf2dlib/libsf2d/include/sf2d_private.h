@@ -9,6 +9,51 @@ void GPU_SetDummyTexEnv(u8 num);
 
 void sf2d_draw_rectangle_internal(const sf2d_vertex_pos_col *vertices);
 
+// Statistics of the frame being drawn
+
+extern sf2d_stats sf2d_frame_stats;
+
+// Fills render target memory once the submitted frame, which may use it, is rendered; right away if there is none
+
+void sf2d_fill_deferred(u32 *start, u32 *end, u32 value);
+
+// GPU state cache, the commands are only sent if they change something
+
+typedef enum {
+	SF2D_VERTEX_POS_COL,  // sf2d_vertex_pos_col
+	SF2D_VERTEX_POS_TEX   // sf2d_vertex_pos_tex
+} sf2d_vertex_format;
+
+void sf2d_state_invalidate();
+void sf2d_state_start_frame();
+void sf2d_set_texenv(u8 id, u16 rgbSources, u16 alphaSources, u16 rgbOperands, u16 alphaOperands, GPU_COMBINEFUNC rgbCombine, GPU_COMBINEFUNC alphaCombine, u32 constantColor);
+void sf2d_set_texture_enable(GPU_TEXUNIT units);
+void sf2d_set_texture(GPU_TEXUNIT unit, u32 *data, u16 width, u16 height, u32 param, GPU_TEXCOLOR colorType);
+void sf2d_set_attribute_buffers(sf2d_vertex_format format, const void *vertices);
+void sf2d_set_projection(const float *m, u32 startreg);
+
+// Offsets everything drawn afterwards in the current frame
+void sf2d_set_translation(float x, float y);
+
+// Textured quads batching
+
+typedef enum {
+	SF2D_BATCH_REPLACE,  // texture color
+	SF2D_BATCH_MODULATE, // texture color * constant color
+	SF2D_BATCH_SDF       // constant color, thresholded distance field alpha; plus the sharpness shift
+} sf2d_batch_env;
+
+// Distance fields are sharpened by up to 2^SF2D_SDF_MAX_SHIFT, one TexEnv stage per doubling
+#define SF2D_SDF_MAX_SHIFT 4
+
+int sf2d_sdf_shift(float spread);
+void sf2d_bind_texture_sdf(const sf2d_texture *texture, GPU_TEXUNIT unit, u32 color, int shift);
+void sf2d_unbind_texture_sdf();
+
+sf2d_vertex_pos_tex *sf2d_batch_add_quad(const sf2d_texture *texture, u32 params, sf2d_batch_env env, u32 color);
+void sf2d_batch_flush();
+void sf2d_batch_reset();
+
 // Vector operations
 
 void vector_mult_matrix4x4(const float *msrc, const sf2d_vector_3f *vsrc, sf2d_vector_3f *vdst);
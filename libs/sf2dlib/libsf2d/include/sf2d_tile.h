@@ -0,0 +1,170 @@
+/**
+ * @file sf2d_tile.h
+ * @brief Conversions between linear images and the tiled layout of the GPU textures
+ *
+ * Textures are stored in 8x8 tiles, each in Morton order, with the rows of
+ * tiles from the bottom of the image to the top. Linear images have their
+ * rows from the top to the bottom.
+ */
+
+#ifndef SF2D_TILE_H
+#define SF2D_TILE_H
+
+#include "sf2d.h"
+#include "sf2d_convert.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Reverse the bytes of 32-bit texels: RGBA bytes in images, ABGR in RGBA8 textures
+ */
+#define SF2D_TILE_SWAP_RGBA8 BIT(0)
+
+/**
+ * @brief The linear images are in RGBA bytes, converted from or to the pixel
+ *        format of the tiled buffer (the same as SF2D_TILE_SWAP_RGBA8 for RGBA8)
+ *
+ * The same as SF2D_PIXEL_RGBA8 for the *_convert_* functions, see sf2d_convert.h.
+ */
+#define SF2D_TILE_CONVERT_RGBA8 BIT(1)
+
+/**
+ * @brief Returns the size of a texel in bytes
+ * @param format the pixel format
+ * @return 1 to 4, or 0 if the format can't be tiled by these functions (4-bit and ETC1 formats)
+ */
+int sf2d_tile_bytes_per_texel(sf2d_texfmt format);
+
+/**
+ * @brief Returns the index of a texel in a tiled buffer
+ * @param x the x coordinate of the texel
+ * @param y the y coordinate of the texel, from the top
+ * @param pow2_w the width of the buffer
+ * @param pow2_h the height of the buffer
+ * @return the index of the texel, in texels
+ */
+u32 sf2d_tile_texel_index(int x, int y, int pow2_w, int pow2_h);
+
+/**
+ * @brief Writes a linear image in a rectangle of a tiled buffer
+ * @param tiled the tiled buffer
+ * @param pow2_w the width of the tiled buffer
+ * @param pow2_h the height of the tiled buffer
+ * @param format the pixel format of both buffers
+ * @param x the x coordinate of the rectangle
+ * @param y the y coordinate of the rectangle, from the top
+ * @param w the width of the rectangle
+ * @param h the height of the rectangle
+ * @param src the linear image
+ * @param src_pitch the distance between the rows of the linear image, in bytes
+ * @param flags SF2D_TILE_SWAP_RGBA8, SF2D_TILE_CONVERT_RGBA8 or 0
+ */
+void sf2d_tile_rect(void *tiled, int pow2_w, int pow2_h, sf2d_texfmt format, int x, int y, int w, int h, const void *src, int src_pitch, u32 flags);
+
+/**
+ * @brief Reads a rectangle of a tiled buffer in a linear image
+ * @param tiled the tiled buffer
+ * @param pow2_w the width of the tiled buffer
+ * @param pow2_h the height of the tiled buffer
+ * @param format the pixel format of both buffers
+ * @param x the x coordinate of the rectangle
+ * @param y the y coordinate of the rectangle, from the top
+ * @param w the width of the rectangle
+ * @param h the height of the rectangle
+ * @param dst the linear image
+ * @param dst_pitch the distance between the rows of the linear image, in bytes
+ * @param flags SF2D_TILE_SWAP_RGBA8, SF2D_TILE_CONVERT_RGBA8 or 0
+ */
+void sf2d_untile_rect(const void *tiled, int pow2_w, int pow2_h, sf2d_texfmt format, int x, int y, int w, int h, void *dst, int dst_pitch, u32 flags);
+
+/**
+ * @brief Writes a linear image of any pixel format in a rectangle of a tiled buffer
+ *
+ * The image is converted to the texels of the buffer on the way (see
+ * sf2d_convert.h), a few texels at a time: there's no converted copy of it.
+ * @param tiled the tiled buffer
+ * @param pow2_w the width of the tiled buffer
+ * @param pow2_h the height of the tiled buffer
+ * @param format the texture format of the tiled buffer
+ * @param x the x coordinate of the rectangle
+ * @param y the y coordinate of the rectangle, from the top
+ * @param w the width of the rectangle
+ * @param h the height of the rectangle
+ * @param src the linear image
+ * @param src_pitch the distance between the rows of the linear image, in bytes
+ * @param src_format the pixel format of the linear image
+ */
+void sf2d_tile_convert_rect(void *tiled, int pow2_w, int pow2_h, sf2d_texfmt format, int x, int y, int w, int h, const void *src, int src_pitch, sf2d_pixel_format src_format);
+
+/**
+ * @brief Reads a rectangle of a tiled buffer in a linear image of any pixel format
+ * @param tiled the tiled buffer
+ * @param pow2_w the width of the tiled buffer
+ * @param pow2_h the height of the tiled buffer
+ * @param format the texture format of the tiled buffer
+ * @param x the x coordinate of the rectangle
+ * @param y the y coordinate of the rectangle, from the top
+ * @param w the width of the rectangle
+ * @param h the height of the rectangle
+ * @param dst the linear image
+ * @param dst_pitch the distance between the rows of the linear image, in bytes
+ * @param dst_format the pixel format of the linear image
+ */
+void sf2d_untile_convert_rect(const void *tiled, int pow2_w, int pow2_h, sf2d_texfmt format, int x, int y, int w, int h, void *dst, int dst_pitch, sf2d_pixel_format dst_format);
+
+/**
+ * @brief Writes rows of a linear image in a texture, in the tiled layout
+ *
+ * Lets image decoders deliver their rows, or strips of rows, straight to the
+ * texture instead of decoding the whole image first. The texture is marked as
+ * tiled; the caller flushes the data cache once all the rows are written.
+ * @param texture the texture
+ * @param y the first row to write, from the top
+ * @param h the number of rows
+ * @param rows the rows, texture->width texels each
+ * @param pitch the distance between the rows, in bytes
+ * @param flags SF2D_TILE_SWAP_RGBA8, SF2D_TILE_CONVERT_RGBA8 or 0
+ */
+void sf2d_tile_texture_rows(sf2d_texture *texture, int y, int h, const void *rows, int pitch, u32 flags);
+
+/**
+ * @brief Writes rows of a linear image of any pixel format in a texture, like sf2d_tile_texture_rows
+ * @param texture the texture
+ * @param y the first row to write, from the top
+ * @param h the number of rows
+ * @param rows the rows, texture->width pixels each
+ * @param pitch the distance between the rows, in bytes
+ * @param format the pixel format of the rows
+ */
+void sf2d_tile_texture_rows_convert(sf2d_texture *texture, int y, int h, const void *rows, int pitch, sf2d_pixel_format format);
+
+/**
+ * @brief Converts a linear image to the tiled layout, in place
+ * @param data the image, pow2_w*pow2_h texels; pow2_h must be a multiple of 8
+ * @param pow2_w the width of the image
+ * @param pow2_h the height of the image
+ * @param format the pixel format
+ * @param flags SF2D_TILE_SWAP_RGBA8 or 0
+ * @return 1 on success, 0 if the format isn't supported or there isn't enough
+ *         memory for the two rows of tiles it works with
+ */
+int sf2d_tile_inplace(void *data, int pow2_w, int pow2_h, sf2d_texfmt format, u32 flags);
+
+/**
+ * @brief Converts a tiled buffer back to a linear image, in place
+ * @param data the tiled buffer, pow2_w*pow2_h texels; pow2_h must be a multiple of 8
+ * @param pow2_w the width of the buffer
+ * @param pow2_h the height of the buffer
+ * @param format the pixel format
+ * @param flags SF2D_TILE_SWAP_RGBA8 or 0
+ * @return 1 on success, 0 if the format isn't supported or there isn't enough memory
+ */
+int sf2d_untile_inplace(void *data, int pow2_w, int pow2_h, sf2d_texfmt format, u32 flags);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
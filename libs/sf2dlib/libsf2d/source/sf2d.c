@@ -1,3 +1,4 @@
+#include <stdlib.h>
 #include <string.h>
 #include "sf2d.h"
 #include "sf2d_private.h"
@@ -6,13 +7,46 @@
 
 static int sf2d_initialized = 0;
 static u32 clear_color = 0;
-static u32 *gpu_cmd = NULL;
+//GPU command lists and temporary memory pools, double-buffered: a frame is
+//recorded in one set while the GPU renders the frame of the other one
+static u32 *gpu_cmd[2] = {NULL, NULL};
+static void *pool_addr[2] = {NULL, NULL};
+static int cur_set = 0;
 //GPU init variables
 static int gpu_cmd_size = 0;
 // Temporary memory pool
-static void *pool_addr = NULL;
 static u32 pool_index = 0;
 static u32 pool_size = 0;
+//Last ended frame, until the GPU has rendered it
+static struct {
+	int active;
+	unsigned int frame;
+	void *target_data;  // NULL for a screen
+	int target_size;
+	gfxScreen_t screen;
+	gfx3dSide_t side;
+} submitted;
+static unsigned int rendered_frames = 0;
+static int swap_pending = 0;
+static u64 wait_ticks = 0;
+//Memory freed while the GPU may still read it, released once the frame it was freed in is rendered
+typedef struct {
+	void *data;
+	sf2d_place place;
+	unsigned int frame;
+} deferred_free;
+static deferred_free *deferred_frees = NULL;
+static int deferred_frees_count = 0;
+static int deferred_frees_size = 0;
+//Memory fills of render targets the submitted frame may use, done once it is rendered
+typedef struct {
+	u32 *start;
+	u32 *end;
+	u32 value;
+} deferred_fill;
+static deferred_fill *deferred_fills = NULL;
+static int deferred_fills_count = 0;
+static int deferred_fills_size = 0;
 //GPU framebuffer address
 static u32 *gpu_fb_addr = NULL;
 //GPU depth buffer address
@@ -22,6 +56,7 @@ static int vblank_wait = 1;
 //FPS calculation
 static float current_fps = 0.0f;
 static unsigned int frames = 0;
+static unsigned int started_frames = 0;
 static u64 last_time = 0;
 //Current screen/side
 static gfxScreen_t cur_screen = GFX_TOP;
@@ -33,15 +68,22 @@ static u32 projection_desc = -1;
 //Matrix
 static float ortho_matrix_top[4*4];
 static float ortho_matrix_bot[4*4];
+static const float *cur_projection = NULL;
+static float cur_translation_x = 0.0f;
+static float cur_translation_y = 0.0f;
 //Rendertarget things
 static sf2d_rendertarget * currentRenderTarget = NULL;
 static void * targetDepthBuffer;
 static int targetDepthBufferLen = 0;
+//Rendering statistics
+sf2d_stats sf2d_frame_stats;
+static sf2d_stats last_frame_stats;
 //Apt hook cookie
 static aptHookCookie apt_hook_cookie;
 //Functions
 static void apt_hook_func(APT_HookType hook, void *param);
 static void reset_gpu_apt_resume();
+static void free_data(void *data, sf2d_place place);
 
 int sf2d_init()
 {
@@ -56,15 +98,18 @@ int sf2d_init_advanced(int gpucmd_size, int temppool_size)
 
 	gpu_fb_addr       = vramMemAlign(400*240*8, 0x100);
 	gpu_depth_fb_addr = vramMemAlign(400*240*8, 0x100);
-	gpu_cmd           = linearAlloc(gpucmd_size * 4);
-	pool_addr         = linearAlloc(temppool_size);
+	gpu_cmd[0]        = linearAlloc(gpucmd_size * 4);
+	gpu_cmd[1]        = linearAlloc(gpucmd_size * 4);
+	pool_addr[0]      = linearAlloc(temppool_size);
+	pool_addr[1]      = linearAlloc(temppool_size);
 	pool_size         = temppool_size;
 	gpu_cmd_size      = gpucmd_size;
 
 	gfxInitDefault();
 	GPU_Init(NULL);
 	gfxSet3D(false);
-	GPU_Reset(NULL, gpu_cmd, gpucmd_size);
+	cur_set = 0;
+	GPU_Reset(NULL, gpu_cmd[cur_set], gpucmd_size);
 
 	//Setup the shader
 	dvlb = DVLB_ParseFile((u32 *)shader_vsh_shbin, shader_vsh_shbin_size);
@@ -78,7 +123,8 @@ int sf2d_init_advanced(int gpucmd_size, int temppool_size)
 
 	matrix_init_orthographic(ortho_matrix_top, 0.0f, 400.0f, 0.0f, 240.0f, 0.0f, 1.0f);
 	matrix_init_orthographic(ortho_matrix_bot, 0.0f, 320.0f, 0.0f, 240.0f, 0.0f, 1.0f);
-	matrix_gpu_set_uniform(ortho_matrix_top, projection_desc);
+	sf2d_state_invalidate();
+	sf2d_set_projection(ortho_matrix_top, projection_desc);
 
 	//Register the apt callback hook
 	aptHook(&apt_hook_cookie, apt_hook_func, NULL);
@@ -91,6 +137,11 @@ int sf2d_init_advanced(int gpucmd_size, int temppool_size)
 	cur_screen = GFX_TOP;
 	cur_side = GFX_LEFT;
 
+	submitted.active = 0;
+	rendered_frames = started_frames;
+	swap_pending = 0;
+	wait_ticks = 0;
+
 	GPUCMD_Finalize();
 	GPUCMD_FlushAndRun();
 	gspWaitForP3D();
@@ -106,18 +157,32 @@ int sf2d_fini()
 {
 	if (!sf2d_initialized) return 0;
 
+	sf2d_wait_gpu();
 	aptUnhook(&apt_hook_cookie);
 
 	gfxExit();
 	shaderProgramFree(&shader);
 	DVLB_Free(dvlb);
 
-	linearFree(pool_addr);
-	linearFree(gpu_cmd);
+	linearFree(pool_addr[0]);
+	linearFree(pool_addr[1]);
+	linearFree(gpu_cmd[0]);
+	linearFree(gpu_cmd[1]);
 	vramFree(gpu_fb_addr);
 	vramFree(gpu_depth_fb_addr);
 	linearFree(targetDepthBuffer);
 
+	// The GPU is done with everything
+	int i;
+	for (i = 0; i < deferred_frees_count; i++)
+		free_data(deferred_frees[i].data, deferred_frees[i].place);
+	free(deferred_frees);
+	free(deferred_fills);
+	deferred_frees = NULL;
+	deferred_fills = NULL;
+	deferred_frees_count = deferred_frees_size = 0;
+	deferred_fills_count = deferred_fills_size = 0;
+
 	sf2d_initialized = 0;
 
 	return 1;
@@ -130,18 +195,16 @@ void sf2d_set_3D(int enable)
 
 void sf2d_start_frame(gfxScreen_t screen, gfx3dSide_t side)
 {
+	started_frames++;
 	sf2d_pool_reset();
-	GPUCMD_SetBufferOffset(0);
+	sf2d_state_start_frame();
+	GPUCMD_SetBuffer(gpu_cmd[cur_set], gpu_cmd_size, 0);
 
-	// Only upload the uniform if the screen changes
-	if (screen != cur_screen) {
-		if (screen == GFX_TOP) {
-			matrix_gpu_set_uniform(ortho_matrix_top, projection_desc);
-		} else {
-			matrix_gpu_set_uniform(ortho_matrix_bot, projection_desc);
-		}
-		cur_screen = screen;
-	}
+	// Only uploaded if it changed, a render target may have been drawn in between
+	cur_projection = screen == GFX_TOP ? ortho_matrix_top : ortho_matrix_bot;
+	cur_translation_x = cur_translation_y = 0.0f;
+	sf2d_set_projection(cur_projection, projection_desc);
+	cur_screen = screen;
 
 	int screen_w;
 	if (screen == GFX_TOP) {
@@ -181,23 +244,29 @@ void sf2d_start_frame(gfxScreen_t screen, gfx3dSide_t side)
 
 void sf2d_start_frame_target(sf2d_rendertarget *target)
 {
+	started_frames++;
 	sf2d_pool_reset();
-	GPUCMD_SetBufferOffset(0);
+	sf2d_state_start_frame();
+	GPUCMD_SetBuffer(gpu_cmd[cur_set], gpu_cmd_size, 0);
 
 	// Upload saved uniform
-	matrix_gpu_set_uniform(target->projection, projection_desc);
+	cur_projection = target->projection;
+	cur_translation_x = cur_translation_y = 0.0f;
+	sf2d_set_projection(cur_projection, projection_desc);
 
-	int bufferLen = target->texture.width * target->texture.height * 4; // apparently depth buffer is (or can be) 32bit?
+	int bufferLen = target->texture.pow2_w * target->texture.pow2_h * 4; // apparently depth buffer is (or can be) 32bit?
 	if (bufferLen > targetDepthBufferLen) { // expand depth buffer
+		sf2d_wait_gpu(); // the submitted frame may be using it
 		if (targetDepthBufferLen > 0) linearFree(targetDepthBuffer);
 		targetDepthBuffer = linearAlloc(bufferLen);
 		memset(targetDepthBuffer, 0, bufferLen);
 		targetDepthBufferLen = bufferLen;
 	}
 
+	// The color buffer has the size and the tiled layout of the texture
 	GPU_SetViewport((u32 *)osConvertVirtToPhys(targetDepthBuffer),
 		(u32 *)osConvertVirtToPhys(target->texture.data),
-		0, 0, target->texture.height, target->texture.width);
+		0, 0, target->texture.pow2_w, target->texture.pow2_h);
 
 	currentRenderTarget = target;
 
@@ -226,18 +295,68 @@ void sf2d_start_frame_target(sf2d_rendertarget *target)
 	GPU_SetDummyTexEnv(5);
 }
 
-void sf2d_end_frame()
+static void free_data(void *data, sf2d_place place)
 {
-	GPU_FinishDrawing();
-	GPUCMD_Finalize();
-	GPUCMD_FlushAndRun();
+	if (place == SF2D_PLACE_RAM) {
+		linearFree(data);
+	} else if (place == SF2D_PLACE_VRAM) {
+		vramFree(data);
+	}
+}
+
+static void fill_data(u32 *start, u32 *end, u32 value)
+{
+	GX_MemoryFill(start, value, end, GX_FILL_TRIGGER | GX_FILL_32BIT_DEPTH, NULL, 0, NULL, 0);
+	gspWaitForPSC0();
+	GSPGPU_InvalidateDataCache(start, (u8 *)end - (u8 *)start);
+}
+
+// Grows an array of deferred operations by one; returns 0 if there isn't enough memory
+static int grow_deferred(void **array, int *size, int count, size_t item_size)
+{
+	if (count < *size) return 1;
+
+	int new_size = *size > 0 ? *size * 2 : 16;
+	void *new_array = realloc(*array, new_size * item_size);
+	if (!new_array) return 0;
+
+	*array = new_array;
+	*size = new_size;
+	return 1;
+}
+
+// Does what was waiting for the frames rendered so far
+static void run_deferred()
+{
+	int i, kept = 0;
+	for (i = 0; i < deferred_fills_count; i++)
+		fill_data(deferred_fills[i].start, deferred_fills[i].end, deferred_fills[i].value);
+	deferred_fills_count = 0;
+
+	for (i = 0; i < deferred_frees_count; i++) {
+		if (deferred_frees[i].frame <= rendered_frames) {
+			free_data(deferred_frees[i].data, deferred_frees[i].place);
+		} else {
+			deferred_frees[kept++] = deferred_frees[i];
+		}
+	}
+	deferred_frees_count = kept;
+}
+
+// Waits until the GPU has rendered the submitted frame, then copies it to the
+// screen framebuffer, or makes the render target visible to the CPU reads
+static void finish_submitted()
+{
+	if (!submitted.active) return;
+
+	u64 start = svcGetSystemTick();
 	gspWaitForP3D();
 
-	if (!currentRenderTarget) {
+	if (!submitted.target_data) {
 		//Copy the GPU rendered FB to the screen FB
-		if (cur_screen == GFX_TOP) {
+		if (submitted.screen == GFX_TOP) {
 			GX_DisplayTransfer(gpu_fb_addr, GX_BUFFER_DIM(240, 400),
-				(u32 *)gfxGetFramebuffer(GFX_TOP, cur_side, NULL, NULL),
+				(u32 *)gfxGetFramebuffer(GFX_TOP, submitted.side, NULL, NULL),
 				GX_BUFFER_DIM(240, 400), 0x1000);
 		} else {
 			GX_DisplayTransfer(gpu_fb_addr, GX_BUFFER_DIM(240, 320),
@@ -252,16 +371,60 @@ void sf2d_end_frame()
 			gpu_depth_fb_addr, 0, &gpu_depth_fb_addr[240*400], GX_FILL_TRIGGER | GX_FILL_32BIT_DEPTH);
 		gspWaitForPSC0();
 	} else {
-		//gspWaitForPPF();
-		//gspWaitForPSC0();
-		sf2d_texture_tile32(&(currentRenderTarget->texture));
+		// Already tiled: only the CPU reads of the texture need to see what the GPU wrote
+		GSPGPU_InvalidateDataCache(submitted.target_data, submitted.target_size);
 	}
+
+	wait_ticks += svcGetSystemTick() - start;
+	rendered_frames = submitted.frame;
+	submitted.active = 0;
+
+	if (swap_pending) {
+		gfxSwapBuffersGpu();
+		swap_pending = 0;
+	}
+
+	run_deferred();
+}
+
+void sf2d_end_frame()
+{
+	sf2d_batch_flush();
+
+	GPU_FinishDrawing();
+	GPUCMD_Finalize();
+
+	// The GPU renders one frame at a time, and the screens share its color
+	// buffer: the previous frame is finished only now, once this one is recorded
+	finish_submitted();
+	GPUCMD_FlushAndRun();
+
+	submitted.active = 1;
+	submitted.frame = started_frames;
+	// The target may be freed before the frame is finished, its data is freed later
+	submitted.target_data = currentRenderTarget ? currentRenderTarget->texture.data : NULL;
+	submitted.target_size = currentRenderTarget ? currentRenderTarget->texture.data_size : 0;
+	submitted.screen = cur_screen;
+	submitted.side = cur_side;
+	cur_set ^= 1;
+
 	currentRenderTarget = NULL;
 }
 
 void sf2d_swapbuffers()
 {
-	gfxSwapBuffersGpu();
+	// The framebuffers are swapped once the last frame is on them
+	if (swap_pending) finish_submitted();
+	if (submitted.active) {
+		swap_pending = 1;
+	} else {
+		gfxSwapBuffersGpu();
+	}
+
+	sf2d_frame_stats.cpu_wait_us = wait_ticks * 1000000 / SYSCLOCK_ARM11;
+	wait_ticks = 0;
+	last_frame_stats = sf2d_frame_stats;
+	memset(&sf2d_frame_stats, 0, sizeof(sf2d_frame_stats));
 	if (vblank_wait) {
 		gspWaitForEvent(GSPGPU_EVENT_VBlank0, false);
 	}
@@ -275,6 +438,11 @@ void sf2d_swapbuffers()
 	}
 }
 
+void sf2d_wait_gpu()
+{
+	finish_submitted();
+}
+
 void sf2d_set_vblank_wait(int enable)
 {
 	vblank_wait = enable;
@@ -285,10 +453,60 @@ float sf2d_get_fps()
 	return current_fps;
 }
 
+unsigned int sf2d_get_frame_count()
+{
+	return started_frames;
+}
+
+unsigned int sf2d_get_rendered_frame_count()
+{
+	return rendered_frames;
+}
+
+void sf2d_free_deferred(void *data, sf2d_place place)
+{
+	if (rendered_frames == started_frames) {
+		free_data(data, place);
+		return;
+	}
+
+	if (!grow_deferred((void **)&deferred_frees, &deferred_frees_size, deferred_frees_count, sizeof(*deferred_frees)))
+		return; // leak it rather than freeing memory the GPU is going to read
+
+	deferred_frees[deferred_frees_count].data = data;
+	deferred_frees[deferred_frees_count].place = place;
+	deferred_frees[deferred_frees_count].frame = started_frames;
+	deferred_frees_count++;
+}
+
+void sf2d_fill_deferred(u32 *start, u32 *end, u32 value)
+{
+	if (!submitted.active) {
+		fill_data(start, end, value);
+		return;
+	}
+
+	if (!grow_deferred((void **)&deferred_fills, &deferred_fills_size, deferred_fills_count, sizeof(*deferred_fills))) {
+		finish_submitted();
+		fill_data(start, end, value);
+		return;
+	}
+
+	deferred_fills[deferred_fills_count].start = start;
+	deferred_fills[deferred_fills_count].end = end;
+	deferred_fills[deferred_fills_count].value = value;
+	deferred_fills_count++;
+}
+
+void sf2d_get_stats(sf2d_stats *stats)
+{
+	*stats = last_frame_stats;
+}
+
 void *sf2d_pool_malloc(u32 size)
 {
 	if ((pool_index + size) < pool_size) {
-		void *addr = (void *)((u32)pool_addr + pool_index);
+		void *addr = (u8 *)pool_addr[cur_set] + pool_index;
 		pool_index += size;
 		return addr;
 	}
@@ -299,7 +517,7 @@ void *sf2d_pool_memalign(u32 size, u32 alignment)
 {
 	u32 new_index = (pool_index + alignment - 1) & ~(alignment - 1);
 	if ((new_index + size) < pool_size) {
-		void *addr = (void *)((u32)pool_addr + new_index);
+		void *addr = (u8 *)pool_addr[cur_set] + new_index;
 		pool_index = new_index + size;
 		return addr;
 	}
@@ -318,6 +536,7 @@ unsigned int sf2d_pool_space_free()
 
 void sf2d_pool_reset()
 {
+	sf2d_batch_reset();
 	pool_index = 0;
 }
 
@@ -332,6 +551,8 @@ void sf2d_set_clear_color(u32 color)
 
 void sf2d_set_scissor_test(GPU_SCISSORMODE mode, u32 x, u32 y, u32 w, u32 h)
 {
+	sf2d_batch_flush();
+
 	if (cur_screen == GFX_TOP) {
 		GPU_SetScissorTest(mode, 240 - (y + h), 400 - (x + w), 240 - y, 400 - x);
 	} else {
@@ -339,6 +560,21 @@ void sf2d_set_scissor_test(GPU_SCISSORMODE mode, u32 x, u32 y, u32 w, u32 h)
 	}
 }
 
+void sf2d_set_translation(float x, float y)
+{
+	if (x == cur_translation_x && y == cur_translation_y) return;
+
+	float m[4*4], mt[4*4];
+	matrix_identity4x4(mt);
+	mt[0x3] = x;
+	mt[0x7] = y;
+	matrix_mult4x4(cur_projection, mt, m);
+	sf2d_set_projection(m, projection_desc);
+
+	cur_translation_x = x;
+	cur_translation_y = y;
+}
+
 gfxScreen_t sf2d_get_current_screen()
 {
 	return cur_screen;
@@ -358,13 +594,15 @@ static void apt_hook_func(APT_HookType hook, void *param)
 
 static void reset_gpu_apt_resume()
 {
-	GPU_Reset(NULL, gpu_cmd, gpu_cmd_size); // Only required for custom GPU cmd sizes
+	sf2d_wait_gpu();
+	GPU_Reset(NULL, gpu_cmd[cur_set], gpu_cmd_size); // Only required for custom GPU cmd sizes
 	shaderProgramUse(&shader);
+	sf2d_state_invalidate();
 
 	if (cur_screen == GFX_TOP) {
-		matrix_gpu_set_uniform(ortho_matrix_top, projection_desc);
+		sf2d_set_projection(ortho_matrix_top, projection_desc);
 	} else {
-		matrix_gpu_set_uniform(ortho_matrix_bot, projection_desc);
+		sf2d_set_projection(ortho_matrix_bot, projection_desc);
 	}
 
 	GPUCMD_Finalize();
@@ -0,0 +1,129 @@
+#include "sf2d.h"
+#include "sf2d_private.h"
+
+// Upper bound of a batch, so the vertex indices fit in 16 bits
+#define SF2D_BATCH_MAX_QUADS (0x10000 / 4)
+
+/*
+ * Consecutive textured quads drawn with the same texture and TexEnv are
+ * appended to a single run of vertices in the temporary pool and drawn with
+ * one indexed triangle list when the state changes, when something else is
+ * drawn, or when the frame ends.
+ */
+static struct {
+	sf2d_vertex_pos_tex *vertices;  // first vertex of the batch
+	u32 quads;                      // number of quads in the batch
+	// State shared by all the quads of the batch
+	const void *data;
+	int pow2_w, pow2_h;
+	sf2d_texfmt pixel_format;
+	u32 params;
+	sf2d_batch_env env;
+	u32 color;
+} batch;
+
+static int batch_state_equals(const sf2d_texture *texture, u32 params, sf2d_batch_env env, u32 color)
+{
+	return batch.data == texture->data &&
+		batch.pow2_w == texture->pow2_w &&
+		batch.pow2_h == texture->pow2_h &&
+		batch.pixel_format == texture->pixel_format &&
+		batch.params == params &&
+		batch.env == env &&
+		(env == SF2D_BATCH_REPLACE || batch.color == color);
+}
+
+static void batch_bind(const sf2d_texture *texture, u32 params, sf2d_batch_env env, u32 color)
+{
+	if (env >= SF2D_BATCH_SDF) {
+		sf2d_bind_texture_sdf(texture, GPU_TEXUNIT0, color, env - SF2D_BATCH_SDF);
+	} else if (env == SF2D_BATCH_MODULATE) {
+		sf2d_bind_texture_color(texture, GPU_TEXUNIT0, color);
+	} else {
+		sf2d_bind_texture_parameters(texture, GPU_TEXUNIT0, params);
+	}
+
+	batch.data = texture->data;
+	batch.pow2_w = texture->pow2_w;
+	batch.pow2_h = texture->pow2_h;
+	batch.pixel_format = texture->pixel_format;
+	batch.params = params;
+	batch.env = env;
+	batch.color = color;
+}
+
+sf2d_vertex_pos_tex *sf2d_batch_add_quad(const sf2d_texture *texture, u32 params, sf2d_batch_env env, u32 color)
+{
+	sf2d_vertex_pos_tex *vertices;
+
+	if (batch.quads > 0 && (batch.quads >= SF2D_BATCH_MAX_QUADS ||
+		!batch_state_equals(texture, params, env, color))) {
+		sf2d_batch_flush();
+	}
+
+	if (batch.quads > 0) {
+		vertices = sf2d_pool_malloc(4 * sizeof(sf2d_vertex_pos_tex));
+		if (!vertices) return NULL;
+		// Something else was allocated in the pool since the last quad
+		if (vertices != batch.vertices + batch.quads * 4) {
+			sf2d_batch_flush();
+		}
+	}
+
+	if (batch.quads == 0) {
+		// The attribute buffer has to be 8 bytes aligned
+		vertices = sf2d_pool_memalign(4 * sizeof(sf2d_vertex_pos_tex), 8);
+		if (!vertices) return NULL;
+		batch_bind(texture, params, env, color);
+		batch.vertices = vertices;
+	}
+
+	batch.quads++;
+	sf2d_frame_stats.quads++;
+
+	return vertices;
+}
+
+void sf2d_batch_flush()
+{
+	if (batch.quads == 0) return;
+
+	u32 quads = batch.quads;
+	batch.quads = 0;
+
+	sf2d_set_translation(0.0f, 0.0f);
+	sf2d_set_attribute_buffers(SF2D_VERTEX_POS_TEX, batch.vertices);
+
+	// The indices are allocated after the vertices; their offset is relative to the attribute buffer
+	u16 *indices = sf2d_pool_memalign(quads * 6 * sizeof(u16), 2);
+	if (indices) {
+		u32 i;
+		for (i = 0; i < quads; i++) {
+			u16 first = i * 4;
+			indices[i*6 + 0] = first + 0;
+			indices[i*6 + 1] = first + 1;
+			indices[i*6 + 2] = first + 2;
+			indices[i*6 + 3] = first + 2;
+			indices[i*6 + 4] = first + 1;
+			indices[i*6 + 5] = first + 3;
+		}
+		GPU_DrawElements(GPU_TRIANGLES, (u32 *)((u8 *)indices - (u8 *)batch.vertices), quads * 6);
+		sf2d_frame_stats.draw_calls++;
+	} else {
+		// Not enough space left for the indices, draw the quads one by one
+		u32 i;
+		for (i = 0; i < quads; i++) {
+			GPU_DrawArray(GPU_TRIANGLE_STRIP, i * 4, 4);
+		}
+		sf2d_frame_stats.draw_calls += quads;
+	}
+
+	if (batch.env >= SF2D_BATCH_SDF) {
+		sf2d_unbind_texture_sdf();
+	}
+}
+
+void sf2d_batch_reset()
+{
+	batch.quads = 0;
+}
@@ -0,0 +1,524 @@
+#include <string.h>
+#include "sf2d.h"
+#include "sf2d_convert.h"
+
+/*
+ * The kernels work on whole words: 32-bit pixels one at a time, 16-bit ones
+ * by pairs, 24-bit ones by groups of 4 (3 words), 8-bit ones by groups of 4.
+ * Their loops are simple enough for the compilers to vectorize on the host;
+ * on the ARM11 of the console, the byte reversals are `rev` and the clamping
+ * of the YUV conversion uses the saturating instructions of ARMv6.
+ * Words are loaded with memcpy: the rows don't have to be aligned.
+ *
+ * An RGBA8 pixel in a word is R | G << 8 | B << 16 | A << 24.
+ */
+
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "the conversion kernels expect little-endian words"
+#endif
+
+#if defined(__ARM_ARCH_6K__) && !defined(__thumb__)
+static inline u32 clamp8(int v)
+{
+	u32 r;
+	__asm__("usat %0, #8, %1" : "=r"(r) : "r"(v));
+	return r;
+}
+
+// Clamps both signed halves of a word to 0..255
+static inline u32 clamp8x2(u32 v)
+{
+	u32 r;
+	__asm__("usat16 %0, #8, %1" : "=r"(r) : "r"(v));
+	return r;
+}
+#else
+static inline u32 clamp8(int v)
+{
+	return v < 0 ? 0 : v > 255 ? 255 : v;
+}
+
+static inline u32 clamp8x2(u32 v)
+{
+	return clamp8((s16)v) | clamp8((s16)(v >> 16)) << 16;
+}
+#endif
+
+static inline u32 load32(const u8 *p)
+{
+	u32 v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline void store32(u8 *p, u32 v)
+{
+	memcpy(p, &v, sizeof(v));
+}
+
+static inline u32 load16(const u8 *p)
+{
+	u16 v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline void store16(u8 *p, u32 v)
+{
+	u16 w = v;
+	memcpy(p, &w, sizeof(w));
+}
+
+#define CH_R(p) ((p) & 0xFF)
+#define CH_G(p) (((p) >> 8) & 0xFF)
+#define CH_B(p) (((p) >> 16) & 0xFF)
+#define CH_A(p) ((p) >> 24)
+
+// Rounds an 8-bit channel to n bits
+#define TO_BITS(v, n) (((v) * ((1 << (n)) - 1) + 127) / 255)
+#define LUMINANCE(p) ((CH_R(p) * 77 + CH_G(p) * 150 + CH_B(p) * 29 + 128) >> 8)
+
+/*
+ * Pixels from and to RGBA8 words
+ */
+
+// 5-bit channels in the low bytes of both halves of a word, widened together
+static inline u32 expand5x2(u32 v)
+{
+	return (v << 3 | v >> 2) & 0x00FF00FF;
+}
+
+static inline u32 from_rgb565(u32 v)
+{
+	u32 g = (v >> 5) & 0x3F;
+	return expand5x2(((v >> 11) & 0x1F) | (v & 0x1F) << 16) | (g << 2 | g >> 4) << 8 | 0xFF000000;
+}
+
+static inline u32 from_rgb5a1(u32 v)
+{
+	u32 g = (v >> 6) & 0x1F;
+	return expand5x2(((v >> 11) & 0x1F) | ((v >> 1) & 0x1F) << 16) | (g << 3 | g >> 2) << 8 | (0 - (v & 1)) << 24;
+}
+
+static inline u32 from_rgba4(u32 v)
+{
+	// No carry between the bytes: 15 * 17 = 255
+	return ((v >> 12) | ((v >> 8) & 0xF) << 8 | ((v >> 4) & 0xF) << 16 | (v & 0xF) << 24) * 17;
+}
+
+static inline u32 to_rgb565(u32 p)
+{
+	return TO_BITS(CH_R(p), 5) << 11 | TO_BITS(CH_G(p), 6) << 5 | TO_BITS(CH_B(p), 5);
+}
+
+static inline u32 to_rgb5a1(u32 p)
+{
+	return TO_BITS(CH_R(p), 5) << 11 | TO_BITS(CH_G(p), 5) << 6 | TO_BITS(CH_B(p), 5) << 1 | CH_A(p) >> 7;
+}
+
+static inline u32 to_rgba4(u32 p)
+{
+	return TO_BITS(CH_R(p), 4) << 12 | TO_BITS(CH_G(p), 4) << 8 | TO_BITS(CH_B(p), 4) << 4 | TO_BITS(CH_A(p), 4);
+}
+
+// Exchanges red and blue
+static inline u32 swap_rb(u32 p)
+{
+	return (p & 0xFF00FF00) | (p & 0xFF) << 16 | ((p >> 16) & 0xFF);
+}
+
+/*
+ * 24-bit pixels: the 3 words of 4 pixels become 4 words. The order tells the
+ * layout of both sides: 0 for RGB8 to RGBA8, 1 for BGR8 to RGBA8, 2 for RGB8
+ * to ABGR8, 3 for BGR8 to ABGR8.
+ */
+static inline u32 order24(u32 v, int order)
+{
+	v |= 0xFF000000;
+	switch (order) {
+	case 1: return swap_rb(v);
+	case 2: return __builtin_bswap32(v);
+	case 3: return v << 8 | 0xFF;
+	default: return v;
+	}
+}
+
+static inline void expand24(u8 *dst, const u8 *src, int n, int order)
+{
+	int i;
+	for (i = 0; i + 4 <= n; i += 4, src += 12, dst += 16) {
+		u32 w0 = load32(src), w1 = load32(src + 4), w2 = load32(src + 8);
+		store32(dst,      order24(w0, order));
+		store32(dst + 4,  order24(w0 >> 24 | w1 << 8, order));
+		store32(dst + 8,  order24(w1 >> 16 | w2 << 16, order));
+		store32(dst + 12, order24(w2 >> 8, order));
+	}
+	for (; i < n; i++, src += 3, dst += 4)
+		store32(dst, order24(src[0] | src[1] << 8 | src[2] << 16, order));
+}
+
+// The other way: 4 RGBA8 words become 3 words, red and blue exchanged if swap
+static inline void pack24(u8 *dst, const u8 *src, int n, int swap)
+{
+	int i;
+	for (i = 0; i + 4 <= n; i += 4, src += 16, dst += 12) {
+		u32 p0 = load32(src), p1 = load32(src + 4), p2 = load32(src + 8), p3 = load32(src + 12);
+		if (swap) {
+			p0 = swap_rb(p0); p1 = swap_rb(p1); p2 = swap_rb(p2); p3 = swap_rb(p3);
+		}
+		store32(dst,     (p0 & 0xFFFFFF) | p1 << 24);
+		store32(dst + 4, ((p1 >> 8) & 0xFFFF) | p2 << 16);
+		store32(dst + 8, ((p2 >> 16) & 0xFF) | p3 << 8);
+	}
+	for (; i < n; i++, src += 4, dst += 3) {
+		u32 p = load32(src);
+		if (swap) p = swap_rb(p);
+		dst[0] = CH_R(p); dst[1] = CH_G(p); dst[2] = CH_B(p);
+	}
+}
+
+/*
+ * YUV422: two pixels share U and V. Full range BT.601, in 16.16 fixed point:
+ * R = Y + 1.402 V, G = Y - 0.344136 U - 0.714136 V, B = Y + 1.772 U, with U
+ * and V centered on 0, each term rounded to the nearest and then clamped.
+ */
+typedef struct {
+	int r, g, b;
+} chroma;
+
+static inline chroma yuv_chroma(int u, int v)
+{
+	chroma c;
+	u -= 128;
+	v -= 128;
+	c.r = (91881 * v + 32768) >> 16;
+	c.g = (-22554 * u - 46802 * v + 32768) >> 16;
+	c.b = (116130 * u + 32768) >> 16;
+	return c;
+}
+
+static inline u32 from_yuv(int y, chroma c)
+{
+	// Red and blue clamped together, in the halves where RGBA8 wants them
+	u32 rb = clamp8x2(((y + c.r) & 0xFFFF) | (u32)(y + c.b) << 16);
+	return rb | clamp8(y + c.g) << 8 | 0xFF000000;
+}
+
+// Writes the n pixels of a YUV422 row with store(dst, i, rgba)
+#define YUV422_LOOP(dst, src, n, STORE) do { \
+	int i_; \
+	for (i_ = 0; i_ + 2 <= (n); i_ += 2, (src) += 4) { \
+		u32 w_ = load32(src); \
+		chroma c_ = yuv_chroma((w_ >> 8) & 0xFF, w_ >> 24); \
+		STORE(dst, i_, from_yuv(w_ & 0xFF, c_)); \
+		STORE(dst, i_ + 1, from_yuv((w_ >> 16) & 0xFF, c_)); \
+	} \
+	if (i_ < (n)) \
+		STORE(dst, i_, from_yuv((src)[0], yuv_chroma((src)[1], (src)[3]))); \
+} while (0)
+
+#define STORE_RGBA8(dst, i, p) store32((dst) + (i) * 4, (p))
+#define STORE_ABGR8(dst, i, p) store32((dst) + (i) * 4, __builtin_bswap32(p))
+#define STORE_RGB565(dst, i, p) store16((dst) + (i) * 2, to_rgb565(p))
+
+/*
+ * Kernels to RGBA8
+ */
+
+static void abgr8_to_rgba8(u8 *dst, const u8 *src, int n)
+{
+	int i;
+	for (i = 0; i < n; i++)
+		store32(dst + i * 4, __builtin_bswap32(load32(src + i * 4)));
+}
+
+static void rgb8_to_rgba8(u8 *dst, const u8 *src, int n) { expand24(dst, src, n, 0); }
+static void bgr8_to_rgba8(u8 *dst, const u8 *src, int n) { expand24(dst, src, n, 1); }
+
+// 16-bit pixels by pairs
+#define DEFINE_TO_RGBA8_16(name, FROM, STORE) \
+static void name(u8 *dst, const u8 *src, int n) \
+{ \
+	int i; \
+	for (i = 0; i + 2 <= n; i += 2) { \
+		u32 v = load32(src + i * 2); \
+		STORE(dst, i, FROM(v & 0xFFFF)); \
+		STORE(dst, i + 1, FROM(v >> 16)); \
+	} \
+	if (i < n) \
+		STORE(dst, i, FROM(load16(src + i * 2))); \
+}
+
+static inline u32 from_ai8(u32 v)
+{
+	return (v >> 8) * 0x010101 | (v & 0xFF) << 24;
+}
+
+DEFINE_TO_RGBA8_16(rgb565_to_rgba8, from_rgb565, STORE_RGBA8)
+DEFINE_TO_RGBA8_16(rgb5a1_to_rgba8, from_rgb5a1, STORE_RGBA8)
+DEFINE_TO_RGBA8_16(rgba4_to_rgba8, from_rgba4, STORE_RGBA8)
+DEFINE_TO_RGBA8_16(ai8_to_rgba8, from_ai8, STORE_RGBA8)
+DEFINE_TO_RGBA8_16(rgb565_to_abgr8, from_rgb565, STORE_ABGR8)
+
+// 8-bit pixels by groups of 4
+#define DEFINE_TO_RGBA8_8(name, FROM) \
+static void name(u8 *dst, const u8 *src, int n) \
+{ \
+	int i; \
+	for (i = 0; i + 4 <= n; i += 4) { \
+		u32 v = load32(src + i); \
+		store32(dst + i * 4, FROM(v & 0xFF)); \
+		store32(dst + i * 4 + 4, FROM((v >> 8) & 0xFF)); \
+		store32(dst + i * 4 + 8, FROM((v >> 16) & 0xFF)); \
+		store32(dst + i * 4 + 12, FROM(v >> 24)); \
+	} \
+	for (; i < n; i++) \
+		store32(dst + i * 4, FROM((u32)src[i])); \
+}
+
+#define FROM_I8(v) ((v) * 0x010101 | 0xFF000000)
+#define FROM_A8(v) ((v) << 24)
+#define FROM_IA4(v) (((v) >> 4) * 0x111111 | ((v) & 0xF) * 0x11000000)
+#define FROM_COVERAGE(v) ((v) << 24 | 0x00FFFFFF)
+#define FROM_COVERAGE_ABGR8(v) ((v) | 0xFFFFFF00)
+
+DEFINE_TO_RGBA8_8(i8_to_rgba8, FROM_I8)
+DEFINE_TO_RGBA8_8(a8_to_rgba8, FROM_A8)
+DEFINE_TO_RGBA8_8(ia4_to_rgba8, FROM_IA4)
+DEFINE_TO_RGBA8_8(coverage_to_rgba8, FROM_COVERAGE)
+DEFINE_TO_RGBA8_8(coverage_to_abgr8, FROM_COVERAGE_ABGR8)
+
+static void mono_to_rgba8(u8 *dst, const u8 *src, int n)
+{
+	int i;
+	for (i = 0; i < n; i++)
+		store32(dst + i * 4, FROM_COVERAGE((0 - ((src[i >> 3] >> (7 - (i & 7))) & 1u)) & 0xFF));
+}
+
+static void yuv422_to_rgba8(u8 *dst, const u8 *src, int n) { YUV422_LOOP(dst, src, n, STORE_RGBA8); }
+
+/*
+ * Kernels from RGBA8
+ */
+
+#define rgba8_to_abgr8 abgr8_to_rgba8
+
+static void rgba8_to_rgb8(u8 *dst, const u8 *src, int n) { pack24(dst, src, n, 0); }
+static void rgba8_to_bgr8(u8 *dst, const u8 *src, int n) { pack24(dst, src, n, 1); }
+
+#define DEFINE_FROM_RGBA8(name, size, TO, STORE) \
+static void name(u8 *dst, const u8 *src, int n) \
+{ \
+	int i; \
+	for (i = 0; i < n; i++) { \
+		u32 p = load32(src + i * 4); \
+		STORE(dst + i * (size), TO(p)); \
+	} \
+}
+
+#define TO_AI8(p) (CH_A(p) | LUMINANCE(p) << 8)
+#define TO_I8(p) LUMINANCE(p)
+#define TO_A8(p) CH_A(p)
+#define TO_IA4(p) (TO_BITS(LUMINANCE(p), 4) << 4 | TO_BITS(CH_A(p), 4))
+#define STORE8(p, v) (*(p) = (v))
+
+DEFINE_FROM_RGBA8(rgba8_to_rgb565, 2, to_rgb565, store16)
+DEFINE_FROM_RGBA8(rgba8_to_rgb5a1, 2, to_rgb5a1, store16)
+DEFINE_FROM_RGBA8(rgba8_to_rgba4, 2, to_rgba4, store16)
+DEFINE_FROM_RGBA8(rgba8_to_ai8, 2, TO_AI8, store16)
+DEFINE_FROM_RGBA8(rgba8_to_i8, 1, TO_I8, STORE8)
+DEFINE_FROM_RGBA8(rgba8_to_a8, 1, TO_A8, STORE8)
+DEFINE_FROM_RGBA8(rgba8_to_ia4, 1, TO_IA4, STORE8)
+
+/*
+ * Direct kernels, for the pairs used by the loaders, the camera and the glyphs
+ */
+
+static void rgb8_to_abgr8(u8 *dst, const u8 *src, int n) { expand24(dst, src, n, 2); }
+static void bgr8_to_abgr8(u8 *dst, const u8 *src, int n) { expand24(dst, src, n, 3); }
+static void yuv422_to_abgr8(u8 *dst, const u8 *src, int n) { YUV422_LOOP(dst, src, n, STORE_ABGR8); }
+static void yuv422_to_rgb565(u8 *dst, const u8 *src, int n) { YUV422_LOOP(dst, src, n, STORE_RGB565); }
+
+static void abgr8_to_a8(u8 *dst, const u8 *src, int n)
+{
+	int i;
+	for (i = 0; i < n; i++)
+		dst[i] = src[i * 4];
+}
+
+static void copy8(u8 *dst, const u8 *src, int n)
+{
+	memmove(dst, src, n);
+}
+
+// Each nibble of a MONO byte becomes a word of 4 coverage bytes, the top bit first
+#define MONO_NIBBLE(v) (((v) & 8 ? 0xFF : 0) | ((v) & 4 ? 0xFF00 : 0) | ((v) & 2 ? 0xFF0000 : 0) | ((v) & 1 ? 0xFF000000 : 0))
+
+static const u32 mono_nibbles[16] = {
+	MONO_NIBBLE(0), MONO_NIBBLE(1), MONO_NIBBLE(2), MONO_NIBBLE(3),
+	MONO_NIBBLE(4), MONO_NIBBLE(5), MONO_NIBBLE(6), MONO_NIBBLE(7),
+	MONO_NIBBLE(8), MONO_NIBBLE(9), MONO_NIBBLE(10), MONO_NIBBLE(11),
+	MONO_NIBBLE(12), MONO_NIBBLE(13), MONO_NIBBLE(14), MONO_NIBBLE(15),
+};
+
+static void mono_to_coverage(u8 *dst, const u8 *src, int n)
+{
+	int i;
+	for (i = 0; i + 8 <= n; i += 8, src++) {
+		store32(dst + i, mono_nibbles[*src >> 4]);
+		store32(dst + i + 4, mono_nibbles[*src & 0xF]);
+	}
+	for (; i < n; i++)
+		dst[i] = (*src >> (7 - (i & 7))) & 1 ? 0xFF : 0;
+}
+
+typedef void (*convert_kernel)(u8 *dst, const u8 *src, int n);
+
+#define FORMATS (SF2D_PIXEL_YUV422 + 1)
+
+static const convert_kernel to_rgba8[FORMATS] = {
+	[SF2D_PIXEL_ABGR8]    = abgr8_to_rgba8,
+	[SF2D_PIXEL_RGB8]     = rgb8_to_rgba8,
+	[SF2D_PIXEL_BGR8]     = bgr8_to_rgba8,
+	[SF2D_PIXEL_RGB565]   = rgb565_to_rgba8,
+	[SF2D_PIXEL_RGB5A1]   = rgb5a1_to_rgba8,
+	[SF2D_PIXEL_RGBA4]    = rgba4_to_rgba8,
+	[SF2D_PIXEL_AI8]      = ai8_to_rgba8,
+	[SF2D_PIXEL_I8]       = i8_to_rgba8,
+	[SF2D_PIXEL_A8]       = a8_to_rgba8,
+	[SF2D_PIXEL_IA4]      = ia4_to_rgba8,
+	[SF2D_PIXEL_COVERAGE] = coverage_to_rgba8,
+	[SF2D_PIXEL_MONO]     = mono_to_rgba8,
+	[SF2D_PIXEL_YUV422]   = yuv422_to_rgba8,
+};
+
+static const convert_kernel from_rgba8[FORMATS] = {
+	[SF2D_PIXEL_ABGR8]    = rgba8_to_abgr8,
+	[SF2D_PIXEL_RGB8]     = rgba8_to_rgb8,
+	[SF2D_PIXEL_BGR8]     = rgba8_to_bgr8,
+	[SF2D_PIXEL_RGB565]   = rgba8_to_rgb565,
+	[SF2D_PIXEL_RGB5A1]   = rgba8_to_rgb5a1,
+	[SF2D_PIXEL_RGBA4]    = rgba8_to_rgba4,
+	[SF2D_PIXEL_AI8]      = rgba8_to_ai8,
+	[SF2D_PIXEL_I8]       = rgba8_to_i8,
+	[SF2D_PIXEL_A8]       = rgba8_to_a8,
+	[SF2D_PIXEL_IA4]      = rgba8_to_ia4,
+	[SF2D_PIXEL_COVERAGE] = rgba8_to_a8,
+};
+
+static const struct {
+	sf2d_pixel_format dst, src;
+	convert_kernel kernel;
+} direct_kernels[] = {
+	{ SF2D_PIXEL_ABGR8,    SF2D_PIXEL_RGB8,     rgb8_to_abgr8 },
+	{ SF2D_PIXEL_ABGR8,    SF2D_PIXEL_BGR8,     bgr8_to_abgr8 },
+	{ SF2D_PIXEL_ABGR8,    SF2D_PIXEL_RGB565,   rgb565_to_abgr8 },
+	{ SF2D_PIXEL_ABGR8,    SF2D_PIXEL_YUV422,   yuv422_to_abgr8 },
+	{ SF2D_PIXEL_RGB565,   SF2D_PIXEL_YUV422,   yuv422_to_rgb565 },
+	{ SF2D_PIXEL_ABGR8,    SF2D_PIXEL_COVERAGE, coverage_to_abgr8 },
+	{ SF2D_PIXEL_COVERAGE, SF2D_PIXEL_ABGR8,    abgr8_to_a8 },
+	{ SF2D_PIXEL_A8,       SF2D_PIXEL_ABGR8,    abgr8_to_a8 },
+	{ SF2D_PIXEL_A8,       SF2D_PIXEL_COVERAGE, copy8 },
+	{ SF2D_PIXEL_COVERAGE, SF2D_PIXEL_A8,       copy8 },
+	{ SF2D_PIXEL_COVERAGE, SF2D_PIXEL_MONO,     mono_to_coverage },
+};
+
+// Pixels converted at once through RGBA8: a multiple of 8, for the MONO rows
+#define CONVERT_CHUNK 64
+
+int sf2d_pixel_bits(sf2d_pixel_format format)
+{
+	switch (format) {
+	case SF2D_PIXEL_RGBA8:
+	case SF2D_PIXEL_ABGR8:
+		return 32;
+	case SF2D_PIXEL_RGB8:
+	case SF2D_PIXEL_BGR8:
+		return 24;
+	case SF2D_PIXEL_RGB565:
+	case SF2D_PIXEL_RGB5A1:
+	case SF2D_PIXEL_RGBA4:
+	case SF2D_PIXEL_AI8:
+	case SF2D_PIXEL_YUV422:
+		return 16;
+	case SF2D_PIXEL_I8:
+	case SF2D_PIXEL_A8:
+	case SF2D_PIXEL_IA4:
+	case SF2D_PIXEL_COVERAGE:
+		return 8;
+	case SF2D_PIXEL_MONO:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+sf2d_pixel_format sf2d_convert_texel_format(sf2d_texfmt format)
+{
+	switch (format) {
+	case TEXFMT_RGBA8:  return SF2D_PIXEL_ABGR8;
+	case TEXFMT_RGB8:   return SF2D_PIXEL_BGR8;
+	case TEXFMT_RGB5A1: return SF2D_PIXEL_RGB5A1;
+	case TEXFMT_RGB565: return SF2D_PIXEL_RGB565;
+	case TEXFMT_RGBA4:  return SF2D_PIXEL_RGBA4;
+	case TEXFMT_IA8:    return SF2D_PIXEL_AI8;
+	case TEXFMT_I8:     return SF2D_PIXEL_I8;
+	case TEXFMT_A8:     return SF2D_PIXEL_A8;
+	case TEXFMT_IA4:    return SF2D_PIXEL_IA4;
+	default:            return SF2D_PIXEL_NONE;
+	}
+}
+
+int sf2d_convert_row(void *dst, sf2d_pixel_format dst_format, const void *src, sf2d_pixel_format src_format, int n)
+{
+	int src_bits = sf2d_pixel_bits(src_format), dst_bits = sf2d_pixel_bits(dst_format);
+	convert_kernel to, from;
+	u32 rgba[CONVERT_CHUNK];
+	int i;
+
+	if (src_bits == 0 || dst_bits == 0 || (unsigned)src_format >= FORMATS || (unsigned)dst_format >= FORMATS)
+		return 0;
+	if (n <= 0)
+		return 1;
+
+	if (dst_format == src_format) {
+		memmove(dst, src, ((size_t)n * src_bits + 7) / 8);
+		return 1;
+	}
+	for (i = 0; i < sizeof(direct_kernels) / sizeof(direct_kernels[0]); i++) {
+		if (direct_kernels[i].dst == dst_format && direct_kernels[i].src == src_format) {
+			direct_kernels[i].kernel(dst, src, n);
+			return 1;
+		}
+	}
+
+	to = to_rgba8[src_format];
+	from = from_rgba8[dst_format];
+	if (src_format == SF2D_PIXEL_RGBA8 && from) {
+		from(dst, src, n);
+		return 1;
+	}
+	if (dst_format == SF2D_PIXEL_RGBA8 && to) {
+		to(dst, src, n);
+		return 1;
+	}
+	if (!to || !from)
+		return 0;
+
+	for (i = 0; i < n; i += CONVERT_CHUNK) {
+		int m = n - i < CONVERT_CHUNK ? n - i : CONVERT_CHUNK;
+		to((u8 *)rgba, (const u8 *)src + (size_t)i * src_bits / 8, m);
+		from((u8 *)dst + (size_t)i * dst_bits / 8, (const u8 *)rgba, m);
+	}
+	return 1;
+}
+
+int sf2d_convert_rect(void *dst, int dst_pitch, sf2d_pixel_format dst_format, const void *src, int src_pitch, sf2d_pixel_format src_format, int w, int h)
+{
+	int j;
+	for (j = 0; j < h; j++) {
+		if (!sf2d_convert_row((u8 *)dst + j * dst_pitch, dst_format, (const u8 *)src + j * src_pitch, src_format, w))
+			return 0;
+	}
+	return 1;
+}
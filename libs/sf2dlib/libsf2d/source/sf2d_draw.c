@@ -7,7 +7,10 @@
 #endif
 
 void sf2d_setup_env_internal(const sf2d_vertex_pos_col* vertices) {
-	GPU_SetTexEnv(
+	// Draw the pending textured quads before changing the TexEnv
+	sf2d_batch_flush();
+
+	sf2d_set_texenv(
 		0,
 		GPU_TEVSOURCES(GPU_PRIMARY_COLOR, GPU_PRIMARY_COLOR, GPU_PRIMARY_COLOR),
 		GPU_TEVSOURCES(GPU_PRIMARY_COLOR, GPU_PRIMARY_COLOR, GPU_PRIMARY_COLOR),
@@ -17,17 +20,8 @@ void sf2d_setup_env_internal(const sf2d_vertex_pos_col* vertices) {
 		0xFFFFFFFF
 	);
 
-	GPU_SetAttributeBuffers(
-		2, // number of attributes
-		(u32*)osConvertVirtToPhys(vertices),
-		GPU_ATTRIBFMT(0, 3, GPU_FLOAT) | GPU_ATTRIBFMT(1, 4, GPU_UNSIGNED_BYTE),
-		0xFFFC, //0b1100
-		0x10,
-		1, //number of buffers
-		(u32[]){0x0}, // buffer offsets (placeholders)
-		(u64[]){0x10}, // attribute permutations for each buffer
-		(u8[]){2} // number of attributes for each buffer
-	);
+	sf2d_set_translation(0.0f, 0.0f);
+	sf2d_set_attribute_buffers(SF2D_VERTEX_POS_COL, vertices);
 }
 
 void sf2d_draw_line(float x0, float y0, float x1, float y1, float width, u32 color)
@@ -65,6 +59,7 @@ void sf2d_draw_line(float x0, float y0, float x1, float y1, float width, u32 col
 	sf2d_setup_env_internal(vertices);
 
 	GPU_DrawArray(GPU_TRIANGLE_STRIP, 0, 4);
+	sf2d_frame_stats.draw_calls++;
 }
 
 void sf2d_draw_rectangle_internal(const sf2d_vertex_pos_col *vertices)
@@ -72,6 +67,7 @@ void sf2d_draw_rectangle_internal(const sf2d_vertex_pos_col *vertices)
     sf2d_setup_env_internal(vertices);
 
 	GPU_DrawArray(GPU_TRIANGLE_STRIP, 0, 4);
+	sf2d_frame_stats.draw_calls++;
 }
 
 void sf2d_draw_triangle_internal(const sf2d_vertex_pos_col *vertices)
@@ -79,6 +75,7 @@ void sf2d_draw_triangle_internal(const sf2d_vertex_pos_col *vertices)
     sf2d_setup_env_internal(vertices);
 
 	GPU_DrawArray(GPU_TRIANGLES, 0, 3);
+	sf2d_frame_stats.draw_calls++;
 }
 
 void sf2d_draw_rectangle(int x, int y, int w, int h, u32 color)
@@ -228,4 +225,5 @@ void sf2d_draw_fill_circle(int x, int y, int radius, u32 color)
 	sf2d_setup_env_internal(vertices);
 
 	GPU_DrawArray(GPU_TRIANGLE_FAN, 0, num_segments + 2);
+	sf2d_frame_stats.draw_calls++;
 }
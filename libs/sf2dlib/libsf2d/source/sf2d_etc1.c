@@ -0,0 +1,280 @@
+#include <string.h>
+#include "sf2d.h"
+#include "sf2d_etc1.h"
+
+/*
+ * A block is a 64-bit little-endian word. The upper half holds the base
+ * colors of its two sub-blocks (4x2 or 2x4 texels, depending on the flip bit),
+ * either as two 4-bit colors or as a 5-bit color and a 3-bit signed
+ * difference, and the modifier table of each sub-block. The lower half holds
+ * a 2-bit modifier index for each texel, in columns: texel (x, y) has its low
+ * bit at x*4+y and its high bit 16 bits above.
+ */
+
+static const int modifiers[8][2] = {
+	{  2,   8 }, {  5,  17 }, {  9,  29 }, { 13,  42 },
+	{ 18,  60 }, { 24,  80 }, { 33, 106 }, { 47, 183 },
+};
+
+// Modifier of each 2-bit index: a, b, -a, -b
+#define MODIFIER(table, index) ((index) & 2 ? -modifiers[table][(index) & 1] : modifiers[table][(index) & 1])
+
+#define TO_BITS(v, n) (((v) * ((1 << (n)) - 1) + 127) / 255)
+
+static inline int clamp255(int v)
+{
+	return v < 0 ? 0 : v > 255 ? 255 : v;
+}
+
+static inline int in_sub_block(int x, int y, int flip, int sub)
+{
+	return (flip ? y >> 1 : x >> 1) == sub;
+}
+
+typedef struct {
+	int table;
+	u32 indices; // 2 bits per texel, at (x*4+y)*2
+	int error;
+} sub_block_fit;
+
+// Finds the modifier table and indices of a sub-block with the best error for a base color
+static void fit_sub_block(const u8 texels[16][4], int flip, int sub, const int base[3], sub_block_fit *fit)
+{
+	int t, x, y, i, c;
+
+	fit->error = 0x7FFFFFFF;
+	for (t = 0; t < 8; t++) {
+		int error = 0;
+		u32 indices = 0;
+		for (x = 0; x < 4; x++) {
+			for (y = 0; y < 4; y++) {
+				if (!in_sub_block(x, y, flip, sub)) continue;
+				const u8 *texel = texels[y * 4 + x];
+				int best = 0x7FFFFFFF, best_index = 0;
+				for (i = 0; i < 4; i++) {
+					int e = 0, m = MODIFIER(t, i);
+					for (c = 0; c < 3; c++) {
+						int d = clamp255(base[c] + m) - texel[c];
+						e += d * d;
+					}
+					if (e < best) {
+						best = e;
+						best_index = i;
+					}
+				}
+				error += best;
+				indices |= (u32)best_index << ((x * 4 + y) * 2);
+			}
+		}
+		if (error < fit->error) {
+			fit->table = t;
+			fit->indices = indices;
+			fit->error = error;
+		}
+	}
+}
+
+// Whether the second color of the differential mode is within 3 bits of the first one
+static inline int diff_fits(u32 q[2][3])
+{
+	int c;
+	for (c = 0; c < 3; c++) {
+		int d = (int)q[1][c] - (int)q[0][c];
+		if (d < -4 || d > 3) return 0;
+	}
+	return 1;
+}
+
+static inline int expand_bits(u32 q, int bits)
+{
+	return bits == 4 ? q * 17 : (q << 3) | (q >> 2);
+}
+
+/*
+ * The average color of a sub-block is rarely the best base color: the
+ * modifiers are symmetric, and clamped. Tries it moved by one step of the
+ * quantization towards black and white as well, and keeps the best one.
+ */
+static void fit_base_color(const u8 texels[16][4], int flip, int sub, u32 q[3], int bits, sub_block_fit *fit)
+{
+	int max = (1 << bits) - 1;
+	u32 best_q[3];
+	int step, c;
+
+	memcpy(best_q, q, sizeof(best_q));
+	fit->error = 0x7FFFFFFF;
+	for (step = -1; step <= 1; step++) {
+		int base[3];
+		u32 moved[3];
+		sub_block_fit candidate;
+		for (c = 0; c < 3; c++) {
+			int v = (int)q[c] + step;
+			moved[c] = v < 0 ? 0 : v > max ? max : v;
+			base[c] = expand_bits(moved[c], bits);
+		}
+		fit_sub_block(texels, flip, sub, base, &candidate);
+		if (candidate.error < fit->error) {
+			*fit = candidate;
+			memcpy(best_q, moved, sizeof(best_q));
+		}
+	}
+	memcpy(q, best_q, sizeof(best_q));
+}
+
+static u64 encode_block(const u8 texels[16][4])
+{
+	u64 best_block = 0;
+	int best_error = 0x7FFFFFFF;
+	int flip, sub, x, y, c;
+
+	for (flip = 0; flip < 2; flip++) {
+		int average[2][3] = {{ 0 }};
+		for (x = 0; x < 4; x++) {
+			for (y = 0; y < 4; y++) {
+				sub = flip ? y >> 1 : x >> 1;
+				for (c = 0; c < 3; c++)
+					average[sub][c] += texels[y * 4 + x][c];
+			}
+		}
+
+		// Individual mode: two 4-bit colors, then differential mode if the 5-bit colors are close enough
+		int diff;
+		for (diff = 0; diff < 2; diff++) {
+			int bits = diff ? 5 : 4;
+			u32 q[2][3], refined[2][3];
+			sub_block_fit fit[2], refined_fit[2];
+			for (sub = 0; sub < 2; sub++)
+				for (c = 0; c < 3; c++)
+					q[sub][c] = TO_BITS((average[sub][c] + 4) / 8, bits);
+			if (diff && !diff_fits(q)) continue;
+
+			memcpy(refined, q, sizeof(q));
+			for (sub = 0; sub < 2; sub++)
+				fit_base_color(texels, flip, sub, refined[sub], bits, &refined_fit[sub]);
+			if (!diff || diff_fits(refined)) {
+				memcpy(q, refined, sizeof(q));
+				memcpy(fit, refined_fit, sizeof(fit));
+			} else {
+				// The refined colors are too far apart for the differential mode
+				for (sub = 0; sub < 2; sub++) {
+					int base[3];
+					for (c = 0; c < 3; c++)
+						base[c] = expand_bits(q[sub][c], bits);
+					fit_sub_block(texels, flip, sub, base, &fit[sub]);
+				}
+			}
+			if (fit[0].error + fit[1].error >= best_error) continue;
+			best_error = fit[0].error + fit[1].error;
+
+			u32 high, low = 0;
+			if (diff) {
+				high = q[0][0] << 27 | ((q[1][0] - q[0][0]) & 7) << 24
+					| q[0][1] << 19 | ((q[1][1] - q[0][1]) & 7) << 16
+					| q[0][2] << 11 | ((q[1][2] - q[0][2]) & 7) << 8;
+			} else {
+				high = q[0][0] << 28 | q[1][0] << 24 | q[0][1] << 20 | q[1][1] << 16 | q[0][2] << 12 | q[1][2] << 8;
+			}
+			high |= (u32)fit[0].table << 5 | fit[1].table << 2 | diff << 1 | flip;
+
+			u32 indices = fit[0].indices | fit[1].indices;
+			int i;
+			for (i = 0; i < 16; i++) {
+				u32 index = (indices >> (i * 2)) & 3;
+				low |= (index >> 1) << (16 + i) | (index & 1) << i;
+			}
+			best_block = (u64)high << 32 | low;
+		}
+	}
+
+	return best_block;
+}
+
+static u64 encode_alpha(const u8 texels[16][4])
+{
+	u64 alpha = 0;
+	int x, y;
+
+	for (x = 0; x < 4; x++)
+		for (y = 0; y < 4; y++)
+			alpha |= (u64)TO_BITS(texels[y * 4 + x][3], 4) << ((x * 4 + y) * 4);
+	return alpha;
+}
+
+// Offset of the block of a texel, in blocks; sy counts the rows from the bottom
+static inline u32 block_index(int sx, int sy, int pow2_w)
+{
+	return ((sy >> 3) * (pow2_w >> 3) + (sx >> 3)) * 4 + ((sy >> 2) & 1) * 2 + ((sx >> 2) & 1);
+}
+
+void sf2d_etc1_encode_texture(sf2d_texture *texture, const void *rgba, int pitch)
+{
+	int alpha = texture->pixel_format == TEXFMT_ETC1A4;
+	int block_size = alpha ? 16 : 8;
+	int bx, by, x, y;
+
+	if (texture->pixel_format != TEXFMT_ETC1 && !alpha) return;
+
+	// Blocks outside of the image are left empty; the texels of the image edges are repeated in the others
+	for (by = 0; by < texture->pow2_h; by += 4) {
+		if (texture->pow2_h - by - 4 >= texture->height) continue;
+		for (bx = 0; bx < texture->width; bx += 4) {
+			u8 texels[16][4];
+			for (y = 0; y < 4; y++) {
+				int iy = texture->pow2_h - 1 - (by + y);
+				if (iy >= texture->height) iy = texture->height - 1;
+				for (x = 0; x < 4; x++) {
+					int ix = bx + x < texture->width ? bx + x : texture->width - 1;
+					memcpy(texels[y * 4 + x], (const u8 *)rgba + iy * pitch + ix * 4, 4);
+				}
+			}
+
+			u8 *block = (u8 *)texture->data + block_index(bx, by, texture->pow2_w) * block_size;
+			u64 v;
+			if (alpha) {
+				v = encode_alpha(texels);
+				memcpy(block, &v, 8);
+				block += 8;
+			}
+			v = encode_block(texels);
+			memcpy(block, &v, 8);
+		}
+	}
+	texture->tiled = 1;
+}
+
+void sf2d_etc1_decode_texel(const void *data, int pow2_w, int pow2_h, int alpha, int x, int y, u8 rgba[4])
+{
+	int sy = pow2_h - 1 - y;
+	const u8 *block = (const u8 *)data + block_index(x, sy, pow2_w) * (alpha ? 16 : 8);
+	int bx = x & 3, by = sy & 3;
+	int i = bx * 4 + by;
+	u64 v;
+
+	if (alpha) {
+		memcpy(&v, block, 8);
+		rgba[3] = ((v >> (i * 4)) & 0xF) * 17;
+		block += 8;
+	} else {
+		rgba[3] = 255;
+	}
+	memcpy(&v, block, 8);
+
+	u32 high = v >> 32, low = v;
+	int flip = high & 1, diff = (high >> 1) & 1;
+	int sub = flip ? by >> 1 : bx >> 1;
+	int table = (high >> (sub ? 2 : 5)) & 7;
+	int index = ((low >> (16 + i)) & 1) << 1 | ((low >> i) & 1);
+	int c;
+
+	for (c = 0; c < 3; c++) {
+		int shift = 27 - c * 8, base;
+		if (diff) {
+			int q = (high >> shift) & 0x1F;
+			if (sub) q += (s32)((high >> (shift - 3)) << 29) >> 29; // sign-extended 3 bits
+			base = (q << 3) | (q >> 2);
+		} else {
+			base = ((high >> (sub ? shift - 3 : shift + 1)) & 0xF) * 17;
+		}
+		rgba[c] = clamp255(base + MODIFIER(table, index));
+	}
+}
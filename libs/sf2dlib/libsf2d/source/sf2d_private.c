@@ -9,7 +9,7 @@
 //stolen from staplebutt
 void GPU_SetDummyTexEnv(u8 num)
 {
-	GPU_SetTexEnv(num,
+	sf2d_set_texenv(num,
 		GPU_TEVSOURCES(GPU_PREVIOUS, 0, 0),
 		GPU_TEVSOURCES(GPU_PREVIOUS, 0, 0),
 		GPU_TEVOPERANDS(0,0,0),
@@ -0,0 +1,150 @@
+#include <string.h>
+#include "sf2d.h"
+#include "sf2d_private.h"
+
+/*
+ * Shadow copy of the GPU state programmed through sf2d, used to skip the
+ * commands that wouldn't change anything. It's invalidated whenever the GPU
+ * is reset (initialization, return from the home menu).
+ */
+typedef struct {
+	u16 rgb_sources;
+	u16 alpha_sources;
+	u16 rgb_operands;
+	u16 alpha_operands;
+	GPU_COMBINEFUNC rgb_combine;
+	GPU_COMBINEFUNC alpha_combine;
+	u32 constant_color;
+} sf2d_texenv_state;
+
+typedef struct {
+	u32 *data;
+	u16 width;
+	u16 height;
+	u32 param;
+	GPU_TEXCOLOR color_type;
+} sf2d_texture_state;
+
+static struct {
+	u8 texenv_valid;  // one bit per TexEnv stage
+	sf2d_texenv_state texenv[6];
+	int texunits_valid;
+	GPU_TEXUNIT texunits;
+	int texture_valid;
+	sf2d_texture_state texture;  // texture unit 0
+	int attributes_valid;
+	sf2d_vertex_format attributes;
+	int projection_valid;
+	float projection[4*4];
+} state;
+
+void sf2d_state_invalidate()
+{
+	memset(&state, 0, sizeof(state));
+}
+
+void sf2d_state_start_frame()
+{
+	// Enabling the texture units also clears the texture cache, which
+	// has to be done once per frame since the textures may have changed
+	state.texunits_valid = 0;
+}
+
+void sf2d_set_texenv(u8 id, u16 rgbSources, u16 alphaSources, u16 rgbOperands, u16 alphaOperands, GPU_COMBINEFUNC rgbCombine, GPU_COMBINEFUNC alphaCombine, u32 constantColor)
+{
+	sf2d_texenv_state texenv = {
+		rgbSources, alphaSources,
+		rgbOperands, alphaOperands,
+		rgbCombine, alphaCombine,
+		constantColor
+	};
+
+	if ((state.texenv_valid & BIT(id)) && memcmp(&state.texenv[id], &texenv, sizeof(texenv)) == 0) {
+		sf2d_frame_stats.commands_skipped++;
+		return;
+	}
+
+	GPU_SetTexEnv(id, rgbSources, alphaSources, rgbOperands, alphaOperands, rgbCombine, alphaCombine, constantColor);
+	sf2d_frame_stats.commands_emitted++;
+
+	state.texenv[id] = texenv;
+	state.texenv_valid |= BIT(id);
+}
+
+void sf2d_set_texture_enable(GPU_TEXUNIT units)
+{
+	if (state.texunits_valid && state.texunits == units) {
+		sf2d_frame_stats.commands_skipped++;
+		return;
+	}
+
+	GPU_SetTextureEnable(units);
+	sf2d_frame_stats.commands_emitted++;
+
+	state.texunits = units;
+	state.texunits_valid = 1;
+}
+
+void sf2d_set_texture(GPU_TEXUNIT unit, u32 *data, u16 width, u16 height, u32 param, GPU_TEXCOLOR colorType)
+{
+	sf2d_texture_state texture = {data, width, height, param, colorType};
+
+	// Only the texture unit 0 is tracked, it's the only one sf2d uses
+	if (unit == GPU_TEXUNIT0) {
+		// Compared field by field, the padding of the structure isn't initialized
+		if (state.texture_valid && state.texture.data == data && state.texture.width == width
+			&& state.texture.height == height && state.texture.param == param && state.texture.color_type == colorType) {
+			sf2d_frame_stats.commands_skipped++;
+			return;
+		}
+		state.texture = texture;
+		state.texture_valid = 1;
+	}
+
+	GPU_SetTexture(unit, data, width, height, param, colorType);
+	sf2d_frame_stats.commands_emitted++;
+}
+
+void sf2d_set_attribute_buffers(sf2d_vertex_format format, const void *vertices)
+{
+	// Same layout as before: only the base address has to change, in a single register write
+	if (state.attributes_valid && state.attributes == format) {
+		GPUCMD_AddWrite(GPUREG_ATTRIBBUFFERS_LOC, (u32)(osConvertVirtToPhys(vertices) >> 3));
+		sf2d_frame_stats.commands_emitted++;
+		return;
+	}
+
+	u64 formats = format == SF2D_VERTEX_POS_TEX
+		? GPU_ATTRIBFMT(0, 3, GPU_FLOAT) | GPU_ATTRIBFMT(1, 2, GPU_FLOAT)
+		: GPU_ATTRIBFMT(0, 3, GPU_FLOAT) | GPU_ATTRIBFMT(1, 4, GPU_UNSIGNED_BYTE);
+
+	GPU_SetAttributeBuffers(
+		2, // number of attributes
+		(u32*)osConvertVirtToPhys(vertices),
+		formats,
+		0xFFFC, //0b1100
+		0x10,
+		1, //number of buffers
+		(u32[]){0x0}, // buffer offsets (placeholders)
+		(u64[]){0x10}, // attribute permutations for each buffer
+		(u8[]){2} // number of attributes for each buffer
+	);
+	sf2d_frame_stats.commands_emitted++;
+
+	state.attributes = format;
+	state.attributes_valid = 1;
+}
+
+void sf2d_set_projection(const float *m, u32 startreg)
+{
+	if (state.projection_valid && memcmp(state.projection, m, sizeof(state.projection)) == 0) {
+		sf2d_frame_stats.commands_skipped++;
+		return;
+	}
+
+	matrix_gpu_set_uniform(m, startreg);
+	sf2d_frame_stats.commands_emitted++;
+
+	memcpy(state.projection, m, sizeof(state.projection));
+	state.projection_valid = 1;
+}
@@ -3,6 +3,8 @@
 #include <math.h>
 #include "sf2d.h"
 #include "sf2d_private.h"
+#include "sf2d_tile.h"
+#include "sf2d_etc1.h"
 
 #ifndef M_PI
 #define M_PI (3.14159265358979323846)
@@ -22,11 +24,14 @@ static unsigned int nibbles_per_pixel(sf2d_texfmt format)
 	case TEXFMT_RGBA4:
 	case TEXFMT_IA8:
 		return 4;
+	case TEXFMT_I4:
 	case TEXFMT_A4:
+	case TEXFMT_ETC1:
 		return 1;
 	case TEXFMT_I8:
 	case TEXFMT_A8:
 	case TEXFMT_IA4:
+	case TEXFMT_ETC1A4:
 	default:
 		return 2;
 	}
@@ -34,7 +39,7 @@ static unsigned int nibbles_per_pixel(sf2d_texfmt format)
 
 static int calc_buffer_size(sf2d_texfmt pixel_format, int width, int height)
 {
-	return width * height * (nibbles_per_pixel(pixel_format)>>1);
+	return width * height * nibbles_per_pixel(pixel_format) / 2;
 }
 
 sf2d_texture *sf2d_create_texture(int width, int height, sf2d_texfmt pixel_format, sf2d_place place)
@@ -100,14 +105,15 @@ sf2d_texture *sf2d_create_texture(int width, int height, sf2d_texfmt pixel_forma
 sf2d_rendertarget *sf2d_create_rendertarget(int width, int height)
 {
 	sf2d_texture *tx = sf2d_create_texture(width, height, TEXFMT_RGBA8, SF2D_PLACE_RAM);
+	if (!tx) return NULL;
+
 	sf2d_rendertarget *rt = malloc(sizeof(*rt));
-	//memcpy(rt, tx, sizeof(*tx));
 	rt->texture = *tx;
 	free(tx);
-	//tx = * rt->texture;
-	//rt->projection
+	// The GPU renders in the tiled layout of the textures; the zeroed data is transparent in any layout
+	rt->texture.tiled = 1;
 
-	matrix_init_orthographic(rt->projection, 0.0f, width, height, 0.0f, 0.0f, 1.0f);
+	matrix_init_orthographic(rt->projection, 0.0f, rt->texture.pow2_w, rt->texture.pow2_h, 0.0f, 0.0f, 1.0f);
 	matrix_rotate_z(rt->projection, M_PI / 2.0f);
 
 	return rt;
@@ -116,11 +122,9 @@ sf2d_rendertarget *sf2d_create_rendertarget(int width, int height)
 void sf2d_free_texture(sf2d_texture *texture)
 {
 	if (texture) {
-		if (texture->place == SF2D_PLACE_RAM) {
-			linearFree(texture->data);
-		} else if (texture->place == SF2D_PLACE_VRAM) {
-			vramFree(texture->data);
-		}
+		// The frames the GPU hasn't rendered yet may use it
+		if (texture->place != SF2D_PLACE_TEMP)
+			sf2d_free_deferred(texture->data, texture->place);
 		free(texture);
 	}
 }
@@ -131,19 +135,13 @@ void sf2d_free_target(sf2d_rendertarget *target)
 	//free(target); // unnecessary since the texture is the start of the target struct
 }
 
-void sf2d_clear_target(sf2d_rendertarget *target, u32 color) {
-	if (color == 0) { // if fully transparent, take a shortcut
-		memset(target->texture.data, 0, target->texture.width * target->texture.height * 4);
-		sf2d_texture_tile32(&(target->texture));
-		return;
-	}
-
-	color = ((color>>24)&0x000000FF) | ((color>>8)&0x0000FF00) | ((color<<8)&0x00FF0000) | ((color<<24)&0xFF000000); // reverse byte order
-
-	int itarget = target->texture.width * target->texture.height;
-	for (int i = 0; i < itarget; i++) { memcpy(target->texture.data + i*4, &color, 4); }
+void sf2d_clear_target(sf2d_rendertarget *target, u32 color)
+{
+	sf2d_texture *texture = &target->texture;
 
-	sf2d_texture_tile32(&(target->texture));
+	// Every texel has the same value, so the fill doesn't depend on the tiling; RGBA8 texels are stored as ABGR.
+	// The frame the GPU is rendering may draw to it or use it, the fill waits for it instead of the CPU.
+	sf2d_fill_deferred(texture->data, (u32 *)((u8 *)texture->data + texture->data_size), __builtin_bswap32(color));
 }
 
 void sf2d_texture_tile32_hardware(sf2d_texture *texture, const void *data, int w, int h)
@@ -168,18 +166,15 @@ void sf2d_texture_tile32_hardware(sf2d_texture *texture, const void *data, int w
 
 void sf2d_fill_texture_from_RGBA8(sf2d_texture *dst, const void *rgba8, int source_w, int source_h)
 {
-	// TODO: add support for non-RGBA8 textures
-
-	u8 *tmp = linearAlloc((dst->pow2_w * dst->pow2_h)<<2);
-	int i, j;
-	for (i = 0; i < source_h; i++) {
-		for (j = 0; j < source_w; j++) {
-			((u32 *)tmp)[i*dst->pow2_w + j] = __builtin_bswap32(((u32 *)rgba8)[i*source_w + j]);
-		}
+	if (dst->pixel_format == TEXFMT_ETC1 || dst->pixel_format == TEXFMT_ETC1A4) {
+		sf2d_etc1_encode_texture(dst, rgba8, source_w * 4);
+	} else {
+		// Converted and tiled in one pass, without a copy of the image
+		sf2d_tile_convert_rect(dst->data, dst->pow2_w, dst->pow2_h, dst->pixel_format,
+			0, 0, source_w, source_h, rgba8, source_w * 4, SF2D_PIXEL_RGBA8);
+		dst->tiled = 1;
 	}
-	sf2d_texture_tile32_hardware(dst, tmp, dst->pow2_w, dst->pow2_h);
-	linearFree(tmp);
-
+	GSPGPU_FlushDataCache(dst->data, dst->data_size);
 }
 
 sf2d_texture *sf2d_create_texture_mem_RGBA8(const void *src_buffer, int src_w, int src_h, sf2d_texfmt pixel_format, sf2d_place place)
@@ -192,9 +187,12 @@ sf2d_texture *sf2d_create_texture_mem_RGBA8(const void *src_buffer, int src_w, i
 
 void sf2d_bind_texture(const sf2d_texture *texture, GPU_TEXUNIT unit)
 {
-	GPU_SetTextureEnable(unit);
+	// The quads batched so far use the previous texture
+	sf2d_batch_flush();
 
-	GPU_SetTexEnv(
+	sf2d_set_texture_enable(unit);
+
+	sf2d_set_texenv(
 		0,
 		GPU_TEVSOURCES(GPU_TEXTURE0, GPU_TEXTURE0, GPU_TEXTURE0),
 		GPU_TEVSOURCES(GPU_TEXTURE0, GPU_TEXTURE0, GPU_TEXTURE0),
@@ -204,7 +202,7 @@ void sf2d_bind_texture(const sf2d_texture *texture, GPU_TEXUNIT unit)
 		0xFFFFFFFF
 	);
 
-	GPU_SetTexture(
+	sf2d_set_texture(
 		unit,
 		(u32 *)osConvertVirtToPhys(texture->data),
 		texture->pow2_w,
@@ -216,9 +214,11 @@ void sf2d_bind_texture(const sf2d_texture *texture, GPU_TEXUNIT unit)
 
 void sf2d_bind_texture_color(const sf2d_texture *texture, GPU_TEXUNIT unit, u32 color)
 {
-	GPU_SetTextureEnable(unit);
+	sf2d_batch_flush();
+
+	sf2d_set_texture_enable(unit);
 
-	GPU_SetTexEnv(
+	sf2d_set_texenv(
 		0,
 		GPU_TEVSOURCES(GPU_TEXTURE0, GPU_CONSTANT, GPU_CONSTANT),
 		GPU_TEVSOURCES(GPU_TEXTURE0, GPU_CONSTANT, GPU_CONSTANT),
@@ -228,7 +228,7 @@ void sf2d_bind_texture_color(const sf2d_texture *texture, GPU_TEXUNIT unit, u32
 		color
 	);
 
-	GPU_SetTexture(
+	sf2d_set_texture(
 		unit,
 		(u32 *)osConvertVirtToPhys(texture->data),
 		texture->pow2_w,
@@ -238,11 +238,98 @@ void sf2d_bind_texture_color(const sf2d_texture *texture, GPU_TEXUNIT unit, u32
 	);
 }
 
+int sf2d_sdf_shift(float spread)
+{
+	// Sharpen the alpha ramp of the field (from 0 at the spread to 1/2 at the edge) to about one pixel
+	float sharpness = 2.0f * spread;
+	int shift = 0;
+	while (shift < SF2D_SDF_MAX_SHIFT && (1 << shift) * 1.4142f < sharpness) {
+		shift++;
+	}
+	return shift;
+}
+
+/*
+ * alpha = clamp((texture alpha - threshold) * 2^shift) * color alpha, with the
+ * threshold chosen so that the edge (alpha 0.5) stays in place. The SUBTRACT
+ * and ADD combiners clamp their result, which does the thresholding.
+ */
+void sf2d_bind_texture_sdf(const sf2d_texture *texture, GPU_TEXUNIT unit, u32 color, int shift)
+{
+	sf2d_batch_flush();
+
+	sf2d_set_texture_enable(unit);
+
+	u32 threshold = 128 - (128 >> shift);
+	sf2d_set_texenv(
+		0,
+		GPU_TEVSOURCES(GPU_CONSTANT, GPU_CONSTANT, GPU_CONSTANT),
+		GPU_TEVSOURCES(GPU_TEXTURE0, GPU_CONSTANT, GPU_CONSTANT),
+		GPU_TEVOPERANDS(0, 0, 0),
+		GPU_TEVOPERANDS(0, 0, 0),
+		GPU_REPLACE, GPU_SUBTRACT,
+		(color & 0x00FFFFFF) | (threshold << 24)
+	);
+
+	int i;
+	for (i = 1; i <= SF2D_SDF_MAX_SHIFT; i++) {
+		if (i <= shift) {
+			sf2d_set_texenv(
+				i,
+				GPU_TEVSOURCES(GPU_PREVIOUS, GPU_PREVIOUS, GPU_PREVIOUS),
+				GPU_TEVSOURCES(GPU_PREVIOUS, GPU_PREVIOUS, GPU_PREVIOUS),
+				GPU_TEVOPERANDS(0, 0, 0),
+				GPU_TEVOPERANDS(0, 0, 0),
+				GPU_REPLACE, GPU_ADD,
+				0xFFFFFFFF
+			);
+		} else {
+			GPU_SetDummyTexEnv(i);
+		}
+	}
+
+	sf2d_set_texenv(
+		SF2D_SDF_MAX_SHIFT + 1,
+		GPU_TEVSOURCES(GPU_PREVIOUS, GPU_CONSTANT, GPU_CONSTANT),
+		GPU_TEVSOURCES(GPU_PREVIOUS, GPU_CONSTANT, GPU_CONSTANT),
+		GPU_TEVOPERANDS(0, 0, 0),
+		GPU_TEVOPERANDS(0, 0, 0),
+		GPU_REPLACE, GPU_MODULATE,
+		color
+	);
+
+	// The quads have margins for the field, which overlap the neighbor glyphs:
+	// their transparent fragments mustn't write the depth buffer
+	GPU_SetAlphaTest(true, GPU_GREATER, 0x00);
+
+	sf2d_set_texture(
+		unit,
+		(u32 *)osConvertVirtToPhys(texture->data),
+		texture->pow2_w,
+		texture->pow2_h,
+		texture->params,
+		texture->pixel_format
+	);
+}
+
+// The other draws only set the first stage
+void sf2d_unbind_texture_sdf()
+{
+	GPU_SetAlphaTest(false, GPU_ALWAYS, 0x00);
+
+	int i;
+	for (i = 1; i <= SF2D_SDF_MAX_SHIFT + 1; i++) {
+		GPU_SetDummyTexEnv(i);
+	}
+}
+
 void sf2d_bind_texture_parameters(const sf2d_texture *texture, GPU_TEXUNIT unit, unsigned int params)
 {
-	GPU_SetTextureEnable(unit);
+	sf2d_batch_flush();
+
+	sf2d_set_texture_enable(unit);
 
-	GPU_SetTexEnv(
+	sf2d_set_texenv(
 		0,
 		GPU_TEVSOURCES(GPU_TEXTURE0, GPU_TEXTURE0, GPU_TEXTURE0),
 		GPU_TEVSOURCES(GPU_TEXTURE0, GPU_TEXTURE0, GPU_TEXTURE0),
@@ -252,7 +339,7 @@ void sf2d_bind_texture_parameters(const sf2d_texture *texture, GPU_TEXUNIT unit,
 		0xFFFFFFFF
 	);
 
-	GPU_SetTexture(
+	sf2d_set_texture(
 		unit,
 		(u32 *)osConvertVirtToPhys(texture->data),
 		texture->pow2_w,
@@ -272,9 +359,9 @@ int sf2d_texture_get_params(const sf2d_texture *texture)
 	return texture->params;
 }
 
-static inline void sf2d_draw_texture_generic(const sf2d_texture *texture, int x, int y)
+static inline void sf2d_draw_texture_generic(const sf2d_texture *texture, int x, int y, sf2d_batch_env env, u32 color)
 {
-	sf2d_vertex_pos_tex *vertices = sf2d_pool_memalign(4 * sizeof(sf2d_vertex_pos_tex), 8);
+	sf2d_vertex_pos_tex *vertices = sf2d_batch_add_quad(texture, texture->params, env, color);
 	if (!vertices) return;
 
 	int w = texture->width;
@@ -292,37 +379,21 @@ static inline void sf2d_draw_texture_generic(const sf2d_texture *texture, int x,
 	vertices[1].texcoord = (sf2d_vector_2f){u,    0.0f};
 	vertices[2].texcoord = (sf2d_vector_2f){0.0f, v};
 	vertices[3].texcoord = (sf2d_vector_2f){u,    v};
-
-	GPU_SetAttributeBuffers(
-		2, // number of attributes
-		(u32*)osConvertVirtToPhys(vertices),
-		GPU_ATTRIBFMT(0, 3, GPU_FLOAT) | GPU_ATTRIBFMT(1, 2, GPU_FLOAT),
-		0xFFFC, //0b1100
-		0x10,
-		1, //number of buffers
-		(u32[]){0x0}, // buffer offsets (placeholders)
-		(u64[]){0x10}, // attribute permutations for each buffer
-		(u8[]){2} // number of attributes for each buffer
-	);
-
-	GPU_DrawArray(GPU_TRIANGLE_STRIP, 0, 4);
 }
 
 void sf2d_draw_texture(const sf2d_texture *texture, int x, int y)
 {
-	sf2d_bind_texture(texture, GPU_TEXUNIT0);
-	sf2d_draw_texture_generic(texture, x, y);
+	sf2d_draw_texture_generic(texture, x, y, SF2D_BATCH_REPLACE, 0xFFFFFFFF);
 }
 
 void sf2d_draw_texture_blend(const sf2d_texture *texture, int x, int y, u32 color)
 {
-	sf2d_bind_texture_color(texture, GPU_TEXUNIT0, color);
-	sf2d_draw_texture_generic(texture, x, y);
+	sf2d_draw_texture_generic(texture, x, y, SF2D_BATCH_MODULATE, color);
 }
 
-static inline void sf2d_draw_texture_rotate_hotspot_generic(const sf2d_texture *texture, int x, int y, float rad, float center_x, float center_y)
+static inline void sf2d_draw_texture_rotate_hotspot_generic(const sf2d_texture *texture, int x, int y, float rad, float center_x, float center_y, sf2d_batch_env env, u32 color)
 {
-	sf2d_vertex_pos_tex *vertices = sf2d_pool_memalign(4 * sizeof(sf2d_vertex_pos_tex), 8);
+	sf2d_vertex_pos_tex *vertices = sf2d_batch_add_quad(texture, texture->params, env, color);
 	if (!vertices) return;
 
 	const float w = texture->width;
@@ -361,32 +432,16 @@ static inline void sf2d_draw_texture_rotate_hotspot_generic(const sf2d_texture *
 		vertices[i].position.x = _x*c - _y*s + x;
 		vertices[i].position.y = _x*s + _y*c + y;
 	}
-
-	GPU_SetAttributeBuffers(
-		2, // number of attributes
-		(u32*)osConvertVirtToPhys(vertices),
-		GPU_ATTRIBFMT(0, 3, GPU_FLOAT) | GPU_ATTRIBFMT(1, 2, GPU_FLOAT),
-		0xFFFC, //0b1100
-		0x10,
-		1, //number of buffers
-		(u32[]){0x0}, // buffer offsets (placeholders)
-		(u64[]){0x10}, // attribute permutations for each buffer
-		(u8[]){2} // number of attributes for each buffer
-	);
-
-	GPU_DrawArray(GPU_TRIANGLE_STRIP, 0, 4);
 }
 
 void sf2d_draw_texture_rotate_hotspot(const sf2d_texture *texture, int x, int y, float rad, float center_x, float center_y)
 {
-	sf2d_bind_texture(texture, GPU_TEXUNIT0);
-	sf2d_draw_texture_rotate_hotspot_generic(texture, x, y, rad, center_x, center_y);
+	sf2d_draw_texture_rotate_hotspot_generic(texture, x, y, rad, center_x, center_y, SF2D_BATCH_REPLACE, 0xFFFFFFFF);
 }
 
 void sf2d_draw_texture_rotate_hotspot_blend(const sf2d_texture *texture, int x, int y, float rad, float center_x, float center_y, u32 color)
 {
-	sf2d_bind_texture_color(texture, GPU_TEXUNIT0, color);
-	sf2d_draw_texture_rotate_hotspot_generic(texture, x, y, rad, center_x, center_y);
+	sf2d_draw_texture_rotate_hotspot_generic(texture, x, y, rad, center_x, center_y, SF2D_BATCH_MODULATE, color);
 }
 
 void sf2d_draw_texture_rotate(const sf2d_texture *texture, int x, int y, float rad)
@@ -404,9 +459,9 @@ void sf2d_draw_texture_rotate_blend(const sf2d_texture *texture, int x, int y, f
 		color);
 }
 
-static inline void sf2d_draw_texture_rotate_scale_hotspot_generic(const sf2d_texture *texture, int x, int y, float rad, float scale_x, float scale_y, float center_x, float center_y)
+static inline void sf2d_draw_texture_rotate_scale_hotspot_generic(const sf2d_texture *texture, int x, int y, float rad, float scale_x, float scale_y, float center_x, float center_y, sf2d_batch_env env, u32 color)
 {
-	sf2d_vertex_pos_tex *vertices = sf2d_pool_memalign(4 * sizeof(sf2d_vertex_pos_tex), 8);
+	sf2d_vertex_pos_tex *vertices = sf2d_batch_add_quad(texture, texture->params, env, color);
 	if (!vertices) return;
 
 	const float w = texture->width;
@@ -425,7 +480,7 @@ static inline void sf2d_draw_texture_rotate_scale_hotspot_generic(const sf2d_tex
 	vertices[2].position.z = SF2D_DEFAULT_DEPTH;
 
 	vertices[3].position.x = (w - center_x) * scale_x;
-	vertices[3].position.y = h - center_y * scale_y;
+	vertices[3].position.y = (h - center_y) * scale_y;
 	vertices[3].position.z = SF2D_DEFAULT_DEPTH;
 
 	float u = w/(float)texture->pow2_w;
@@ -445,37 +500,21 @@ static inline void sf2d_draw_texture_rotate_scale_hotspot_generic(const sf2d_tex
 		vertices[i].position.x = _x*c - _y*s + x;
 		vertices[i].position.y = _x*s + _y*c + y;
 	}
-
-	GPU_SetAttributeBuffers(
-		2, // number of attributes
-		(u32*)osConvertVirtToPhys(vertices),
-		GPU_ATTRIBFMT(0, 3, GPU_FLOAT) | GPU_ATTRIBFMT(1, 2, GPU_FLOAT),
-		0xFFFC, //0b1100
-		0x10,
-		1, //number of buffers
-		(u32[]){0x0}, // buffer offsets (placeholders)
-		(u64[]){0x10}, // attribute permutations for each buffer
-		(u8[]){2} // number of attributes for each buffer
-	);
-
-	GPU_DrawArray(GPU_TRIANGLE_STRIP, 0, 4);
 }
 
 void sf2d_draw_texture_rotate_scale_hotspot(const sf2d_texture *texture, int x, int y, float rad, float scale_x, float scale_y, float center_x, float center_y)
 {
-    sf2d_bind_texture(texture, GPU_TEXUNIT0);
-	sf2d_draw_texture_rotate_scale_hotspot_generic(texture, x, y, rad, scale_x, scale_y, center_x, center_y);
+	sf2d_draw_texture_rotate_scale_hotspot_generic(texture, x, y, rad, scale_x, scale_y, center_x, center_y, SF2D_BATCH_REPLACE, 0xFFFFFFFF);
 }
 
 void sf2d_draw_texture_rotate_scale_hotspot_blend(const sf2d_texture *texture, int x, int y, float rad, float scale_x, float scale_y, float center_x, float center_y, u32 color)
 {
-    sf2d_bind_texture_color(texture, GPU_TEXUNIT0, color);
-	sf2d_draw_texture_rotate_scale_hotspot_generic(texture, x, y, rad, scale_x, scale_y, center_x, center_y);
+	sf2d_draw_texture_rotate_scale_hotspot_generic(texture, x, y, rad, scale_x, scale_y, center_x, center_y, SF2D_BATCH_MODULATE, color);
 }
 
-static inline void sf2d_draw_texture_part_generic(const sf2d_texture *texture, int x, int y, int tex_x, int tex_y, int tex_w, int tex_h)
+static inline void sf2d_draw_texture_part_generic(const sf2d_texture *texture, int x, int y, int tex_x, int tex_y, int tex_w, int tex_h, sf2d_batch_env env, u32 color)
 {
-	sf2d_vertex_pos_tex *vertices = sf2d_pool_memalign(4 * sizeof(sf2d_vertex_pos_tex), 8);
+	sf2d_vertex_pos_tex *vertices = sf2d_batch_add_quad(texture, texture->params, env, color);
 	if (!vertices) return;
 
 	vertices[0].position = (sf2d_vector_3f){(float)x,       (float)y,       SF2D_DEFAULT_DEPTH};
@@ -492,37 +531,21 @@ static inline void sf2d_draw_texture_part_generic(const sf2d_texture *texture, i
 	vertices[1].texcoord = (sf2d_vector_2f){u1, v0};
 	vertices[2].texcoord = (sf2d_vector_2f){u0, v1};
 	vertices[3].texcoord = (sf2d_vector_2f){u1, v1};
-
-	GPU_SetAttributeBuffers(
-		2, // number of attributes
-		(u32*)osConvertVirtToPhys(vertices),
-		GPU_ATTRIBFMT(0, 3, GPU_FLOAT) | GPU_ATTRIBFMT(1, 2, GPU_FLOAT),
-		0xFFFC, //0b1100
-		0x10,
-		1, //number of buffers
-		(u32[]){0x0}, // buffer offsets (placeholders)
-		(u64[]){0x10}, // attribute permutations for each buffer
-		(u8[]){2} // number of attributes for each buffer
-	);
-
-	GPU_DrawArray(GPU_TRIANGLE_STRIP, 0, 4);
 }
 
 void sf2d_draw_texture_part(const sf2d_texture *texture, int x, int y, int tex_x, int tex_y, int tex_w, int tex_h)
 {
-	sf2d_bind_texture(texture, GPU_TEXUNIT0);
-	sf2d_draw_texture_part_generic(texture, x, y, tex_x, tex_y, tex_w, tex_h);
+	sf2d_draw_texture_part_generic(texture, x, y, tex_x, tex_y, tex_w, tex_h, SF2D_BATCH_REPLACE, 0xFFFFFFFF);
 }
 
 void sf2d_draw_texture_part_blend(const sf2d_texture *texture, int x, int y, int tex_x, int tex_y, int tex_w, int tex_h, u32 color)
 {
-	sf2d_bind_texture_color(texture, GPU_TEXUNIT0, color);
-	sf2d_draw_texture_part_generic(texture, x, y, tex_x, tex_y, tex_w, tex_h);
+	sf2d_draw_texture_part_generic(texture, x, y, tex_x, tex_y, tex_w, tex_h, SF2D_BATCH_MODULATE, color);
 }
 
-static inline void sf2d_draw_texture_scale_generic(const sf2d_texture *texture, int x, int y, float x_scale, float y_scale)
+static inline void sf2d_draw_texture_scale_generic(const sf2d_texture *texture, int x, int y, float x_scale, float y_scale, sf2d_batch_env env, u32 color)
 {
-	sf2d_vertex_pos_tex *vertices = sf2d_pool_memalign(4 * sizeof(sf2d_vertex_pos_tex), 8);
+	sf2d_vertex_pos_tex *vertices = sf2d_batch_add_quad(texture, texture->params, env, color);
 	if (!vertices) return;
 
 	int ws = texture->width * x_scale;
@@ -540,37 +563,21 @@ static inline void sf2d_draw_texture_scale_generic(const sf2d_texture *texture,
 	vertices[1].texcoord = (sf2d_vector_2f){u,    0.0f};
 	vertices[2].texcoord = (sf2d_vector_2f){0.0f, v};
 	vertices[3].texcoord = (sf2d_vector_2f){u,    v};
-
-	GPU_SetAttributeBuffers(
-		2, // number of attributes
-		(u32*)osConvertVirtToPhys(vertices),
-		GPU_ATTRIBFMT(0, 3, GPU_FLOAT) | GPU_ATTRIBFMT(1, 2, GPU_FLOAT),
-		0xFFFC, //0b1100
-		0x10,
-		1, //number of buffers
-		(u32[]){0x0}, // buffer offsets (placeholders)
-		(u64[]){0x10}, // attribute permutations for each buffer
-		(u8[]){2} // number of attributes for each buffer
-	);
-
-	GPU_DrawArray(GPU_TRIANGLE_STRIP, 0, 4);
 }
 
 void sf2d_draw_texture_scale(const sf2d_texture *texture, int x, int y, float x_scale, float y_scale)
 {
-	sf2d_bind_texture(texture, GPU_TEXUNIT0);
-	sf2d_draw_texture_scale_generic(texture, x, y, x_scale, y_scale);
+	sf2d_draw_texture_scale_generic(texture, x, y, x_scale, y_scale, SF2D_BATCH_REPLACE, 0xFFFFFFFF);
 }
 
 void sf2d_draw_texture_scale_blend(const sf2d_texture *texture, int x, int y, float x_scale, float y_scale, u32 color)
 {
-	sf2d_bind_texture_color(texture, GPU_TEXUNIT0, color);
-	sf2d_draw_texture_scale_generic(texture, x, y, x_scale, y_scale);
+	sf2d_draw_texture_scale_generic(texture, x, y, x_scale, y_scale, SF2D_BATCH_MODULATE, color);
 }
 
-static inline void sf2d_draw_texture_part_scale_generic(const sf2d_texture *texture, float x, float y, float tex_x, float tex_y, float tex_w, float tex_h, float x_scale, float y_scale)
+static inline void sf2d_draw_texture_part_scale_generic(const sf2d_texture *texture, float x, float y, float tex_x, float tex_y, float tex_w, float tex_h, float x_scale, float y_scale, sf2d_batch_env env, u32 color)
 {
-	sf2d_vertex_pos_tex *vertices = sf2d_pool_memalign(4 * sizeof(sf2d_vertex_pos_tex), 8);
+	sf2d_vertex_pos_tex *vertices = sf2d_batch_add_quad(texture, texture->params, env, color);
 	if (!vertices) return;
 
 	float u0 = tex_x/(float)texture->pow2_w;
@@ -590,37 +597,26 @@ static inline void sf2d_draw_texture_part_scale_generic(const sf2d_texture *text
 	vertices[1].position = (sf2d_vector_3f){(float)x+tex_w, (float)y,       SF2D_DEFAULT_DEPTH};
 	vertices[2].position = (sf2d_vector_3f){(float)x,       (float)y+tex_h, SF2D_DEFAULT_DEPTH};
 	vertices[3].position = (sf2d_vector_3f){(float)x+tex_w, (float)y+tex_h, SF2D_DEFAULT_DEPTH};
-
-	GPU_SetAttributeBuffers(
-		2, // number of attributes
-		(u32*)osConvertVirtToPhys(vertices),
-		GPU_ATTRIBFMT(0, 3, GPU_FLOAT) | GPU_ATTRIBFMT(1, 2, GPU_FLOAT),
-		0xFFFC, //0b1100
-		0x10,
-		1, //number of buffers
-		(u32[]){0x0}, // buffer offsets (placeholders)
-		(u64[]){0x10}, // attribute permutations for each buffer
-		(u8[]){2} // number of attributes for each buffer
-	);
-
-	GPU_DrawArray(GPU_TRIANGLE_STRIP, 0, 4);
 }
 
 void sf2d_draw_texture_part_scale(const sf2d_texture *texture, float x, float y, float tex_x, float tex_y, float tex_w, float tex_h, float x_scale, float y_scale)
 {
-	sf2d_bind_texture(texture, GPU_TEXUNIT0);
-	sf2d_draw_texture_part_scale_generic(texture, x, y, tex_x, tex_y, tex_w, tex_h, x_scale, y_scale);
+	sf2d_draw_texture_part_scale_generic(texture, x, y, tex_x, tex_y, tex_w, tex_h, x_scale, y_scale, SF2D_BATCH_REPLACE, 0xFFFFFFFF);
 }
 
 void sf2d_draw_texture_part_scale_blend(const sf2d_texture *texture, float x, float y, float tex_x, float tex_y, float tex_w, float tex_h, float x_scale, float y_scale, u32 color)
 {
-	sf2d_bind_texture_color(texture, GPU_TEXUNIT0, color);
-	sf2d_draw_texture_part_scale_generic(texture, x, y, tex_x, tex_y, tex_w, tex_h, x_scale, y_scale);
+	sf2d_draw_texture_part_scale_generic(texture, x, y, tex_x, tex_y, tex_w, tex_h, x_scale, y_scale, SF2D_BATCH_MODULATE, color);
+}
+
+void sf2d_draw_texture_part_scale_sdf(const sf2d_texture *texture, float x, float y, float tex_x, float tex_y, float tex_w, float tex_h, float x_scale, float y_scale, u32 color, float spread)
+{
+	sf2d_draw_texture_part_scale_generic(texture, x, y, tex_x, tex_y, tex_w, tex_h, x_scale, y_scale, SF2D_BATCH_SDF + sf2d_sdf_shift(spread), color);
 }
 
-static inline void sf2d_draw_texture_part_rotate_scale_hotspot_generic(const sf2d_texture *texture, int x, int y, float rad, int tex_x, int tex_y, int tex_w, int tex_h, float x_scale, float y_scale, float center_x, float center_y)
+static inline void sf2d_draw_texture_part_rotate_scale_hotspot_generic(const sf2d_texture *texture, int x, int y, float rad, int tex_x, int tex_y, int tex_w, int tex_h, float x_scale, float y_scale, float center_x, float center_y, sf2d_batch_env env, u32 color)
 {
-	sf2d_vertex_pos_tex *vertices = sf2d_pool_memalign(4 * sizeof(sf2d_vertex_pos_tex), 8);
+	sf2d_vertex_pos_tex *vertices = sf2d_batch_add_quad(texture, texture->params, env, color);
 	if (!vertices) return;
 
 	int w = tex_w;
@@ -629,7 +625,7 @@ static inline void sf2d_draw_texture_part_rotate_scale_hotspot_generic(const sf2
 	vertices[0].position = (sf2d_vector_3f){(float)-center_x * x_scale, (float)-center_y * y_scale, SF2D_DEFAULT_DEPTH};
 	vertices[1].position = (sf2d_vector_3f){(float) (w - center_x) * x_scale, (float)-center_y * y_scale, SF2D_DEFAULT_DEPTH};
 	vertices[2].position = (sf2d_vector_3f){(float)-center_x * x_scale, (float) (h - center_y) * y_scale, SF2D_DEFAULT_DEPTH};
-	vertices[3].position = (sf2d_vector_3f){(float) (w - center_x) * x_scale, (float) h - center_y * y_scale, SF2D_DEFAULT_DEPTH};
+	vertices[3].position = (sf2d_vector_3f){(float) (w - center_x) * x_scale, (float) (h - center_y) * y_scale, SF2D_DEFAULT_DEPTH};
 
 	float u0 = tex_x/(float)texture->pow2_w;
 	float v0 = tex_y/(float)texture->pow2_h;
@@ -650,43 +646,26 @@ static inline void sf2d_draw_texture_part_rotate_scale_hotspot_generic(const sf2
 		vertices[i].position.x = _x*c - _y*s + x;
 		vertices[i].position.y = _x*s + _y*c + y;
 	}
-
-	GPU_SetAttributeBuffers(
-		2, // number of attributes
-		(u32*)osConvertVirtToPhys(vertices),
-		GPU_ATTRIBFMT(0, 3, GPU_FLOAT) | GPU_ATTRIBFMT(1, 2, GPU_FLOAT),
-		0xFFFC, //0b1100
-		0x10,
-		1, //number of buffers
-		(u32[]){0x0}, // buffer offsets (placeholders)
-		(u64[]){0x10}, // attribute permutations for each buffer
-		(u8[]){2} // number of attributes for each buffer
-	);
-
-	GPU_DrawArray(GPU_TRIANGLE_STRIP, 0, 4);
 }
 
 void sf2d_draw_texture_part_rotate_scale(const sf2d_texture *texture, int x, int y, float rad, int tex_x, int tex_y, int tex_w, int tex_h, float x_scale, float y_scale)
 {
-	sf2d_bind_texture(texture, GPU_TEXUNIT0);
-	sf2d_draw_texture_part_rotate_scale_hotspot_generic(texture, x, y, rad, tex_x, tex_y, tex_w, tex_h, x_scale, y_scale, tex_w/2.0f, tex_h/2.0f);
+	sf2d_draw_texture_part_rotate_scale_hotspot_generic(texture, x, y, rad, tex_x, tex_y, tex_w, tex_h, x_scale, y_scale, tex_w/2.0f, tex_h/2.0f, SF2D_BATCH_REPLACE, 0xFFFFFFFF);
 }
 
 void sf2d_draw_texture_part_rotate_scale_blend(const sf2d_texture *texture, int x, int y, float rad, int tex_x, int tex_y, int tex_w, int tex_h, float x_scale, float y_scale, u32 color)
 {
-	sf2d_bind_texture_color(texture, GPU_TEXUNIT0, color);
-	sf2d_draw_texture_part_rotate_scale_hotspot_generic(texture, x, y, rad, tex_x, tex_y, tex_w, tex_h, x_scale, y_scale, tex_w/2.0f, tex_h/2.0f);
+	sf2d_draw_texture_part_rotate_scale_hotspot_generic(texture, x, y, rad, tex_x, tex_y, tex_w, tex_h, x_scale, y_scale, tex_w/2.0f, tex_h/2.0f, SF2D_BATCH_MODULATE, color);
 }
 
 void sf2d_draw_texture_part_rotate_scale_hotspot_blend(const sf2d_texture *texture, int x, int y, float rad, int tex_x, int tex_y, int tex_w, int tex_h, float x_scale, float y_scale, float center_x, float center_y, u32 color)
 {
-	sf2d_bind_texture_color(texture, GPU_TEXUNIT0, color);
-	sf2d_draw_texture_part_rotate_scale_hotspot_generic(texture, x, y, rad, tex_x, tex_y, tex_w, tex_h, x_scale, y_scale, center_x, center_y);
+	sf2d_draw_texture_part_rotate_scale_hotspot_generic(texture, x, y, rad, tex_x, tex_y, tex_w, tex_h, x_scale, y_scale, center_x, center_y, SF2D_BATCH_MODULATE, color);
 }
 
-static inline void sf2d_draw_texture_depth_generic(const sf2d_texture *texture, int x, int y, signed short z)
+static inline void sf2d_draw_texture_depth_generic(const sf2d_texture *texture, int x, int y, signed short z, sf2d_batch_env env, u32 color)
 {
-	sf2d_vertex_pos_tex *vertices = sf2d_pool_memalign(4 * sizeof(sf2d_vertex_pos_tex), 8);
+	sf2d_vertex_pos_tex *vertices = sf2d_batch_add_quad(texture, texture->params, env, color);
 	if (!vertices) return;
 
 	int w = texture->width;
@@ -705,38 +684,22 @@ static inline void sf2d_draw_texture_depth_generic(const sf2d_texture *texture,
 	vertices[1].texcoord = (sf2d_vector_2f){u,    0.0f};
 	vertices[2].texcoord = (sf2d_vector_2f){0.0f, v};
 	vertices[3].texcoord = (sf2d_vector_2f){u,    v};
-
-	GPU_SetAttributeBuffers(
-		2, // number of attributes
-		(u32*)osConvertVirtToPhys(vertices),
-		GPU_ATTRIBFMT(0, 3, GPU_FLOAT) | GPU_ATTRIBFMT(1, 2, GPU_FLOAT),
-		0xFFFC, //0b1100
-		0x10,
-		1, //number of buffers
-		(u32[]){0x0}, // buffer offsets (placeholders)
-		(u64[]){0x10}, // attribute permutations for each buffer
-		(u8[]){2} // number of attributes for each buffer
-	);
-
-	GPU_DrawArray(GPU_TRIANGLE_STRIP, 0, 4);
 }
 
 void sf2d_draw_texture_depth(const sf2d_texture *texture, int x, int y, signed short z)
 {
-	sf2d_bind_texture(texture, GPU_TEXUNIT0);
-	sf2d_draw_texture_depth_generic(texture, x, y, z);
+	sf2d_draw_texture_depth_generic(texture, x, y, z, SF2D_BATCH_REPLACE, 0xFFFFFFFF);
 }
 
 void sf2d_draw_texture_depth_blend(const sf2d_texture *texture, int x, int y, signed short z, u32 color)
 {
-	sf2d_bind_texture_color(texture, GPU_TEXUNIT0, color);
-	sf2d_draw_texture_depth_generic(texture, x, y, z);
+	sf2d_draw_texture_depth_generic(texture, x, y, z, SF2D_BATCH_MODULATE, color);
 }
 
 
 void sf2d_draw_quad_uv(const sf2d_texture *texture, float left, float top, float right, float bottom, float u0, float v0, float u1, float v1, unsigned int params)
 {
-	sf2d_vertex_pos_tex *vertices = sf2d_pool_memalign(4 * sizeof(sf2d_vertex_pos_tex), 8);
+	sf2d_vertex_pos_tex *vertices = sf2d_batch_add_quad(texture, params, SF2D_BATCH_REPLACE, 0xFFFFFFFF);
 	if (!vertices) return;
 
 	vertices[0].position = (sf2d_vector_3f){left,  top,    SF2D_DEFAULT_DEPTH};
@@ -748,63 +711,70 @@ void sf2d_draw_quad_uv(const sf2d_texture *texture, float left, float top, float
 	vertices[1].texcoord = (sf2d_vector_2f){u1, v0};
 	vertices[2].texcoord = (sf2d_vector_2f){u0, v1};
 	vertices[3].texcoord = (sf2d_vector_2f){u1, v1};
-
-	sf2d_bind_texture_parameters(texture, GPU_TEXUNIT0, params);
-
-	GPU_SetAttributeBuffers(
-		2, // number of attributes
-		(u32*)osConvertVirtToPhys(vertices),
-		GPU_ATTRIBFMT(0, 3, GPU_FLOAT) | GPU_ATTRIBFMT(1, 2, GPU_FLOAT),
-		0xFFFC, //0b1100
-		0x10,
-		1, //number of buffers
-		(u32[]){0x0}, // buffer offsets (placeholders)
-		(u64[]){0x10}, // attribute permutations for each buffer
-		(u8[]){2} // number of attributes for each buffer
-	);
-
-	GPU_DrawArray(GPU_TRIANGLE_STRIP, 0, 4);
 }
 
-// Grabbed from Citra Emulator (citra/src/video_core/utils.h)
-static inline u32 morton_interleave(u32 x, u32 y)
+void sf2d_draw_quads(const sf2d_texture *texture, const sf2d_vertex_pos_tex *vertices, const u16 *indices, int quads, float x, float y, u32 color)
 {
-	u32 i = (x & 7) | ((y & 7) << 8); // ---- -210
-	i = (i ^ (i << 2)) & 0x1313;      // ---2 --10
-	i = (i ^ (i << 1)) & 0x1515;      // ---2 -1-0
-	i = (i | (i >> 7)) & 0x3F;
-	return i;
+	if (quads <= 0) return;
+
+	if (color == 0xFFFFFFFF) {
+		sf2d_bind_texture(texture, GPU_TEXUNIT0);
+	} else {
+		sf2d_bind_texture_color(texture, GPU_TEXUNIT0, color);
+	}
+
+	sf2d_set_translation(x, y);
+	sf2d_set_attribute_buffers(SF2D_VERTEX_POS_TEX, vertices);
+
+	// The index offset is relative to the attribute buffer
+	GPU_DrawElements(GPU_TRIANGLES, (u32 *)((u8 *)indices - (u8 *)vertices), quads * 6);
+	sf2d_frame_stats.draw_calls++;
+	sf2d_frame_stats.quads += quads;
 }
 
-//Grabbed from Citra Emulator (citra/src/video_core/utils.h)
-static inline u32 get_morton_offset(u32 x, u32 y, u32 bytes_per_pixel)
+void sf2d_draw_quads_sdf(const sf2d_texture *texture, const sf2d_vertex_pos_tex *vertices, const u16 *indices, int quads, float x, float y, u32 color, float spread)
 {
-    u32 i = morton_interleave(x, y);
-    unsigned int offset = (x & ~7) * 8;
-    return (i + offset) * bytes_per_pixel;
+	if (quads <= 0) return;
+
+	sf2d_bind_texture_sdf(texture, GPU_TEXUNIT0, color, sf2d_sdf_shift(spread));
+
+	sf2d_set_translation(x, y);
+	sf2d_set_attribute_buffers(SF2D_VERTEX_POS_TEX, vertices);
+
+	GPU_DrawElements(GPU_TRIANGLES, (u32 *)((u8 *)indices - (u8 *)vertices), quads * 6);
+	sf2d_frame_stats.draw_calls++;
+	sf2d_frame_stats.quads += quads;
+
+	sf2d_unbind_texture_sdf();
 }
 
 void sf2d_set_pixel(sf2d_texture *texture, int x, int y, u32 new_color)
 {
-	y = (texture->pow2_h - 1 - y);
-	if (texture->tiled) {
-		u32 coarse_y = y & ~7;
-		u32 offset = get_morton_offset(x, y, 4) + coarse_y * texture->pow2_w * 4;
-		*(u32 *)(texture->data + offset) = new_color;
+	if (texture->pixel_format != TEXFMT_RGBA8) {
+		// Nothing is written in compressed textures
+		u32 rgba = __builtin_bswap32(new_color);
+		sf2d_tile_rect(texture->data, texture->pow2_w, texture->pow2_h, texture->pixel_format, x, y, 1, 1, &rgba, 4, SF2D_TILE_CONVERT_RGBA8);
+	} else if (texture->tiled) {
+		((u32 *)texture->data)[sf2d_tile_texel_index(x, y, texture->pow2_w, texture->pow2_h)] = new_color;
 	} else {
-		((u32 *)texture->data)[x + y * texture->pow2_w] = new_color;
+		((u32 *)texture->data)[x + (texture->pow2_h - 1 - y) * texture->pow2_w] = new_color;
 	}
 }
 
 u32 sf2d_get_pixel(sf2d_texture *texture, int x, int y)
 {
-	y = (texture->pow2_h - 1 - y);
-	if (texture->tiled) {
-		u32 coarse_y = y & ~7;
-		u32 offset = get_morton_offset(x, y, 4) + coarse_y * texture->pow2_w * 4;
-		return *(u32 *)(texture->data + offset);
+	if (texture->pixel_format == TEXFMT_ETC1 || texture->pixel_format == TEXFMT_ETC1A4) {
+		u8 rgba[4];
+		sf2d_etc1_decode_texel(texture->data, texture->pow2_w, texture->pow2_h, texture->pixel_format == TEXFMT_ETC1A4, x, y, rgba);
+		return (u32)rgba[0] << 24 | rgba[1] << 16 | rgba[2] << 8 | rgba[3];
+	} else if (texture->pixel_format != TEXFMT_RGBA8) {
+		u32 rgba = 0;
+		sf2d_untile_rect(texture->data, texture->pow2_w, texture->pow2_h, texture->pixel_format, x, y, 1, 1, &rgba, 4, SF2D_TILE_CONVERT_RGBA8);
+		return __builtin_bswap32(rgba);
+	} else if (texture->tiled) {
+		return ((u32 *)texture->data)[sf2d_tile_texel_index(x, y, texture->pow2_w, texture->pow2_h)];
 	} else {
-		return ((u32 *)texture->data)[x + y * texture->pow2_w];
+		return ((u32 *)texture->data)[x + (texture->pow2_h - 1 - y) * texture->pow2_w];
 	}
 }
 
@@ -813,23 +783,8 @@ void sf2d_texture_tile32(sf2d_texture *texture)
 {
 	if (texture->tiled) return;
 
-	// TODO: add support for non-RGBA8 textures
-	u8 *tmp = linearAlloc(texture->pow2_w * texture->pow2_h * 4);
-
-	int i, j;
-	for (j = 0; j < texture->pow2_h; j++) {
-		for (i = 0; i < texture->pow2_w; i++) {
-
-			u32 coarse_y = j & ~7;
-			u32 dst_offset = get_morton_offset(i, j, 4) + coarse_y * texture->pow2_w * 4;
-
-			u32 v = ((u32 *)texture->data)[i + (texture->pow2_h - 1 - j)*texture->pow2_w];
-			*(u32 *)(tmp + dst_offset) = __builtin_bswap32(v); /* RGBA8 -> ABGR8 */
-		}
-	}
-
-	memcpy(texture->data, tmp, texture->pow2_w*texture->pow2_h*4);
-	linearFree(tmp);
-
-	texture->tiled = 1;
+	// The rows are stored bottom to top and converted in place, RGBA8 -> ABGR8
+	if (sf2d_tile_inplace(texture->data, texture->pow2_w, texture->pow2_h, texture->pixel_format,
+		texture->pixel_format == TEXFMT_RGBA8 ? SF2D_TILE_SWAP_RGBA8 : 0))
+		texture->tiled = 1;
 }
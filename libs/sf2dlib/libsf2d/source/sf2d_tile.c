@@ -0,0 +1,302 @@
+#include <stdlib.h>
+#include <string.h>
+#include "sf2d.h"
+#include "sf2d_tile.h"
+
+/*
+ * A row of a tile is 8 texels, stored in Morton order as 4 pairs of
+ * horizontally adjacent texels: each pair is copied as one word twice the
+ * size of a texel. Rows are processed in the order of the linear image so
+ * the reads (or writes) of the linear side stay sequential.
+ */
+
+// Index of the first texel of each pair of a tile row, for each row of the tile
+static const u8 pair_offsets[8][4] = {
+	{  0,  4, 16, 20 }, {  2,  6, 18, 22 }, {  8, 12, 24, 28 }, { 10, 14, 26, 30 },
+	{ 32, 36, 48, 52 }, { 34, 38, 50, 54 }, { 40, 44, 56, 60 }, { 42, 46, 58, 62 },
+};
+
+// Index of each texel in its tile: pair offset, +1 for the odd texels
+#define TEXEL_OFFSET(row, col) (pair_offsets[(row)][(col) >> 1] + ((col) & 1))
+
+int sf2d_tile_bytes_per_texel(sf2d_texfmt format)
+{
+	switch (format) {
+	case TEXFMT_RGBA8:
+		return 4;
+	case TEXFMT_RGB8:
+		return 3;
+	case TEXFMT_RGB5A1:
+	case TEXFMT_RGB565:
+	case TEXFMT_RGBA4:
+	case TEXFMT_IA8:
+		return 2;
+	case TEXFMT_I8:
+	case TEXFMT_A8:
+	case TEXFMT_IA4:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+u32 sf2d_tile_texel_index(int x, int y, int pow2_w, int pow2_h)
+{
+	y = pow2_h - 1 - y;
+	return (y & ~7) * pow2_w + (x & ~7) * 8 + TEXEL_OFFSET(y & 7, x & 7);
+}
+
+// Reverses the bytes of the two texels of a pair, without exchanging them
+static inline u64 swap_pair32(u64 v)
+{
+	v = __builtin_bswap64(v);
+	return (v >> 32) | (v << 32);
+}
+
+static inline u32 swap_texel32(u32 v, int swap)
+{
+	return swap ? __builtin_bswap32(v) : v;
+}
+
+/*
+ * Row kernels: copy w texels between the linear row `line`, starting at x,
+ * and the tile row `row` of the row of tiles `tiles`. The unaligned texels
+ * at both ends are copied one by one, the whole tiles by pairs.
+ */
+#define DEFINE_ROW_KERNELS(bits, texel_t, pair_t, SWAP_TEXEL, SWAP_PAIR) \
+static void tile_row##bits(texel_t *tiles, int row, int x, int w, const u8 *line, int swap) \
+{ \
+	const u8 *offsets = pair_offsets[row]; \
+	int end = x + w; \
+	texel_t v; \
+	for (; x < end && (x & 7); x++, line += sizeof(texel_t)) { \
+		memcpy(&v, line, sizeof(v)); \
+		tiles[(x & ~7) * 8 + TEXEL_OFFSET(row, x & 7)] = SWAP_TEXEL(v, swap); \
+	} \
+	for (; x + 8 <= end; x += 8, line += 8 * sizeof(texel_t)) { \
+		texel_t *tile = tiles + x * 8; \
+		pair_t p[4]; \
+		int i; \
+		memcpy(p, line, sizeof(p)); \
+		for (i = 0; i < 4; i++) { \
+			pair_t q = SWAP_PAIR(p[i], swap); \
+			memcpy(tile + offsets[i], &q, sizeof(q)); \
+		} \
+	} \
+	for (; x < end; x++, line += sizeof(texel_t)) { \
+		memcpy(&v, line, sizeof(v)); \
+		tiles[(x & ~7) * 8 + TEXEL_OFFSET(row, x & 7)] = SWAP_TEXEL(v, swap); \
+	} \
+} \
+static void untile_row##bits(const texel_t *tiles, int row, int x, int w, u8 *line, int swap) \
+{ \
+	const u8 *offsets = pair_offsets[row]; \
+	int end = x + w; \
+	texel_t v; \
+	for (; x < end && (x & 7); x++, line += sizeof(texel_t)) { \
+		v = tiles[(x & ~7) * 8 + TEXEL_OFFSET(row, x & 7)]; \
+		v = SWAP_TEXEL(v, swap); \
+		memcpy(line, &v, sizeof(v)); \
+	} \
+	for (; x + 8 <= end; x += 8, line += 8 * sizeof(texel_t)) { \
+		const texel_t *tile = tiles + x * 8; \
+		pair_t p[4]; \
+		int i; \
+		for (i = 0; i < 4; i++) { \
+			memcpy(&p[i], tile + offsets[i], sizeof(pair_t)); \
+			p[i] = SWAP_PAIR(p[i], swap); \
+		} \
+		memcpy(line, p, sizeof(p)); \
+	} \
+	for (; x < end; x++, line += sizeof(texel_t)) { \
+		v = tiles[(x & ~7) * 8 + TEXEL_OFFSET(row, x & 7)]; \
+		v = SWAP_TEXEL(v, swap); \
+		memcpy(line, &v, sizeof(v)); \
+	} \
+}
+
+#define NO_SWAP(v, swap) (v)
+#define SWAP_TEXEL32(v, swap) swap_texel32((v), (swap))
+#define SWAP_PAIR32(v, swap) ((swap) ? swap_pair32(v) : (v))
+
+DEFINE_ROW_KERNELS(8, u8, u16, NO_SWAP, NO_SWAP)
+DEFINE_ROW_KERNELS(16, u16, u32, NO_SWAP, NO_SWAP)
+DEFINE_ROW_KERNELS(32, u32, u64, SWAP_TEXEL32, SWAP_PAIR32)
+
+// RGB8 texels don't fit a machine word: copied one by one
+static void tile_row24(u8 *tiles, int row, int x, int w, const u8 *line)
+{
+	for (; w > 0; w--, x++, line += 3)
+		memcpy(tiles + ((x & ~7) * 8 + TEXEL_OFFSET(row, x & 7)) * 3, line, 3);
+}
+
+static void untile_row24(const u8 *tiles, int row, int x, int w, u8 *line)
+{
+	for (; w > 0; w--, x++, line += 3)
+		memcpy(line, tiles + ((x & ~7) * 8 + TEXEL_OFFSET(row, x & 7)) * 3, 3);
+}
+
+static void tile_row(u8 *tiles, int bpp, int row, int x, int w, const u8 *line, int swap)
+{
+	switch (bpp) {
+	case 1: tile_row8(tiles, row, x, w, line, 0); break;
+	case 2: tile_row16((u16 *)tiles, row, x, w, line, 0); break;
+	case 3: tile_row24(tiles, row, x, w, line); break;
+	case 4: tile_row32((u32 *)tiles, row, x, w, line, swap); break;
+	}
+}
+
+static void untile_row(const u8 *tiles, int bpp, int row, int x, int w, u8 *line, int swap)
+{
+	switch (bpp) {
+	case 1: untile_row8(tiles, row, x, w, line, 0); break;
+	case 2: untile_row16((const u16 *)tiles, row, x, w, line, 0); break;
+	case 3: untile_row24(tiles, row, x, w, line); break;
+	case 4: untile_row32((const u32 *)tiles, row, x, w, line, swap); break;
+	}
+}
+
+// Texels converted at once by the row functions: a multiple of 8, to keep the tiles aligned
+#define CONVERT_TEXELS 64
+
+/*
+ * The linear image is converted to the texels in pieces of CONVERT_TEXELS,
+ * which are then tiled, unless it already holds the texels (or RGBA8 texels
+ * with their bytes reversed, which the row kernels reverse themselves).
+ */
+void sf2d_tile_convert_rect(void *tiled, int pow2_w, int pow2_h, sf2d_texfmt format, int x, int y, int w, int h, const void *src, int src_pitch, sf2d_pixel_format src_format)
+{
+	int bpp = sf2d_tile_bytes_per_texel(format);
+	sf2d_pixel_format texel_format = sf2d_convert_texel_format(format);
+	int swap = src_format == SF2D_PIXEL_RGBA8 && texel_format == SF2D_PIXEL_ABGR8;
+	int src_bits = sf2d_pixel_bits(src_format);
+	u32 texels[CONVERT_TEXELS];
+	const u8 *line = src;
+	int i, j;
+
+	if (bpp == 0 || src_bits == 0 || w <= 0) return;
+
+	for (j = 0; j < h; j++, line += src_pitch) {
+		int ty = pow2_h - 1 - (y + j);
+		u8 *tiles = (u8 *)tiled + (ty & ~7) * pow2_w * bpp;
+
+		if (src_format == texel_format || swap) {
+			tile_row(tiles, bpp, ty & 7, x, w, line, swap);
+			continue;
+		}
+		for (i = 0; i < w; i += CONVERT_TEXELS) {
+			int n = w - i < CONVERT_TEXELS ? w - i : CONVERT_TEXELS;
+			if (!sf2d_convert_row(texels, texel_format, line + i * src_bits / 8, src_format, n)) return;
+			tile_row(tiles, bpp, ty & 7, x + i, n, (const u8 *)texels, 0);
+		}
+	}
+}
+
+void sf2d_untile_convert_rect(const void *tiled, int pow2_w, int pow2_h, sf2d_texfmt format, int x, int y, int w, int h, void *dst, int dst_pitch, sf2d_pixel_format dst_format)
+{
+	int bpp = sf2d_tile_bytes_per_texel(format);
+	sf2d_pixel_format texel_format = sf2d_convert_texel_format(format);
+	int swap = dst_format == SF2D_PIXEL_RGBA8 && texel_format == SF2D_PIXEL_ABGR8;
+	int dst_bits = sf2d_pixel_bits(dst_format);
+	u32 texels[CONVERT_TEXELS];
+	u8 *line = dst;
+	int i, j;
+
+	if (bpp == 0 || dst_bits == 0 || w <= 0) return;
+
+	for (j = 0; j < h; j++, line += dst_pitch) {
+		int ty = pow2_h - 1 - (y + j);
+		const u8 *tiles = (const u8 *)tiled + (ty & ~7) * pow2_w * bpp;
+
+		if (dst_format == texel_format || swap) {
+			untile_row(tiles, bpp, ty & 7, x, w, line, swap);
+			continue;
+		}
+		for (i = 0; i < w; i += CONVERT_TEXELS) {
+			int n = w - i < CONVERT_TEXELS ? w - i : CONVERT_TEXELS;
+			untile_row(tiles, bpp, ty & 7, x + i, n, (u8 *)texels, 0);
+			if (!sf2d_convert_row(line + i * dst_bits / 8, dst_format, texels, texel_format, n)) return;
+		}
+	}
+}
+
+// Pixel format of the linear side for the flags of sf2d_tile_rect and sf2d_untile_rect
+static sf2d_pixel_format flags_format(sf2d_texfmt format, u32 flags)
+{
+	if ((flags & SF2D_TILE_CONVERT_RGBA8) || ((flags & SF2D_TILE_SWAP_RGBA8) && format == TEXFMT_RGBA8))
+		return SF2D_PIXEL_RGBA8;
+	return sf2d_convert_texel_format(format);
+}
+
+void sf2d_tile_rect(void *tiled, int pow2_w, int pow2_h, sf2d_texfmt format, int x, int y, int w, int h, const void *src, int src_pitch, u32 flags)
+{
+	sf2d_tile_convert_rect(tiled, pow2_w, pow2_h, format, x, y, w, h, src, src_pitch, flags_format(format, flags));
+}
+
+void sf2d_untile_rect(const void *tiled, int pow2_w, int pow2_h, sf2d_texfmt format, int x, int y, int w, int h, void *dst, int dst_pitch, u32 flags)
+{
+	sf2d_untile_convert_rect(tiled, pow2_w, pow2_h, format, x, y, w, h, dst, dst_pitch, flags_format(format, flags));
+}
+
+void sf2d_tile_texture_rows(sf2d_texture *texture, int y, int h, const void *rows, int pitch, u32 flags)
+{
+	sf2d_tile_rect(texture->data, texture->pow2_w, texture->pow2_h, texture->pixel_format,
+		0, y, texture->width, h, rows, pitch, flags);
+	texture->tiled = 1;
+}
+
+void sf2d_tile_texture_rows_convert(sf2d_texture *texture, int y, int h, const void *rows, int pitch, sf2d_pixel_format format)
+{
+	sf2d_tile_convert_rect(texture->data, texture->pow2_w, texture->pow2_h, texture->pixel_format,
+		0, y, texture->width, h, rows, pitch, format);
+	texture->tiled = 1;
+}
+
+/*
+ * The linear rows 8k..8k+7 become the row of tiles n-1-k, so the rows of
+ * tiles are converted by pairs (k, n-1-k), both copied to a buffer first.
+ * Only two rows of tiles are allocated instead of a copy of the image.
+ */
+static int convert_inplace(void *data, int pow2_w, int pow2_h, sf2d_texfmt format, u32 flags, int tile)
+{
+	int bpp = sf2d_tile_bytes_per_texel(format);
+	size_t strip = 8 * pow2_w * bpp;
+	int n = pow2_h / 8;
+	u8 *tmp;
+	int k;
+
+	if (bpp == 0 || (pow2_h & 7)) return 0;
+	if (!(tmp = malloc(2 * strip))) return 0;
+
+	for (k = 0; k < (n + 1) / 2; k++) {
+		int l = n - 1 - k;
+		u8 *first = (u8 *)data + k * strip;
+		u8 *last = (u8 *)data + l * strip;
+
+		memcpy(tmp, first, strip);
+		if (l != k) memcpy(tmp + strip, last, strip);
+
+		if (tile) {
+			// The linear rows of k go to the tiles in l, and the other way around
+			sf2d_tile_rect(data, pow2_w, pow2_h, format, 0, 8 * k, pow2_w, 8, tmp, pow2_w * bpp, flags);
+			if (l != k) sf2d_tile_rect(data, pow2_w, pow2_h, format, 0, 8 * l, pow2_w, 8, tmp + strip, pow2_w * bpp, flags);
+		} else {
+			// The tiles in k hold the linear rows of l
+			sf2d_untile_rect(tmp, pow2_w, 8, format, 0, 0, pow2_w, 8, last, pow2_w * bpp, flags);
+			if (l != k) sf2d_untile_rect(tmp + strip, pow2_w, 8, format, 0, 0, pow2_w, 8, first, pow2_w * bpp, flags);
+		}
+	}
+
+	free(tmp);
+	return 1;
+}
+
+int sf2d_tile_inplace(void *data, int pow2_w, int pow2_h, sf2d_texfmt format, u32 flags)
+{
+	return convert_inplace(data, pow2_w, pow2_h, format, flags, 1);
+}
+
+int sf2d_untile_inplace(void *data, int pow2_w, int pow2_h, sf2d_texfmt format, u32 flags)
+{
+	return convert_inplace(data, pow2_w, pow2_h, format, flags, 0);
+}
@@ -15,6 +15,45 @@
 extern "C" {
 #endif
 
+/**
+ * @brief Options of the sfil_load_*_options functions
+ *
+ * The region is cut from the image first, then scaled down to fit in the
+ * maximum size, keeping its aspect ratio. Zeroed options load the whole image.
+ */
+typedef struct {
+	int max_width;  /**< Maximum width of the texture, 0 for no limit */
+	int max_height; /**< Maximum height of the texture, 0 for no limit */
+	int region_x;   /**< Left of the region of the image to load */
+	int region_y;   /**< Top of the region of the image to load */
+	int region_w;   /**< Width of the region, 0 for the rest of the image */
+	int region_h;   /**< Height of the region, 0 for the rest of the image */
+} sfil_load_options;
+
+/**
+ * @brief Computes the region and the size of an image loaded with options
+ * @param options the options, or NULL
+ * @param width the width of the image
+ * @param height the height of the image
+ * @param region the region of the image to load (x, y, w, h), clamped to the image
+ * @param out_w the width of the texture
+ * @param out_h the height of the texture
+ * @return 1, or 0 if the region is out of the image
+ */
+int sfil_options_apply(const sfil_load_options *options, int width, int height, int region[4], int *out_w, int *out_h);
+
+/**
+ * @brief Cuts and scales down an RGBA8 image with options, with a box filter
+ * @param rgba the image, in RGBA bytes
+ * @param width the width of the image
+ * @param height the height of the image
+ * @param options the options
+ * @param out_w the width of the returned image
+ * @param out_h the height of the returned image
+ * @return a new image in RGBA bytes, to free, or NULL in case of error
+ */
+void *sfil_scale_RGBA8(const void *rgba, int width, int height, const sfil_load_options *options, int *out_w, int *out_h);
+
 /**
  * @brief Loads a PNG image from the SD card
  * @param filename the path of the image to load
@@ -23,6 +62,18 @@ extern "C" {
  */
 sf2d_texture *sfil_load_PNG_file(const char *filename, sf2d_place place);
 
+/**
+ * @brief Loads a PNG image from the SD card, cut and scaled down
+ *
+ * The rows are scaled down while they're decoded: only the texture is
+ * allocated, at its final size, and the decoding stops after the region.
+ * @param filename the path of the image to load
+ * @param place where to allocate the texture
+ * @param options the region and maximum size to load
+ * @return a pointer to the newly created texture/image
+ */
+sf2d_texture *sfil_load_PNG_file_options(const char *filename, sf2d_place place, const sfil_load_options *options);
+
 /**
  * @brief Loads a PNG image from a memory buffer
  * @param buffer the pointer of the memory buffer to load the image from
@@ -39,6 +90,19 @@ sf2d_texture *sfil_load_PNG_buffer(const void *buffer, sf2d_place place);
  */
 sf2d_texture *sfil_load_JPEG_file(const char *filename, sf2d_place place);
 
+/**
+ * @brief Loads a JPG/JPEG image from the SD card, cut and scaled down
+ *
+ * The image is decoded at 1/2, 1/4 or 1/8 of its size when that's still
+ * bigger than the texture (the DCT scaling of libjpeg, much faster than a
+ * full decoding), then scaled down like sfil_load_PNG_file_options.
+ * @param filename the path of the image to load
+ * @param place where to allocate the texture
+ * @param options the region and maximum size to load
+ * @return a pointer to the newly created texture/image
+ */
+sf2d_texture *sfil_load_JPEG_file_options(const char *filename, sf2d_place place, const sfil_load_options *options);
+
 /**
  * @brief Loads a JPG/JPEG image from a memory buffer
  * @param buffer the pointer of the memory buffer to load the image from
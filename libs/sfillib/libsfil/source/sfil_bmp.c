@@ -1,4 +1,5 @@
 #include "sfil.h"
+#include <sf2d_tile.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -44,50 +45,35 @@ static sf2d_texture *_sfil_load_BMP_generic(
 
 	sf2d_texture *texture = sf2d_create_texture(bmp_ih->biWidth, bmp_ih->biHeight,
 		GPU_RGBA8, place);
+	if (texture == NULL) {
+		return NULL;
+	}
 
 	seek_fn(user_data, bmp_fh->bfOffBits);
 
-	int stride = texture->pow2_w * 4;
+	// The rows are converted on the way to the tiles of the texture
+	sf2d_pixel_format format;
+	switch (bmp_ih->biBitCount) {
+	case 32: format = SF2D_PIXEL_ABGR8; break;	//ABGR8888
+	case 24: format = SF2D_PIXEL_BGR8; break;	//BGR888
+	case 16: format = SF2D_PIXEL_RGB565; break;	//RGB565
+	default: format = SF2D_PIXEL_NONE; break;
+	}
 
 	void *buffer = malloc(row_size);
-	unsigned int *tex_ptr;
-	unsigned int color;
-	int i, x, y;
+	int i, y;
 
 	for (i = 0; i < bmp_ih->biHeight; i++) {
 
 		read_fn(user_data, buffer, row_size);
 
 		y = bmp_ih->biHeight - 1 - i;
-		tex_ptr = (unsigned int *)(texture->data + y*stride);
-
-		for (x = 0; x < bmp_ih->biWidth; x++) {
-
-			if (bmp_ih->biBitCount == 32) {		//ABGR8888
-				color = *(unsigned int *)(buffer + x*4);
-				*tex_ptr = (color&0xFF)<<24 | ((color>>8)&0xFF)<<16 |
-					((color>>16)&0xFF)<<8 | (color>>24);
-
-			} else if (bmp_ih->biBitCount == 24) {	//BGR888
-				unsigned char *address = buffer + x*3;
-				*tex_ptr = (*address)<<16 | (*(address+1))<<8 |
-					(*(address+2)) | (0xFF<<24);
-
-			} else if (bmp_ih->biBitCount == 16) {	//BGR565
-				color = *(unsigned short *)(buffer + x*2);
-				unsigned char r = (color       & 0x1F)  *((float)255/31);
-				unsigned char g = ((color>>5)  & 0x3F)  *((float)255/63);
-				unsigned char b = ((color>>11) & 0x1F)  *((float)255/31);
-				*tex_ptr = ((r<<16) | (g<<8) | b | (0xFF<<24));
-			}
-
-			tex_ptr++;
-		}
+		sf2d_tile_texture_rows_convert(texture, y, 1, buffer, 0, format);
 	}
 
 	free(buffer);
 
-	sf2d_texture_tile32(texture);
+	GSPGPU_FlushDataCache(texture->data, texture->data_size);
 	return texture;
 }
 
@@ -103,13 +89,13 @@ static void _sfil_read_bmp_file_read_fn(void *user_data, void *buffer, unsigned
 
 static void _sfil_read_bmp_buffer_seek_fn(void *user_data, unsigned int offset)
 {
-	*(unsigned int *)user_data += offset;
+	*(const unsigned char **)user_data += offset;
 }
 
 static void _sfil_read_bmp_buffer_read_fn(void *user_data, void *buffer, unsigned int length)
 {
-	memcpy(buffer, (void *)*(unsigned int *)user_data, length);
-	*(unsigned int *)user_data += length;
+	memcpy(buffer, *(const unsigned char **)user_data, length);
+	*(const unsigned char **)user_data += length;
 }
 
 sf2d_texture *sfil_load_BMP_file(const char *filename, sf2d_place place)
@@ -130,7 +116,7 @@ sf2d_texture *sfil_load_BMP_file(const char *filename, sf2d_place place)
 
 	sf2d_texture *texture = _sfil_load_BMP_generic(&bmp_fh,
 		&bmp_ih,
-		(void *)&fp,
+		(void *)fp,
 		_sfil_read_bmp_file_seek_fn,
 		_sfil_read_bmp_file_read_fn,
 		place);
@@ -156,7 +142,7 @@ sf2d_texture *sfil_load_BMP_buffer(const void *buffer, sf2d_place place)
 	BITMAPINFOHEADER bmp_ih;
 	memcpy(&bmp_ih, buffer + sizeof(BITMAPFILEHEADER), sizeof(BITMAPINFOHEADER));
 
-	unsigned int buffer_address = (unsigned int)buffer;
+	const unsigned char *buffer_address = buffer;
 
 	sf2d_texture *texture = _sfil_load_BMP_generic(&bmp_fh,
 		&bmp_ih,
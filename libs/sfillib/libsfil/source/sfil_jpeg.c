@@ -1,61 +1,99 @@
 #include "sfil.h"
+#include "sfil_scale.h"
+#include <sf2d_tile.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <jpeglib.h>
 
 
-static sf2d_texture *_sfil_load_JPEG_generic(struct jpeg_decompress_struct *jinfo, struct jpeg_error_mgr *jerr, sf2d_place place)
+// Decodes an image whose header is read; finishes or aborts the decompression if it's started
+static sf2d_texture *_sfil_load_JPEG_generic(struct jpeg_decompress_struct *jinfo, struct jpeg_error_mgr *jerr, sf2d_place place, const sfil_load_options *options)
 {
-	int row_bytes;
-	switch (jinfo->out_color_space) {
-	case JCS_RGB:
-		row_bytes = jinfo->image_width * 3;
-		break;
-	default:
-		goto exit_error;
+	if (jinfo->out_color_space != JCS_RGB) {
+		return NULL;
 	}
 
-	sf2d_texture *texture = sf2d_create_texture(jinfo->image_width,
-		jinfo->image_height,
-		GPU_RGBA8, place);
+	int region[4], out_w, out_h;
+	sfil_scaler *scaler = NULL;
+	sf2d_texture *texture;
+	if (options) {
+		if (!sfil_options_apply(options, jinfo->image_width, jinfo->image_height, region, &out_w, &out_h)) {
+			return NULL;
+		}
 
-	JSAMPARRAY buffer = (JSAMPARRAY)malloc(sizeof(JSAMPROW));
-	buffer[0] = (JSAMPROW)malloc(sizeof(JSAMPLE) * row_bytes);
+		// Decoded at the smallest scale still bigger than the texture, by skipping DCT coefficients
+		int denom = 8;
+		while (denom > 1 && (region[2] / denom < out_w || region[3] / denom < out_h))
+			denom /= 2;
+		jinfo->scale_num = 1;
+		jinfo->scale_denom = denom;
+		jpeg_calc_output_dimensions(jinfo);
+
+		// The region at that scale, rounded out
+		int x = region[0] / denom, y = region[1] / denom;
+		int right = (region[0] + region[2] + denom - 1) / denom, bottom = (region[1] + region[3] + denom - 1) / denom;
+		if (right > jinfo->output_width) right = jinfo->output_width;
+		if (bottom > jinfo->output_height) bottom = jinfo->output_height;
+		int scaled[4] = { x, y, right - x, bottom - y };
+
+		texture = sf2d_create_texture(out_w, out_h, GPU_RGBA8, place);
+		if (texture == NULL) {
+			return NULL;
+		}
+		scaler = sfil_scaler_create(jinfo->output_width, scaled, out_w, out_h, sfil_scaler_emit_texture, texture);
+		if (scaler == NULL) {
+			sf2d_free_texture(texture);
+			return NULL;
+		}
+	} else {
+		texture = sf2d_create_texture(jinfo->image_width, jinfo->image_height, GPU_RGBA8, place);
+		if (texture == NULL) {
+			return NULL;
+		}
+	}
 
-	unsigned int i, color, *tex_ptr;
-	unsigned char *jpeg_ptr;
-	void *row_ptr = texture->data;
 	jpeg_start_decompress(jinfo);
 
-	int stride = texture->pow2_w * 4;
+	int row_bytes = jinfo->output_width * 3;
+	JSAMPARRAY buffer = (JSAMPARRAY)malloc(sizeof(JSAMPROW));
+	buffer[0] = (JSAMPROW)malloc(sizeof(JSAMPLE) * row_bytes);
+	// The scaler takes RGBA8 rows; the texture takes the RGB8 rows, converted on the way to its tiles
+	unsigned int *row = scaler ? malloc(jinfo->output_width * 4) : NULL;
+	int done = 0;
 
-	while (jinfo->output_scanline < jinfo->output_height) {
+	while (!done && jinfo->output_scanline < jinfo->output_height) {
+		int y = jinfo->output_scanline;
 		jpeg_read_scanlines(jinfo, buffer, 1);
-		tex_ptr = (row_ptr += stride);
-		for (i = 0, jpeg_ptr = buffer[0]; i < jinfo->output_width; i++) {
-			color = *(jpeg_ptr++);
-			color |= *(jpeg_ptr++)<<8;
-			color |= *(jpeg_ptr++)<<16;
-			*(tex_ptr++) = color | 0xFF000000;
+		if (scaler) {
+			sf2d_convert_row(row, SF2D_PIXEL_RGBA8, buffer[0], SF2D_PIXEL_RGB8, jinfo->output_width);
+			done = !sfil_scaler_push(scaler, row);
+		} else {
+			sf2d_tile_texture_rows_convert(texture, y, 1, buffer[0], 0, SF2D_PIXEL_RGB8);
 		}
 	}
 
+	// The rows after the region aren't decoded
+	if (jinfo->output_scanline < jinfo->output_height) {
+		jpeg_abort_decompress(jinfo);
+	} else {
+		jpeg_finish_decompress(jinfo);
+	}
+
+	free(row);
 	free(buffer[0]);
 	free(buffer);
+	sfil_scaler_free(scaler);
 
-	sf2d_texture_tile32(texture);
+	GSPGPU_FlushDataCache(texture->data, texture->data_size);
 	return texture;
-
-exit_error:
-	return NULL;
 }
 
 
-sf2d_texture *sfil_load_JPEG_file(const char *filename, sf2d_place place)
+static sf2d_texture *_sfil_load_JPEG_file(const char *filename, sf2d_place place, const sfil_load_options *options)
 {
 	FILE *fp;
-	if ((fp = fopen(filename, "rb")) < 0) {
+	if ((fp = fopen(filename, "rb")) == NULL) {
 		return NULL;
 	}
 
@@ -67,9 +105,8 @@ sf2d_texture *sfil_load_JPEG_file(const char *filename, sf2d_place place)
 	jpeg_stdio_src(&jinfo, fp);
 	jpeg_read_header(&jinfo, 1);
 
-	sf2d_texture *texture = _sfil_load_JPEG_generic(&jinfo, &jerr, place);
+	sf2d_texture *texture = _sfil_load_JPEG_generic(&jinfo, &jerr, place, options);
 
-	jpeg_finish_decompress(&jinfo);
 	jpeg_destroy_decompress(&jinfo);
 
 	fclose(fp);
@@ -77,6 +114,18 @@ sf2d_texture *sfil_load_JPEG_file(const char *filename, sf2d_place place)
 }
 
 
+sf2d_texture *sfil_load_JPEG_file(const char *filename, sf2d_place place)
+{
+	return _sfil_load_JPEG_file(filename, place, NULL);
+}
+
+
+sf2d_texture *sfil_load_JPEG_file_options(const char *filename, sf2d_place place, const sfil_load_options *options)
+{
+	return _sfil_load_JPEG_file(filename, place, options);
+}
+
+
 sf2d_texture *sfil_load_JPEG_buffer(const void *buffer, unsigned long buffer_size, sf2d_place place)
 {
 	struct jpeg_decompress_struct jinfo;
@@ -88,9 +137,8 @@ sf2d_texture *sfil_load_JPEG_buffer(const void *buffer, unsigned long buffer_siz
 	jpeg_mem_src(&jinfo, (void *)buffer, buffer_size);
 	jpeg_read_header(&jinfo, 1);
 
-	sf2d_texture *texture = _sfil_load_JPEG_generic(&jinfo, &jerr, place);
+	sf2d_texture *texture = _sfil_load_JPEG_generic(&jinfo, &jerr, place, NULL);
 
-	jpeg_finish_decompress(&jinfo);
 	jpeg_destroy_decompress(&jinfo);
 
 	return texture;
@@ -1,4 +1,6 @@
 #include "sfil.h"
+#include "sfil_scale.h"
+#include <sf2d_tile.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -14,12 +16,12 @@ static void _sfil_read_png_file_fn(png_structp png_ptr, png_bytep data, png_size
 
 static void _sfil_read_png_buffer_fn(png_structp png_ptr, png_bytep data, png_size_t length)
 {
-	unsigned int *address = png_get_io_ptr(png_ptr);
-	memcpy(data, (void *)*address, length);
+	const unsigned char **address = png_get_io_ptr(png_ptr);
+	memcpy(data, *address, length);
 	*address += length;
 }
 
-static sf2d_texture *_sfil_load_PNG_generic(const void *io_ptr, png_rw_ptr read_data_fn, sf2d_place place)
+static sf2d_texture *_sfil_load_PNG_generic(const void *io_ptr, png_rw_ptr read_data_fn, sf2d_place place, const sfil_load_options *options)
 {
 	png_structp png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
 	if (png_ptr == NULL) {
@@ -31,12 +33,21 @@ static sf2d_texture *_sfil_load_PNG_generic(const void *io_ptr, png_rw_ptr read_
 		goto exit_destroy_read;
 	}
 
-	png_bytep *row_ptrs = NULL;
+	// Still needed after a longjmp
+	png_bytep *volatile row_ptrs = NULL;
+	png_bytep volatile row = NULL;
+	sf2d_texture *volatile texture = NULL;
+	sfil_scaler *volatile scaler = NULL;
 
 	if (setjmp(png_jmpbuf(png_ptr))) {
 		png_destroy_read_struct(&png_ptr, &info_ptr, (png_infopp)0);
 		if (row_ptrs != NULL)
 			free(row_ptrs);
+		if (row != NULL)
+			free(row);
+		if (texture != NULL)
+			sf2d_free_texture(texture);
+		sfil_scaler_free(scaler);
 		goto exit_error;
 	}
 
@@ -57,7 +68,13 @@ static sf2d_texture *_sfil_load_PNG_generic(const void *io_ptr, png_rw_ptr read_
 			png_set_expand(png_ptr);
 	}
 
-	if (bit_depth == 8 && color_type == PNG_COLOR_TYPE_RGB)
+	if (bit_depth == 16)
+		png_set_strip_16(png_ptr);
+
+	if (color_type == PNG_COLOR_TYPE_GRAY || color_type == PNG_COLOR_TYPE_GRAY_ALPHA)
+		png_set_gray_to_rgb(png_ptr);
+
+	if (color_type == PNG_COLOR_TYPE_RGB || color_type == PNG_COLOR_TYPE_GRAY)
 		png_set_filler(png_ptr, 0xFF, PNG_FILLER_AFTER);
 
 	if (color_type == PNG_COLOR_TYPE_PALETTE) {
@@ -74,23 +91,82 @@ static sf2d_texture *_sfil_load_PNG_generic(const void *io_ptr, png_rw_ptr read_
 	if (bit_depth < 8)
 		png_set_packing(png_ptr);
 
+	int passes = png_set_interlace_handling(png_ptr);
+
 	png_read_update_info(png_ptr, info_ptr);
 
-	row_ptrs = (png_bytep *)malloc(sizeof(png_bytep) * height);
-	sf2d_texture *texture = sf2d_create_texture(width, height, GPU_RGBA8, place);
+	// The rows are written to the texture as RGBA8
+	if (png_get_rowbytes(png_ptr, info_ptr) != width * 4) {
+		png_destroy_read_struct(&png_ptr, &info_ptr, (png_infopp)0);
+		goto exit_error;
+	}
 
-	int stride = texture->pow2_w * 4;
-	int i;
-	for (i = 0; i < height; i++) {
-		row_ptrs[i] = (png_bytep)(texture->data + i*stride);
+	if (options) {
+		int region[4], out_w, out_h;
+		if (sfil_options_apply(options, width, height, region, &out_w, &out_h)) {
+			texture = sf2d_create_texture(out_w, out_h, GPU_RGBA8, place);
+			if (texture != NULL)
+				scaler = sfil_scaler_create(width, region, out_w, out_h, sfil_scaler_emit_texture, texture);
+		}
+		if (scaler == NULL) {
+			png_destroy_read_struct(&png_ptr, &info_ptr, (png_infopp)0);
+			if (texture != NULL)
+				sf2d_free_texture(texture);
+			goto exit_error;
+		}
+	} else {
+		texture = sf2d_create_texture(width, height, GPU_RGBA8, place);
+		if (texture == NULL) {
+			png_destroy_read_struct(&png_ptr, &info_ptr, (png_infopp)0);
+			goto exit_error;
+		}
 	}
 
-	png_read_image(png_ptr, row_ptrs);
+	int i;
+	if (passes == 1) {
+		// Each decoded row goes straight to its tiles, or to the scaler; the rows after the region aren't decoded
+		row = malloc(png_get_rowbytes(png_ptr, info_ptr));
+		for (i = 0; i < height; i++) {
+			png_read_row(png_ptr, row, NULL);
+			if (scaler) {
+				if (!sfil_scaler_push(scaler, row))
+					break;
+			} else {
+				sf2d_tile_texture_rows_convert(texture, i, 1, row, 0, SF2D_PIXEL_RGBA8);
+			}
+		}
+		free(row);
+		row = NULL;
+	} else if (scaler) {
+		// Interlaced images need all the rows for each pass, at their full size
+		row = malloc(width * height * 4);
+		row_ptrs = (png_bytep *)malloc(sizeof(png_bytep) * height);
+		for (i = 0; i < height; i++) {
+			row_ptrs[i] = row + i*width*4;
+		}
+		png_read_image(png_ptr, row_ptrs);
+		for (i = 0; i < height && sfil_scaler_push(scaler, row_ptrs[i]); i++);
+		free(row_ptrs);
+		row_ptrs = NULL;
+		free(row);
+		row = NULL;
+	} else {
+		// Interlaced images need all the rows for each pass
+		int stride = texture->pow2_w * 4;
+		row_ptrs = (png_bytep *)malloc(sizeof(png_bytep) * height);
+		for (i = 0; i < height; i++) {
+			row_ptrs[i] = (png_bytep)(texture->data + i*stride);
+		}
+		png_read_image(png_ptr, row_ptrs);
+		free(row_ptrs);
+		row_ptrs = NULL;
+		sf2d_texture_tile32(texture);
+	}
+	sfil_scaler_free(scaler);
 
 	png_destroy_read_struct(&png_ptr, &info_ptr, (png_infopp)0);
-	free(row_ptrs);
 
-	sf2d_texture_tile32(texture);
+	GSPGPU_FlushDataCache(texture->data, texture->data_size);
 	return texture;
 
 exit_destroy_read:
@@ -100,7 +176,7 @@ exit_error:
 }
 
 
-sf2d_texture *sfil_load_PNG_file(const char *filename, sf2d_place place)
+static sf2d_texture *_sfil_load_PNG_file(const char *filename, sf2d_place place, const sfil_load_options *options)
 {
 	png_byte pngsig[PNG_SIGSIZE];
 	FILE *fp;
@@ -117,7 +193,7 @@ sf2d_texture *sfil_load_PNG_file(const char *filename, sf2d_place place)
 		goto exit_close;
 	}
 
-	sf2d_texture *texture = _sfil_load_PNG_generic((void *)fp, _sfil_read_png_file_fn, place);
+	sf2d_texture *texture = _sfil_load_PNG_generic((void *)fp, _sfil_read_png_file_fn, place, options);
 	fclose(fp);
 	return texture;
 
@@ -127,13 +203,23 @@ exit_error:
 	return NULL;
 }
 
+sf2d_texture *sfil_load_PNG_file(const char *filename, sf2d_place place)
+{
+	return _sfil_load_PNG_file(filename, place, NULL);
+}
+
+sf2d_texture *sfil_load_PNG_file_options(const char *filename, sf2d_place place, const sfil_load_options *options)
+{
+	return _sfil_load_PNG_file(filename, place, options);
+}
+
 sf2d_texture *sfil_load_PNG_buffer(const void *buffer, sf2d_place place)
 {
 	if (png_sig_cmp((png_byte *) buffer, 0, PNG_SIGSIZE) != 0) {
 		return NULL;
 	}
 
-	unsigned int buffer_address = (unsigned int)buffer + PNG_SIGSIZE;
+	const unsigned char *buffer_address = (const unsigned char *)buffer + PNG_SIGSIZE;
 
-	return _sfil_load_PNG_generic((void *)&buffer_address, _sfil_read_png_buffer_fn, place);
+	return _sfil_load_PNG_generic((void *)&buffer_address, _sfil_read_png_buffer_fn, place, NULL);
 }
@@ -0,0 +1,187 @@
+#include "sfil_scale.h"
+#include <sf2d_tile.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct sfil_scaler {
+	int x, y, w, h;       // region
+	int out_w, out_h;
+	int row;              // next image row pushed
+	int out_row;          // output row being accumulated
+	int rows;             // image rows accumulated in it
+	int *col;             // output column of each region column
+	int *col_count;       // region columns of each output column
+	u32 *sums;            // RGBA sums of the output row, up to 16M texels each
+	u8 *out;
+	sfil_scaler_emit emit;
+	void *ctx;
+};
+
+int sfil_options_apply(const sfil_load_options *options, int width, int height, int region[4], int *out_w, int *out_h)
+{
+	sfil_load_options none = { 0 };
+	if (!options) options = &none;
+
+	int x = options->region_x, y = options->region_y;
+	if (x < 0 || y < 0 || x >= width || y >= height || options->region_w < 0 || options->region_h < 0)
+		return 0;
+	int w = width - x, h = height - y;
+	if (options->region_w > 0 && options->region_w < w) w = options->region_w;
+	if (options->region_h > 0 && options->region_h < h) h = options->region_h;
+	region[0] = x;
+	region[1] = y;
+	region[2] = w;
+	region[3] = h;
+
+	// Fit in the maximum size, keeping the aspect ratio
+	int max_w = options->max_width > 0 && options->max_width < w ? options->max_width : w;
+	int max_h = options->max_height > 0 && options->max_height < h ? options->max_height : h;
+	if (max_w == w && max_h == h) {
+		*out_w = w;
+		*out_h = h;
+	} else if ((s64)w * max_h > (s64)h * max_w) {
+		*out_w = max_w;
+		*out_h = (s64)h * max_w / w;
+	} else {
+		*out_w = (s64)w * max_h / h;
+		*out_h = max_h;
+	}
+	if (*out_w < 1) *out_w = 1;
+	if (*out_h < 1) *out_h = 1;
+	return 1;
+}
+
+sfil_scaler *sfil_scaler_create(int image_w, const int region[4], int out_w, int out_h, sfil_scaler_emit emit, void *ctx)
+{
+	if (region[0] + region[2] > image_w || out_w > region[2] || out_h > region[3])
+		return NULL;
+
+	sfil_scaler *scaler = calloc(1, sizeof(*scaler));
+	if (!scaler)
+		return NULL;
+	scaler->x = region[0];
+	scaler->y = region[1];
+	scaler->w = region[2];
+	scaler->h = region[3];
+	scaler->out_w = out_w;
+	scaler->out_h = out_h;
+	scaler->emit = emit;
+	scaler->ctx = ctx;
+
+	// Rows of the right size are passed through
+	if (out_w == region[2] && out_h == region[3])
+		return scaler;
+
+	scaler->col = malloc(region[2] * sizeof(int));
+	scaler->col_count = calloc(out_w, sizeof(int));
+	scaler->sums = calloc(out_w * 4, sizeof(u32));
+	scaler->out = malloc(out_w * 4);
+	if (!scaler->col || !scaler->col_count || !scaler->sums || !scaler->out) {
+		sfil_scaler_free(scaler);
+		return NULL;
+	}
+	int i;
+	for (i = 0; i < region[2]; i++) {
+		scaler->col[i] = (s64)i * out_w / region[2];
+		scaler->col_count[scaler->col[i]]++;
+	}
+	return scaler;
+}
+
+static void emit_row(sfil_scaler *scaler)
+{
+	int i, c;
+	for (i = 0; i < scaler->out_w; i++) {
+		u32 count = scaler->col_count[i] * scaler->rows;
+		for (c = 0; c < 4; c++)
+			scaler->out[i*4 + c] = (scaler->sums[i*4 + c] + count / 2) / count;
+	}
+	scaler->emit(scaler->ctx, scaler->out_row, scaler->out);
+	memset(scaler->sums, 0, scaler->out_w * 4 * sizeof(u32));
+	scaler->rows = 0;
+}
+
+int sfil_scaler_push(sfil_scaler *scaler, const void *row)
+{
+	int r = scaler->row++ - scaler->y;
+	if (r < 0)
+		return 1;
+	if (r >= scaler->h)
+		return 0;
+
+	const u8 *src = (const u8 *)row + scaler->x * 4;
+	if (!scaler->sums) {
+		scaler->emit(scaler->ctx, r, src);
+		return r + 1 < scaler->h;
+	}
+
+	int out_row = (s64)r * scaler->out_h / scaler->h;
+	if (out_row != scaler->out_row) {
+		emit_row(scaler);
+		scaler->out_row = out_row;
+	}
+	int i;
+	for (i = 0; i < scaler->w; i++, src += 4) {
+		u32 *sum = scaler->sums + scaler->col[i] * 4;
+		sum[0] += src[0];
+		sum[1] += src[1];
+		sum[2] += src[2];
+		sum[3] += src[3];
+	}
+	scaler->rows++;
+
+	if (r + 1 < scaler->h)
+		return 1;
+	emit_row(scaler);
+	return 0;
+}
+
+void sfil_scaler_free(sfil_scaler *scaler)
+{
+	if (!scaler)
+		return;
+	free(scaler->col);
+	free(scaler->col_count);
+	free(scaler->sums);
+	free(scaler->out);
+	free(scaler);
+}
+
+void sfil_scaler_emit_texture(void *texture, int y, const void *rgba)
+{
+	sf2d_tile_texture_rows_convert(texture, y, 1, rgba, 0, SF2D_PIXEL_RGBA8);
+}
+
+typedef struct {
+	u8 *data;
+	int pitch;
+} buffer_ctx;
+
+static void emit_buffer(void *ctx, int y, const void *rgba)
+{
+	buffer_ctx *buffer = ctx;
+	memcpy(buffer->data + y * buffer->pitch, rgba, buffer->pitch);
+}
+
+void *sfil_scale_RGBA8(const void *rgba, int width, int height, const sfil_load_options *options, int *out_w, int *out_h)
+{
+	int region[4];
+	if (!sfil_options_apply(options, width, height, region, out_w, out_h))
+		return NULL;
+
+	buffer_ctx buffer = { malloc(*out_w * *out_h * 4), *out_w * 4 };
+	if (!buffer.data)
+		return NULL;
+	sfil_scaler *scaler = sfil_scaler_create(width, region, *out_w, *out_h, emit_buffer, &buffer);
+	if (!scaler) {
+		free(buffer.data);
+		return NULL;
+	}
+	// The rows above the region aren't needed
+	scaler->row = region[1];
+	int y;
+	for (y = region[1]; y < region[1] + region[3]; y++)
+		sfil_scaler_push(scaler, (const u8 *)rgba + y * width * 4);
+	sfil_scaler_free(scaler);
+	return buffer.data;
+}
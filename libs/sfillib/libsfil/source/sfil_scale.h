@@ -0,0 +1,26 @@
+#ifndef SFIL_SCALE_H
+#define SFIL_SCALE_H
+
+#include "sfil.h"
+
+/*
+ * Streaming box filter: takes the rows of an image one by one, as they're
+ * decoded, and outputs the rows of its region scaled down, each output texel
+ * being the average of the image texels it covers.
+ */
+typedef void (*sfil_scaler_emit)(void *ctx, int y, const void *rgba);
+
+typedef struct sfil_scaler sfil_scaler;
+
+// Scaler of a region (x, y, w, h) of an image image_w wide to out_w x out_h, at most the size of the region
+sfil_scaler *sfil_scaler_create(int image_w, const int region[4], int out_w, int out_h, sfil_scaler_emit emit, void *ctx);
+
+// Takes the next row of the image, in RGBA bytes; returns 0 once the region is done and no more rows are needed
+int sfil_scaler_push(sfil_scaler *scaler, const void *row);
+
+void sfil_scaler_free(sfil_scaler *scaler);
+
+// Emitter writing the rows to a RGBA8 texture
+void sfil_scaler_emit_texture(void *texture, int y, const void *rgba);
+
+#endif
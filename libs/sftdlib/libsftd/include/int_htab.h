@@ -24,7 +24,8 @@ int_htab *int_htab_create(size_t size);
 void int_htab_free(int_htab *htab);
 int int_htab_insert(int_htab *htab, unsigned int key, void *value);
 void *int_htab_find(const int_htab *htab, unsigned int key);
-int int_htab_erase(const int_htab *htab, unsigned int key);
+// Also frees the value
+int int_htab_erase(int_htab *htab, unsigned int key);
 
 
 #ifdef __cplusplus
@@ -21,6 +21,31 @@ extern "C" {
  */
 typedef struct sftd_font sftd_font;
 
+/**
+ * @brief Represents a text laid out once, ready to be drawn
+ */
+typedef struct sftd_text sftd_text;
+
+/**
+ * @brief How the glyphs of a font are rasterized and drawn
+ */
+typedef enum {
+	SFTD_MODE_BITMAP, ///< a bitmap for each size, drawn as is
+	SFTD_MODE_SDF     ///< a distance field for all sizes, thresholded on the GPU
+} sftd_mode;
+
+/**
+ * @brief Statistics of the glyph atlas of a font
+ */
+typedef struct {
+	unsigned int hits;      ///< glyph lookups found in the atlas
+	unsigned int misses;    ///< glyph lookups which had to be rasterized
+	unsigned int evictions; ///< glyphs evicted to make room for new ones
+	unsigned int glyphs;    ///< glyphs currently in the atlas
+	int pages;              ///< allocated pages
+	int max_pages;          ///< maximum number of pages
+} sftd_atlas_stats;
+
 // Basic functions
 
 /**
@@ -159,6 +184,107 @@ void sftd_calc_bounding_box(int *boundingWidth, int *boundingHeight, sftd_font *
  */
 void sftd_draw_textf_wrap(sftd_font *font, int x, int y, unsigned int color, unsigned int size, unsigned int lineWidth, const char *text, ...);
 
+// Prepared text functions
+
+/**
+ * @brief Lays out wide text once, so it can be drawn with a single draw call
+ * @param font the font to use; it must not be freed before the prepared text
+ * @param size the font size
+ * @param lineWidth the length of one line before a line break occurs, 0 to disable wrapping
+ * @param text a pointer to the wide text to lay out
+ * @return a pointer to the prepared text (NULL on error)
+ */
+sftd_text *sftd_prepare_wtext(sftd_font *font, unsigned int size, unsigned int lineWidth, const wchar_t *text);
+
+/**
+ * @brief Draws a prepared text, with one draw call per atlas page it uses.
+ *        It's laid out again if some of its glyphs were evicted from the atlas or
+ *        if the mode of the font changed, in a new vertex buffer if the GPU may
+ *        still read the current one.
+ * @param text the prepared text to draw
+ * @param x the x coordinate to draw the text to
+ * @param y the y coordinate to draw the text to
+ * @param color the color to draw the text
+ */
+void sftd_draw_prepared_text(sftd_text *text, int x, int y, unsigned int color);
+
+/**
+ * @brief Returns the size of a prepared text in pixels
+ * @param text the prepared text
+ * @param width pointer to the address where the width will be stored
+ * @param height pointer to the address where the height will be stored
+ */
+void sftd_get_prepared_text_size(const sftd_text *text, int *width, int *height);
+
+/**
+ * @brief Frees a prepared text; it must not be in use by the GPU anymore
+ * @param text pointer to the prepared text to free
+ */
+void sftd_free_prepared_text(sftd_text *text);
+
+// Glyph atlas functions
+
+/**
+ * @brief Returns the statistics of the glyph atlas of a font
+ * @param font the font
+ * @param stats pointer to where the statistics will be stored
+ */
+void sftd_get_atlas_stats(sftd_font *font, sftd_atlas_stats *stats);
+
+/**
+ * @brief Sets the maximum number of pages of the glyph atlas of a font.
+ *        Once they are all full, the least recently used glyphs of the least
+ *        recently used page are evicted.
+ * @param font the font
+ * @param max_pages the maximum number of pages; it can't be lowered
+ */
+void sftd_set_atlas_max_pages(sftd_font *font, int max_pages);
+
+/**
+ * @brief Sets the rendering mode of a font. In SDF mode, each glyph is
+ *        rasterized once as a signed distance field and drawn sharp at any
+ *        size, using less atlas space and rasterization when many sizes are drawn.
+ * @param font the font
+ * @param mode the new mode; the glyphs of the other mode are evicted as they stop being used
+ */
+void sftd_set_mode(sftd_font *font, sftd_mode mode);
+
+/**
+ * @brief Returns the rendering mode of a font
+ * @param font the font
+ * @return the mode
+ */
+sftd_mode sftd_get_mode(const sftd_font *font);
+
+/**
+ * @brief Rasterizes the glyphs of a wide text in the glyph atlas ahead of time,
+ *        so drawing them later doesn't go through FreeType
+ * @param font the font
+ * @param size the font size
+ * @param text a pointer to the wide text with the glyphs to load
+ * @param max_glyphs maximum number of glyphs to rasterize, -1 for no limit
+ * @param missing pointer to where the number of glyphs of the text still not in the atlas will be stored
+ * @return the number of rasterized glyphs
+ */
+int sftd_preload_wtext(sftd_font *font, unsigned int size, const wchar_t *text, int max_glyphs, int *missing);
+
+/**
+ * @brief Saves the glyphs in the atlas of a font (metrics and bitmaps) to a file
+ * @param font the font
+ * @param path the path of the file
+ * @return whether the file has been written or not
+ */
+int sftd_save_glyph_cache(sftd_font *font, const char *path);
+
+/**
+ * @brief Loads the glyphs of a file saved by sftd_save_glyph_cache in the atlas of a font, without
+ *        rasterizing them. Glyphs are added until the atlas is full, the most recently used ones first.
+ * @param font the font; it must be the one the file was saved from
+ * @param path the path of the file
+ * @return the number of loaded glyphs, -1 if the file couldn't be read or was saved from another font
+ */
+int sftd_load_glyph_cache(sftd_font *font, const char *path);
+
 #ifdef __cplusplus
 }
 #endif
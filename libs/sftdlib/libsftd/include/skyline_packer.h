@@ -0,0 +1,41 @@
+#ifndef SKYLINE_PACKER_H
+#define SKYLINE_PACKER_H
+
+#include "bin_packing_2d.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SKYLINE_MAX_FREE_RECTS 256
+
+typedef struct skyline_segment {
+	int x, y, w;
+} skyline_segment;
+
+typedef struct skyline_packer {
+	int width, height;
+	// The top of the packed rectangles, left to right; there can't be more segments than pixels in a row
+	skyline_segment *segments;
+	int num_segments;
+	// Released rectangles below the skyline, reused before growing it
+	bp2d_rectangle free_rects[SKYLINE_MAX_FREE_RECTS];
+	int num_free_rects;
+	int used_area;
+} skyline_packer;
+
+skyline_packer *skyline_create(int width, int height);
+void skyline_free(skyline_packer *packer);
+void skyline_reset(skyline_packer *packer);
+// 1 success, 0 failure
+int skyline_insert(skyline_packer *packer, const bp2d_size *in_size, bp2d_position *out_pos);
+// Makes the area of a rectangle returned by skyline_insert available again
+void skyline_release(skyline_packer *packer, const bp2d_rectangle *rect);
+// Fraction of the area used by the inserted rectangles
+float skyline_occupancy(const skyline_packer *packer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
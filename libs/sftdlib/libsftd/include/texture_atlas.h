@@ -3,6 +3,7 @@
 
 #include "sf2d.h"
 #include "bin_packing_2d.h"
+#include "skyline_packer.h"
 #include "int_htab.h"
 
 #ifdef __cplusplus
@@ -11,24 +12,59 @@ extern "C" {
 
 typedef struct atlas_htab_entry {
 	bp2d_rectangle rect;
+	int page;
 	int bitmap_left;
 	int bitmap_top;
 	int advance_x;
 	int advance_y;
 	int glyph_size;
+	unsigned int last_used; // sf2d frame count when the glyph was last used
 } atlas_htab_entry;
 
-typedef struct texture_atlas {
+typedef struct atlas_page {
 	sf2d_texture *tex;
-	bp2d_node *bp_root;
+	skyline_packer *packer;
+	unsigned int glyphs;
+	unsigned int last_used;  // sf2d frame count when a glyph of the page was last used
+	unsigned int generation; // incremented when glyphs of the page are evicted
+	int dirty_first, dirty_last; // rows of tiles written since the last flush, -1 if none
+} atlas_page;
+
+typedef struct texture_atlas_stats {
+	unsigned int hits;
+	unsigned int misses;
+	unsigned int evictions;
+	unsigned int glyphs;
+	int pages;
+	int max_pages;
+} texture_atlas_stats;
+
+typedef struct texture_atlas {
+	int width, height;
+	sf2d_texfmt format;
+	sf2d_place place;
+	atlas_page *pages;
+	int num_pages;
+	int max_pages;
 	int_htab *htab;
+	texture_atlas_stats stats;
 } texture_atlas;
 
-texture_atlas *texture_atlas_create(int width, int height, sf2d_texfmt format, sf2d_place place);
+texture_atlas *texture_atlas_create(int width, int height, sf2d_texfmt format, sf2d_place place, int max_pages);
 void texture_atlas_free(texture_atlas *atlas);
-int texture_atlas_insert(texture_atlas *atlas, unsigned int character, const void *image, int width, int height, int bitmap_left, int bitmap_top, int advance_x, int advance_y, int glyph_size);
-int texture_atlas_exists(texture_atlas *atlas, unsigned int character);
-void texture_atlas_get(texture_atlas *atlas, unsigned int character, bp2d_rectangle *rect, int *bitmap_left, int *bitmap_top, int *advance_x, int *advance_y, int *glyph_size);
+void texture_atlas_set_max_pages(texture_atlas *atlas, int max_pages);
+// Adds a glyph from its 8-bit coverage bitmap; returns the new entry, or NULL if there's no room
+// for it in a page unused in the current frame, or without evicting glyphs if no_evict is set.
+// Call texture_atlas_flush before drawing it.
+atlas_htab_entry *texture_atlas_insert(texture_atlas *atlas, unsigned int key, const unsigned char *alpha, int pitch, int width, int height, int bitmap_left, int bitmap_top, int advance_x, int advance_y, int glyph_size, int no_evict);
+// Reads the 8-bit coverage bitmap of a glyph back from its page
+void texture_atlas_read(const texture_atlas *atlas, const atlas_htab_entry *entry, unsigned char *alpha, int pitch);
+// Flushes the parts of the pages written since the last call from the CPU cache
+void texture_atlas_flush(texture_atlas *atlas);
+// Returns the entry, or NULL if it isn't in the atlas; marks its page as used in the current frame,
+// or between two frames with nothing left to render, in the next one
+atlas_htab_entry *texture_atlas_find(texture_atlas *atlas, unsigned int key);
+void texture_atlas_get_stats(const texture_atlas *atlas, texture_atlas_stats *stats);
 
 #ifdef __cplusplus
 }
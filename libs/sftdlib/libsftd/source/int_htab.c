@@ -35,6 +35,7 @@ void int_htab_free(int_htab *htab)
 		if (htab->entries[i].value != NULL)
 			free(htab->entries[i].value);
 	}
+	free(htab->entries);
 	free(htab);
 }
 
@@ -104,7 +105,7 @@ void *int_htab_find(const int_htab *htab, unsigned int key)
 	return NULL;
 }
 
-int int_htab_erase(const int_htab *htab, unsigned int key)
+int int_htab_erase(int_htab *htab, unsigned int key)
 {
 	unsigned int mask = htab->size - 1;
 	unsigned int idx = FNV_1a(key) & mask;
@@ -114,11 +115,31 @@ int int_htab_erase(const int_htab *htab, unsigned int key)
 		idx = (idx + 1) & mask;
 	}
 
-	/* Found the key */
-	if (htab->entries[idx].key == key) {
-		htab->entries[idx].value = NULL;
-		return 1;
+	/* Not found */
+	if (htab->entries[idx].value == NULL) {
+		return 0;
+	}
+
+	free(htab->entries[idx].value);
+	htab->used--;
+
+	/* Shift back the following entries of the probe sequence, so that no lookup stops at the hole */
+	unsigned int next = idx;
+	while (1) {
+		next = (next + 1) & mask;
+		if (htab->entries[next].value == NULL)
+			break;
+
+		unsigned int home = FNV_1a(htab->entries[next].key) & mask;
+		int stays = (idx <= next) ? (idx < home && home <= next) : (idx < home || home <= next);
+		if (!stays) {
+			htab->entries[idx] = htab->entries[next];
+			idx = next;
+		}
 	}
 
-	return 0;
+	htab->entries[idx].key = 0;
+	htab->entries[idx].value = NULL;
+
+	return 1;
 }
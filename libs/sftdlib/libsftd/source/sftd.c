@@ -3,13 +3,54 @@
 #include "bin_packing_2d.h"
 #include <wchar.h>
 #include <sf2d.h>
+#include <sf2d_convert.h>
 #include <ft2build.h>
 #include <string.h>
+#include <stdio.h>
+#include <math.h>
 #include FT_CACHE_H
 #include FT_FREETYPE_H
 
 #define ATLAS_DEFAULT_W 512
 #define ATLAS_DEFAULT_H 512
+#define ATLAS_DEFAULT_PAGES 4
+
+// Glyphs are rasterized for each size
+#define GLYPH_KEY(glyph_index, size) (((size) << 16) | ((glyph_index) & 0xFFFF))
+
+// Advance of a glyph (16.16 fixed point) at the drawing size, rounded to whole pixels
+#define GLYPH_ADVANCE(advance, draw_scale) ((int)floorf((advance) / 65536.0f * (draw_scale) + 0.5f))
+
+// Distance field glyphs are rasterized once at SDF_GLYPH_SIZE, with a field
+// going SDF_SPREAD pixels away from the edges, and scaled to any size
+#define SDF_GLYPH_SIZE 32
+#define SDF_SPREAD 4
+#define SDF_KEY_SIZE (0x8000 | SDF_GLYPH_SIZE)
+
+#define PREPARED_TEXT_MAX_QUADS (65536/4)
+
+// Glyph cache files: a header, then a record and the coverage bitmap of each glyph
+#define GLYPH_CACHE_MAGIC "SFGC"
+#define GLYPH_CACHE_VERSION 1
+
+typedef struct {
+	char magic[4];
+	u32 version;
+	u32 font_id;
+	u32 glyphs;
+} glyph_cache_header;
+
+typedef struct {
+	u32 key;
+	s32 bitmap_left;
+	s32 bitmap_top;
+	s32 advance_x;
+	s32 advance_y;
+	u16 glyph_size;
+	u16 width;
+	u16 height;
+	u16 reserved;
+} glyph_cache_record;
 
 static int sftd_initialized = 0;
 static FT_Library ftlibrary;
@@ -32,6 +73,7 @@ struct sftd_font {
 	FTC_CMapCache cmapcache;
 	FTC_ImageCache imagecache;
 	texture_atlas *tex_atlas;
+	sftd_mode mode;
 };
 
 static FT_Error ftc_face_requester(FTC_FaceID face_id, FT_Library library, FT_Pointer request_data, FT_Face *face)
@@ -116,8 +158,16 @@ sftd_font *sftd_load_font_file(const char *filename)
 	FTC_ImageCache_New(font->ftcmanager, &font->imagecache);
 
 	font->from = SFTD_LOAD_FROM_FILE;
+	font->mode = SFTD_MODE_BITMAP;
 	font->tex_atlas = texture_atlas_create(ATLAS_DEFAULT_W, ATLAS_DEFAULT_H,
-		TEXFMT_RGBA8, SF2D_PLACE_RAM);
+		TEXFMT_RGBA8, SF2D_PLACE_RAM, ATLAS_DEFAULT_PAGES);
+
+	if (!font->tex_atlas) {
+		FTC_Manager_Done(font->ftcmanager);
+		free(font->filename);
+		free(font);
+		return NULL;
+	}
 
 	return font;
 }
@@ -151,8 +201,15 @@ sftd_font *sftd_load_font_mem(const void *buffer, unsigned int size)
 	FTC_ImageCache_New(font->ftcmanager, &font->imagecache);
 
 	font->from = SFTD_LOAD_FROM_MEM;
+	font->mode = SFTD_MODE_BITMAP;
 	font->tex_atlas = texture_atlas_create(ATLAS_DEFAULT_W, ATLAS_DEFAULT_H,
-		TEXFMT_RGBA8, SF2D_PLACE_RAM);
+		TEXFMT_RGBA8, SF2D_PLACE_RAM, ATLAS_DEFAULT_PAGES);
+
+	if (!font->tex_atlas) {
+		FTC_Manager_Done(font->ftcmanager);
+		free(font);
+		return NULL;
+	}
 
 	return font;
 }
@@ -171,36 +228,273 @@ void sftd_free_font(sftd_font *font)
 	}
 }
 
-static int atlas_add_glyph(texture_atlas *atlas, unsigned int glyph_index, const FT_BitmapGlyph bitmap_glyph, int glyph_size)
+// Return the 8-bit coverage of a glyph bitmap, expanding 1-bit ones in *buffer (NULL if there isn't enough memory)
+static const unsigned char *glyph_coverage(const FT_Bitmap *bitmap, int *pitch, unsigned char **buffer)
 {
-	const FT_Bitmap *bitmap = &bitmap_glyph->bitmap;
-
-	unsigned int *buffer = malloc(bitmap->width * bitmap->rows * 4);
 	unsigned int w = bitmap->width;
 	unsigned int h = bitmap->rows;
 
-	int j, k;
-	for (j = 0; j < h; j++) {
-		for (k = 0; k < w; k++) {
-			if (bitmap->pixel_mode == FT_PIXEL_MODE_MONO) {
-				buffer[j*w + k] =
-					(bitmap->buffer[j*bitmap->pitch + k/8] & (1 << (7 - k%8)))
-					? 0xFF : 0;
-			} else {
-				buffer[j*w + k] = 0x00FFFFFF | (bitmap->buffer[j*bitmap->pitch + k] << 24);
-			}
-		}
-	}
+	*buffer = NULL;
+	*pitch = bitmap->pitch;
+	if (bitmap->pixel_mode != FT_PIXEL_MODE_MONO)
+		return bitmap->buffer;
+
+	*buffer = malloc(w * h);
+	if (!*buffer)
+		return NULL;
+
+	sf2d_convert_rect(*buffer, w, SF2D_PIXEL_COVERAGE, bitmap->buffer, bitmap->pitch, SF2D_PIXEL_MONO, w, h);
+	*pitch = w;
+
+	return *buffer;
+}
 
-	int ret = texture_atlas_insert(atlas, glyph_index, buffer,
+static atlas_htab_entry *atlas_add_glyph(texture_atlas *atlas, unsigned int key, const FT_BitmapGlyph bitmap_glyph, int glyph_size)
+{
+	const FT_Bitmap *bitmap = &bitmap_glyph->bitmap;
+
+	// The atlas takes one byte of coverage per pixel
+	unsigned char *buffer;
+	int pitch;
+	const unsigned char *alpha = glyph_coverage(bitmap, &pitch, &buffer);
+	if (!alpha && bitmap->rows > 0)
+		return NULL;
+
+	atlas_htab_entry *entry = texture_atlas_insert(atlas, key, alpha, pitch,
 		bitmap->width, bitmap->rows,
 		bitmap_glyph->left, bitmap_glyph->top,
 		bitmap_glyph->root.advance.x, bitmap_glyph->root.advance.y,
-		glyph_size);
+		glyph_size, 0);
 
 	free(buffer);
 
-	return ret;
+	return entry;
+}
+
+// Propagate the nearest seed (pixel with a bias, see compute_sdf) of each pixel from one neighbor
+static inline void sdf_propagate(float *distance, int *nearest, const float *bias, int field_w, int p, int neighbor)
+{
+	int q = nearest[neighbor];
+	if (q < 0)
+		return;
+
+	int dx = p % field_w - q % field_w;
+	int dy = p / field_w - q / field_w;
+	float d = sqrtf(dx*dx + dy*dy) + bias[q];
+	if (d < distance[p]) {
+		distance[p] = d;
+		nearest[p] = q;
+	}
+}
+
+/*
+ * Distance from each pixel to the nearest seed, where the distance to a seed
+ * q is |p - q| + bias[q] (bias is negative if q isn't a seed): two raster
+ * scans propagating the nearest seed of the neighbors (dead reckoning).
+ */
+static void sdf_distance_transform(float *distance, int *nearest, const float *bias, int field_w, int field_h)
+{
+	int x, y, p;
+	for (p = 0; p < field_w * field_h; p++) {
+		distance[p] = bias[p] >= 0 ? bias[p] : SDF_SPREAD;
+		nearest[p] = bias[p] >= 0 ? p : -1;
+	}
+
+	for (y = 0; y < field_h; y++) {
+		for (x = 0; x < field_w; x++) {
+			p = y*field_w + x;
+			if (x > 0) sdf_propagate(distance, nearest, bias, field_w, p, p - 1);
+			if (y > 0) {
+				if (x > 0) sdf_propagate(distance, nearest, bias, field_w, p, p - field_w - 1);
+				sdf_propagate(distance, nearest, bias, field_w, p, p - field_w);
+				if (x < field_w - 1) sdf_propagate(distance, nearest, bias, field_w, p, p - field_w + 1);
+			}
+		}
+	}
+	for (y = field_h - 1; y >= 0; y--) {
+		for (x = field_w - 1; x >= 0; x--) {
+			p = y*field_w + x;
+			if (x < field_w - 1) sdf_propagate(distance, nearest, bias, field_w, p, p + 1);
+			if (y < field_h - 1) {
+				if (x < field_w - 1) sdf_propagate(distance, nearest, bias, field_w, p, p + field_w + 1);
+				sdf_propagate(distance, nearest, bias, field_w, p, p + field_w);
+				if (x > 0) sdf_propagate(distance, nearest, bias, field_w, p, p + field_w - 1);
+			}
+		}
+	}
+}
+
+/*
+ * Compute the signed distance field of a coverage bitmap, with a margin of
+ * SDF_SPREAD pixels: 128 on the edges, decreasing to 0 at SDF_SPREAD pixels
+ * outside and increasing to 255 inside. The distance to the nearest pixel
+ * covering some of the other side is corrected by its coverage, to place the
+ * edge within it. Returns 0 if there isn't enough memory.
+ */
+static int compute_sdf(const unsigned char *coverage, int pitch, int w, int h, unsigned char *field)
+{
+	int field_w = w + 2*SDF_SPREAD;
+	int field_h = h + 2*SDF_SPREAD;
+	int size = field_w * field_h;
+
+	float *bias_out = malloc(size * sizeof(float));
+	float *bias_in = malloc(size * sizeof(float));
+	float *distance_out = malloc(size * sizeof(float));
+	float *distance_in = malloc(size * sizeof(float));
+	int *nearest = malloc(size * sizeof(int));
+	if (!bias_out || !bias_in || !distance_out || !distance_in || !nearest) {
+		free(bias_out);
+		free(bias_in);
+		free(distance_out);
+		free(distance_in);
+		free(nearest);
+		return 0;
+	}
+
+	int x, y;
+	for (y = 0; y < field_h; y++) {
+		for (x = 0; x < field_w; x++) {
+			int sx = x - SDF_SPREAD;
+			int sy = y - SDF_SPREAD;
+			int c = (sx >= 0 && sx < w && sy >= 0 && sy < h) ? coverage[sy*pitch + sx] : 0;
+			// Seeds of the outside pixels are partly inside, and the other way around
+			bias_out[y*field_w + x] = c > 0 ? 0.5f - c/255.0f : -1.0f;
+			bias_in[y*field_w + x] = c < 255 ? c/255.0f - 0.5f : -1.0f;
+		}
+	}
+
+	sdf_distance_transform(distance_out, nearest, bias_out, field_w, field_h);
+	sdf_distance_transform(distance_in, nearest, bias_in, field_w, field_h);
+
+	for (y = 0; y < field_h; y++) {
+		for (x = 0; x < field_w; x++) {
+			int sx = x - SDF_SPREAD;
+			int sy = y - SDF_SPREAD;
+			int c = (sx >= 0 && sx < w && sy >= 0 && sy < h) ? coverage[sy*pitch + sx] : 0;
+
+			int value = c >= 128 ?
+				128 + distance_in[y*field_w + x]*128/SDF_SPREAD :
+				128 - distance_out[y*field_w + x]*128/SDF_SPREAD;
+			field[y*field_w + x] = value < 0 ? 0 : value > 255 ? 255 : value;
+		}
+	}
+
+	free(bias_out);
+	free(bias_in);
+	free(distance_out);
+	free(distance_in);
+	free(nearest);
+
+	return 1;
+}
+
+// Rasterize a glyph at SDF_GLYPH_SIZE and add its distance field to the atlas (NULL on error)
+static const atlas_htab_entry *rasterize_sdf_glyph(sftd_font *font, FTC_Scaler scaler, FT_UInt glyph_index, unsigned int key)
+{
+	FTC_ScalerRec sdf_scaler = *scaler;
+	sdf_scaler.width = SDF_GLYPH_SIZE;
+	sdf_scaler.height = SDF_GLYPH_SIZE;
+
+	// Hinting is for one size, the field is drawn at all of them
+	FT_Glyph glyph;
+	FT_ULong flags = FT_LOAD_RENDER | FT_LOAD_NO_HINTING;
+	FT_Error error = FTC_ImageCache_LookupScaler(font->imagecache, &sdf_scaler, flags, glyph_index, &glyph, NULL);
+
+	// The kerning is scaled with the active size of the face
+	FT_Size ft_size;
+	FTC_Manager_LookupSize(font->ftcmanager, scaler, &ft_size);
+
+	if (error != FT_Err_Ok)
+		return NULL;
+
+	const FT_BitmapGlyph bitmap_glyph = (FT_BitmapGlyph)glyph;
+	const FT_Bitmap *bitmap = &bitmap_glyph->bitmap;
+	int w = bitmap->width;
+	int h = bitmap->rows;
+
+	// Empty glyphs (spaces) stay empty
+	int margin = (w > 0 && h > 0) ? SDF_SPREAD : 0;
+	unsigned char *field = NULL;
+	if (margin > 0) {
+		unsigned char *buffer;
+		int pitch;
+		const unsigned char *coverage = glyph_coverage(bitmap, &pitch, &buffer);
+		field = malloc((w + 2*margin) * (h + 2*margin));
+		if (!coverage || !field) {
+			free(buffer);
+			free(field);
+			return NULL;
+		}
+		int ok = compute_sdf(coverage, pitch, w, h, field);
+		free(buffer);
+		if (!ok) {
+			free(field);
+			return NULL;
+		}
+	}
+
+	atlas_htab_entry *entry = texture_atlas_insert(font->tex_atlas, key, field, w + 2*margin,
+		w + 2*margin, h + 2*margin,
+		bitmap_glyph->left - margin, bitmap_glyph->top + margin,
+		bitmap_glyph->root.advance.x, bitmap_glyph->root.advance.y,
+		SDF_GLYPH_SIZE, 0);
+
+	free(field);
+
+	return entry;
+}
+
+// Rasterize a glyph at the scaler size and add it to the atlas (NULL on error)
+static const atlas_htab_entry *rasterize_glyph(sftd_font *font, FTC_Scaler scaler, FT_UInt glyph_index, unsigned int key)
+{
+	FT_Glyph glyph;
+	FT_ULong flags = FT_LOAD_RENDER | FT_LOAD_TARGET_NORMAL;
+
+	if (FTC_ImageCache_LookupScaler(font->imagecache, scaler, flags, glyph_index, &glyph, NULL) != FT_Err_Ok)
+		return NULL;
+
+	return atlas_add_glyph(font->tex_atlas, key, (FT_BitmapGlyph)glyph, scaler->width);
+}
+
+// Return the atlas key of a glyph drawn at the scaler size
+static unsigned int glyph_key(const sftd_font *font, FTC_Scaler scaler, FT_UInt glyph_index)
+{
+	return GLYPH_KEY(glyph_index, font->mode == SFTD_MODE_SDF ? SDF_KEY_SIZE : scaler->width);
+}
+
+// Rasterize a glyph for the mode of the font
+static const atlas_htab_entry *rasterize_glyph_mode(sftd_font *font, FTC_Scaler scaler, FT_UInt glyph_index, unsigned int key)
+{
+	if (font->mode == SFTD_MODE_SDF)
+		return rasterize_sdf_glyph(font, scaler, glyph_index, key);
+	return rasterize_glyph(font, scaler, glyph_index, key);
+}
+
+// Return the atlas entry of a glyph at the scaler size, rasterizing it if needed (NULL on error)
+static const atlas_htab_entry *get_glyph(sftd_font *font, FTC_Scaler scaler, FT_UInt glyph_index)
+{
+	unsigned int key = glyph_key(font, scaler, glyph_index);
+
+	const atlas_htab_entry *entry = texture_atlas_find(font->tex_atlas, key);
+	if (!entry)
+		entry = rasterize_glyph_mode(font, scaler, glyph_index, key);
+
+	return entry;
+}
+
+// Draw a glyph of the atlas, scaled from the size it was rasterized at
+static void draw_glyph(sftd_font *font, const atlas_htab_entry *entry, float x, float y, float draw_scale, unsigned int color)
+{
+	const bp2d_rectangle rect = entry->rect;
+	const sf2d_texture *tex = font->tex_atlas->pages[entry->page].tex;
+
+	if (font->mode == SFTD_MODE_SDF) {
+		sf2d_draw_texture_part_scale_sdf(tex, x, y, rect.x, rect.y, rect.w, rect.h,
+			draw_scale, draw_scale, color, SDF_SPREAD * draw_scale);
+	} else {
+		sf2d_draw_texture_part_scale_blend(tex, x, y, rect.x, rect.y, rect.w, rect.h,
+			draw_scale, draw_scale, color);
+	}
 }
 
 void sftd_draw_text(sftd_font *font, int x, int y, unsigned int color, unsigned int size, const char *text)
@@ -212,7 +506,6 @@ void sftd_draw_text(sftd_font *font, int x, int y, unsigned int color, unsigned
 	FT_Int charmap_index;
 	charmap_index = FT_Get_Charmap_Index(face->charmap);
 
-	FT_Glyph glyph;
 	FT_Bool use_kerning = FT_HAS_KERNING(face);
 	FT_UInt glyph_index, previous = 0;
 	int pen_x = x;
@@ -224,7 +517,9 @@ void sftd_draw_text(sftd_font *font, int x, int y, unsigned int color, unsigned
 	scaler.height = size;
 	scaler.pixel = 1;
 
-	FT_ULong flags = FT_LOAD_RENDER | FT_LOAD_TARGET_NORMAL;
+	// The kerning is scaled with the active size of the face
+	FT_Size ft_size;
+	FTC_Manager_LookupSize(font->ftcmanager, &scaler, &ft_size);
 
 	while (*text) {
 		if(*text == '\n') {
@@ -242,39 +537,27 @@ void sftd_draw_text(sftd_font *font, int x, int y, unsigned int color, unsigned
 			pen_x += delta.x >> 6;
 		}
 
-		if (!texture_atlas_exists(font->tex_atlas, glyph_index)) {
-			FTC_ImageCache_LookupScaler(font->imagecache, &scaler, flags, glyph_index, &glyph, NULL);
-
-			if (!atlas_add_glyph(font->tex_atlas, glyph_index, (FT_BitmapGlyph)glyph, size)) {
-				continue;
-			}
+		const atlas_htab_entry *entry = get_glyph(font, &scaler, glyph_index);
+		if (!entry) {
+			text++;
+			continue;
 		}
 
-		bp2d_rectangle rect;
-		int bitmap_left, bitmap_top;
-		int advance_x, advance_y;
-		int glyph_size;
+		const float draw_scale = size/(float)entry->glyph_size;
 
-		texture_atlas_get(font->tex_atlas, glyph_index,
-			&rect, &bitmap_left, &bitmap_top,
-			&advance_x, &advance_y, &glyph_size);
+		draw_glyph(font, entry,
+			pen_x + entry->bitmap_left * draw_scale,
+			pen_y - entry->bitmap_top * draw_scale,
+			draw_scale, color);
 
-		const float draw_scale = size/(float)glyph_size;
-
-		sf2d_draw_texture_part_scale_blend(font->tex_atlas->tex,
-			pen_x + bitmap_left * draw_scale,
-			pen_y - bitmap_top * draw_scale,
-			rect.x, rect.y, rect.w, rect.h,
-			draw_scale,
-			draw_scale,
-			color);
-
-		pen_x += (advance_x >> 16) * draw_scale;
-		pen_y += (advance_y >> 16) * draw_scale;
+		pen_x += GLYPH_ADVANCE(entry->advance_x, draw_scale);
+		pen_y += GLYPH_ADVANCE(entry->advance_y, draw_scale);
 
 		previous = glyph_index;
 		text++;
 	}
+
+	texture_atlas_flush(font->tex_atlas);
 }
 
 void sftd_draw_textf(sftd_font *font, int x, int y, unsigned int color, unsigned int size, const char *text, ...)
@@ -296,7 +579,6 @@ void sftd_draw_wtext(sftd_font *font, int x, int y, unsigned int color, unsigned
 	FT_Int charmap_index;
 	charmap_index = FT_Get_Charmap_Index(face->charmap);
 
-	FT_Glyph glyph;
 	FT_Bool use_kerning = FT_HAS_KERNING(face);
 	FT_UInt glyph_index, previous = 0;
 	int pen_x = x;
@@ -308,7 +590,9 @@ void sftd_draw_wtext(sftd_font *font, int x, int y, unsigned int color, unsigned
 	scaler.height = size;
 	scaler.pixel = 1;
 
-	FT_ULong flags = FT_LOAD_RENDER | FT_LOAD_TARGET_NORMAL;
+	// The kerning is scaled with the active size of the face
+	FT_Size ft_size;
+	FTC_Manager_LookupSize(font->ftcmanager, &scaler, &ft_size);
 
 	while (*text) {
 		if(*text == '\n') {
@@ -326,39 +610,27 @@ void sftd_draw_wtext(sftd_font *font, int x, int y, unsigned int color, unsigned
 			pen_x += delta.x >> 6;
 		}
 
-		if (!texture_atlas_exists(font->tex_atlas, glyph_index)) {
-			FTC_ImageCache_LookupScaler(font->imagecache, &scaler, flags, glyph_index, &glyph, NULL);
-
-			if (!atlas_add_glyph(font->tex_atlas, glyph_index, (FT_BitmapGlyph)glyph, size)) {
-				continue;
-			}
+		const atlas_htab_entry *entry = get_glyph(font, &scaler, glyph_index);
+		if (!entry) {
+			text++;
+			continue;
 		}
 
-		bp2d_rectangle rect;
-		int bitmap_left, bitmap_top;
-		int advance_x, advance_y;
-		int glyph_size;
+		const float draw_scale = size/(float)entry->glyph_size;
 
-		texture_atlas_get(font->tex_atlas, glyph_index,
-			&rect, &bitmap_left, &bitmap_top,
-			&advance_x, &advance_y, &glyph_size);
+		draw_glyph(font, entry,
+			pen_x + entry->bitmap_left * draw_scale,
+			pen_y - entry->bitmap_top * draw_scale,
+			draw_scale, color);
 
-		const float draw_scale = size/(float)glyph_size;
-
-		sf2d_draw_texture_part_scale_blend(font->tex_atlas->tex,
-			pen_x + bitmap_left * draw_scale,
-			pen_y - bitmap_top * draw_scale,
-			rect.x, rect.y, rect.w, rect.h,
-			draw_scale,
-			draw_scale,
-			color);
-
-		pen_x += (advance_x >> 16) * draw_scale;
-		pen_y += (advance_y >> 16) * draw_scale;
+		pen_x += GLYPH_ADVANCE(entry->advance_x, draw_scale);
+		pen_y += GLYPH_ADVANCE(entry->advance_y, draw_scale);
 
 		previous = glyph_index;
 		text++;
 	}
+
+	texture_atlas_flush(font->tex_atlas);
 }
 
 void sftd_draw_wtextf(sftd_font *font, int x, int y, unsigned int color, unsigned int size, const wchar_t *text, ...)
@@ -380,7 +652,6 @@ int sftd_get_text_width(sftd_font *font, unsigned int size, const char *text)
 	FT_Int charmap_index;
 	charmap_index = FT_Get_Charmap_Index(face->charmap);
 
-	FT_Glyph glyph;
 	FT_Bool use_kerning = FT_HAS_KERNING(face);
 	FT_UInt glyph_index, previous = 0;
 	int pen_x = 0;
@@ -392,7 +663,9 @@ int sftd_get_text_width(sftd_font *font, unsigned int size, const char *text)
 	scaler.height = size;
 	scaler.pixel = 1;
 
-	FT_ULong flags = FT_LOAD_RENDER | FT_LOAD_TARGET_NORMAL;
+	// The kerning is scaled with the active size of the face
+	FT_Size ft_size;
+	FTC_Manager_LookupSize(font->ftcmanager, &scaler, &ft_size);
 
 	while (*text) {
 		glyph_index = FTC_CMapCache_Lookup(font->cmapcache, (FTC_FaceID)font, charmap_index, *text);
@@ -403,31 +676,22 @@ int sftd_get_text_width(sftd_font *font, unsigned int size, const char *text)
 			pen_x += delta.x >> 6;
 		}
 
-		if (!texture_atlas_exists(font->tex_atlas, glyph_index)) {
-			FTC_ImageCache_LookupScaler(font->imagecache, &scaler, flags, glyph_index, &glyph, NULL);
-
-			if (!atlas_add_glyph(font->tex_atlas, glyph_index, (FT_BitmapGlyph)glyph, size)) {
-				continue;
-			}
+		const atlas_htab_entry *entry = get_glyph(font, &scaler, glyph_index);
+		if (!entry) {
+			text++;
+			continue;
 		}
 
-		bp2d_rectangle rect;
-		int bitmap_left, bitmap_top;
-		int advance_x, advance_y;
-		int glyph_size;
+		const float draw_scale = size/(float)entry->glyph_size;
 
-		texture_atlas_get(font->tex_atlas, glyph_index,
-			&rect, &bitmap_left, &bitmap_top,
-			&advance_x, &advance_y, &glyph_size);
-
-		const float draw_scale = size/(float)glyph_size;
-
-		pen_x += (advance_x >> 16) * draw_scale;
-		pen_y += (advance_y >> 16) * draw_scale;
+		pen_x += GLYPH_ADVANCE(entry->advance_x, draw_scale);
+		pen_y += GLYPH_ADVANCE(entry->advance_y, draw_scale);
 
 		previous = glyph_index;
 		text++;
 	}
+
+	texture_atlas_flush(font->tex_atlas);
 	return pen_x;
 }
 
@@ -440,7 +704,6 @@ int sftd_get_wtext_width(sftd_font *font, unsigned int size, const wchar_t *text
 	FT_Int charmap_index;
 	charmap_index = FT_Get_Charmap_Index(face->charmap);
 
-	FT_Glyph glyph;
 	FT_Bool use_kerning = FT_HAS_KERNING(face);
 	FT_UInt glyph_index, previous = 0;
 	int pen_x = 0;
@@ -452,7 +715,9 @@ int sftd_get_wtext_width(sftd_font *font, unsigned int size, const wchar_t *text
 	scaler.height = size;
 	scaler.pixel = 1;
 
-	FT_ULong flags = FT_LOAD_RENDER | FT_LOAD_TARGET_NORMAL;
+	// The kerning is scaled with the active size of the face
+	FT_Size ft_size;
+	FTC_Manager_LookupSize(font->ftcmanager, &scaler, &ft_size);
 
 	while (*text) {
 		glyph_index = FTC_CMapCache_Lookup(font->cmapcache, (FTC_FaceID)font, charmap_index, *text);
@@ -463,31 +728,22 @@ int sftd_get_wtext_width(sftd_font *font, unsigned int size, const wchar_t *text
 			pen_x += delta.x >> 6;
 		}
 
-		if (!texture_atlas_exists(font->tex_atlas, glyph_index)) {
-			FTC_ImageCache_LookupScaler(font->imagecache, &scaler, flags, glyph_index, &glyph, NULL);
-
-			if (!atlas_add_glyph(font->tex_atlas, glyph_index, (FT_BitmapGlyph)glyph, size)) {
-				continue;
-			}
+		const atlas_htab_entry *entry = get_glyph(font, &scaler, glyph_index);
+		if (!entry) {
+			text++;
+			continue;
 		}
 
-		bp2d_rectangle rect;
-		int bitmap_left, bitmap_top;
-		int advance_x, advance_y;
-		int glyph_size;
-
-		texture_atlas_get(font->tex_atlas, glyph_index,
-			&rect, &bitmap_left, &bitmap_top,
-			&advance_x, &advance_y, &glyph_size);
+		const float draw_scale = size/(float)entry->glyph_size;
 
-		const float draw_scale = size/(float)glyph_size;
-
-		pen_x += (advance_x >> 16) * draw_scale;
-		pen_y += (advance_y >> 16) * draw_scale;
+		pen_x += GLYPH_ADVANCE(entry->advance_x, draw_scale);
+		pen_y += GLYPH_ADVANCE(entry->advance_y, draw_scale);
 
 		previous = glyph_index;
 		text++;
 	}
+
+	texture_atlas_flush(font->tex_atlas);
 	return pen_x;
 }
 
@@ -500,7 +756,6 @@ void sftd_draw_text_wrap(sftd_font *font, int x, int y, unsigned int color, unsi
 	FT_Int charmap_index;
 	charmap_index = FT_Get_Charmap_Index(face->charmap);
 
-	FT_Glyph glyph;
 	FT_Bool use_kerning = FT_HAS_KERNING(face);
 	FT_UInt glyph_index, previous = 0;
 	int pen_x = x;
@@ -512,7 +767,9 @@ void sftd_draw_text_wrap(sftd_font *font, int x, int y, unsigned int color, unsi
 	scaler.height = size;
 	scaler.pixel = 1;
 
-	FT_ULong flags = FT_LOAD_RENDER | FT_LOAD_TARGET_NORMAL;
+	// The kerning is scaled with the active size of the face
+	FT_Size ft_size;
+	FTC_Manager_LookupSize(font->ftcmanager, &scaler, &ft_size);
 
 	bool isFirstLine = true;
 	char buffer[strlen(text)];
@@ -545,35 +802,20 @@ void sftd_draw_text_wrap(sftd_font *font, int x, int y, unsigned int color, unsi
 				pen_x += delta.x >> 6;
 			}
 
-			if (!texture_atlas_exists(font->tex_atlas, glyph_index)) {
-				FTC_ImageCache_LookupScaler(font->imagecache, &scaler, flags, glyph_index, &glyph, NULL);
-
-				if (!atlas_add_glyph(font->tex_atlas, glyph_index, (FT_BitmapGlyph)glyph, size)) {
-					continue;
-				}
+			const atlas_htab_entry *entry = get_glyph(font, &scaler, glyph_index);
+			if (!entry) {
+				continue;
 			}
 
-			bp2d_rectangle rect;
-			int bitmap_left, bitmap_top;
-			int advance_x, advance_y;
-			int glyph_size;
-
-			texture_atlas_get(font->tex_atlas, glyph_index,
-				&rect, &bitmap_left, &bitmap_top,
-				&advance_x, &advance_y, &glyph_size);
-
-			const float draw_scale = size/(float)glyph_size;
+			const float draw_scale = size/(float)entry->glyph_size;
 
-			sf2d_draw_texture_part_scale_blend(font->tex_atlas->tex,
-				pen_x + bitmap_left * draw_scale,
-				pen_y - bitmap_top * draw_scale,
-				rect.x, rect.y, rect.w, rect.h,
-				draw_scale,
-				draw_scale,
-				color);
+			draw_glyph(font, entry,
+				pen_x + entry->bitmap_left * draw_scale,
+				pen_y - entry->bitmap_top * draw_scale,
+				draw_scale, color);
 
-			pen_x += (advance_x >> 16) * draw_scale;
-			pen_y += (advance_y >> 16) * draw_scale;
+			pen_x += GLYPH_ADVANCE(entry->advance_x, draw_scale);
+			pen_y += GLYPH_ADVANCE(entry->advance_y, draw_scale);
 
 
 			previous = glyph_index;
@@ -582,6 +824,8 @@ void sftd_draw_text_wrap(sftd_font *font, int x, int y, unsigned int color, unsi
 		}
 		currentWord = strtok(NULL, " ");
 	}
+
+	texture_atlas_flush(font->tex_atlas);
 }
 
 void sftd_calc_bounding_box(int *boundingWidth, int *boundingHeight, sftd_font *font, unsigned int size, unsigned int lineWidth, const char *text)
@@ -593,7 +837,6 @@ void sftd_calc_bounding_box(int *boundingWidth, int *boundingHeight, sftd_font *
 	FT_Int charmap_index;
 	charmap_index = FT_Get_Charmap_Index(face->charmap);
 
-	FT_Glyph glyph;
 	FT_Bool use_kerning = FT_HAS_KERNING(face);
 	FT_UInt glyph_index, previous = 0;
 	int pen_x = 0;
@@ -605,7 +848,9 @@ void sftd_calc_bounding_box(int *boundingWidth, int *boundingHeight, sftd_font *
 	scaler.height = size;
 	scaler.pixel = 1;
 
-	FT_ULong flags = FT_LOAD_RENDER | FT_LOAD_TARGET_NORMAL;
+	// The kerning is scaled with the active size of the face
+	FT_Size ft_size;
+	FTC_Manager_LookupSize(font->ftcmanager, &scaler, &ft_size);
 
 	bool isFirstLine = true;
 	char buffer[strlen(text)];
@@ -642,27 +887,15 @@ void sftd_calc_bounding_box(int *boundingWidth, int *boundingHeight, sftd_font *
 				pen_x += delta.x >> 6;
 			}
 
-			if (!texture_atlas_exists(font->tex_atlas, glyph_index)) {
-				FTC_ImageCache_LookupScaler(font->imagecache, &scaler, flags, glyph_index, &glyph, NULL);
-
-				if (!atlas_add_glyph(font->tex_atlas, glyph_index, (FT_BitmapGlyph)glyph, size)) {
-					continue;
-				}
+			const atlas_htab_entry *entry = get_glyph(font, &scaler, glyph_index);
+			if (!entry) {
+				continue;
 			}
 
-			bp2d_rectangle rect;
-			int bitmap_left, bitmap_top;
-			int advance_x, advance_y;
-			int glyph_size;
-
-			texture_atlas_get(font->tex_atlas, glyph_index,
-				&rect, &bitmap_left, &bitmap_top,
-				&advance_x, &advance_y, &glyph_size);
-
-			const float draw_scale = size/(float)glyph_size;
+				const float draw_scale = size/(float)entry->glyph_size;
 
-			pen_x += (advance_x >> 16) * draw_scale;
-			pen_y += (advance_y >> 16) * draw_scale;
+			pen_x += GLYPH_ADVANCE(entry->advance_x, draw_scale);
+			pen_y += GLYPH_ADVANCE(entry->advance_y, draw_scale);
 
 
 			previous = glyph_index;
@@ -671,6 +904,8 @@ void sftd_calc_bounding_box(int *boundingWidth, int *boundingHeight, sftd_font *
 		}
 		currentWord = strtok(NULL, " ");
 	}
+
+	texture_atlas_flush(font->tex_atlas);
 	*boundingWidth = greatesLineWidth;
 	*boundingHeight = pen_y;
 }
@@ -684,3 +919,540 @@ void sftd_draw_textf_wrap(sftd_font *font, int x, int y, unsigned int color, uns
 	sftd_draw_text_wrap(font, x, y, color, size, lineWidth, buffer);
 	va_end(args);
 }
+
+typedef struct sftd_text_range {
+	int page;
+	unsigned int generation; // of the page when the text was laid out
+	int first;
+	int quads;
+} sftd_text_range;
+
+struct sftd_text {
+	sftd_font *font;
+	wchar_t *text;
+	unsigned int size;
+	unsigned int line_width;
+	sf2d_vertex_pos_tex *vertices;
+	u16 *indices;
+	int capacity;
+	int quads;
+	sftd_text_range *ranges; // the quads grouped by atlas page
+	int num_ranges;
+	int width;
+	int height;
+	sftd_mode mode; // of the font when the text was laid out
+	unsigned int last_frame; // last frame the text was drawn in
+};
+
+// Move the quads [first, last) by (dx, dy)
+static void move_quads(sf2d_vertex_pos_tex *vertices, int first, int last, float dx, float dy)
+{
+	int i;
+	for (i = first*4; i < last*4; i++) {
+		vertices[i].position.x += dx;
+		vertices[i].position.y += dy;
+	}
+}
+
+// Lay out the text in its vertex buffer; returns 0 if there isn't enough memory
+static int layout_text(sftd_text *prepared)
+{
+	sftd_font *font = prepared->font;
+	const wchar_t *text = prepared->text;
+	unsigned int size = prepared->size;
+	unsigned int lineWidth = prepared->line_width;
+
+	prepared->quads = 0;
+	prepared->num_ranges = 0;
+	prepared->width = 0;
+	prepared->height = 0;
+	prepared->mode = font->mode;
+
+	if (prepared->capacity == 0)
+		return 1;
+
+	// Laid out in text order first, then grouped by page
+	sf2d_vertex_pos_tex *vertices = malloc(prepared->capacity * 4*sizeof(sf2d_vertex_pos_tex));
+	int *quad_pages = malloc(prepared->capacity * sizeof(int));
+	if (!vertices || !quad_pages) {
+		free(vertices);
+		free(quad_pages);
+		return 0;
+	}
+
+	FTC_FaceID face_id = (FTC_FaceID)font;
+	FT_Face face;
+	FTC_Manager_LookupFace(font->ftcmanager, face_id, &face);
+
+	FT_Int charmap_index;
+	charmap_index = FT_Get_Charmap_Index(face->charmap);
+
+	FT_Bool use_kerning = FT_HAS_KERNING(face);
+	FT_UInt glyph_index, previous = 0;
+	int pen_x = 0;
+	int pen_y = size;
+
+	FTC_ScalerRec scaler;
+	scaler.face_id = face_id;
+	scaler.width = size;
+	scaler.height = size;
+	scaler.pixel = 1;
+
+	// The kerning is scaled with the active size of the face
+	FT_Size ft_size;
+	FTC_Manager_LookupSize(font->ftcmanager, &scaler, &ft_size);
+
+	int quads = 0;
+
+	// Last break opportunity of the current line: the pen position before and after the space, and the first quad after it
+	int break_end = 0, break_x = 0;
+	int break_quad = -1;
+
+	for (; *text; text++) {
+		if (*text == '\n') {
+			if (pen_x > prepared->width) prepared->width = pen_x;
+			pen_x = 0;
+			pen_y += size;
+			previous = 0;
+			break_quad = -1;
+			continue;
+		}
+
+		glyph_index = FTC_CMapCache_Lookup(font->cmapcache, (FTC_FaceID)font, charmap_index, *text);
+
+		if (use_kerning && previous && glyph_index) {
+			FT_Vector delta;
+			FT_Get_Kerning(face, previous, glyph_index, FT_KERNING_DEFAULT, &delta);
+			pen_x += delta.x >> 6;
+		}
+
+		const atlas_htab_entry *entry = get_glyph(font, &scaler, glyph_index);
+		if (!entry) {
+			continue;
+		}
+
+		const bp2d_rectangle rect = entry->rect;
+		const float draw_scale = size/(float)entry->glyph_size;
+
+		// Empty glyphs (spaces) don't need a quad
+		if (rect.w > 0 && rect.h > 0 && quads < prepared->capacity) {
+			const sf2d_texture *tex = font->tex_atlas->pages[entry->page].tex;
+
+			float left = pen_x + entry->bitmap_left * draw_scale;
+			float top = pen_y - entry->bitmap_top * draw_scale;
+			float right = left + rect.w * draw_scale;
+			float bottom = top + rect.h * draw_scale;
+
+			float u0 = rect.x/(float)tex->pow2_w;
+			float v0 = rect.y/(float)tex->pow2_h;
+			float u1 = (rect.x+rect.w)/(float)tex->pow2_w;
+			float v1 = (rect.y+rect.h)/(float)tex->pow2_h;
+
+			sf2d_vertex_pos_tex *quad = &vertices[quads*4];
+			quad[0] = (sf2d_vertex_pos_tex){{left,  top,    SF2D_DEFAULT_DEPTH}, {u0, v0}};
+			quad[1] = (sf2d_vertex_pos_tex){{right, top,    SF2D_DEFAULT_DEPTH}, {u1, v0}};
+			quad[2] = (sf2d_vertex_pos_tex){{left,  bottom, SF2D_DEFAULT_DEPTH}, {u0, v1}};
+			quad[3] = (sf2d_vertex_pos_tex){{right, bottom, SF2D_DEFAULT_DEPTH}, {u1, v1}};
+			quad_pages[quads] = entry->page;
+			quads++;
+		}
+
+		if (*text == ' ') break_end = pen_x;
+
+		pen_x += GLYPH_ADVANCE(entry->advance_x, draw_scale);
+		pen_y += GLYPH_ADVANCE(entry->advance_y, draw_scale);
+
+		if (*text == ' ') {
+			break_x = pen_x;
+			break_quad = quads;
+		} else if (lineWidth > 0 && pen_x > (int)lineWidth && break_quad >= 0) {
+			// Move the current word to a new line
+			if (break_end > prepared->width) prepared->width = break_end;
+			move_quads(vertices, break_quad, quads, -break_x, size);
+			pen_x -= break_x;
+			pen_y += size;
+			break_quad = -1;
+		}
+
+		previous = glyph_index;
+	}
+
+	if (pen_x > prepared->width) prepared->width = pen_x;
+	prepared->height = pen_y;
+	prepared->quads = quads;
+
+	// Group the quads by page, so each page is drawn at once
+	texture_atlas *atlas = font->tex_atlas;
+	sftd_text_range *ranges = realloc(prepared->ranges, atlas->num_pages * sizeof(*ranges));
+	if (!ranges) {
+		free(vertices);
+		free(quad_pages);
+		prepared->quads = 0;
+		return 0;
+	}
+	prepared->ranges = ranges;
+
+	int page, i, first = 0;
+	for (page = 0; page < atlas->num_pages; page++) {
+		sftd_text_range *range = &ranges[prepared->num_ranges];
+		range->page = page;
+		range->generation = atlas->pages[page].generation;
+		range->first = first;
+		range->quads = 0;
+
+		for (i = 0; i < quads; i++) {
+			if (quad_pages[i] == page) {
+				memcpy(&prepared->vertices[(first + range->quads)*4], &vertices[i*4], 4*sizeof(sf2d_vertex_pos_tex));
+				range->quads++;
+			}
+		}
+
+		if (range->quads > 0) {
+			first += range->quads;
+			prepared->num_ranges++;
+		}
+	}
+
+	free(vertices);
+	free(quad_pages);
+
+	texture_atlas_flush(font->tex_atlas);
+	GSPGPU_FlushDataCache(prepared->vertices, quads * 4*sizeof(sf2d_vertex_pos_tex));
+
+	return 1;
+}
+
+// Lay the text out again, in a new vertex buffer if the GPU may still read the current one
+static int relayout_text(sftd_text *prepared)
+{
+	if (prepared->capacity > 0 && prepared->last_frame > sf2d_get_rendered_frame_count()) {
+		sf2d_vertex_pos_tex *vertices = linearAlloc(prepared->capacity * (4*sizeof(sf2d_vertex_pos_tex) + 6*sizeof(u16)));
+		if (!vertices)
+			return 0;
+
+		// The indices don't change
+		u16 *indices = (u16 *)(vertices + prepared->capacity*4);
+		memcpy(indices, prepared->indices, prepared->capacity * 6*sizeof(u16));
+		GSPGPU_FlushDataCache(indices, prepared->capacity * 6*sizeof(u16));
+
+		sf2d_free_deferred(prepared->vertices, SF2D_PLACE_RAM);
+		prepared->vertices = vertices;
+		prepared->indices = indices;
+	}
+
+	return layout_text(prepared);
+}
+
+sftd_text *sftd_prepare_wtext(sftd_font *font, unsigned int size, unsigned int lineWidth, const wchar_t *text)
+{
+	sftd_text *prepared = malloc(sizeof(*prepared));
+	if (!prepared)
+		return NULL;
+
+	size_t len = wcslen(text);
+
+	prepared->font = font;
+	prepared->text = malloc((len + 1) * sizeof(wchar_t));
+	prepared->size = size;
+	prepared->line_width = lineWidth;
+	prepared->vertices = NULL;
+	prepared->indices = NULL;
+	prepared->ranges = NULL;
+	prepared->num_ranges = 0;
+	prepared->last_frame = 0;
+
+	// One quad at most per character; the indices can't address more than PREPARED_TEXT_MAX_QUADS
+	prepared->capacity = len < PREPARED_TEXT_MAX_QUADS ? len : PREPARED_TEXT_MAX_QUADS;
+
+	if (!prepared->text)
+		goto error;
+	wcscpy(prepared->text, text);
+
+	if (prepared->capacity > 0) {
+		// The indices are stored after the vertices
+		prepared->vertices = linearAlloc(prepared->capacity * (4*sizeof(sf2d_vertex_pos_tex) + 6*sizeof(u16)));
+		if (!prepared->vertices)
+			goto error;
+		prepared->indices = (u16 *)(prepared->vertices + prepared->capacity*4);
+
+		// Each page range is drawn from its first vertex, so the same indices fit them all
+		u16 *indices = prepared->indices;
+		int i;
+		for (i = 0; i < prepared->capacity; i++) {
+			indices[i*6 + 0] = i*4 + 0;
+			indices[i*6 + 1] = i*4 + 1;
+			indices[i*6 + 2] = i*4 + 2;
+			indices[i*6 + 3] = i*4 + 2;
+			indices[i*6 + 4] = i*4 + 1;
+			indices[i*6 + 5] = i*4 + 3;
+		}
+		GSPGPU_FlushDataCache(indices, prepared->capacity * 6*sizeof(u16));
+	}
+
+	if (!layout_text(prepared))
+		goto error;
+
+	return prepared;
+
+error:
+	sftd_free_prepared_text(prepared);
+	return NULL;
+}
+
+void sftd_draw_prepared_text(sftd_text *text, int x, int y, unsigned int color)
+{
+	texture_atlas *atlas = text->font->tex_atlas;
+
+	// Lay the text out again if some of its glyphs were evicted from the atlas, or if the mode of the font changed
+	int i, stale = text->mode != text->font->mode;
+	for (i = 0; i < text->num_ranges && !stale; i++) {
+		stale = atlas->pages[text->ranges[i].page].generation != text->ranges[i].generation;
+	}
+	if (stale && !relayout_text(text))
+		return;
+
+	unsigned int frame = sf2d_get_frame_count();
+	text->last_frame = frame;
+	for (i = 0; i < text->num_ranges; i++) {
+		const sftd_text_range *range = &text->ranges[i];
+		atlas_page *page = &atlas->pages[range->page];
+
+		page->last_used = frame;
+		if (text->mode == SFTD_MODE_SDF) {
+			sf2d_draw_quads_sdf(page->tex, &text->vertices[range->first*4], text->indices, range->quads, x, y, color,
+				SDF_SPREAD * text->size / (float)SDF_GLYPH_SIZE);
+		} else {
+			sf2d_draw_quads(page->tex, &text->vertices[range->first*4], text->indices, range->quads, x, y, color);
+		}
+	}
+}
+
+void sftd_get_prepared_text_size(const sftd_text *text, int *width, int *height)
+{
+	*width = text->width;
+	*height = text->height;
+}
+
+void sftd_free_prepared_text(sftd_text *text)
+{
+	if (text) {
+		if (text->vertices)
+			linearFree(text->vertices);
+		free(text->ranges);
+		free(text->text);
+		free(text);
+	}
+}
+
+void sftd_get_atlas_stats(sftd_font *font, sftd_atlas_stats *stats)
+{
+	texture_atlas_stats atlas_stats;
+	texture_atlas_get_stats(font->tex_atlas, &atlas_stats);
+
+	stats->hits = atlas_stats.hits;
+	stats->misses = atlas_stats.misses;
+	stats->evictions = atlas_stats.evictions;
+	stats->glyphs = atlas_stats.glyphs;
+	stats->pages = atlas_stats.pages;
+	stats->max_pages = atlas_stats.max_pages;
+}
+
+void sftd_set_atlas_max_pages(sftd_font *font, int max_pages)
+{
+	texture_atlas_set_max_pages(font->tex_atlas, max_pages);
+}
+
+int sftd_preload_wtext(sftd_font *font, unsigned int size, const wchar_t *text, int max_glyphs, int *missing)
+{
+	FTC_FaceID face_id = (FTC_FaceID)font;
+	FT_Face face;
+	FTC_Manager_LookupFace(font->ftcmanager, face_id, &face);
+
+	FT_Int charmap_index;
+	charmap_index = FT_Get_Charmap_Index(face->charmap);
+
+	FTC_ScalerRec scaler;
+	scaler.face_id = face_id;
+	scaler.width = size;
+	scaler.height = size;
+	scaler.pixel = 1;
+
+	int loaded = 0;
+	*missing = 0;
+
+	for (; *text; text++) {
+		if (*text == '\n')
+			continue;
+
+		FT_UInt glyph_index = FTC_CMapCache_Lookup(font->cmapcache, face_id, charmap_index, *text);
+		unsigned int key = glyph_key(font, &scaler, glyph_index);
+
+		// Not counted in the statistics, nothing is drawn
+		if (int_htab_find(font->tex_atlas->htab, key))
+			continue;
+
+		if ((max_glyphs >= 0 && loaded >= max_glyphs) || !rasterize_glyph_mode(font, &scaler, glyph_index, key)) {
+			(*missing)++;
+			continue;
+		}
+		loaded++;
+	}
+
+	texture_atlas_flush(font->tex_atlas);
+
+	return loaded;
+}
+
+// Identifies the face a glyph cache file was made from
+static u32 glyph_cache_font_id(sftd_font *font)
+{
+	FT_Face face;
+	if (FTC_Manager_LookupFace(font->ftcmanager, (FTC_FaceID)font, &face) != FT_Err_Ok)
+		return 0;
+
+	// FNV-1a
+	u32 hash = 2166136261u;
+	const char *names[] = { face->family_name, face->style_name };
+	int i;
+	for (i = 0; i < 2; i++) {
+		const char *name = names[i] ? names[i] : "";
+		for (; *name; name++)
+			hash = (hash ^ (unsigned char)*name) * 16777619u;
+	}
+	const u32 values[] = { face->num_glyphs, face->units_per_EM, face->face_flags, face->style_flags };
+	for (i = 0; i < sizeof(values)/sizeof(*values); i++)
+		hash = (hash ^ values[i]) * 16777619u;
+
+	return hash;
+}
+
+static int compare_entries_last_used(const void *a, const void *b)
+{
+	const atlas_htab_entry *entry_a = ((const int_htab_entry *)a)->value;
+	const atlas_htab_entry *entry_b = ((const int_htab_entry *)b)->value;
+	// Most recently used first
+	return (entry_a->last_used < entry_b->last_used) - (entry_a->last_used > entry_b->last_used);
+}
+
+int sftd_save_glyph_cache(sftd_font *font, const char *path)
+{
+	texture_atlas *atlas = font->tex_atlas;
+
+	int_htab_entry *entries = malloc(atlas->stats.glyphs * sizeof(*entries));
+	if (!entries && atlas->stats.glyphs > 0)
+		return 0;
+
+	unsigned int num_entries = 0;
+	size_t i;
+	for (i = 0; i < atlas->htab->size; i++) {
+		if (atlas->htab->entries[i].value != NULL)
+			entries[num_entries++] = atlas->htab->entries[i];
+	}
+	// If it doesn't fit in the atlas when it's loaded, keep the glyphs used last
+	qsort(entries, num_entries, sizeof(*entries), compare_entries_last_used);
+
+	FILE *file = fopen(path, "wb");
+	if (!file) {
+		free(entries);
+		return 0;
+	}
+
+	glyph_cache_header header;
+	memcpy(header.magic, GLYPH_CACHE_MAGIC, 4);
+	header.version = GLYPH_CACHE_VERSION;
+	header.font_id = glyph_cache_font_id(font);
+	header.glyphs = num_entries;
+	int ok = fwrite(&header, sizeof(header), 1, file) == 1;
+
+	unsigned char *alpha = malloc(atlas->width * atlas->height);
+	ok = ok && alpha;
+
+	for (i = 0; i < num_entries && ok; i++) {
+		const atlas_htab_entry *entry = entries[i].value;
+
+		glyph_cache_record record;
+		record.key = entries[i].key;
+		record.bitmap_left = entry->bitmap_left;
+		record.bitmap_top = entry->bitmap_top;
+		record.advance_x = entry->advance_x;
+		record.advance_y = entry->advance_y;
+		record.glyph_size = entry->glyph_size;
+		record.width = entry->rect.w;
+		record.height = entry->rect.h;
+		record.reserved = 0;
+
+		texture_atlas_read(atlas, entry, alpha, record.width);
+
+		ok = fwrite(&record, sizeof(record), 1, file) == 1 &&
+			fwrite(alpha, 1, record.width * record.height, file) == record.width * record.height;
+	}
+
+	free(alpha);
+	free(entries);
+	if (fclose(file) != 0)
+		ok = 0;
+
+	return ok;
+}
+
+int sftd_load_glyph_cache(sftd_font *font, const char *path)
+{
+	texture_atlas *atlas = font->tex_atlas;
+
+	FILE *file = fopen(path, "rb");
+	if (!file)
+		return -1;
+
+	glyph_cache_header header;
+	if (fread(&header, sizeof(header), 1, file) != 1 ||
+		memcmp(header.magic, GLYPH_CACHE_MAGIC, 4) != 0 ||
+		header.version != GLYPH_CACHE_VERSION ||
+		header.font_id != glyph_cache_font_id(font)) {
+		fclose(file);
+		return -1;
+	}
+
+	unsigned char *alpha = malloc(atlas->width * atlas->height);
+	if (!alpha) {
+		fclose(file);
+		return -1;
+	}
+
+	int loaded = 0;
+	u32 i;
+	for (i = 0; i < header.glyphs; i++) {
+		glyph_cache_record record;
+		if (fread(&record, sizeof(record), 1, file) != 1 ||
+			record.width > atlas->width || record.height > atlas->height ||
+			fread(alpha, 1, record.width * record.height, file) != record.width * record.height) {
+			loaded = -1;
+			break;
+		}
+
+		if (int_htab_find(atlas->htab, record.key))
+			continue;
+
+		// The atlas is full: the glyphs already in it, and the ones just loaded, are kept
+		if (!texture_atlas_insert(atlas, record.key, alpha, record.width, record.width, record.height,
+				record.bitmap_left, record.bitmap_top, record.advance_x, record.advance_y, record.glyph_size, 1))
+			break;
+
+		loaded++;
+	}
+
+	free(alpha);
+	fclose(file);
+	texture_atlas_flush(atlas);
+
+	return loaded;
+}
+
+void sftd_set_mode(sftd_font *font, sftd_mode mode)
+{
+	font->mode = mode;
+}
+
+sftd_mode sftd_get_mode(const sftd_font *font)
+{
+	return font->mode;
+}
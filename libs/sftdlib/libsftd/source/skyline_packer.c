@@ -0,0 +1,293 @@
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "skyline_packer.h"
+
+skyline_packer *skyline_create(int width, int height)
+{
+	skyline_packer *packer = malloc(sizeof(*packer));
+	if (!packer)
+		return NULL;
+
+	packer->segments = malloc(width * sizeof(*packer->segments));
+	if (!packer->segments) {
+		free(packer);
+		return NULL;
+	}
+
+	packer->width = width;
+	packer->height = height;
+	skyline_reset(packer);
+
+	return packer;
+}
+
+void skyline_free(skyline_packer *packer)
+{
+	free(packer->segments);
+	free(packer);
+}
+
+void skyline_reset(skyline_packer *packer)
+{
+	packer->segments[0].x = 0;
+	packer->segments[0].y = 0;
+	packer->segments[0].w = packer->width;
+	packer->num_segments = 1;
+	packer->num_free_rects = 0;
+	packer->used_area = 0;
+}
+
+static void skyline_add_free(skyline_packer *packer, bp2d_rectangle rect);
+
+// Height where a rectangle of width w fits if its left edge is at the start of segment i, or -1
+static int skyline_fit(const skyline_packer *packer, int i, int w)
+{
+	const skyline_segment *segments = packer->segments;
+	int x = segments[i].x;
+	if (x + w > packer->width)
+		return -1;
+
+	int y = 0;
+	int remaining = w;
+	while (remaining > 0) {
+		if (segments[i].y > y)
+			y = segments[i].y;
+		remaining -= segments[i].w;
+		i++;
+	}
+
+	return y;
+}
+
+// Set the skyline to y over [x, x+w), splitting and merging the segments as needed
+static void skyline_set_span(skyline_packer *packer, int x, int w, int y)
+{
+	skyline_segment *segments = packer->segments;
+	int end = x + w;
+
+	// First segment overlapping the span, split if it starts before it
+	int i = 0;
+	while (segments[i].x + segments[i].w <= x)
+		i++;
+	if (segments[i].x < x) {
+		memmove(&segments[i+1], &segments[i], (packer->num_segments - i) * sizeof(*segments));
+		packer->num_segments++;
+		segments[i].w = x - segments[i].x;
+		i++;
+		segments[i].w -= segments[i-1].w;
+		segments[i].x = x;
+	}
+
+	// Segments fully covered by the span
+	int j = i;
+	while (j < packer->num_segments && segments[j].x + segments[j].w <= end)
+		j++;
+
+	// Shrink the segment overlapping the end of the span
+	if (j < packer->num_segments && segments[j].x < end) {
+		segments[j].w -= end - segments[j].x;
+		segments[j].x = end;
+	}
+
+	// Replace the covered segments by one
+	int removed = j - i;
+	if (removed != 1) {
+		memmove(&segments[i+1], &segments[j], (packer->num_segments - j) * sizeof(*segments));
+		packer->num_segments += 1 - removed;
+	}
+	segments[i].x = x;
+	segments[i].y = y;
+	segments[i].w = w;
+
+	// Merge with the neighbours at the same height
+	if (i + 1 < packer->num_segments && segments[i+1].y == y) {
+		segments[i].w += segments[i+1].w;
+		memmove(&segments[i+1], &segments[i+2], (packer->num_segments - i - 2) * sizeof(*segments));
+		packer->num_segments--;
+	}
+	if (i > 0 && segments[i-1].y == y) {
+		segments[i-1].w += segments[i].w;
+		memmove(&segments[i], &segments[i+1], (packer->num_segments - i - 1) * sizeof(*segments));
+		packer->num_segments--;
+	}
+}
+
+// Take the smallest released rectangle the size fits in, and keep what's left of it
+static int skyline_insert_free(skyline_packer *packer, const bp2d_size *in_size, bp2d_position *out_pos)
+{
+	int best = -1;
+	int best_area = INT_MAX;
+	int i;
+	for (i = 0; i < packer->num_free_rects; i++) {
+		const bp2d_rectangle *rect = &packer->free_rects[i];
+		if (in_size->w <= rect->w && in_size->h <= rect->h && rect->w*rect->h < best_area) {
+			best = i;
+			best_area = rect->w*rect->h;
+		}
+	}
+	if (best < 0)
+		return 0;
+
+	bp2d_rectangle rect = packer->free_rects[best];
+	packer->free_rects[best] = packer->free_rects[--packer->num_free_rects];
+
+	out_pos->x = rect.x;
+	out_pos->y = rect.y;
+
+	// Guillotine split of the rest, along the longest leftover side
+	bp2d_rectangle right = { rect.x + in_size->w, rect.y, rect.w - in_size->w, rect.h };
+	bp2d_rectangle bottom = { rect.x, rect.y + in_size->h, in_size->w, rect.h - in_size->h };
+	if (right.w < bottom.h) {
+		right.h = in_size->h;
+		bottom.w = rect.w;
+	}
+	if (right.w > 0 && right.h > 0)
+		skyline_add_free(packer, right);
+	if (bottom.w > 0 && bottom.h > 0)
+		skyline_add_free(packer, bottom);
+
+	return 1;
+}
+
+int skyline_insert(skyline_packer *packer, const bp2d_size *in_size, bp2d_position *out_pos)
+{
+	// Empty rectangles don't take any room
+	if (in_size->w <= 0 || in_size->h <= 0) {
+		out_pos->x = 0;
+		out_pos->y = 0;
+		return 1;
+	}
+
+	if (skyline_insert_free(packer, in_size, out_pos)) {
+		packer->used_area += in_size->w * in_size->h;
+		return 1;
+	}
+
+	// Bottom-left: the lowest position, then the narrowest segment
+	int best = -1;
+	int best_y = INT_MAX;
+	int best_w = INT_MAX;
+	int i;
+	for (i = 0; i < packer->num_segments; i++) {
+		int y = skyline_fit(packer, i, in_size->w);
+		if (y < 0)
+			break;
+		if (y + in_size->h > packer->height)
+			continue;
+		if (y < best_y || (y == best_y && packer->segments[i].w < best_w)) {
+			best = i;
+			best_y = y;
+			best_w = packer->segments[i].w;
+		}
+	}
+	if (best < 0)
+		return 0;
+
+	out_pos->x = packer->segments[best].x;
+	out_pos->y = best_y;
+
+	// Keep the gaps left below the rectangle, to fill them later
+	int end = out_pos->x + in_size->w;
+	for (i = best; i < packer->num_segments && packer->segments[i].x < end; i++) {
+		const skyline_segment *segment = &packer->segments[i];
+		if (segment->y < best_y) {
+			int right = segment->x + segment->w < end ? segment->x + segment->w : end;
+			bp2d_rectangle gap = { segment->x, segment->y, right - segment->x, best_y - segment->y };
+			skyline_add_free(packer, gap);
+		}
+	}
+
+	skyline_set_span(packer, out_pos->x, in_size->w, best_y + in_size->h);
+	packer->used_area += in_size->w * in_size->h;
+
+	return 1;
+}
+
+// Lower the skyline over a rectangle if it's right below it; returns whether it did
+static int skyline_lower(skyline_packer *packer, const bp2d_rectangle *rect)
+{
+	int i = 0;
+	while (packer->segments[i].x + packer->segments[i].w <= rect->x)
+		i++;
+	for (; i < packer->num_segments && packer->segments[i].x < rect->x + rect->w; i++) {
+		if (packer->segments[i].y != rect->y + rect->h)
+			return 0;
+	}
+
+	skyline_set_span(packer, rect->x, rect->w, rect->y);
+	return 1;
+}
+
+// Add a rectangle to the released ones, merged with a neighbour when they form a rectangle
+static void skyline_add_free(skyline_packer *packer, bp2d_rectangle rect)
+{
+	int i;
+	for (i = 0; i < packer->num_free_rects; i++) {
+		bp2d_rectangle *other = &packer->free_rects[i];
+		int merged = 0;
+		if (other->x == rect.x && other->w == rect.w) {
+			if (other->y + other->h == rect.y || rect.y + rect.h == other->y) {
+				rect.y = other->y < rect.y ? other->y : rect.y;
+				rect.h += other->h;
+				merged = 1;
+			}
+		} else if (other->y == rect.y && other->h == rect.h) {
+			if (other->x + other->w == rect.x || rect.x + rect.w == other->x) {
+				rect.x = other->x < rect.x ? other->x : rect.x;
+				rect.w += other->w;
+				merged = 1;
+			}
+		}
+		if (merged) {
+			// The merged rectangle may itself merge with another one
+			packer->free_rects[i] = packer->free_rects[--packer->num_free_rects];
+			i = -1;
+		}
+	}
+
+	if (packer->num_free_rects < SKYLINE_MAX_FREE_RECTS) {
+		packer->free_rects[packer->num_free_rects++] = rect;
+		return;
+	}
+
+	// Full: forget the smallest one
+	int smallest = 0;
+	for (i = 1; i < packer->num_free_rects; i++) {
+		if (packer->free_rects[i].w*packer->free_rects[i].h < packer->free_rects[smallest].w*packer->free_rects[smallest].h)
+			smallest = i;
+	}
+	if (packer->free_rects[smallest].w*packer->free_rects[smallest].h < rect.w*rect.h)
+		packer->free_rects[smallest] = rect;
+}
+
+void skyline_release(skyline_packer *packer, const bp2d_rectangle *rect)
+{
+	if (rect->w <= 0 || rect->h <= 0)
+		return;
+
+	packer->used_area -= rect->w * rect->h;
+	if (packer->used_area <= 0) {
+		skyline_reset(packer);
+		return;
+	}
+
+	if (!skyline_lower(packer, rect)) {
+		skyline_add_free(packer, *rect);
+		return;
+	}
+
+	// Released rectangles which are now right below the skyline can lower it too
+	int i;
+	for (i = 0; i < packer->num_free_rects; i++) {
+		if (skyline_lower(packer, &packer->free_rects[i])) {
+			packer->free_rects[i] = packer->free_rects[--packer->num_free_rects];
+			i = -1;
+		}
+	}
+}
+
+float skyline_occupancy(const skyline_packer *packer)
+{
+	return packer->used_area / (float)(packer->width * packer->height);
+}
@@ -1,90 +1,355 @@
 #include <stdlib.h>
 #include <string.h>
+#include <sf2d_tile.h>
 #include "texture_atlas.h"
 
-texture_atlas *texture_atlas_create(int width, int height, sf2d_texfmt format, sf2d_place place)
+// Least recently used glyphs released from a full page before emptying it
+#define ATLAS_MAX_RELEASES 16
+
+// Columns of a rectangle cleared at once by page_write
+#define CLEAR_TEXELS 64
+
+/*
+ * Write the coverage of an 8-bit bitmap in a rectangle of a page (or clear it
+ * to transparent black if alpha is NULL), converted to the format of the page
+ * on the way to its tiles. The touched tile rows are flushed by
+ * texture_atlas_flush.
+ */
+static void page_write(atlas_page *page, int x, int y, int w, int h, const unsigned char *alpha, int pitch)
+{
+	static const u32 zeros[CLEAR_TEXELS];
+
+	if (w <= 0 || h <= 0)
+		return;
+
+	sf2d_texture *tex = page->tex;
+	if (alpha) {
+		sf2d_tile_convert_rect(tex->data, tex->pow2_w, tex->pow2_h, tex->pixel_format, x, y, w, h,
+			alpha, pitch, SF2D_PIXEL_COVERAGE);
+	} else {
+		// Zero texels, the same rows of them for each row
+		int i;
+		for (i = 0; i < w; i += CLEAR_TEXELS) {
+			sf2d_tile_convert_rect(tex->data, tex->pow2_w, tex->pow2_h, tex->pixel_format, x + i, y,
+				w - i < CLEAR_TEXELS ? w - i : CLEAR_TEXELS, h, zeros, 0, sf2d_convert_texel_format(tex->pixel_format));
+		}
+	}
+
+	// The tiled rows are stored bottom to top
+	int first_tile_row = (tex->pow2_h - (y + h)) / 8;
+	int last_tile_row = (tex->pow2_h - 1 - y) / 8;
+	if (page->dirty_first < 0 || first_tile_row < page->dirty_first) page->dirty_first = first_tile_row;
+	if (last_tile_row > page->dirty_last) page->dirty_last = last_tile_row;
+}
+
+// Read back the alpha of a rectangle of a page in an 8-bit bitmap
+static void page_read(const atlas_page *page, int x, int y, int w, int h, unsigned char *alpha, int pitch)
+{
+	const sf2d_texture *tex = page->tex;
+	sf2d_untile_convert_rect(tex->data, tex->pow2_w, tex->pow2_h, tex->pixel_format, x, y, w, h,
+		alpha, pitch, SF2D_PIXEL_COVERAGE);
+}
+
+static int page_init(texture_atlas *atlas, atlas_page *page)
+{
+	page->tex = sf2d_create_texture(atlas->width, atlas->height, atlas->format, atlas->place);
+	if (!page->tex)
+		return 0;
+	sf2d_texture_set_params(page->tex, GPU_TEXTURE_MAG_FILTER(GPU_LINEAR) | GPU_TEXTURE_MIN_FILTER(GPU_LINEAR));
+	sf2d_texture_tile32(page->tex);
+
+	page->packer = skyline_create(atlas->width, atlas->height);
+	if (!page->packer) {
+		sf2d_free_texture(page->tex);
+		return 0;
+	}
+	page->glyphs = 0;
+	page->last_used = sf2d_get_frame_count();
+	page->generation = 0;
+	page->dirty_first = -1;
+	page->dirty_last = -1;
+
+	return 1;
+}
+
+static void page_fini(atlas_page *page)
+{
+	sf2d_free_texture(page->tex);
+	skyline_free(page->packer);
+}
+
+texture_atlas *texture_atlas_create(int width, int height, sf2d_texfmt format, sf2d_place place, int max_pages)
 {
 	texture_atlas *atlas = malloc(sizeof(*atlas));
 	if (!atlas)
 		return NULL;
 
-	bp2d_rectangle rect;
-	rect.x = 0;
-	rect.y = 0;
-	rect.w = width;
-	rect.h = height;
-
-	atlas->tex = sf2d_create_texture(width, height, format, place);
-	sf2d_texture_set_params(atlas->tex, GPU_TEXTURE_MAG_FILTER(GPU_LINEAR) | GPU_TEXTURE_MIN_FILTER(GPU_LINEAR));
-	sf2d_texture_tile32(atlas->tex);
-
-	atlas->bp_root = bp2d_create(&rect);
+	atlas->width = width;
+	atlas->height = height;
+	atlas->format = format;
+	atlas->place = place;
+	atlas->max_pages = max_pages > 0 ? max_pages : 1;
+	atlas->pages = malloc(atlas->max_pages * sizeof(*atlas->pages));
+	atlas->num_pages = 0;
 	atlas->htab = int_htab_create(256);
+	memset(&atlas->stats, 0, sizeof(atlas->stats));
+
+	if (!atlas->pages || !atlas->htab || !page_init(atlas, &atlas->pages[0])) {
+		free(atlas->pages);
+		if (atlas->htab)
+			int_htab_free(atlas->htab);
+		free(atlas);
+		return NULL;
+	}
+	atlas->num_pages = 1;
 
 	return atlas;
 }
 
 void texture_atlas_free(texture_atlas *atlas)
 {
-	sf2d_free_texture(atlas->tex);
-	bp2d_free(atlas->bp_root);
+	int i;
+	for (i = 0; i < atlas->num_pages; i++) {
+		page_fini(&atlas->pages[i]);
+	}
+	free(atlas->pages);
 	int_htab_free(atlas->htab);
 	free(atlas);
 }
 
-int texture_atlas_insert(texture_atlas *atlas, unsigned int character, const void *image, int width, int height, int bitmap_left, int bitmap_top, int advance_x, int advance_y, int glyph_size)
+void texture_atlas_set_max_pages(texture_atlas *atlas, int max_pages)
+{
+	// Only grows, pages in use can't be dropped
+	if (max_pages <= atlas->max_pages)
+		return;
+
+	atlas_page *pages = realloc(atlas->pages, max_pages * sizeof(*atlas->pages));
+	if (!pages)
+		return;
+
+	atlas->pages = pages;
+	atlas->max_pages = max_pages;
+}
+
+// Remove all the glyphs of a page and clear it
+static void page_evict(texture_atlas *atlas, int page_index)
+{
+	atlas_page *page = &atlas->pages[page_index];
+
+	// Collect the keys first, erasing moves the entries around
+	unsigned int *keys = malloc(page->glyphs * sizeof(*keys));
+	unsigned int num_keys = 0;
+	size_t i;
+	for (i = 0; i < atlas->htab->size && keys; i++) {
+		atlas_htab_entry *entry = atlas->htab->entries[i].value;
+		if (entry != NULL && entry->page == page_index) {
+			keys[num_keys++] = atlas->htab->entries[i].key;
+		}
+	}
+	for (i = 0; i < num_keys; i++) {
+		int_htab_erase(atlas->htab, keys[i]);
+	}
+	free(keys);
+
+	skyline_reset(page->packer);
+
+	memset(page->tex->data, 0, page->tex->data_size);
+	page->dirty_first = 0;
+	page->dirty_last = page->tex->pow2_h/8 - 1;
+
+	atlas->stats.glyphs -= num_keys;
+	atlas->stats.evictions += num_keys;
+	page->glyphs = 0;
+	page->generation++;
+}
+
+static int compare_last_used(const void *a, const void *b)
+{
+	const atlas_htab_entry *entry_a = *(atlas_htab_entry * const *)a;
+	const atlas_htab_entry *entry_b = *(atlas_htab_entry * const *)b;
+	return (entry_a->last_used > entry_b->last_used) - (entry_a->last_used < entry_b->last_used);
+}
+
+// Release the least recently used glyphs of a page until the size fits; returns whether it did
+static int page_release_glyphs(texture_atlas *atlas, int page_index, const bp2d_size *size, bp2d_position *pos)
+{
+	atlas_page *page = &atlas->pages[page_index];
+
+	atlas_htab_entry **entries = malloc(page->glyphs * sizeof(*entries));
+	unsigned int *keys = malloc(page->glyphs * sizeof(*keys));
+	unsigned int num_entries = 0;
+	size_t i;
+	for (i = 0; i < atlas->htab->size && entries && keys; i++) {
+		atlas_htab_entry *entry = atlas->htab->entries[i].value;
+		if (entry != NULL && entry->page == page_index) {
+			entries[num_entries++] = entry;
+		}
+	}
+	qsort(entries, num_entries, sizeof(*entries), compare_last_used);
+
+	// Find the keys back, erasing moves the entries around
+	unsigned int num_released = num_entries < ATLAS_MAX_RELEASES ? num_entries : ATLAS_MAX_RELEASES;
+	for (i = 0; i < atlas->htab->size && num_released > 0; i++) {
+		atlas_htab_entry *entry = atlas->htab->entries[i].value;
+		unsigned int j;
+		for (j = 0; entry != NULL && j < num_released; j++) {
+			if (entries[j] == entry)
+				keys[j] = atlas->htab->entries[i].key;
+		}
+	}
+
+	int fits = 0;
+	for (i = 0; i < num_released && !fits; i++) {
+		const bp2d_rectangle rect = entries[i]->rect;
+
+		// Clear it, the new glyphs may not cover all of it
+		page_write(page, rect.x, rect.y, rect.w, rect.h, NULL, 0);
+
+		skyline_release(page->packer, &rect);
+		int_htab_erase(atlas->htab, keys[i]);
+		page->glyphs--;
+		atlas->stats.glyphs--;
+		atlas->stats.evictions++;
+
+		fits = skyline_insert(page->packer, size, pos);
+	}
+	if (i > 0)
+		page->generation++;
+
+	free(entries);
+	free(keys);
+
+	return fits;
+}
+
+// The frame a glyph used now is drawn in: the current one, or outside of a frame with nothing left to render, the next
+// one. The glyphs of a text laid out between two frames are then kept until it's drawn, instead of evicting each other.
+static unsigned int use_frame()
+{
+	unsigned int frame = sf2d_get_frame_count();
+	return sf2d_get_rendered_frame_count() == frame ? frame + 1 : frame;
+}
+
+// Find a page with room for a glyph: an existing one, a new one, or unless no_evict is set, the least recently used one
+// with glyphs released
+static int atlas_alloc(texture_atlas *atlas, const bp2d_size *size, bp2d_position *pos, int no_evict)
+{
+	if (size->w > atlas->width || size->h > atlas->height)
+		return -1;
+
+	int i;
+	for (i = atlas->num_pages - 1; i >= 0; i--) {
+		if (skyline_insert(atlas->pages[i].packer, size, pos))
+			return i;
+	}
+
+	if (atlas->num_pages < atlas->max_pages && page_init(atlas, &atlas->pages[atlas->num_pages])) {
+		i = atlas->num_pages++;
+		return skyline_insert(atlas->pages[i].packer, size, pos) ? i : -1;
+	}
+
+	if (no_evict)
+		return -1;
+
+	// Pages used in the frames the GPU hasn't rendered yet are still needed
+	unsigned int rendered = sf2d_get_rendered_frame_count();
+	int lru = -1;
+	for (i = 0; i < atlas->num_pages; i++) {
+		atlas_page *page = &atlas->pages[i];
+		if (page->last_used <= rendered && (lru < 0 || page->last_used < atlas->pages[lru].last_used))
+			lru = i;
+	}
+	if (lru < 0)
+		return -1;
+
+	if (page_release_glyphs(atlas, lru, size, pos))
+		return lru;
+
+	page_evict(atlas, lru);
+	return skyline_insert(atlas->pages[lru].packer, size, pos) ? lru : -1;
+}
+
+atlas_htab_entry *texture_atlas_insert(texture_atlas *atlas, unsigned int key, const unsigned char *alpha, int pitch, int width, int height, int bitmap_left, int bitmap_top, int advance_x, int advance_y, int glyph_size, int no_evict)
 {
 	bp2d_size size;
 	size.w = width;
 	size.h = height;
 
 	bp2d_position pos;
-	if (bp2d_insert(atlas->bp_root, &size, &pos) == 0)
-		return 0;
+	int page_index = atlas_alloc(atlas, &size, &pos, no_evict);
+	if (page_index < 0)
+		return NULL;
+
+	atlas_page *page = &atlas->pages[page_index];
 
 	atlas_htab_entry *entry = malloc(sizeof(*entry));
+	if (!entry) {
+		bp2d_rectangle rect = {pos.x, pos.y, width, height};
+		skyline_release(page->packer, &rect);
+		return NULL;
+	}
 
 	entry->rect.x = pos.x;
 	entry->rect.y = pos.y;
 	entry->rect.w = width;
 	entry->rect.h = height;
+	entry->page = page_index;
 	entry->bitmap_left = bitmap_left;
 	entry->bitmap_top = bitmap_top;
 	entry->advance_x = advance_x;
 	entry->advance_y = advance_y;
 	entry->glyph_size = glyph_size;
+	entry->last_used = use_frame();
 
-	int_htab_insert(atlas->htab, character, entry);
+	int_htab_insert(atlas->htab, key, entry);
+	page->glyphs++;
+	page->last_used = entry->last_used;
+	atlas->stats.glyphs++;
 
-	int i, j;
-	for (i = 0; i < height; i++) {
-		for (j = 0; j < width; j++) {
-			sf2d_set_pixel(atlas->tex, pos.x + j, pos.y + i,
-				__builtin_bswap32(*(unsigned int *)(image + (j + i*width)*4)));
-		}
-	}
+	page_write(page, pos.x, pos.y, width, height, alpha, pitch);
 
-	GSPGPU_FlushDataCache(atlas->tex->data, atlas->tex->data_size);
+	return entry;
+}
 
-	return 1;
+void texture_atlas_read(const texture_atlas *atlas, const atlas_htab_entry *entry, unsigned char *alpha, int pitch)
+{
+	const bp2d_rectangle rect = entry->rect;
+	page_read(&atlas->pages[entry->page], rect.x, rect.y, rect.w, rect.h, alpha, pitch);
 }
 
-int texture_atlas_exists(texture_atlas *atlas, unsigned int character)
+void texture_atlas_flush(texture_atlas *atlas)
 {
-	return int_htab_find(atlas->htab, character) != NULL;
+	int i;
+	for (i = 0; i < atlas->num_pages; i++) {
+		atlas_page *page = &atlas->pages[i];
+		if (page->dirty_first < 0)
+			continue;
+
+		// A row of tiles is contiguous
+		u32 row_size = page->tex->pow2_w * 8 * sf2d_tile_bytes_per_texel(page->tex->pixel_format);
+		GSPGPU_FlushDataCache((u8 *)page->tex->data + page->dirty_first * row_size,
+			(page->dirty_last - page->dirty_first + 1) * row_size);
+		page->dirty_first = page->dirty_last = -1;
+	}
 }
 
-void texture_atlas_get(texture_atlas *atlas, unsigned int character, bp2d_rectangle *rect, int *bitmap_left, int *bitmap_top, int *advance_x, int *advance_y, int *glyph_size)
+atlas_htab_entry *texture_atlas_find(texture_atlas *atlas, unsigned int key)
 {
-	atlas_htab_entry *entry = int_htab_find(atlas->htab, character);
+	atlas_htab_entry *entry = int_htab_find(atlas->htab, key);
+
+	if (entry) {
+		entry->last_used = atlas->pages[entry->page].last_used = use_frame();
+		atlas->stats.hits++;
+	} else {
+		atlas->stats.misses++;
+	}
 
-	rect->x = entry->rect.x;
-	rect->y = entry->rect.y;
-	rect->w = entry->rect.w;
-	rect->h = entry->rect.h;
-	*bitmap_left = entry->bitmap_left;
-	*bitmap_top = entry->bitmap_top;
-	*advance_x = entry->advance_x;
-	*advance_y = entry->advance_y;
-	*glyph_size = entry->glyph_size;
+	return entry;
+}
+
+void texture_atlas_get_stats(const texture_atlas *atlas, texture_atlas_stats *stats)
+{
+	*stats = atlas->stats;
+	stats->pages = atlas->num_pages;
+	stats->max_pages = atlas->max_pages;
 }
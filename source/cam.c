@@ -10,12 +10,16 @@ The `cam` module.
 #include <3ds/services/cam.h>
 
 #include <sf2d.h>
+#include <sf2d_tile.h>
+#include <sf2d_convert.h>
 
 #include <lua.h>
 #include <lauxlib.h>
 
 #include <malloc.h>
+#include <string.h>
 
+#include "gfx.h"
 #include "texture.h"
 
 /***
@@ -314,36 +318,67 @@ static int cam_setFrameRate(lua_State *L) {
 	return 0;
 }
 
+// Size of the camera frames, RGB565; the transfers are done by units of the biggest size the camera service allows
+static u32 frameSize(s16 w, s16 h, u32 *transferUnit) {
+	CAMU_GetMaxBytes(transferUnit, w, h);
+	return w * h * 2;
+}
+
+// Write an RGB565 frame to a texture of the same size, and flush it for the GPU
+static void frameToTexture(sf2d_texture *texture, const u8 *frame) {
+	sf2d_tile_texture_rows_convert(texture, 0, texture->height, frame, texture->width * 2, SF2D_PIXEL_RGB565);
+	GSPGPU_FlushDataCache(texture->data, texture->data_size);
+}
+
 /***
-Take a picture and put it in a texture.
+Take a picture and put it in a texture. Blocks until the camera delivers a frame; see `startStream` for a live preview.
+The output format of the camera must be RGB565 (it's set by `startStream`).
 @function takePicture
 @tparam number camera should be PORT_CAM1 if you have only 1 camera activated (`PORT_x`)
 @tparam number w width of the picture
 @tparam number h height of the picture
 @tparam[opt=PLACE_RAM] number place where to put the texture
-@treturn texture the texture object
+@treturn[1] texture the texture object, in the RGB565 format
+@treturn[2] nil if the picture couldn't be taken
+@treturn[2] string error message
 */
 static int cam_takePicture(lua_State *L) {
 	u8 cam = luaL_checkinteger(L, 1);
 	s16 w = luaL_optinteger(L, 2, 640);
 	s16 h = luaL_optinteger(L, 3, 480);
-	u32 bufSize = 0;
+	u8 place = luaL_optinteger(L, 4, SF2D_PLACE_RAM);
+	u32 transferUnit = 0;
+	u32 size = frameSize(w, h, &transferUnit);
 	
-	// Take the actual picture
-	CAMU_GetMaxBytes(&bufSize, w, h);
-	u8* buf = malloc(bufSize);
-	CAMU_SetTransferBytes(cam, bufSize, w, h);
+	u8 *buf = malloc(size);
+	sf2d_texture *picture = buf ? sf2d_create_texture(w, h, TEXFMT_RGB565, place) : NULL;
+	if (picture == NULL) {
+		free(buf);
+		lua_pushnil(L);
+		lua_pushstring(L, "Failed to allocate the picture");
+		return 2;
+	}
 	
+	// Take the actual picture
 	Handle camReceiveEvent = 0;
-	
+	CAMU_SetTransferBytes(cam, transferUnit, w, h);
 	CAMU_ClearBuffer(cam);
 	CAMU_StartCapture(cam);
-	CAMU_SetReceiving(&camReceiveEvent, buf, cam, bufSize, (s16)bufSize);
-	svcWaitSynchronization(camReceiveEvent, 300000000ULL);
+	CAMU_SetReceiving(&camReceiveEvent, buf, cam, size, (s16)transferUnit);
+	Result ret = svcWaitSynchronization(camReceiveEvent, 300000000ULL);
 	CAMU_StopCapture(cam);
+	svcCloseHandle(camReceiveEvent);
 	
-	// Load it in a texture
-	u8 place = luaL_optinteger(L, 4, SF2D_PLACE_RAM);
+	if (ret != 0) {
+		free(buf);
+		sf2d_free_texture(picture);
+		lua_pushnil(L);
+		lua_pushstring(L, "No picture received from the camera");
+		return 2;
+	}
+	
+	frameToTexture(picture, buf);
+	free(buf);
 	
 	texture_userdata *texture;
 	texture = (texture_userdata *)lua_newuserdata(L, sizeof(*texture));
@@ -351,16 +386,318 @@ static int cam_takePicture(lua_State *L) {
 	luaL_getmetatable(L, "LTexture");
 	lua_setmetatable(L, -2);
 	
-	texture->texture = sf2d_create_texture_mem_RGBA8(buf, w, h, TEXFMT_RGB565, place);
-	sf2d_texture_tile32(texture->texture);
+	texture->entry = NULL;
+	texture->borrowed = false;
+	texture->lastFrame = 0;
+	texture->texture = picture;
+	texture->scaleX = 1.0f;
+	texture->scaleY = 1.0f;
+	texture->blendColor = 0xffffffff;
 	
+	return 1;
+}
+
+// Streams
+
+#define STREAM_BUFFERS 3 // receiving, newest frame, converted
+#define STREAM_STACK_SIZE 0x1000
+#define STREAM_TIMEOUT 100000000LL // ns, how often the capture thread checks if it has to stop
+
+typedef struct {
+	u8 port;
+	s16 width;
+	s16 height;
+	u32 size;
+	u32 transferUnit;
+	u8 *buffers[STREAM_BUFFERS];
+	sf2d_texture *textures[2]; // the one drawn, and the one the next frame goes to
+	int back; // index of the texture the next frame goes to
+	u32 backFrame; // value of lua_frameCount when textures[back] was last drawn
+	texture_userdata *texture; // texture object, drawing textures[!back]
+	
+	Thread thread;
+	volatile bool running;
+	LightLock lock; // protects the fields below
+	int receiving; // buffer the camera writes to
+	int newest; // last frame received, or -1
+	int reading; // buffer being converted, or -1
+	bool fresh; // newest hasn't been converted yet
+	u32 received; // frames received
+	u32 converted; // frames converted
+} stream_userdata;
+
+/*
+The capture thread keeps a transfer running in the receiving buffer; once it's complete, that buffer becomes the newest
+frame, and the next transfer goes to the buffer that is neither the newest frame nor being converted by update. The
+main thread never waits for the camera, and the camera never waits for the main thread: frames that arrive faster than
+they're converted replace the newest one.
+*/
+static void streamCapture(void *arg) {
+	stream_userdata *stream = arg;
+	Handle event = 0;
+	
+	while (stream->running) {
+		if (event == 0) {
+			if (CAMU_SetReceiving(&event, stream->buffers[stream->receiving], stream->port, stream->size, (s16)stream->transferUnit) != 0) {
+				event = 0;
+				svcSleepThread(STREAM_TIMEOUT);
+				continue;
+			}
+		}
+		if (svcWaitSynchronization(event, STREAM_TIMEOUT) != 0) continue;
+		svcCloseHandle(event);
+		event = 0;
+		
+		LightLock_Lock(&stream->lock);
+		stream->newest = stream->receiving;
+		stream->fresh = true;
+		stream->received++;
+		for (int i = 0; i < STREAM_BUFFERS; i++) {
+			if (i != stream->newest && i != stream->reading) {
+				stream->receiving = i;
+				break;
+			}
+		}
+		LightLock_Unlock(&stream->lock);
+	}
+	
+	if (event != 0) svcCloseHandle(event);
+}
+
+static void stopStream(stream_userdata *stream) {
+	if (stream->thread == NULL) return;
+	
+	stream->running = false;
+	threadJoin(stream->thread, U64_MAX);
+	threadFree(stream->thread);
+	stream->thread = NULL;
+	CAMU_StopCapture(stream->port);
+}
+
+/***
+Start capturing frames from a camera continuously, for a live preview. The frames are received by a background thread
+in buffers allocated once, and `camStream:update` puts the newest one in the texture of the stream without waiting for
+the camera. The output format of the cameras is set to RGB565, like the texture.
+@function startStream
+@tparam number camera should be PORT_CAM1 if you have only 1 camera activated (`PORT_x`)
+@tparam[opt=640] number w width of the frames
+@tparam[opt=480] number h height of the frames
+@tparam[opt=PLACE_RAM] number place where to put the textures
+@treturn[1] camStream the stream object
+@treturn[2] nil in case of error
+@treturn[2] string error message
+@usage local stream = cam.startStream(cam.PORT_CAM1, 400, 240)
+local preview = stream:getTexture()
+while ctr.run() do
+	stream:update()
+	gfx.start(gfx.TOP)
+	preview:draw(0, 0)
+	gfx.stop()
+	gfx.render()
+end
+*/
+static int cam_startStream(lua_State *L) {
+	u8 port = luaL_checkinteger(L, 1);
+	s16 w = luaL_optinteger(L, 2, 640);
+	s16 h = luaL_optinteger(L, 3, 480);
+	u8 place = luaL_optinteger(L, 4, SF2D_PLACE_RAM);
+	luaL_argcheck(L, port == PORT_CAM1 || port == PORT_CAM2, 1, "the stream needs a single port");
+	luaL_argcheck(L, w > 0 && w <= 1024 && h > 0 && h <= 1024, 2, "invalid frame size");
+	
+	stream_userdata *stream = lua_newuserdata(L, sizeof(*stream));
+	memset(stream, 0, sizeof(*stream));
+	luaL_getmetatable(L, "LCamStream");
+	lua_setmetatable(L, -2);
+	
+	stream->port = port;
+	stream->width = w;
+	stream->height = h;
+	stream->size = frameSize(w, h, &stream->transferUnit);
+	bool allocated = true;
+	for (int i = 0; i < STREAM_BUFFERS; i++) {
+		stream->buffers[i] = malloc(stream->size);
+		allocated = allocated && stream->buffers[i] != NULL;
+	}
+	for (int i = 0; i < 2; i++) {
+		stream->textures[i] = sf2d_create_texture(w, h, TEXFMT_RGB565, place);
+		allocated = allocated && stream->textures[i] != NULL;
+	}
+	if (!allocated) {
+		lua_pushnil(L);
+		lua_pushstring(L, "Failed to allocate the stream");
+		return 2; // the rest is freed with the stream
+	}
+	
+	// Black until the first frame
+	for (int i = 0; i < 2; i++) {
+		memset(stream->textures[i]->data, 0, stream->textures[i]->data_size);
+		stream->textures[i]->tiled = 1;
+		GSPGPU_FlushDataCache(stream->textures[i]->data, stream->textures[i]->data_size);
+	}
+	stream->back = 1;
+	
+	// The texture object keeps the stream alive, and the stream its texture object
+	texture_userdata *texture = lua_newuserdata(L, sizeof(*texture));
+	luaL_getmetatable(L, "LTexture");
+	lua_setmetatable(L, -2);
+	lua_pushvalue(L, -2);
+	lua_setuservalue(L, -2);
+	texture->entry = NULL;
+	texture->borrowed = true;
+	texture->lastFrame = 0;
+	texture->texture = stream->textures[0];
 	texture->scaleX = 1.0f;
 	texture->scaleY = 1.0f;
 	texture->blendColor = 0xffffffff;
+	stream->texture = texture;
+	lua_setuservalue(L, -2);
+	
+	LightLock_Init(&stream->lock);
+	stream->receiving = 0;
+	stream->newest = -1;
+	stream->reading = -1;
+	
+	CAMU_SetOutputFormat(SELECT_ALL, OUTPUT_RGB_565, CONTEXT_BOTH);
+	CAMU_SetTransferBytes(port, stream->transferUnit, w, h);
+	CAMU_ClearBuffer(port);
+	CAMU_StartCapture(port);
+	
+	s32 priority = 0x30;
+	svcGetThreadPriority(&priority, CUR_THREAD_HANDLE);
+	stream->running = true;
+	// Above the main thread, so the next transfer starts as soon as a frame is received
+	stream->thread = threadCreate(streamCapture, stream, STREAM_STACK_SIZE, priority - 1, -2, false);
+	if (stream->thread == NULL) {
+		stream->running = false;
+		CAMU_StopCapture(port);
+		lua_pushnil(L);
+		lua_pushstring(L, "Can't start the capture thread");
+		return 2;
+	}
+	
+	return 1;
+}
+
+/***
+camStream object
+@section Stream methods
+*/
+
+/***
+Put the newest frame received from the camera in the texture of the stream, if there's a new one. Doesn't wait for the
+camera. The frame is written to the texture that isn't drawn, then the texture object is switched to it, so the GPU
+never draws a texture while it's being written to.
+@function :update
+@treturn boolean `true` if the texture has a new frame, `false` if no frame arrived since the last update
+*/
+static int stream_update(lua_State *L) {
+	stream_userdata *stream = luaL_checkudata(L, 1, "LCamStream");
+	
+	if (stream->texture == NULL) {
+		lua_pushboolean(L, false);
+		return 1;
+	}
+	
+	LightLock_Lock(&stream->lock);
+	bool fresh = stream->fresh;
+	if (fresh) {
+		stream->reading = stream->newest;
+		stream->fresh = false;
+	}
+	LightLock_Unlock(&stream->lock);
+	if (!fresh) {
+		lua_pushboolean(L, false);
+		return 1;
+	}
+	
+	// The GPU may still be rendering the last frame that drew the texture
+	sf2d_texture *back = stream->textures[stream->back];
+	if (gfxFrameInUse(stream->backFrame)) sf2d_wait_gpu();
+	frameToTexture(back, stream->buffers[stream->reading]);
+	stream->texture->texture = back;
+	stream->back = !stream->back;
+	stream->backFrame = stream->texture->lastFrame;
+	stream->converted++;
+	
+	LightLock_Lock(&stream->lock);
+	stream->reading = -1;
+	LightLock_Unlock(&stream->lock);
+	
+	lua_pushboolean(L, true);
+	return 1;
+}
+
+/***
+Return the texture the frames are put in. It's always the same texture object, which stays valid as long as it's used.
+@function :getTexture
+@treturn texture the texture, in the RGB565 format, black until the first frame
+*/
+static int stream_getTexture(lua_State *L) {
+	luaL_checkudata(L, 1, "LCamStream");
+	
+	lua_getuservalue(L, 1);
 	
 	return 1;
 }
 
+/***
+Return the number of frames received from the camera and put in the texture, to see the frames skipped.
+@function :getFrameCount
+@treturn number frames received from the camera
+@treturn number frames put in the texture by `:update`
+*/
+static int stream_getFrameCount(lua_State *L) {
+	stream_userdata *stream = luaL_checkudata(L, 1, "LCamStream");
+	
+	LightLock_Lock(&stream->lock);
+	lua_pushinteger(L, stream->received);
+	LightLock_Unlock(&stream->lock);
+	lua_pushinteger(L, stream->converted);
+	
+	return 2;
+}
+
+/***
+Stop capturing. The texture keeps the last frame.
+@function :stop
+*/
+static int stream_stop(lua_State *L) {
+	stream_userdata *stream = luaL_checkudata(L, 1, "LCamStream");
+	
+	stopStream(stream);
+	
+	return 0;
+}
+
+static int stream___gc(lua_State *L) {
+	stream_userdata *stream = luaL_checkudata(L, 1, "LCamStream");
+	
+	stopStream(stream);
+	for (int i = 0; i < STREAM_BUFFERS; i++) {
+		free(stream->buffers[i]);
+		stream->buffers[i] = NULL;
+	}
+	// Collected with its texture object, which can't be drawn anymore
+	for (int i = 0; i < 2; i++) {
+		if (stream->textures[i] != NULL) sf2d_free_texture(stream->textures[i]);
+		stream->textures[i] = NULL;
+	}
+	if (stream->texture != NULL) stream->texture->texture = NULL;
+	stream->texture = NULL;
+	
+	return 0;
+}
+
+// Stream methods
+static const struct luaL_Reg stream_methods[] = {
+	{"update",        stream_update       },
+	{"getTexture",    stream_getTexture   },
+	{"getFrameCount", stream_getFrameCount},
+	{"stop",          stream_stop         },
+	{"__gc",          stream___gc         },
+	{NULL, NULL}
+};
+
 // Functions
 static const struct luaL_Reg cam_lib[] = {
 	{"init",                      cam_init                     },
@@ -383,6 +720,7 @@ static const struct luaL_Reg cam_lib[] = {
 	{"setEffect",                 cam_setEffect                },
 	{"setFrameRate",              cam_setFrameRate             },
 	{"takePicture",               cam_takePicture              },
+	{"startStream",               cam_startStream              },
 	{NULL, NULL}
 };
 
@@ -739,6 +1077,12 @@ struct { char *name; int value; } cam_constants[] = {
 };
 
 int luaopen_cam_lib(lua_State *L) {
+	luaL_newmetatable(L, "LCamStream");
+	lua_pushvalue(L, -1);
+	lua_setfield(L, -2, "__index");
+	luaL_setfuncs(L, stream_methods, 0);
+	lua_pop(L, 1);
+	
 	luaL_newlib(L, cam_lib);
 	
 	for (int i = 0; cam_constants[i].name; i++) {
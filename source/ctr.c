@@ -176,7 +176,7 @@ Return a number of microseconds based on the system ticks.
 @treturn number microseconds
 */
 static int ctr_utime(lua_State *L) {
-	lua_pushinteger(L, svcGetSystemTick()/268.123480);
+	lua_pushinteger(L, (u64)(svcGetSystemTick()/268.123480)); // wraps around with 32-bit integers, differences stay valid
 	
 	return 1;
 }
@@ -6,6 +6,7 @@ The `gfx.font` module
 
 #include <unistd.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <sftd.h>
 #include "vera_ttf.h"
@@ -13,21 +14,77 @@ The `gfx.font` module
 #include <lua.h>
 #include <lauxlib.h>
 
+#include "gfx.h"
 #include "font.h"
 
 u32 textSize = 9;
 
+// Prepared texts replaced or collected while they were drawn in a frame the GPU still needs them for
+static sftd_text **retiredTexts = NULL;
+static int retiredCount = 0;
+static u32 retiredFrame = 0;
+
+static void freeRetiredTexts(bool all) {
+	if (!all && gfxFrameInUse(retiredFrame)) return;
+
+	for (int i = 0; i < retiredCount; i++) sftd_free_prepared_text(retiredTexts[i]);
+	retiredCount = 0;
+}
+
+static void retireText(text_userdata *text) {
+	if (text->text == NULL) return;
+
+	freeRetiredTexts(false);
+	if (!gfxFrameInUse(text->lastFrame)) {
+		sftd_free_prepared_text(text->text);
+	} else {
+		sftd_text **newRetired = realloc(retiredTexts, (retiredCount+1)*sizeof(sftd_text*));
+		if (newRetired != NULL) {
+			retiredTexts = newRetired;
+			retiredTexts[retiredCount++] = text->text;
+			retiredFrame = lua_frameCount;
+		} // else leak it rather than freeing memory the GPU is going to read
+	}
+	text->text = NULL;
+}
+
+// Convert an UTF-8 string to a new wide string; returns NULL if there isn't enough memory
+static wchar_t *toWideString(const char *string) {
+	// Wide caracters support. (wchar = UTF32 on 3DS.)
+	size_t len = strlen(string);
+	wchar_t *wtext = malloc((len+1)*sizeof(wchar_t));
+	if (wtext == NULL) return NULL;
+	len = mbstowcs(wtext, string, len);
+	if (len == (size_t)-1) len = 0;
+	*(wtext+len) = 0x0; // text end
+
+	return wtext;
+}
+
+// Lay out text->string; returns false if there isn't enough memory
+static bool prepareText(text_userdata *text) {
+	wchar_t *wtext = toWideString(text->string);
+	if (wtext == NULL) return false;
+
+	text->text = sftd_prepare_wtext(text->font->font, text->size, text->wrapWidth, wtext);
+	free(wtext);
+
+	return text->text != NULL;
+}
+
 /***
 Load a font. Supported formats: TTF, OTF, TTC, OTC, WOFF, PFA, PFB, PCF, FNT, BDF, PFR, and others.
 ctrµLua support all formats supported by FreeType. See here for a more complete list: http://freetype.org/freetype2/docs/index.html
 @function load
 @tparam string path path to the file
+@tparam[opt] string cachePath path to a glyph cache file saved with @{font:saveCache} from this font, loaded if it exists
 @treturn[1] font the loaded font.
 @treturn[2] nil if an error occurred
 @treturn[2] string error message
 */
 static int font_load(lua_State *L) {
 	const char *path = luaL_checkstring(L, 1);
+	const char *cachePath = luaL_optstring(L, 2, NULL);
 
 	font_userdata *font = lua_newuserdata(L, sizeof(*font));
 	luaL_getmetatable(L, "LFont");
@@ -42,6 +99,9 @@ static int font_load(lua_State *L) {
 		return 2;
 	}
 
+	// A missing or outdated cache is rebuilt as glyphs are drawn
+	if (cachePath != NULL) sftd_load_glyph_cache(font->font, cachePath);
+
 	return 1;
 }
 
@@ -128,6 +188,229 @@ static int font_object_width(lua_State *L) {
 	return 1;
 }
 
+/***
+Lay out a text once, to draw it later without redoing the per-glyph work.
+Drawing a prepared text only costs one draw call, so use it for text which doesn't change every frame.
+@function :prepare
+@tparam string text the text to lay out
+@tparam[opt=default size] integer size drawing size, in pixels
+@tparam[opt=0] integer wrapWidth width of a line before a word is moved to the next one, in pixels; 0 disables wrapping
+@treturn[1] text the prepared text
+@treturn[2] nil if an error occurred
+@treturn[2] string error message
+*/
+static int font_object_prepare(lua_State *L) {
+	font_userdata *font = luaL_checkudata(L, 1, "LFont");
+	if (font->font == NULL) luaL_error(L, "The font object was unloaded");
+
+	const char *string = luaL_checkstring(L, 2);
+	int size = luaL_optinteger(L, 3, textSize);
+	int wrapWidth = luaL_optinteger(L, 4, 0);
+
+	text_userdata *text = lua_newuserdata(L, sizeof(*text));
+	text->text = NULL;
+	text->font = font;
+	text->size = size;
+	text->wrapWidth = wrapWidth > 0 ? wrapWidth : 0;
+	text->string = strdup(string);
+	text->lastFrame = lua_frameCount - 1;
+	luaL_getmetatable(L, "LText");
+	lua_setmetatable(L, -2);
+
+	// Keep the font alive as long as the text
+	lua_pushvalue(L, 1);
+	lua_setuservalue(L, -2);
+
+	if (text->string == NULL || !prepareText(text)) {
+		lua_pushnil(L);
+		lua_pushstring(L, "Not enough memory");
+		return 2;
+	}
+
+	return 1;
+}
+
+/***
+Return the statistics of the glyph cache of the font. Glyphs are rasterized once for each size and kept in atlas pages; when they are all full, the least recently used glyphs are evicted.
+@function :getCacheStats
+@treturn table a table with the fields `hits` and `misses` (glyph lookups found in the cache or rasterized), `hitRate` (between 0 and 1), `evictions` (evicted glyphs), `glyphs` (glyphs in the cache), `pages` and `maxPages`
+*/
+static int font_object_getCacheStats(lua_State *L) {
+	font_userdata *font = luaL_checkudata(L, 1, "LFont");
+	if (font->font == NULL) luaL_error(L, "The font object was unloaded");
+
+	sftd_atlas_stats stats;
+	sftd_get_atlas_stats(font->font, &stats);
+
+	unsigned int lookups = stats.hits + stats.misses;
+
+	lua_createtable(L, 0, 7);
+	lua_pushinteger(L, stats.hits);
+	lua_setfield(L, -2, "hits");
+	lua_pushinteger(L, stats.misses);
+	lua_setfield(L, -2, "misses");
+	lua_pushnumber(L, lookups > 0 ? stats.hits/(double)lookups : 1);
+	lua_setfield(L, -2, "hitRate");
+	lua_pushinteger(L, stats.evictions);
+	lua_setfield(L, -2, "evictions");
+	lua_pushinteger(L, stats.glyphs);
+	lua_setfield(L, -2, "glyphs");
+	lua_pushinteger(L, stats.pages);
+	lua_setfield(L, -2, "pages");
+	lua_pushinteger(L, stats.max_pages);
+	lua_setfield(L, -2, "maxPages");
+
+	return 1;
+}
+
+/***
+Set the maximum number of pages of the glyph cache of the font. Each page is a 512x512 RGBA8 texture (1MiB).
+@function :setCachePages
+@tparam integer pages maximum number of pages (default 4); it can only be raised
+*/
+static int font_object_setCachePages(lua_State *L) {
+	font_userdata *font = luaL_checkudata(L, 1, "LFont");
+	if (font->font == NULL) luaL_error(L, "The font object was unloaded");
+
+	sftd_set_atlas_max_pages(font->font, luaL_checkinteger(L, 2));
+
+	return 0;
+}
+
+static const char *const fontModes[] = { "bitmap", "sdf", NULL };
+
+/***
+Set how the glyphs of the font are rendered.
+In `"bitmap"` mode (the default), glyphs are rasterized for each size they're drawn at. In `"sdf"` mode, each glyph is rasterized once as a signed distance field and drawn sharp at any size, which saves rasterization and glyph cache space when many sizes are used, and keeps big text crisp; small text looks a bit lighter.
+@function :setMode
+@tparam string mode `"bitmap"` or `"sdf"`
+*/
+static int font_object_setMode(lua_State *L) {
+	font_userdata *font = luaL_checkudata(L, 1, "LFont");
+	if (font->font == NULL) luaL_error(L, "The font object was unloaded");
+
+	sftd_set_mode(font->font, luaL_checkoption(L, 2, NULL, fontModes) == 1 ? SFTD_MODE_SDF : SFTD_MODE_BITMAP);
+
+	return 0;
+}
+
+/***
+Return how the glyphs of the font are rendered.
+@function :getMode
+@treturn string `"bitmap"` or `"sdf"`
+*/
+static int font_object_getMode(lua_State *L) {
+	font_userdata *font = luaL_checkudata(L, 1, "LFont");
+	if (font->font == NULL) luaL_error(L, "The font object was unloaded");
+
+	lua_pushstring(L, fontModes[sftd_get_mode(font->font) == SFTD_MODE_SDF ? 1 : 0]);
+
+	return 1;
+}
+
+/***
+Rasterize the glyphs of a set of characters ahead of time, so the first frames drawing them don't have to.
+With maxGlyphs, the work can be spread over several frames: call it again until it returns 0.
+@function :preload
+@tparam string charset the characters to load
+@tparam[opt=default size] integer|table sizes font size, or list of font sizes, in pixels
+@tparam[opt=0] integer maxGlyphs maximum number of glyphs to rasterize in this call, 0 for no limit
+@treturn integer number of glyphs still not in the glyph cache; more than 0 if it's full, see @{font:setCachePages}
+*/
+static int font_object_preload(lua_State *L) {
+	font_userdata *font = luaL_checkudata(L, 1, "LFont");
+	if (font->font == NULL) luaL_error(L, "The font object was unloaded");
+
+	const char *charset = luaL_checkstring(L, 2);
+	int maxGlyphs = luaL_optinteger(L, 4, 0);
+
+	int numSizes = 1;
+	if (lua_istable(L, 3)) {
+		numSizes = luaL_len(L, 3);
+	} else if (!lua_isnoneornil(L, 3)) {
+		luaL_checkinteger(L, 3);
+	}
+
+	wchar_t *wtext = toWideString(charset);
+	if (wtext == NULL) luaL_error(L, "Not enough memory");
+
+	// The glyphs over the budget are counted as missing
+	int budget = maxGlyphs > 0 ? maxGlyphs : -1;
+	int missing = 0;
+	for (int i = 1; i <= numSizes; i++) {
+		int size = textSize;
+		if (lua_istable(L, 3)) {
+			lua_rawgeti(L, 3, i);
+			size = lua_tointeger(L, -1);
+			lua_pop(L, 1);
+		} else if (!lua_isnoneornil(L, 3)) {
+			size = lua_tointeger(L, 3);
+		}
+		if (size <= 0) continue;
+
+		int sizeMissing;
+		int loaded = sftd_preload_wtext(font->font, size, wtext, budget, &sizeMissing);
+		if (budget > 0) budget -= loaded;
+		missing += sizeMissing;
+	}
+	free(wtext);
+
+	lua_pushinteger(L, missing);
+
+	return 1;
+}
+
+/***
+Save the glyph cache of the font to a file: the metrics and bitmaps of the glyphs, to load them at startup without rasterizing them.
+@function :saveCache
+@tparam string path path of the file
+@treturn[1] boolean true
+@treturn[2] nil if an error occurred
+@treturn[2] string error message
+*/
+static int font_object_saveCache(lua_State *L) {
+	font_userdata *font = luaL_checkudata(L, 1, "LFont");
+	if (font->font == NULL) luaL_error(L, "The font object was unloaded");
+
+	const char *path = luaL_checkstring(L, 2);
+
+	if (!sftd_save_glyph_cache(font->font, path)) {
+		lua_pushnil(L);
+		lua_pushfstring(L, "Can't write the glyph cache to %s", path);
+		return 2;
+	}
+
+	lua_pushboolean(L, true);
+
+	return 1;
+}
+
+/***
+Load glyphs saved with @{font:saveCache} in the glyph cache of the font, until it is full.
+@function :loadCache
+@tparam string path path of the file
+@treturn[1] integer number of loaded glyphs
+@treturn[2] nil if an error occurred
+@treturn[2] string error message
+*/
+static int font_object_loadCache(lua_State *L) {
+	font_userdata *font = luaL_checkudata(L, 1, "LFont");
+	if (font->font == NULL) luaL_error(L, "The font object was unloaded");
+
+	const char *path = luaL_checkstring(L, 2);
+
+	int loaded = sftd_load_glyph_cache(font->font, path);
+	if (loaded < 0) {
+		lua_pushnil(L);
+		lua_pushfstring(L, "No valid glyph cache for this font at %s", path);
+		return 2;
+	}
+
+	lua_pushinteger(L, loaded);
+
+	return 1;
+}
+
 /***
 Unload a font.
 @function :unload
@@ -144,9 +427,145 @@ static int font_object_unload(lua_State *L) {
 
 // Font object methods
 static const struct luaL_Reg font_object_methods[] = {
-	{ "width",  font_object_width  },
-	{ "unload", font_object_unload },
-	{ "__gc",   font_object_unload },
+	{ "width",         font_object_width         },
+	{ "prepare",       font_object_prepare       },
+	{ "getCacheStats", font_object_getCacheStats },
+	{ "setCachePages", font_object_setCachePages },
+	{ "setMode",       font_object_setMode       },
+	{ "getMode",       font_object_getMode       },
+	{ "preload",       font_object_preload       },
+	{ "saveCache",     font_object_saveCache     },
+	{ "loadCache",     font_object_loadCache     },
+	{ "unload",        font_object_unload        },
+	{ "__gc",          font_object_unload        },
+	{ NULL, NULL }
+};
+
+/***
+text object
+@section Text methods
+*/
+
+static text_userdata *checkText(lua_State *L, int index) {
+	text_userdata *text = luaL_checkudata(L, index, "LText");
+	if (text->string == NULL) luaL_error(L, "The text object was unloaded");
+	if (text->font->font == NULL) luaL_error(L, "The font object was unloaded");
+
+	return text;
+}
+
+/***
+Draw a prepared text.
+@function :draw
+@tparam integer x text drawing origin horizontal coordinate, in pixels
+@tparam integer y text drawing origin vertical coordinate, in pixels
+@tparam[opt=default color] integer color drawing color
+*/
+static int text_object_draw(lua_State *L) {
+	text_userdata *text = checkText(L, 1);
+	int x = luaL_checkinteger(L, 2);
+	int y = luaL_checkinteger(L, 3);
+	u32 color = luaL_optinteger(L, 4, color_default);
+
+	if (text->text == NULL) return 0;
+
+	sftd_draw_prepared_text(text->text, x, y, color);
+	text->lastFrame = lua_frameCount;
+
+	return 0;
+}
+
+/***
+Change the text. It is only laid out again if it is different from the current one.
+@function :setText
+@tparam string text the new text
+@treturn[1] boolean true
+@treturn[2] nil if an error occurred
+@treturn[2] string error message
+*/
+static int text_object_setText(lua_State *L) {
+	text_userdata *text = checkText(L, 1);
+	const char *string = luaL_checkstring(L, 2);
+
+	if (text->text != NULL && strcmp(text->string, string) == 0) {
+		lua_pushboolean(L, true);
+		return 1;
+	}
+
+	char *newString = strdup(string);
+	if (newString == NULL) {
+		lua_pushnil(L);
+		lua_pushstring(L, "Not enough memory");
+		return 2;
+	}
+	free(text->string);
+	text->string = newString;
+
+	retireText(text);
+	if (!prepareText(text)) {
+		lua_pushnil(L);
+		lua_pushstring(L, "Not enough memory");
+		return 2;
+	}
+
+	lua_pushboolean(L, true);
+	return 1;
+}
+
+/***
+Return the text.
+@function :getText
+@treturn string the text
+*/
+static int text_object_getText(lua_State *L) {
+	text_userdata *text = checkText(L, 1);
+
+	lua_pushstring(L, text->string);
+
+	return 1;
+}
+
+/***
+Return the size of the laid out text.
+@function :getSize
+@treturn integer width of the text, in pixels
+@treturn integer height of the text, in pixels
+*/
+static int text_object_getSize(lua_State *L) {
+	text_userdata *text = checkText(L, 1);
+
+	int width = 0, height = 0;
+	if (text->text != NULL) sftd_get_prepared_text_size(text->text, &width, &height);
+
+	lua_pushinteger(L, width);
+	lua_pushinteger(L, height);
+
+	return 2;
+}
+
+/***
+Unload a text.
+@function :unload
+*/
+static int text_object_unload(lua_State *L) {
+	text_userdata *text = luaL_checkudata(L, 1, "LText");
+	if (text->string == NULL) return 0;
+
+	retireText(text);
+	free(text->string);
+	text->string = NULL;
+
+	return 0;
+}
+
+// Text object methods
+static const struct luaL_Reg text_object_methods[] = {
+	{ "draw",    text_object_draw    },
+	{ "setText", text_object_setText },
+	{ "getText", text_object_getText },
+	{ "getSize", text_object_getSize },
+	{ "unload",  text_object_unload  },
+	{ "__gc",    text_object_unload  },
 	{ NULL, NULL }
 };
 
@@ -166,12 +585,20 @@ int luaopen_font_lib(lua_State *L) {
 	lua_setfield(L, -2, "__index");
 	luaL_setfuncs(L, font_object_methods, 0);
 
+	luaL_newmetatable(L, "LText");
+	lua_pushvalue(L, -1);
+	lua_setfield(L, -2, "__index");
+	luaL_setfuncs(L, text_object_methods, 0);
+
 	luaL_newlib(L, font_lib);
 
 	return 1;
 }
 
 void load_font_lib(lua_State *L) {
+	// Load lib (registers the LFont metatable)
+	luaL_requiref(L, "ctr.gfx.font", luaopen_font_lib, false);
+
 	// Load default font
 	font_userdata *font = lua_newuserdata(L, sizeof(*font));
 	luaL_getmetatable(L, "LFont");
@@ -180,16 +607,20 @@ void load_font_lib(lua_State *L) {
 	font->font = sftd_load_font_mem(vera_ttf, vera_ttf_size);
 
 	lua_setfield(L, LUA_REGISTRYINDEX, "LFontDefault");
-
-	// Load lib
-	luaL_requiref(L, "ctr.gfx.font", luaopen_font_lib, false);
 }
 
 void unload_font_lib(lua_State *L) {
 	lua_getfield(L, LUA_REGISTRYINDEX, "LFontDefault");
 
-	if (luaL_testudata(L, -1, "LFont") != NULL)
-		sftd_free_font(((font_userdata *)lua_touserdata(L, -1))->font); // Unload current font
+	font_userdata *font = luaL_testudata(L, -1, "LFont");
+	if (font != NULL) { // Unload current font
+		sftd_free_font(font->font);
+		font->font = NULL;
+	}
 	
 	lua_pop(L, 1);
+
+	freeRetiredTexts(true);
+	free(retiredTexts);
+	retiredTexts = NULL;
 }
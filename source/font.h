@@ -5,6 +5,15 @@ typedef struct {
 	sftd_font *font;
 } font_userdata;
 
+typedef struct {
+	sftd_text *text; // NULL if the text couldn't be laid out
+	font_userdata *font;
+	int size;
+	int wrapWidth;
+	char *string;
+	u32 lastFrame; // value of lua_frameCount when it was last drawn
+} text_userdata;
+
 extern u32 textSize;
 
 #endif
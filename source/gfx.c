@@ -8,7 +8,9 @@ The `gfx` module.
 #include <math.h>
 
 #include <sf2d.h>
+#include <sf2d_convert.h>
 #include <sftd.h>
+#include <png.h>
 
 //#include <3ds/vram.h>
 //#include <3ds/services/gsp.h>
@@ -35,6 +37,14 @@ scissor_state lua_scissor = {
 	0, 0
 };
 
+// Incremented by each gfx.start(), so the C code can tell what the GPU may still use in the current frame.
+u32 lua_frameCount = 0;
+
+// The frames sf2d has started but the GPU hasn't finished rendering are the last ones
+bool gfxFrameInUse(u32 frame) {
+	return lua_frameCount - frame < sf2d_get_frame_count() - sf2d_get_rendered_frame_count();
+}
+
 // Rotate a point (x,y) around the center (cx,cy) by angle radians.
 void rotatePoint(int x, int y, int cx, int cy, float angle, int* outx, int* outy) {
 	float s = sin(angle), c = cos(angle);
@@ -81,6 +91,8 @@ Must be called before any draw operation.
 @tparam[opt=gfx.LEFT] number eye the eye to draw to (`gfx.LEFT` or `gfx.RIGHT`)
 */
 static int gfx_start(lua_State *L) {
+	lua_frameCount++;
+
 	if (lua_isinteger(L, 1)) {
 		u8 screen = luaL_checkinteger(L, 1);
 		u8 eye = luaL_optinteger(L, 2, GFX_LEFT);
@@ -108,6 +120,8 @@ static int gfx_stop(lua_State *L) {
 
 /***
 Display any drawn pixel.
+The GPU renders a screen while the next one is drawn: if it's still rendering the last one, the screens are updated
+as soon as it's done, and `getStats` tells how long the CPU waited for the GPU.
 @function render
 */
 static int gfx_render(lua_State *L) {
@@ -129,6 +143,31 @@ static int gfx_getFPS(lua_State *L) {
 	return 1;
 }
 
+/***
+Get the rendering statistics of the last frame (everything drawn between the last two calls to `gfx.render()`).
+Consecutive texture draws sharing the same texture and blend color (including maps and text) are batched in a single GPU draw call, and GPU state changes that wouldn't change anything are not sent.
+@function getStats
+@treturn table a table with the fields `drawCalls` (number of draw calls sent to the GPU), `quads` (number of textured quads drawn), `commandsEmitted` (number of GPU state changes sent), `commandsSkipped` (number of redundant GPU state changes skipped) and `cpuWait` (time spent waiting for the GPU to finish rendering, in milliseconds)
+*/
+static int gfx_getStats(lua_State *L) {
+	sf2d_stats stats;
+	sf2d_get_stats(&stats);
+
+	lua_createtable(L, 0, 5);
+	lua_pushinteger(L, stats.draw_calls);
+	lua_setfield(L, -2, "drawCalls");
+	lua_pushinteger(L, stats.quads);
+	lua_setfield(L, -2, "quads");
+	lua_pushinteger(L, stats.commands_emitted);
+	lua_setfield(L, -2, "commandsEmitted");
+	lua_pushinteger(L, stats.commands_skipped);
+	lua_setfield(L, -2, "commandsSkipped");
+	lua_pushnumber(L, stats.cpu_wait_us / 1000.0);
+	lua_setfield(L, -2, "cpuWait");
+
+	return 1;
+}
+
 /***
 Enable or disable the stereoscopic 3D on the top screen.
 @function set3D
@@ -584,11 +623,63 @@ static int gfx_scissor(lua_State *L) {
 }
 
 /***
-__Work in progress__. Create a render target. Don't use it.
+Save the image of a screen to a file without blocking, like `texture:saveAsync`: the screen is copied right away, then
+encoded and written by a background thread. Call it after `gfx.stop()` and before `gfx.render()` to save the frame just
+drawn.
+@function screenshot
+@tparam string filename path to the file to save the image to
+@tparam[opt=gfx.TOP] number screen the screen to save (`gfx.TOP` or `gfx.BOTTOM`)
+@tparam[opt=gfx.LEFT] number eye the eye of the top screen to save (`gfx.LEFT` or `gfx.RIGHT`)
+@tparam[opt=TYPE_PNG] number type type of the image: `texture.TYPE_PNG` or `texture.TYPE_BMP`
+@tparam[opt=6] integer level PNG compression level, see `texture:save`
+@tparam[opt=FILTER_ALL] integer filters PNG filters, see `texture:save`
+@treturn[1] textureSave the object to wait for the save with
+@treturn[2] nil in case of error
+@treturn[2] string error message
+*/
+static int gfx_screenshot(lua_State *L) {
+	const char *path = luaL_checkstring(L, 1);
+	u8 screen = luaL_optinteger(L, 2, GFX_TOP);
+	u8 eye = luaL_optinteger(L, 3, GFX_LEFT);
+	u8 type = luaL_optinteger(L, 4, TYPE_PNG);
+	int level = luaL_optinteger(L, 5, PNG_DEFAULT_LEVEL);
+	int filters = luaL_optinteger(L, 6, PNG_ALL_FILTERS);
+	luaL_argcheck(L, screen == GFX_TOP || screen == GFX_BOTTOM, 2, "not a valid screen");
+	luaL_argcheck(L, type == TYPE_PNG || type == TYPE_BMP, 4, "not a valid type");
+	luaL_argcheck(L, level >= 0 && level <= 9, 5, "invalid compression level");
+
+	sf2d_wait_gpu(); // the last screen may still be rendering
+	u16 fbWidth, fbHeight;
+	const u8 *fb = gfxGetFramebuffer(screen, eye, &fbWidth, &fbHeight);
+	int width = fbHeight, height = fbWidth; // the LCDs are rotated
+	u8 *pixels = malloc(width * height * 4);
+	if (pixels == NULL) {
+		lua_pushnil(L);
+		lua_pushstring(L, "Failed to allocate buffer");
+		return 2;
+	}
+
+	// The framebuffers are BGR8 columns, from the bottom to the top of the screen, written by the GPU: each column is
+	// converted at once, then its pixels are put in place
+	GSPGPU_InvalidateDataCache(fb, fbWidth * fbHeight * 3);
+	u32 column[fbWidth];
+	for (int x = 0; x < width; x++) {
+		sf2d_convert_row(column, SF2D_PIXEL_RGBA8, fb + x * fbWidth * 3, SF2D_PIXEL_BGR8, fbWidth);
+		u32 *dst = (u32 *)pixels + (height - 1) * width + x;
+		for (int i = 0; i < fbWidth; i++, dst -= width) *dst = column[i];
+	}
+
+	return saveAsync(L, pixels, width, height, path, type, level, filters);
+}
+
+/***
+Create a render target: a texture that can be drawn to, like a screen, with `gfx.start(target)`. The target stays in the
+tiled layout of the GPU, and is cleared by the GPU: it can be drawn to and cleared every frame at no CPU cost.
 @function target
-@tparam integer width
-@tparam integer height
-@treturn target
+@tparam integer width width of the target, rounded up to a power of 2
+@tparam integer height height of the target, rounded up to a power of 2
+@treturn[1] target the new render target
+@treturn[2] nil if there is not enough memory
 */
 static int gfx_target(lua_State *L) {
 	int width = luaL_checkinteger(L, 1);
@@ -606,6 +697,10 @@ static int gfx_target(lua_State *L) {
 	lua_setmetatable(L, -2);
 	
 	target->target = sf2d_create_rendertarget(width, height);
+	if (target->target == NULL) {
+		lua_pushnil(L);
+		return 1;
+	}
 	
 	return 1;
 }
@@ -623,6 +718,7 @@ Clear a target to a specified color.
 static int gfx_target_clear(lua_State *L) {
 	target_userdata *target = luaL_checkudata(L, 1, "LTarget");
 	u32 color = luaL_optinteger(L, 2, color_default);
+	luaL_argcheck(L, target->target != NULL, 1, "destroyed target");
 	
 	sf2d_clear_target(target->target, color);
 	
@@ -630,13 +726,16 @@ static int gfx_target_clear(lua_State *L) {
 }
 
 /***
-Destroy a target.
+Destroy a target. Its `texture` can't be used afterwards.
 @function :destroy
 */
 static int gfx_target_destroy(lua_State *L) {
 	target_userdata *target = luaL_checkudata(L, 1, "LTarget");
 	
-	sf2d_free_target(target->target);
+	if (target->target != NULL) {
+		sf2d_free_target(target->target);
+		target->target = NULL;
+	}
 	
 	return 0;
 }
@@ -650,11 +749,22 @@ static int gfx_target___index(lua_State *L) {
 	const char* name = luaL_checkstring(L, 2);
 	
 	if (strcmp(name, "texture") == 0) {
+		if (target->target == NULL) {
+			lua_pushnil(L);
+			return 1;
+		}
+		
 		texture_userdata *texture;
 		texture = (texture_userdata*)lua_newuserdata(L, sizeof(*texture));
 		luaL_getmetatable(L, "LTexture");
 		lua_setmetatable(L, -2);
 		
+		// The texture belongs to the target, which stays alive as long as the texture object
+		lua_pushvalue(L, 1);
+		lua_setuservalue(L, -2);
+		texture->entry = NULL;
+		texture->borrowed = true;
+		texture->lastFrame = 0;
 		texture->texture = &(target->target->texture);
 		texture->scaleX = 1.0f;
 		texture->scaleY = 1.0f;
@@ -744,6 +854,7 @@ static const struct luaL_Reg gfx_lib[] = {
 	{ "stop",            gfx_stop            },
 	{ "render",          gfx_render          },
 	{ "getFPS",          gfx_getFPS          },
+	{ "getStats",        gfx_getStats        },
 	{ "set3D",           gfx_set3D           },
 	{ "get3D",           gfx_get3D           },
 	{ "setVBlankWait",   gfx_setVBlankWait   },
@@ -762,6 +873,7 @@ static const struct luaL_Reg gfx_lib[] = {
 	{ "calcBoundingBox", gfx_calcBoundingBox },
 	{ "scissor",         gfx_scissor         },
 	{ "target",          gfx_target          },
+	{ "screenshot",      gfx_screenshot      },
 	{ "console",         gfx_console         },
 	{ "clearConsole",    gfx_clearConsole    },
 	{ "disableConsole",  gfx_disableConsole  },
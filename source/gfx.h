@@ -9,4 +9,13 @@ typedef struct {
 
 extern scissor_state lua_scissor;
 
+// Number of gfx.start() calls
+extern u32 lua_frameCount;
+
+// Whether the GPU may still read what was drawn in a frame (a value of lua_frameCount): the current frame, or the
+// previous one while the GPU renders it
+bool gfxFrameInUse(u32 frame);
+
+extern u32 color_default;
+
 #endif
@@ -5,6 +5,7 @@ The circle pad pro is supported, it's keys replace the "3ds only" keys
 @usage local hid = require("ctr.hid")
 */
 #include <3ds/types.h>
+#include <3ds/os.h>
 #include <3ds/services/hid.h>
 #include <3ds/services/irrst.h>
 
@@ -251,11 +252,9 @@ Return the 3D cursor position.
 @treturn number 3d cursor position (`0` to `1`)
 */
 static int hid_3d(lua_State *L) {
-  float slider = (*(float*)0x1FF81080);
-  
-  lua_pushnumber(L, slider);
-  
-  return 1;
+	lua_pushnumber(L, osGet3DSliderState());
+
+	return 1;
 }
 
 static const struct luaL_Reg hid_lib[] = {
@@ -1,6 +1,6 @@
 /***
 The `gfx.map` module.
-Tile coordinates start at x=0,y=0.
+Tile coordinates start at x=0,y=0; layers are numbered from 1.
 @module ctr.gfx.map
 @usage local map = require("ctr.gfx.map")
 */
@@ -15,29 +15,463 @@ Tile coordinates start at x=0,y=0.
 #include <string.h>
 #include <math.h>
 
+#include <zlib.h>
+
 #include "gfx.h"
 #include "texture.h"
 
+#define CHUNK_SIZE 16 // in tiles
+#define MAX_BUILT_CHUNKS 64 // per layer; the least recently drawn are freed and built again when needed
+#define NO_TILE 0xFFFF // empty tile, not drawn
+#define MAX_MAP_TILES (1 << 24) // per layer, so the sizes of the layers fit in 32 bits
+
+// Tile flags, for the spatial queries; the other bits are free for the user
+#define MAP_TILE_SOLID   0x1
+#define MAP_TILE_ONE_WAY 0x2
+#define MAP_TILE_HAZARD  0x4
+
+// Vertices of a square part of a map layer, kept in linear memory so they can be drawn at once
 typedef struct {
-	texture_userdata *texture;
-	u8 tileSizeX;
-	u8 tileSizeY;
+	sf2d_vertex_pos_tex *vertices; // 4 per tile, followed by the indices in the same allocation; NULL if not built yet
+	u16 *indices; // 6 per tile
+	int width; // in tiles
+	int height; // in tiles
+	u32 lastFrame; // value of lua_frameCount when it was last drawn
+	int animatedTiles; // number of animated tiles in the chunk
+	u32 animationStep; // value of the map animationStep when its animated tiles were last written
+} map_chunk;
+
+typedef struct {
+	u16 *data;
+	texture_userdata *texture; // tileset
 	int tilesetSizeX; // in tiles
 	int tilesetSizeY; // in tiles
-	u16 *data;
+	float scrollX; // parallax factors, applied to the draw offset
+	float scrollY;
+	map_chunk *chunks;
+	int builtChunks;
+} map_layer;
+
+// Animated tile: the tile is drawn as each of the frames in turn
+typedef struct {
+	u16 tile;
+	u16 *frames;
+	int frameCount;
+	u32 frameDuration; // in milliseconds
+	int currentFrame;
+} map_animation;
+
+typedef struct {
+	u8 tileSizeX;
+	u8 tileSizeY;
 	int width;
 	int height;
 	int spaceX; // in pixels
 	int spaceY; // in pixels
+	map_layer *layers;
+	int layerCount;
+	int chunksX;
+	int chunksY;
+	map_animation *animations;
+	int animationCount;
+	u64 animationStart; // osGetTime() when the map was loaded
+	u32 animationStep; // incremented each time an animation changes frame
+	u8 *tileFlags; // flags of each tile value (MAP_TILE_*), NULL until some are set
 } map_userdata;
 
-void getTilePos(map_userdata *map, u16 tile, int *texX, int *texY) {
-	*texX = (tile%map->tilesetSizeX)*map->tileSizeX;
-	*texY = (tile/map->tilesetSizeX)*map->tileSizeY;
+// Binary map file header, followed by the tiles (u16, row by row, layer after layer).
+// All the values are little-endian, like on the 3DS, so the tiles can be read as-is.
+typedef struct {
+	char magic[4]; // MAP_FILE_MAGIC
+	u16 version; // MAP_FILE_VERSION
+	u16 flags; // MAP_FILE_*
+	u32 width; // in tiles
+	u32 height; // in tiles
+	u16 tileWidth; // in pixels
+	u16 tileHeight; // in pixels
+	u16 layers;
+	u16 reserved;
+	u32 dataSize; // size of the tiles in the file (compressed or not), in bytes
+} map_file_header;
+
+#define MAP_FILE_MAGIC "LMAP"
+#define MAP_FILE_VERSION 1
+#define MAP_FILE_ZLIB 0x1 // the tiles are compressed with zlib
+
+void getTilePos(map_layer *layer, map_userdata *map, u16 tile, int *texX, int *texY) {
+	*texX = (tile%layer->tilesetSizeX)*map->tileSizeX;
+	*texY = (tile/layer->tilesetSizeX)*map->tileSizeY;
+}
+
+u16 getTile(map_userdata *map, map_layer *layer, int x, int y) {
+	return layer->data[x+(y*map->width)];
+}
+
+map_chunk *getChunk(map_userdata *map, map_layer *layer, int x, int y) {
+	return &layer->chunks[(x/CHUNK_SIZE)+((y/CHUNK_SIZE)*map->chunksX)];
+}
+
+map_animation *getAnimation(map_userdata *map, u16 tile) {
+	for (int i = 0; i < map->animationCount; i++) {
+		if (map->animations[i].tile == tile) return &map->animations[i];
+	}
+	return NULL;
+}
+
+// Write the vertices of a tile in its chunk, and return them
+sf2d_vertex_pos_tex *setTileVertices(map_userdata *map, map_layer *layer, int x, int y) {
+	map_chunk *chunk = getChunk(map, layer, x, y);
+	sf2d_vertex_pos_tex *vertices = &chunk->vertices[((x%CHUNK_SIZE)+((y%CHUNK_SIZE)*chunk->width))*4];
+	sf2d_texture *texture = layer->texture->texture;
+
+	u16 tile = getTile(map, layer, x, y);
+	if (tile == NO_TILE) {
+		// Degenerate quad, nothing is drawn
+		memset(vertices, 0, 4*sizeof(sf2d_vertex_pos_tex));
+		return vertices;
+	}
+	map_animation *animation = getAnimation(map, tile);
+	if (animation != NULL) tile = animation->frames[animation->currentFrame];
+
+	int texX, texY;
+	getTilePos(layer, map, tile, &texX, &texY);
+
+	float left = x*(map->tileSizeX+map->spaceX);
+	float top = y*(map->tileSizeY+map->spaceY);
+	float right = left + map->tileSizeX;
+	float bottom = top + map->tileSizeY;
+
+	float u0 = texX/(float)texture->pow2_w;
+	float v0 = texY/(float)texture->pow2_h;
+	float u1 = (texX+map->tileSizeX)/(float)texture->pow2_w;
+	float v1 = (texY+map->tileSizeY)/(float)texture->pow2_h;
+
+	vertices[0] = (sf2d_vertex_pos_tex){{left,  top,    SF2D_DEFAULT_DEPTH}, {u0, v0}};
+	vertices[1] = (sf2d_vertex_pos_tex){{right, top,    SF2D_DEFAULT_DEPTH}, {u1, v0}};
+	vertices[2] = (sf2d_vertex_pos_tex){{left,  bottom, SF2D_DEFAULT_DEPTH}, {u0, v1}};
+	vertices[3] = (sf2d_vertex_pos_tex){{right, bottom, SF2D_DEFAULT_DEPTH}, {u1, v1}};
+
+	return vertices;
+}
+
+// Before the vertices of a chunk are rewritten: the current frame only reads them once it ends, but the GPU may still be
+// rendering the previous frame, which drew them
+static void waitChunkUnused(map_chunk *chunk) {
+	if (gfxFrameInUse(chunk->lastFrame)) sf2d_wait_gpu();
+}
+
+// Write the vertices of every tile (or only the animated ones) of a built chunk
+void setChunkVertices(map_userdata *map, map_layer *layer, int cx, int cy, bool animatedOnly) {
+	map_chunk *chunk = &layer->chunks[cx+(cy*map->chunksX)];
+	waitChunkUnused(chunk);
+
+	int animatedTiles = 0;
+	for (int y = cy*CHUNK_SIZE; y < cy*CHUNK_SIZE + chunk->height; y++) {
+		for (int x = cx*CHUNK_SIZE; x < cx*CHUNK_SIZE + chunk->width; x++) {
+			bool animated = map->animationCount > 0 && getAnimation(map, getTile(map, layer, x, y)) != NULL;
+			if (animated) animatedTiles++;
+			if (animated || !animatedOnly) setTileVertices(map, layer, x, y);
+		}
+	}
+	chunk->animatedTiles = animatedTiles;
+	chunk->animationStep = map->animationStep;
+
+	GSPGPU_FlushDataCache(chunk->vertices, chunk->width*chunk->height*4*sizeof(sf2d_vertex_pos_tex));
+}
+
+// Write the vertices of all the built chunks of the map
+void setMapVertices(map_userdata *map) {
+	for (int l = 0; l < map->layerCount; l++) {
+		for (int cy = 0; cy < map->chunksY; cy++) {
+			for (int cx = 0; cx < map->chunksX; cx++) {
+				if (map->layers[l].chunks[cx+(cy*map->chunksX)].vertices != NULL) setChunkVertices(map, &map->layers[l], cx, cy, false);
+			}
+		}
+	}
+}
+
+void freeChunk(map_layer *layer, map_chunk *chunk) {
+	linearFree(chunk->vertices);
+	chunk->vertices = NULL;
+	chunk->indices = NULL;
+	layer->builtChunks--;
+}
+
+// Allocate and fill the vertices of a chunk; returns false if there's not enough memory
+bool buildChunk(map_userdata *map, map_layer *layer, int cx, int cy) {
+	map_chunk *chunk = &layer->chunks[cx+(cy*map->chunksX)];
+
+	// Free the least recently drawn chunk; the ones drawn in the frames the GPU may still read are kept
+	if (layer->builtChunks >= MAX_BUILT_CHUNKS) {
+		map_chunk *oldest = NULL;
+		for (int i = 0; i < map->chunksX*map->chunksY; i++) {
+			map_chunk *c = &layer->chunks[i];
+			if (c->vertices != NULL && !gfxFrameInUse(c->lastFrame) && (oldest == NULL || c->lastFrame < oldest->lastFrame))
+				oldest = c;
+		}
+		if (oldest != NULL) freeChunk(layer, oldest);
+	}
+
+	int tiles = chunk->width*chunk->height;
+	chunk->vertices = linearMemAlign(tiles*(4*sizeof(sf2d_vertex_pos_tex) + 6*sizeof(u16)), 8);
+	if (chunk->vertices == NULL) return false;
+	chunk->indices = (u16 *)&chunk->vertices[tiles*4];
+	layer->builtChunks++;
+
+	// Two triangles per tile; the indices never change
+	for (int i = 0; i < tiles; i++) {
+		chunk->indices[i*6 + 0] = i*4 + 0;
+		chunk->indices[i*6 + 1] = i*4 + 1;
+		chunk->indices[i*6 + 2] = i*4 + 2;
+		chunk->indices[i*6 + 3] = i*4 + 2;
+		chunk->indices[i*6 + 4] = i*4 + 1;
+		chunk->indices[i*6 + 5] = i*4 + 3;
+	}
+	GSPGPU_FlushDataCache(chunk->indices, tiles*6*sizeof(u16));
+
+	setChunkVertices(map, layer, cx, cy, false);
+
+	return true;
+}
+
+// Allocate a new layer, with its chunks; their vertices are built the first time they're drawn.
+// Returns NULL if there's not enough memory.
+map_layer *addLayer(map_userdata *map, texture_userdata *tileset) {
+	map_layer *layers = realloc(map->layers, (map->layerCount+1)*sizeof(map_layer));
+	if (layers == NULL) return NULL;
+	map->layers = layers;
+
+	map_layer *layer = &map->layers[map->layerCount];
+	layer->data = malloc(sizeof(u16)*map->width*map->height);
+	layer->chunks = calloc(map->chunksX*map->chunksY, sizeof(map_chunk));
+	if (layer->data == NULL || layer->chunks == NULL) {
+		free(layer->data);
+		free(layer->chunks);
+		return NULL;
+	}
+	layer->texture = tileset;
+	layer->tilesetSizeX = tileset->texture->width/map->tileSizeX;
+	layer->tilesetSizeY = tileset->texture->height/map->tileSizeY;
+	layer->scrollX = 1.0f;
+	layer->scrollY = 1.0f;
+	layer->builtChunks = 0;
+
+	for (int cy = 0; cy < map->chunksY; cy++) {
+		for (int cx = 0; cx < map->chunksX; cx++) {
+			map_chunk *chunk = &layer->chunks[cx+(cy*map->chunksX)];
+			chunk->width = fmin(CHUNK_SIZE, map->width - cx*CHUNK_SIZE);
+			chunk->height = fmin(CHUNK_SIZE, map->height - cy*CHUNK_SIZE);
+		}
+	}
+
+	map->layerCount++;
+	return layer;
+}
+
+void freeLayers(map_userdata *map) {
+	for (int l = 0; l < map->layerCount; l++) {
+		map_layer *layer = &map->layers[l];
+		for (int i = 0; i < map->chunksX*map->chunksY; i++) {
+			if (layer->chunks[i].vertices != NULL) freeChunk(layer, &layer->chunks[i]);
+		}
+		free(layer->chunks);
+		free(layer->data);
+	}
+	free(map->layers);
+	map->layers = NULL;
+	map->layerCount = 0;
+}
+
+// Set the size of the map; must be done before adding the layers
+void setMapSize(map_userdata *map, int width, int height) {
+	map->width = width;
+	map->height = height;
+	map->chunksX = (width + CHUNK_SIZE - 1)/CHUNK_SIZE;
+	map->chunksY = (height + CHUNK_SIZE - 1)/CHUNK_SIZE;
+}
+
+// Advance the animations to the current time; returns true if a frame changed
+bool updateAnimations(map_userdata *map) {
+	if (map->animationCount == 0) return false;
+
+	u64 time = osGetTime() - map->animationStart;
+	bool changed = false;
+	for (int i = 0; i < map->animationCount; i++) {
+		map_animation *animation = &map->animations[i];
+		int frame = (time/animation->frameDuration) % animation->frameCount;
+		if (frame != animation->currentFrame) {
+			animation->currentFrame = frame;
+			changed = true;
+		}
+	}
+	if (changed) map->animationStep++;
+
+	return changed;
 }
 
-u16 getTile(map_userdata *map, int x, int y) {
-	return map->data[x+(y*map->width)];
+void freeAnimations(map_userdata *map) {
+	for (int i = 0; i < map->animationCount; i++) free(map->animations[i].frames);
+	free(map->animations);
+	map->animations = NULL;
+	map->animationCount = 0;
+}
+
+// Store the tileset of a layer in the registry, to block its GC
+// registry[map_userdata][layer] = texture_userdata
+void refLayerTileset(lua_State *L, int mapIndex, int layer, int textureIndex) {
+	lua_pushvalue(L, mapIndex);
+	lua_gettable(L, LUA_REGISTRYINDEX);
+	lua_pushvalue(L, textureIndex);
+	lua_rawseti(L, -2, layer);
+	lua_pop(L, 1);
+}
+
+// Read the tiles of a binary map file, after its header; returns NULL on success or an error message
+const char *readBinaryMap(map_userdata *map, map_file_header *header, FILE *file, texture_userdata *tileset) {
+	if (header->version != MAP_FILE_VERSION) return "unsupported map file version";
+	if (header->width < 1 || header->height < 1 || header->layers < 1) return "invalid map size";
+	if ((u64)header->width*header->height > MAX_MAP_TILES) return "invalid map size";
+
+	setMapSize(map, header->width, header->height);
+	for (int l = 0; l < header->layers; l++) {
+		if (addLayer(map, tileset) == NULL) return "not enough memory";
+	}
+
+	u32 layerSize = sizeof(u16)*map->width*map->height;
+	if (header->flags & MAP_FILE_ZLIB) {
+		u8 *compressed = malloc(header->dataSize);
+		if (compressed == NULL) return "not enough memory";
+		if (fread(compressed, 1, header->dataSize, file) != header->dataSize) {
+			free(compressed);
+			return "truncated map file";
+		}
+
+		// Inflate each layer straight into its tiles
+		z_stream stream = { .next_in = compressed, .avail_in = header->dataSize };
+		int result = inflateInit(&stream);
+		for (int l = 0; l < map->layerCount && result == Z_OK; l++) {
+			stream.next_out = (Bytef *)map->layers[l].data;
+			stream.avail_out = layerSize;
+			result = inflate(&stream, Z_SYNC_FLUSH);
+			if (stream.avail_out != 0) result = Z_DATA_ERROR;
+			else if (result == Z_STREAM_END && l < map->layerCount-1) result = Z_DATA_ERROR;
+			else if (result == Z_STREAM_END) result = Z_OK;
+		}
+		inflateEnd(&stream);
+		free(compressed);
+		if (result != Z_OK) return "corrupted map file";
+	} else {
+		if (header->dataSize != layerSize*map->layerCount) return "truncated map file";
+		for (int l = 0; l < map->layerCount; l++) {
+			if (fread(map->layers[l].data, 1, layerSize, file) != layerSize) return "truncated map file";
+		}
+	}
+
+	return NULL;
+}
+
+// Read the tiles of a CSV map file
+const char *readCSVMap(map_userdata *map, FILE *file, texture_userdata *tileset) {
+	fseek(file, 0L, SEEK_END);
+	int fileSize = ftell(file);
+	fseek(file, 0L, SEEK_SET);
+	char *buffer = (char *)malloc(sizeof(char)*(fileSize+1));
+	fileSize = fread(buffer, 1, fileSize, file);
+	buffer[fileSize] = '\0';
+
+	int width = 0;
+	for (int i=0; buffer[i]; i++) {
+		if (buffer[i] == ',') {
+			width++;
+		} else if (buffer[i] == '\n') {
+			width++;
+			break;
+		}
+	}
+	int height = 0;
+	for (int i=0; buffer[i]; i++) { // this should do
+		if (buffer[i] == '\n' && (buffer[i+1] != '\n' || !buffer[i+1])) height++;
+	}
+
+	if (width < 1 || height < 1) {
+		free(buffer);
+		return "invalid map size";
+	}
+	setMapSize(map, width, height);
+	map_layer *layer = addLayer(map, tileset);
+	if (layer == NULL) {
+		free(buffer);
+		return "not enough memory";
+	}
+
+	int i = 0;
+	char *token = strtok(buffer, ",\n");
+	while (token != NULL && i < width*height) {
+		layer->data[i] = (u16)atoi(token);
+		i++;
+		token = strtok(NULL, ",\n");
+	}
+	free(buffer);
+
+	return NULL;
+}
+
+// Read the tiles of a layer from a 2D table at the given index
+void readTableLayer(lua_State *L, int index, map_userdata *map, map_layer *layer) {
+	if (luaL_len(L, index) < map->height) luaL_error(L, "map table is shorter than the map height");
+
+	for (int y=1; y<=map->height; y++) {
+		if (lua_geti(L, index, y) != LUA_TTABLE) luaL_error(L, "map table must be an array of tables");
+		if (luaL_len(L, -1) < map->width) luaL_error(L, "table line y=%d is shorter than the map width", y);
+
+		for (int x=1; x<=map->width; x++) {
+			lua_geti(L, -1, x);
+
+			int isnum;
+			layer->data[(x-1)+((y-1)*map->width)] = (u16)lua_tointegerx(L, -1, &isnum);
+			if (!isnum) luaL_error(L, "tiles must be integers");
+
+			lua_pop(L, 1);
+		}
+
+		lua_pop(L, 1);
+	}
+}
+
+u8 getTileFlags(map_userdata *map, map_layer *layer, int x, int y) {
+	if (map->tileFlags == NULL || x < 0 || y < 0 || x >= map->width || y >= map->height) return 0;
+	u16 tile = getTile(map, layer, x, y);
+	return tile == NO_TILE ? 0 : map->tileFlags[tile];
+}
+
+// Built with -ffast-math, which assumes there are no infinities nor NaNs: isfinite() would always be true
+bool isFiniteNumber(double n) {
+	u64 bits;
+	memcpy(&bits, &n, sizeof(bits));
+	return ((bits >> 52) & 0x7FF) != 0x7FF;
+}
+
+// Narrow the progress range [tMin, tMax] of a ray to the part where start + t*d is within [0, size]; false if nothing is left
+bool clipRay(double start, double d, int size, double *tMin, double *tMax) {
+	if (d == 0) return start >= 0 && start <= size;
+
+	double t0 = -start / d, t1 = (size - start) / d;
+	if (t0 > t1) {
+		double swap = t0;
+		t0 = t1;
+		t1 = swap;
+	}
+	if (t0 > *tMin) *tMin = t0;
+	if (t1 < *tMax) *tMax = t1;
+
+	return *tMin <= *tMax;
+}
+
+// Check the layer argument at the given index (from 1); returns the layer
+map_layer *checkLayer(lua_State *L, map_userdata *map, int index) {
+	int layer = luaL_optinteger(L, index, 1);
+	luaL_argcheck(L, layer >= 1 && layer <= map->layerCount, index, "no such layer");
+	return &map->layers[layer-1];
 }
 
 // module functions
@@ -45,85 +479,74 @@ u16 getTile(map_userdata *map, int x, int y) {
 /***
 Load a map from a file.
 @function load
-@tparam string/table map path to the .map or a 2D table containing tile data (`{ [Y1]={[X1]=tile1, [X2]=tile2}, [Y2]=..., ... }`)
+@tparam string/table map path to the .csv or binary .map file (see `:save`), or a 2D table containing tile data (`{ [Y1]={[X1]=tile1, [X2]=tile2}, [Y2]=..., ... }`)
 @tparam texture tileset containing the tileset
-@tparam number tileWidth tile width
-@tparam number tileHeight tile height
+@tparam[opt] number tileWidth tile width; optional for binary map files, which store it
+@tparam[opt] number tileHeight tile height; optional for binary map files, which store it
 @treturn[1] map loaded map object
 @treturn[2] nil in case of error
 @treturn[2] string error message
 */
 static int map_load(lua_State *L) {
 	texture_userdata *texture = luaL_checkudata(L, 2, "LTexture");
-	u8 tileSizeX = luaL_checkinteger(L, 3);
-	u8 tileSizeY = luaL_checkinteger(L, 4);
+	int tileSizeX = luaL_optinteger(L, 3, 0);
+	int tileSizeY = luaL_optinteger(L, 4, 0);
 	
 	map_userdata *map = lua_newuserdata(L, sizeof(map_userdata));
 	luaL_getmetatable(L, "LMap");
 	lua_setmetatable(L, -2);
+	int mapIndex = lua_gettop(L);
 
-	// Block GC of the texture by keeping a reference to it in the registry
-	// registry[map_userdata] = texture_userdata
-	lua_pushnil(L);
-	lua_copy(L, -2, -1); // map_userdata
-	lua_pushnil(L);
-	lua_copy(L, 2, -1); // texture_userdata
+	// Block GC of the tilesets by keeping a reference to them in the registry
+	// registry[map_userdata] = { [layer] = texture_userdata, ... }
+	lua_pushvalue(L, mapIndex);
+	lua_newtable(L);
 	lua_settable(L, LUA_REGISTRYINDEX);
 
 	// Init userdata fields
-	map->texture = texture;
-	map->tileSizeX = tileSizeX;
-	map->tileSizeY = tileSizeY;
-	map->tilesetSizeX = (map->texture->texture->width/tileSizeX);
-	map->tilesetSizeY = (map->texture->texture->height/tileSizeY);
 	map->spaceX = 0;
 	map->spaceY = 0;
+	map->layers = NULL;
+	map->layerCount = 0;
+	map->animations = NULL;
+	map->animationCount = 0;
+	map->animationStart = osGetTime();
+	map->animationStep = 0;
+	map->tileFlags = NULL;
+	setMapSize(map, 0, 0);
+
+	// The tilesets sizes (in tiles) depend on the tile size, which may be read from the file
+	map->tileSizeX = 1;
+	map->tileSizeY = 1;
 	
 	// read the map file
+	const char *error = NULL;
 	if (lua_isstring(L, 1)) {
 		const char *mapPath = luaL_checkstring(L, 1);
 
-		FILE *mapFile = fopen(mapPath, "r");
+		FILE *mapFile = fopen(mapPath, "rb");
 		if (mapFile == NULL) {
 			lua_pushnil(L);
 			lua_pushfstring(L, "no such file \"%s\"", mapPath);
 			return 2;
 		}
-		fseek(mapFile, 0L, SEEK_END);
-		int fileSize = ftell(mapFile);
-		fseek(mapFile, 0L, SEEK_SET);
-		char *buffer = (char *)malloc(sizeof(char)*fileSize);
-		fread(buffer, 1, fileSize, mapFile);
-		fclose(mapFile);
 
-		int width = 0;
-		for (int i=0; buffer[i]; i++) {
-			if (buffer[i] == ',') {
-				width++;
-			} else if (buffer[i] == '\n') {
-				width++;
-				break;
-			}
+		map_file_header header;
+		size_t headerSize = fread(&header, 1, sizeof(header), mapFile);
+		if (headerSize >= 4 && memcmp(header.magic, MAP_FILE_MAGIC, 4) == 0) {
+			error = headerSize < sizeof(header) ? "truncated map file" : readBinaryMap(map, &header, mapFile, texture);
+			if (tileSizeX == 0) tileSizeX = header.tileWidth;
+			if (tileSizeY == 0) tileSizeY = header.tileHeight;
+		} else {
+			error = readCSVMap(map, mapFile, texture);
 		}
-		int height = 0;
-		for (int i=0; buffer[i]; i++) { // this should do
-			if (buffer[i] == '\n' && (buffer[i+1] != '\n' || !buffer[i+1])) height++;
-		}
-
-		map->width = width;
-		map->height = height;
+		fclose(mapFile);
 
-		map->data = malloc(sizeof(u16)*width*height);
-		int i = 0;
-		char *token = strtok(buffer, ",\n");
-		while (token != NULL) {
-			map->data[i] = (u16)atoi(token);
-			i++;
-			token = strtok(NULL, ",\n");
+		if (error != NULL) {
+			lua_pushnil(L);
+			lua_pushfstring(L, "can't load \"%s\": %s", mapPath, error);
+			return 2;
 		}
-		free(buffer);
-
-		return 1;
 
 	} else if (lua_istable(L, 1)) {
 		int height = luaL_len(L, 1);
@@ -134,33 +557,31 @@ static int map_load(lua_State *L) {
 		if (width < 1) luaL_error(L, "map width must be greater or equal to 1");
 		lua_pop(L, 1);
 
-		map->width = width;
-		map->height = height;
-
-		map->data = malloc(sizeof(u16)*width*height);
-		for (int y=1; y<=height; y++) {
-			if (lua_geti(L, 1, y) != LUA_TTABLE) luaL_error(L, "map table must be an array of tables");
-			if (luaL_len(L, -1) < width) luaL_error(L, "table line y=%d is shorter than the map width", y);
-
-			for (int x=1; x<=width; x++) {
-				lua_geti(L, -1, x);
-
-				bool isnum;
-				map->data[(x-1)+((y-1)*map->width)] = (u16)lua_tointegerx(L, -1, (int *)&isnum);
-				if (!isnum) luaL_error(L, "tiles must be integers");
-
-				lua_pop(L, 1);
-			}
-
-			lua_pop(L, 1);
+		setMapSize(map, width, height);
+		map_layer *layer = addLayer(map, texture);
+		if (layer == NULL) {
+			lua_pushnil(L);
+			lua_pushstring(L, "not enough memory");
+			return 2;
 		}
-		
-		return 1;
+		readTableLayer(L, 1, map, layer);
 
 	} else {
 		luaL_error(L, "map (first argument) must be a string or a table");
 		return 0;
 	}
+
+	if (tileSizeX < 1 || tileSizeX > 255 || tileSizeY < 1 || tileSizeY > 255) luaL_error(L, "tile size must be between 1 and 255");
+	map->tileSizeX = tileSizeX;
+	map->tileSizeY = tileSizeY;
+
+	for (int l = 0; l < map->layerCount; l++) {
+		map->layers[l].tilesetSizeX = texture->texture->width/tileSizeX;
+		map->layers[l].tilesetSizeY = texture->texture->height/tileSizeY;
+		refLayerTileset(L, mapIndex, l+1, 2);
+	}
+
+	return 1;
 }
 
 /***
@@ -170,6 +591,7 @@ Map object
 
 /***
 Draw (a part of) the map on the screen.
+The map is drawn by chunks of 16x16 tiles, using one GPU draw call per visible chunk of each layer; the layers are drawn in order, each one with its scroll factor applied to the offset.
 @function :draw
 @tparam integer x X top-left coordinate to draw the map on the screen (pixels)
 @tparam integer y Y top-left coordinate to draw the map on the screen (pixels)
@@ -177,6 +599,7 @@ Draw (a part of) the map on the screen.
 @tparam[opt=0] integer offsetY drawn area Y start coordinate on the map (pixels)
 @tparam[opt=400] integer width width of the drawn area on the map (pixels)
 @tparam[opt=240] integer height height of the drawn area on the map (pixels)
+@tparam[opt] integer layer only draw this layer (for example to draw sprites between two layers)
 @usage
 -- This will draw on the screen at x=5,y=5 a part of the map. The part is the rectangle on the map starting at x=16,y=16 and width=32,height=48.
 -- For example, if you use 16x16 pixel tiles, this will draw the tiles from 1,1 (top-left corner of the rectangle) to 2,3 (bottom-right corner).
@@ -190,35 +613,45 @@ static int map_draw(lua_State *L) {
 	int offsetY = luaL_optinteger(L, 5, 0);
 	int width = luaL_optinteger(L, 6, 400);
 	int height = luaL_optinteger(L, 7, 240);
+	int firstLayer = 0;
+	int lastLayer = map->layerCount-1;
+	if (!lua_isnoneornil(L, 8)) {
+		firstLayer = lastLayer = checkLayer(L, map, 8) - map->layers;
+	}
 
-	int xI = fmax(floor((double)offsetX / map->tileSizeX), 0); // initial tile X
-	int xF = fmin(ceil((double)(offsetX + width) / map->tileSizeX), map->width); // final tile X
-
-	int yI = fmax(floor((double)offsetY / map->tileSizeY), 0); // initial tile Y
-	int yF = fmin(ceil((double)(offsetY + height) / map->tileSizeY), map->height); // final tile Y
+	updateAnimations(map);
 
 	if (sf2d_get_current_screen() == GFX_TOP)
 		sf2d_set_scissor_test(GPU_SCISSOR_NORMAL, x, y, fmin(width, 400 - x), fmin(height, 240 - y)); // Scissor test doesn't work when x/y + width > screenWidth/Height
 	else
 		sf2d_set_scissor_test(GPU_SCISSOR_NORMAL, x, y, fmin(width, 320 - x), fmin(height, 240 - y));
 
-	int texX = 0;
-	int texY = 0;
+	for (int l = firstLayer; l <= lastLayer; l++) {
+		map_layer *layer = &map->layers[l];
+		float layerOffsetX = offsetX*layer->scrollX;
+		float layerOffsetY = offsetY*layer->scrollY;
 
-	if (map->texture->blendColor == 0xffffffff) {
-		for (int xp = xI; xp < xF; xp++) {
-			for (int yp = yI; yp < yF; yp++) {
-				u16 tile = getTile(map, xp, yp);
-				getTilePos(map, tile, &texX, &texY);
-				sf2d_draw_texture_part(map->texture->texture, x+(map->tileSizeX*xp)+(xp*map->spaceX)-offsetX, y+(map->tileSizeY*yp)+(yp*map->spaceY)-offsetY, texX, texY, map->tileSizeX, map->tileSizeY);
-			}
-		}
-	} else {
-		for (int xp = xI; xp < xF; xp++) {
-			for (int yp = yI; yp < yF; yp++) {
-				u16 tile = getTile(map, xp, yp);
-				getTilePos(map, tile, &texX, &texY);
-				sf2d_draw_texture_part_blend(map->texture->texture, x+(map->tileSizeX*xp)+(xp*map->spaceX)-offsetX, y+(map->tileSizeY*yp)+(yp*map->spaceY)-offsetY, texX, texY, map->tileSizeX, map->tileSizeY, map->texture->blendColor);
+		int xI = fmax(floor(layerOffsetX / map->tileSizeX), 0); // initial tile X
+		int xF = fmin(ceil((layerOffsetX + width) / map->tileSizeX), map->width); // final tile X
+
+		int yI = fmax(floor(layerOffsetY / map->tileSizeY), 0); // initial tile Y
+		int yF = fmin(ceil((layerOffsetY + height) / map->tileSizeY), map->height); // final tile Y
+
+		if (xI >= xF || yI >= yF) continue;
+
+		cacheTextureDrawn(layer->texture);
+
+		// Draw each visible chunk at once
+		for (int cy = yI/CHUNK_SIZE; cy <= (yF-1)/CHUNK_SIZE; cy++) {
+			for (int cx = xI/CHUNK_SIZE; cx <= (xF-1)/CHUNK_SIZE; cx++) {
+				map_chunk *chunk = &layer->chunks[cx+(cy*map->chunksX)];
+				if (chunk->vertices == NULL) {
+					if (!buildChunk(map, layer, cx, cy)) continue;
+				} else if (chunk->animatedTiles > 0 && chunk->animationStep != map->animationStep) {
+					setChunkVertices(map, layer, cx, cy, true);
+				}
+				chunk->lastFrame = lua_frameCount;
+				sf2d_draw_quads(layer->texture->texture, chunk->vertices, chunk->indices, chunk->width*chunk->height, x-layerOffsetX, y-layerOffsetY, layer->texture->blendColor);
 			}
 		}
 	}
@@ -235,9 +668,12 @@ Unload a map.
 static int map_unload(lua_State *L) {
 	map_userdata *map = luaL_checkudata(L, 1, "LMap");
 
-	free(map->data);
+	freeLayers(map);
+	freeAnimations(map);
+	free(map->tileFlags);
+	map->tileFlags = NULL;
 
-	// Remove the reference to the texture in the registry
+	// Remove the references to the tilesets in the registry
 	// registry[map_userdata] = nil
 	lua_pushnil(L);
 	lua_copy(L, 1, -1); // map_userdata
@@ -267,14 +703,18 @@ Return the value of a tile.
 @function :getTile
 @tparam number x X position of the tile (in tiles)
 @tparam number y Y position of the tile (in tiles)
+@tparam[opt=1] number layer layer of the tile
 @treturn number value of the tile
 */
 static int map_getTile(lua_State *L) {
 	map_userdata *map = luaL_checkudata(L, 1, "LMap");
 	int x = luaL_checkinteger(L, 2);
 	int y = luaL_checkinteger(L, 3);
+	luaL_argcheck(L, x >= 0 && x < map->width, 2, "x out of the map");
+	luaL_argcheck(L, y >= 0 && y < map->height, 3, "y out of the map");
+	map_layer *layer = checkLayer(L, map, 4);
 	
-	lua_pushinteger(L, getTile(map, x, y));
+	lua_pushinteger(L, getTile(map, layer, x, y));
 
 	return 1;
 }
@@ -284,15 +724,30 @@ Set the value of a tile.
 @function :setTile
 @tparam number x X position of the tile (in tiles)
 @tparam number y Y position of the tile (in tiles)
-@tparam number value new value for the tile
+@tparam number value new value for the tile (`NO_TILE` for an empty tile)
+@tparam[opt=1] number layer layer of the tile
 */
 static int map_setTile(lua_State *L) {
 	map_userdata *map = luaL_checkudata(L, 1, "LMap");
 	int x = luaL_checkinteger(L, 2);
 	int y = luaL_checkinteger(L, 3);
+	luaL_argcheck(L, x >= 0 && x < map->width, 2, "x out of the map");
+	luaL_argcheck(L, y >= 0 && y < map->height, 3, "y out of the map");
 	u16 tile = luaL_checkinteger(L, 4);
-	
-	map->data[x+(y*map->width)] = tile;
+	map_layer *layer = checkLayer(L, map, 5);
+
+	u16 previous = getTile(map, layer, x, y);
+	layer->data[x+(y*map->width)] = tile;
+
+	map_chunk *chunk = getChunk(map, layer, x, y);
+	if (chunk->vertices != NULL) {
+		waitChunkUnused(chunk);
+		sf2d_vertex_pos_tex *vertices = setTileVertices(map, layer, x, y);
+		GSPGPU_FlushDataCache(vertices, 4*sizeof(sf2d_vertex_pos_tex));
+
+		if (getAnimation(map, previous) != NULL) chunk->animatedTiles--;
+		if (getAnimation(map, tile) != NULL) chunk->animatedTiles++;
+	}
 	
 	return 0;
 }
@@ -310,19 +765,424 @@ static int map_setSpace(lua_State *L) {
 	
 	map->spaceX = x;
 	map->spaceY = y;
+
+	setMapVertices(map);
 	
 	return 0;
 }
 
+/***
+Add a layer to the map, drawn over the previous ones.
+@function :addLayer
+@tparam[opt] table tiles 2D table containing the tile data, like in `load`, of the size of the map; if not given, the layer is empty (filled with `NO_TILE`)
+@tparam[opt] texture tileset texture containing the tileset of the layer, with the same tile size; the map tileset by default
+@treturn number the index of the new layer
+*/
+static int map_addLayer(lua_State *L) {
+	map_userdata *map = luaL_checkudata(L, 1, "LMap");
+	if (!lua_isnoneornil(L, 2)) luaL_checktype(L, 2, LUA_TTABLE);
+	texture_userdata *tileset = lua_isnoneornil(L, 3) ? map->layers[0].texture : luaL_checkudata(L, 3, "LTexture");
+
+	map_layer *layer = addLayer(map, tileset);
+	if (layer == NULL) luaL_error(L, "not enough memory");
+	layer->tilesetSizeX = tileset->texture->width/map->tileSizeX;
+	layer->tilesetSizeY = tileset->texture->height/map->tileSizeY;
+
+	if (lua_istable(L, 2)) {
+		readTableLayer(L, 2, map, layer);
+	} else {
+		for (int i = 0; i < map->width*map->height; i++) layer->data[i] = NO_TILE;
+	}
+
+	if (lua_isnoneornil(L, 3)) {
+		lua_pushvalue(L, 1);
+		lua_gettable(L, LUA_REGISTRYINDEX);
+		lua_rawgeti(L, -1, 1);
+		refLayerTileset(L, 1, map->layerCount, lua_gettop(L));
+		lua_pop(L, 2);
+	} else {
+		refLayerTileset(L, 1, map->layerCount, 3);
+	}
+
+	lua_pushinteger(L, map->layerCount);
+	return 1;
+}
+
+/***
+Return the number of layers of the map.
+@function :getLayerCount
+@treturn number number of layers
+*/
+static int map_getLayerCount(lua_State *L) {
+	map_userdata *map = luaL_checkudata(L, 1, "LMap");
+
+	lua_pushinteger(L, map->layerCount);
+
+	return 1;
+}
+
+/***
+Set the scroll factor of a layer, used for parallax: the draw offset is multiplied by it for this layer.
+@function :setLayerScroll
+@tparam number layer layer index
+@tparam number x X scroll factor (1 scrolls with the map, 0 doesn't scroll)
+@tparam[opt=x] number y Y scroll factor
+*/
+static int map_setLayerScroll(lua_State *L) {
+	map_userdata *map = luaL_checkudata(L, 1, "LMap");
+	map_layer *layer = checkLayer(L, map, 2);
+	float x = luaL_checknumber(L, 3);
+	float y = luaL_optnumber(L, 4, x);
+
+	layer->scrollX = x;
+	layer->scrollY = y;
+
+	return 0;
+}
+
+/***
+Set the tileset of a layer. It must use the same tile size as the map.
+@function :setLayerTileset
+@tparam number layer layer index
+@tparam texture tileset texture containing the tileset
+*/
+static int map_setLayerTileset(lua_State *L) {
+	map_userdata *map = luaL_checkudata(L, 1, "LMap");
+	map_layer *layer = checkLayer(L, map, 2);
+	texture_userdata *tileset = luaL_checkudata(L, 3, "LTexture");
+
+	layer->texture = tileset;
+	layer->tilesetSizeX = tileset->texture->width/map->tileSizeX;
+	layer->tilesetSizeY = tileset->texture->height/map->tileSizeY;
+	refLayerTileset(L, 1, layer - map->layers + 1, 3);
+
+	setMapVertices(map);
+
+	return 0;
+}
+
+/***
+Animate a tile: wherever it is on the map, it will be drawn as each of the frames in turn.
+The animations are advanced when the map is drawn, without having to change the tiles.
+@function :setAnimation
+@tparam number tile the animated tile value
+@tparam[opt] table frames list of the tile values to draw in turn; if not given, the tile isn't animated anymore
+@tparam[opt=0.1] number duration duration of each frame (seconds)
+@usage
+-- The water tile 5 cycles through the tiles 5, 6 and 7, each one displayed for 0.2 second
+map:setAnimation(5, { 5, 6, 7 }, 0.2)
+*/
+static int map_setAnimation(lua_State *L) {
+	map_userdata *map = luaL_checkudata(L, 1, "LMap");
+	u16 tile = luaL_checkinteger(L, 2);
+	double duration = luaL_optnumber(L, 4, 0.1);
+
+	// Remove the previous animation of this tile
+	map_animation *animation = getAnimation(map, tile);
+	if (animation != NULL) {
+		free(animation->frames);
+		*animation = map->animations[--map->animationCount];
+	}
+
+	if (!lua_isnoneornil(L, 3)) {
+		luaL_checktype(L, 3, LUA_TTABLE);
+		int frameCount = luaL_len(L, 3);
+		luaL_argcheck(L, frameCount >= 1, 3, "at least one frame is needed");
+		luaL_argcheck(L, duration > 0, 4, "the duration must be positive");
+
+		map_animation *animations = realloc(map->animations, (map->animationCount+1)*sizeof(map_animation));
+		if (animations == NULL) luaL_error(L, "not enough memory");
+		map->animations = animations;
+
+		animation = &map->animations[map->animationCount];
+		animation->frames = malloc(frameCount*sizeof(u16));
+		if (animation->frames == NULL) luaL_error(L, "not enough memory");
+		for (int i = 0; i < frameCount; i++) {
+			lua_geti(L, 3, i+1);
+			animation->frames[i] = luaL_checkinteger(L, -1);
+			lua_pop(L, 1);
+		}
+		animation->tile = tile;
+		animation->frameCount = frameCount;
+		animation->frameDuration = fmax(duration*1000, 1);
+		animation->currentFrame = 0;
+		map->animationCount++;
+		updateAnimations(map);
+	}
+
+	setMapVertices(map);
+
+	return 0;
+}
+
+/***
+Set the flags of a tile value, used by the spatial queries (`queryRect` and `raycast`).
+The flags are a bit field: use the `SOLID`, `ONE_WAY` and `HAZARD` constants, or your own values up to 0x80.
+@function :setTileFlags
+@tparam number tile the tile value
+@tparam number flags the flags of the tile
+@usage
+map:setTileFlags(12, map.SOLID)
+map:setTileFlags(13, map.SOLID | map.HAZARD)
+*/
+static int map_setTileFlags(lua_State *L) {
+	map_userdata *map = luaL_checkudata(L, 1, "LMap");
+	u16 tile = luaL_checkinteger(L, 2);
+	u8 flags = luaL_checkinteger(L, 3);
+
+	if (map->tileFlags == NULL) {
+		if (flags == 0) return 0;
+		map->tileFlags = calloc(0x10000, sizeof(u8));
+		if (map->tileFlags == NULL) luaL_error(L, "not enough memory");
+	}
+	map->tileFlags[tile] = flags;
+
+	return 0;
+}
+
+/***
+Return the flags of a tile value.
+@function :getTileFlags
+@tparam number tile the tile value
+@treturn number the flags of the tile
+*/
+static int map_getTileFlags(lua_State *L) {
+	map_userdata *map = luaL_checkudata(L, 1, "LMap");
+	u16 tile = luaL_checkinteger(L, 2);
+
+	lua_pushinteger(L, map->tileFlags == NULL ? 0 : map->tileFlags[tile]);
+
+	return 1;
+}
+
+/***
+Check the tiles overlapping a rectangle, for example the bounding box of a moving body.
+The tiles outside of the map have no flags.
+@function :queryRect
+@tparam number x X top-left coordinate of the rectangle on the map (pixels)
+@tparam number y Y top-left coordinate of the rectangle on the map (pixels)
+@tparam number width width of the rectangle (pixels)
+@tparam number height height of the rectangle (pixels)
+@tparam[opt=0xFF] number mask only the tiles with one of these flags are counted
+@tparam[opt=1] number layer layer to check
+@treturn number the flags of the counted tiles, combined (0 if there's none)
+@treturn number the number of counted tiles
+@usage
+if map:queryRect(player.x, player.y + 1, 16, 16, map.SOLID) ~= 0 then
+	player.onGround = true
+end
+*/
+static int map_queryRect(lua_State *L) {
+	map_userdata *map = luaL_checkudata(L, 1, "LMap");
+	double x = luaL_checknumber(L, 2);
+	double y = luaL_checknumber(L, 3);
+	double width = luaL_checknumber(L, 4);
+	double height = luaL_checknumber(L, 5);
+	u8 mask = luaL_optinteger(L, 6, 0xFF);
+	map_layer *layer = checkLayer(L, map, 7);
+
+	int pitchX = map->tileSizeX + map->spaceX;
+	int pitchY = map->tileSizeY + map->spaceY;
+
+	int xI = fmax(floor(x / pitchX), 0); // initial tile X
+	int xF = fmin(ceil((x + width) / pitchX), map->width); // final tile X
+	int yI = fmax(floor(y / pitchY), 0); // initial tile Y
+	int yF = fmin(ceil((y + height) / pitchY), map->height); // final tile Y
+
+	u8 flags = 0;
+	int count = 0;
+	if (map->tileFlags != NULL) {
+		for (int yp = yI; yp < yF; yp++) {
+			for (int xp = xI; xp < xF; xp++) {
+				u8 tileFlags = getTileFlags(map, layer, xp, yp) & mask;
+				if (tileFlags) {
+					flags |= tileFlags;
+					count++;
+				}
+			}
+		}
+	}
+
+	lua_pushinteger(L, flags);
+	lua_pushinteger(L, count);
+
+	return 2;
+}
+
+/***
+Cast a ray on the map and find the first tile it hits, walking through the tiles (DDA) from the start to the end of the ray.
+@function :raycast
+@tparam number x0 X start coordinate of the ray on the map (pixels)
+@tparam number y0 Y start coordinate of the ray on the map (pixels)
+@tparam number x1 X end coordinate of the ray on the map (pixels)
+@tparam number y1 Y end coordinate of the ray on the map (pixels)
+@tparam[opt=SOLID] number mask only the tiles with one of these flags stop the ray
+@tparam[opt=1] number layer layer to check
+@treturn[1] number X coordinate where the ray enters the hit tile (pixels)
+@treturn[1] number Y coordinate where the ray enters the hit tile (pixels)
+@treturn[1] number X position of the hit tile (in tiles)
+@treturn[1] number Y position of the hit tile (in tiles)
+@treturn[2] nil if no tile was hit
+*/
+static int map_raycast(lua_State *L) {
+	map_userdata *map = luaL_checkudata(L, 1, "LMap");
+	double x0 = luaL_checknumber(L, 2);
+	double y0 = luaL_checknumber(L, 3);
+	double x1 = luaL_checknumber(L, 4);
+	double y1 = luaL_checknumber(L, 5);
+	luaL_argcheck(L, isFiniteNumber(x0), 2, "not a finite number");
+	luaL_argcheck(L, isFiniteNumber(y0), 3, "not a finite number");
+	luaL_argcheck(L, isFiniteNumber(x1), 4, "not a finite number");
+	luaL_argcheck(L, isFiniteNumber(y1), 5, "not a finite number");
+	u8 mask = luaL_optinteger(L, 6, MAP_TILE_SOLID);
+	map_layer *layer = checkLayer(L, map, 7);
+
+	// In tiles
+	int pitchX = map->tileSizeX + map->spaceX;
+	int pitchY = map->tileSizeY + map->spaceY;
+	double startX = x0 / pitchX, startY = y0 / pitchY;
+	double dx = x1 / pitchX - startX, dy = y1 / pitchY - startY;
+
+	// Only the part of the ray over the map is walked
+	double t = 0, tEnd = 1;
+	if (map->tileFlags == NULL || !clipRay(startX, dx, map->width, &t, &tEnd) || !clipRay(startY, dy, map->height, &t, &tEnd)) {
+		lua_pushnil(L);
+		return 1;
+	}
+	startX = fmin(fmax(startX + t*dx, 0), map->width);
+	startY = fmin(fmax(startY + t*dy, 0), map->height);
+
+	// On the far border of the map, the ray starts in the last tile
+	int tileX = fmin(fmax(floor(startX), 0), map->width - 1);
+	int tileY = fmin(fmax(floor(startY), 0), map->height - 1);
+	int stepX = dx > 0 ? 1 : -1, stepY = dy > 0 ? 1 : -1;
+
+	// Ray progress (0 to 1) at the next tile border on each axis, and between two borders
+	double nextX = dx != 0 ? t + (dx > 0 ? tileX + 1 - startX : startX - tileX) / fabs(dx) : INFINITY;
+	double nextY = dy != 0 ? t + (dy > 0 ? tileY + 1 - startY : startY - tileY) / fabs(dy) : INFINITY;
+	double deltaX = dx != 0 ? 1 / fabs(dx) : INFINITY;
+	double deltaY = dy != 0 ? 1 / fabs(dy) : INFINITY;
+
+	// The tiles are also checked, t may not move along a very long ray
+	while (t <= tEnd && tileX >= 0 && tileX < map->width && tileY >= 0 && tileY < map->height) {
+		if (getTileFlags(map, layer, tileX, tileY) & mask) {
+			lua_pushnumber(L, x0 + t*(x1 - x0));
+			lua_pushnumber(L, y0 + t*(y1 - y0));
+			lua_pushinteger(L, tileX);
+			lua_pushinteger(L, tileY);
+			return 4;
+		}
+
+		if (nextX < nextY) {
+			t = nextX;
+			nextX += deltaX;
+			tileX += stepX;
+		} else {
+			t = nextY;
+			nextY += deltaY;
+			tileY += stepY;
+		}
+	}
+
+	lua_pushnil(L);
+	return 1;
+}
+
+/***
+Save the map (with all its layers) to a binary map file, which loads much faster than a CSV file.
+The tilesets are not saved.
+@function :save
+@tparam string path path to the file to save the map to
+@tparam[opt=false] boolean compress compress the tiles with zlib
+@treturn[1] boolean true on success
+@treturn[2] boolean `false` in case of error
+@treturn[2] string error message
+*/
+static int map_save(lua_State *L) {
+	map_userdata *map = luaL_checkudata(L, 1, "LMap");
+	const char *path = luaL_checkstring(L, 2);
+	bool compress = lua_toboolean(L, 3);
+
+	u32 layerSize = sizeof(u16)*map->width*map->height;
+	map_file_header header = {
+		.magic = MAP_FILE_MAGIC,
+		.version = MAP_FILE_VERSION,
+		.flags = 0,
+		.width = map->width,
+		.height = map->height,
+		.tileWidth = map->tileSizeX,
+		.tileHeight = map->tileSizeY,
+		.layers = map->layerCount,
+		.reserved = 0,
+		.dataSize = layerSize*map->layerCount
+	};
+
+	u8 *compressed = NULL;
+	if (compress) {
+		uLong compressedSize = compressBound(header.dataSize);
+		compressed = malloc(compressedSize);
+
+		// Deflate all the layers in a single stream
+		z_stream stream = { .next_out = compressed, .avail_out = compressedSize };
+		int result = compressed != NULL ? deflateInit(&stream, Z_BEST_COMPRESSION) : Z_MEM_ERROR;
+		for (int l = 0; l < map->layerCount && result == Z_OK; l++) {
+			stream.next_in = (Bytef *)map->layers[l].data;
+			stream.avail_in = layerSize;
+			result = deflate(&stream, l == map->layerCount-1 ? Z_FINISH : Z_NO_FLUSH);
+		}
+		if (compressed != NULL) deflateEnd(&stream);
+
+		if (result != Z_STREAM_END) {
+			free(compressed);
+			lua_pushboolean(L, false);
+			lua_pushstring(L, "can't compress the map");
+			return 2;
+		}
+		header.flags |= MAP_FILE_ZLIB;
+		header.dataSize = stream.total_out;
+	}
+
+	FILE *file = fopen(path, "wb");
+	bool written = file != NULL && fwrite(&header, sizeof(header), 1, file) == 1;
+	if (compress) {
+		written = written && fwrite(compressed, 1, header.dataSize, file) == header.dataSize;
+	} else {
+		for (int l = 0; l < map->layerCount; l++) {
+			written = written && fwrite(map->layers[l].data, 1, layerSize, file) == layerSize;
+		}
+	}
+	if (file != NULL) written = (fclose(file) == 0) && written;
+	free(compressed);
+
+	if (!written) {
+		lua_pushboolean(L, false);
+		lua_pushfstring(L, "can't write \"%s\"", path);
+		return 2;
+	}
+
+	lua_pushboolean(L, true);
+	return 1;
+}
+
 // object
 static const struct luaL_Reg map_methods[] = {
-	{"draw",          map_draw         },
-	{"unload",        map_unload       },
-	{"getSize",       map_getSize      },
-	{"getTile",       map_getTile      },
-	{"setTile",       map_setTile      },
-	{"setSpace",      map_setSpace     },
-	{"__gc",          map_unload       },
+	{"draw",            map_draw           },
+	{"unload",          map_unload         },
+	{"getSize",         map_getSize        },
+	{"getTile",         map_getTile        },
+	{"setTile",         map_setTile        },
+	{"setSpace",        map_setSpace       },
+	{"addLayer",        map_addLayer       },
+	{"getLayerCount",   map_getLayerCount  },
+	{"setLayerScroll",  map_setLayerScroll },
+	{"setLayerTileset", map_setLayerTileset},
+	{"setAnimation",    map_setAnimation   },
+	{"setTileFlags",    map_setTileFlags   },
+	{"getTileFlags",    map_getTileFlags   },
+	{"queryRect",       map_queryRect      },
+	{"raycast",         map_raycast        },
+	{"save",            map_save           },
+	{"__gc",            map_unload         },
 	{NULL, NULL}
 };
 
@@ -332,6 +1192,36 @@ static const struct luaL_Reg map_functions[] = {
 	{NULL, NULL}
 };
 
+/***
+Fields
+@section Fields
+*/
+
+// constants
+struct { char *name; int value; } map_constants[] = {
+	/***
+	Tile value of an empty tile, which is not drawn.
+	@field NO_TILE
+	*/
+	{"NO_TILE", NO_TILE},
+	/***
+	Tile flag for solid tiles; stops the rays by default.
+	@field SOLID
+	*/
+	{"SOLID",   MAP_TILE_SOLID},
+	/***
+	Tile flag for one-way platforms.
+	@field ONE_WAY
+	*/
+	{"ONE_WAY", MAP_TILE_ONE_WAY},
+	/***
+	Tile flag for hazards.
+	@field HAZARD
+	*/
+	{"HAZARD",  MAP_TILE_HAZARD},
+	{NULL, 0}
+};
+
 int luaopen_map_lib(lua_State *L) {
 	luaL_newmetatable(L, "LMap");
 	lua_pushvalue(L, -1);
@@ -339,6 +1229,11 @@ int luaopen_map_lib(lua_State *L) {
 	luaL_setfuncs(L, map_methods, 0);
 	
 	luaL_newlib(L, map_functions);
+
+	for (int i = 0; map_constants[i].name; i++) {
+		lua_pushinteger(L, map_constants[i].value);
+		lua_setfield(L, -2, map_constants[i].name);
+	}
 	
 	return 1;
 }
@@ -4,6 +4,9 @@ The `gfx.texture` module.
 @usage local texture = require("ctr.gfx.texture")
 */
 #include <sf2d.h>
+#include <sf2d_tile.h>
+#include <sf2d_convert.h>
+#include <sf2d_etc1.h>
 #include <sfil.h>
 
 #include <lapi.h>
@@ -18,12 +21,12 @@ The `gfx.texture` module.
 #include <stb_image_write.h>
 #include <png.h>
 
+#include "gfx.h"
 #include "texture.h"
 
 int getType(const char *name) {
 	const char *dot = strrchr(name, '.');
-	if(!dot || dot == name) dot = "";
-	const char *ext = dot + 1;
+	const char *ext = (!dot || dot == name) ? "" : dot + 1;
 	if (strncmp(ext, "png", 3) == 0) {
 		return 0;
 	} else if (strncmp(ext, "jpeg", 4) == 0 || strncmp(ext, "jpg", 3) == 0) {
@@ -35,22 +38,182 @@ int getType(const char *name) {
 	}
 }
 
+// Texture file header, followed by the texture data as it is in memory (tiled, and compressed for ETC1), so it's
+// loaded without any decoding. All the values are little-endian, like on the 3DS.
+typedef struct {
+	char magic[4]; // TEXTURE_FILE_MAGIC
+	u16 version; // TEXTURE_FILE_VERSION
+	u16 format; // sf2d_texfmt
+	u16 width;
+	u16 height;
+	u16 pow2_w;
+	u16 pow2_h;
+	u32 dataSize; // in bytes
+} texture_file_header;
+
+#define TEXTURE_FILE_MAGIC "LTEX"
+#define TEXTURE_FILE_VERSION 1
+
+// Check the optional format argument of a function
+static sf2d_texfmt checkFormat(lua_State *L, int arg) {
+	int format = luaL_optinteger(L, arg, TEXFMT_RGBA8);
+	luaL_argcheck(L, format == TEXFMT_ETC1 || format == TEXFMT_ETC1A4 || sf2d_tile_bytes_per_texel(format) > 0, arg, "unsupported texture format");
+	return format;
+}
+
+// Create a texture from an image in RGBA bytes, converted to the format; NULL if there's not enough memory
+static sf2d_texture *createTexture(const u8 *rgba, int w, int h, sf2d_texfmt format, u8 place) {
+	sf2d_texture *texture = sf2d_create_texture(w, h, format, place);
+	if (texture == NULL) return NULL;
+
+	if (format == TEXFMT_ETC1 || format == TEXFMT_ETC1A4) {
+		sf2d_etc1_encode_texture(texture, rgba, w*4);
+	} else {
+		// Tiled straight from the decoded image, without the byte-swapped copy of sf2d_create_texture_mem_RGBA8
+		sf2d_tile_texture_rows(texture, 0, h, rgba, w*4, SF2D_TILE_CONVERT_RGBA8);
+	}
+	GSPGPU_FlushDataCache(texture->data, texture->data_size);
+
+	return texture;
+}
+
+// Load a texture file (see texture:save); returns NULL if it isn't one, with *error set to false, or in case of error
+static sf2d_texture *loadTextureFile(const char *path, u8 place, bool *error) {
+	*error = false;
+	FILE *file = fopen(path, "rb");
+	if (file == NULL) return NULL;
+
+	texture_file_header header;
+	sf2d_texture *texture = NULL;
+	if (fread(&header, 1, sizeof(header), file) == sizeof(header) && memcmp(header.magic, TEXTURE_FILE_MAGIC, 4) == 0) {
+		*error = true;
+		if (header.version == TEXTURE_FILE_VERSION && header.format <= TEXFMT_ETC1A4) {
+			texture = sf2d_create_texture(header.width, header.height, header.format, place);
+		}
+		if (texture != NULL) {
+			if (texture->pow2_w == header.pow2_w && texture->pow2_h == header.pow2_h && texture->data_size == header.dataSize
+				&& fread(texture->data, 1, header.dataSize, file) == header.dataSize) {
+				texture->tiled = 1;
+				GSPGPU_FlushDataCache(texture->data, texture->data_size);
+				*error = false;
+			} else {
+				sf2d_free_texture(texture);
+				texture = NULL;
+			}
+		}
+	}
+	fclose(file);
+
+	return texture;
+}
+
+// Load an image file in a new texture, cut and scaled down with the options if not NULL; NULL in case of error
+static sf2d_texture *loadFile(const char *path, u8 place, u8 type, sf2d_texfmt format, const sfil_load_options *options) {
+	if (type==3) type = getType(path);
+	if (format == TEXFMT_RGBA8) {
+		if (type==0) { //PNG
+			return options ? sfil_load_PNG_file_options(path, place, options) : sfil_load_PNG_file(path, place);
+		} else if (type==1) { //JPEG
+			return options ? sfil_load_JPEG_file_options(path, place, options) : sfil_load_JPEG_file(path, place);
+		} else if (type==2 && options == NULL) { //BMP
+			return sfil_load_BMP_file(path, place);
+		}
+	}
+
+	// Texture files are loaded as they are
+	if (type >= TYPE_TEX && options == NULL) {
+		bool error;
+		sf2d_texture *texture = loadTextureFile(path, place, &error);
+		if (texture != NULL || error) return texture;
+	}
+
+	// Other formats: decoded by stbi, then converted
+	int w, h;
+	u8* data = stbi_load(path, &w, &h, NULL, 4);
+	if (data == NULL) return NULL;
+
+	if (options != NULL) {
+		u8 *scaled = sfil_scale_RGBA8(data, w, h, options, &w, &h);
+		free(data);
+		if (scaled == NULL) return NULL;
+		data = scaled;
+	}
+
+	sf2d_texture *texture = createTexture(data, w, h, format, place);
+	free(data);
+
+	return texture;
+}
+
+// Read the options table of load
+static void checkLoadOptions(lua_State *L, int arg, u8 *place, u8 *type, sf2d_texfmt *format, sfil_load_options *options) {
+	luaL_checktype(L, arg, LUA_TTABLE);
+	memset(options, 0, sizeof(*options));
+
+	lua_getfield(L, arg, "place");
+	*place = luaL_optinteger(L, -1, SF2D_PLACE_RAM);
+	lua_getfield(L, arg, "type");
+	*type = luaL_optinteger(L, -1, 3);
+	lua_getfield(L, arg, "format");
+	*format = checkFormat(L, lua_gettop(L));
+	lua_getfield(L, arg, "maxWidth");
+	options->max_width = luaL_optinteger(L, -1, 0);
+	lua_getfield(L, arg, "maxHeight");
+	options->max_height = luaL_optinteger(L, -1, 0);
+	lua_pop(L, 5);
+	luaL_argcheck(L, options->max_width >= 0 && options->max_height >= 0, arg, "negative maximum size");
+
+	if (lua_getfield(L, arg, "region") != LUA_TNIL) {
+		luaL_argcheck(L, lua_istable(L, -1), arg, "region must be a table {x, y, width, height}");
+		int *region[4] = { &options->region_x, &options->region_y, &options->region_w, &options->region_h };
+		for (int i = 0; i < 4; i++) {
+			lua_rawgeti(L, -1, i + 1);
+			luaL_argcheck(L, lua_isinteger(L, -1), arg, "region must be a table {x, y, width, height}");
+			*region[i] = lua_tointeger(L, -1);
+			lua_pop(L, 1);
+		}
+		luaL_argcheck(L, options->region_x >= 0 && options->region_y >= 0, arg, "negative region position");
+		luaL_argcheck(L, options->region_w > 0 && options->region_h > 0, arg, "empty region");
+	}
+	lua_pop(L, 1);
+}
+
 // module functions
 
 /***
-Load a texture from a file. Supported formats: PNG, JPEG, BMP, GIF, PSD, TGA, HDR, PIC, PNM.
+Load a texture from a file. Supported formats: PNG, JPEG, BMP, GIF, PSD, TGA, HDR, PIC, PNM, and the texture files
+written by `:save`, which are loaded without decoding.
+The place argument can be replaced by a table of options, to load a part of the image, or an image bigger than needed
+(like a photo) scaled down: the fields `place`, `type` and `format` (the arguments), `maxWidth` and `maxHeight` (the
+image is scaled down to fit, keeping its aspect ratio) and `region` (the part of the image to load, `{x, y, width,
+height}`, cut before scaling). PNG and JPEG files (with the sfil library) are scaled while they're decoded, without
+allocating the full image, and JPEG files are decoded at 1/2, 1/4 or 1/8 of their size when possible, much faster.
+Texture files can't be loaded with options.
 @function load
 @tparam string path path to the image file
-@tparam[opt=PLACE_RAM] number place where to put the loaded texture
+@tparam[opt=PLACE_RAM] number|table place where to put the loaded texture, or the table of options
 @tparam[opt=auto] number type type of the image. This is only used to force loading PNG, JPEG or BMP files with the sfil library; any value between 5 and 250 will force using the stbi library. Leave nil to autodetect the format.
+@tparam[opt=FORMAT_RGBA8] number format pixel format of the texture (`FORMAT_*`), the image is converted to it; other
+formats than RGBA8 use less memory, the ETC1 ones down to 4 bits per pixel, but are always decoded with the stbi
+library, and encoding ETC1 is slow (see `:save` to encode it once). Texture files keep their own format.
 @treturn[1] texture the loaded texture object
 @treturn[2] nil in case of error
 @treturn[2] string error message
+@usage local photo = texture.load("photo.jpg", { maxWidth = 400, maxHeight = 240 })
 */
 static int texture_load(lua_State *L) {
 	const char *path = luaL_checkstring(L, 1);
-	u8 place = luaL_optinteger(L, 2, SF2D_PLACE_RAM); //place in ram by default
-	u8 type = luaL_optinteger(L, 3, 3); //type 3 is "search at the end of the filename"
+	u8 place, type;
+	sf2d_texfmt format;
+	sfil_load_options options, *loadOptions = NULL;
+	if (lua_istable(L, 2)) {
+		checkLoadOptions(L, 2, &place, &type, &format, &options);
+		loadOptions = &options;
+	} else {
+		place = luaL_optinteger(L, 2, SF2D_PLACE_RAM); //place in ram by default
+		type = luaL_optinteger(L, 3, 3); //type 3 is "search at the end of the filename"
+		format = checkFormat(L, 4);
+	}
 
 	texture_userdata *texture;
 	texture = (texture_userdata *)lua_newuserdata(L, sizeof(*texture));
@@ -58,24 +221,10 @@ static int texture_load(lua_State *L) {
 	luaL_getmetatable(L, "LTexture");
 	lua_setmetatable(L, -2);
 
-	if (type==3) type = getType(path);
-	if (type==0) { //PNG
-		texture->texture = sfil_load_PNG_file(path, place);
-	} else if (type==1) { //JPEG
-		texture->texture = sfil_load_JPEG_file(path, place);
-	} else if (type==2) { //BMP
-		texture->texture = sfil_load_BMP_file(path, place); //appears to be broken right now.
-	} else {
-		int w, h;
-		char* data = (char*)stbi_load(path, &w, &h, NULL, 4);
-		if (data == NULL) {
-			lua_pushnil(L);
-			lua_pushstring(L, "Can't open file");
-			return 2;
-		}
-		texture->texture = sf2d_create_texture_mem_RGBA8(data, w, h, TEXFMT_RGBA8, place);
-		free(data);
-	}
+	texture->entry = NULL;
+	texture->borrowed = false;
+	texture->lastFrame = 0;
+	texture->texture = loadFile(path, place, type, format, loadOptions);
 
 	if (texture->texture == NULL) {
 	  lua_pushnil(L);
@@ -96,12 +245,24 @@ Create an empty texture.
 @tparam number width Texture width
 @tparam number height Texture height
 @tparam[opt=PLACE_RAM] number place where to put the loaded texture
-@treturn texture the loaded texture object
+@tparam[opt=FORMAT_RGBA8] number format pixel format of the texture (`FORMAT_*`); ETC1 textures can't be changed
+@treturn[1] texture the loaded texture object
+@treturn[2] nil in case of error
+@treturn[2] string error message
 */
 static int texture_new(lua_State *L) {
 	int w = luaL_checkinteger(L, 1);
 	int h = luaL_checkinteger(L, 2);
 	u8 place = luaL_checkinteger(L, 3);
+	sf2d_texfmt format = checkFormat(L, 4);
+
+	sf2d_texture *tex = sf2d_create_texture(w, h, format, place);
+	if (tex == NULL) {
+		lua_pushnil(L);
+		lua_pushstring(L, "Failed to create the texture");
+		return 2;
+	}
+	sf2d_texture_tile32(tex);
 
 	texture_userdata *texture;
 	texture = (texture_userdata *)lua_newuserdata(L, sizeof(*texture));
@@ -109,9 +270,205 @@ static int texture_new(lua_State *L) {
 	luaL_getmetatable(L, "LTexture");
 	lua_setmetatable(L, -2);
 
-	texture->texture = sf2d_create_texture(w, h, TEXFMT_RGBA8, place);
-	sf2d_texture_tile32(texture->texture);
+	texture->entry = NULL;
+	texture->borrowed = false;
+	texture->lastFrame = 0;
+	texture->texture = tex;
+
+	texture->scaleX = 1.0f;
+	texture->scaleY = 1.0f;
+	texture->blendColor = 0xffffffff;
+
+	return 1;
+}
+
+// Texture cache: textures shared by path and load options, kept in LRU order after their last user until the budgets
+// need their memory
+
+#define PLACE_AUTO 0xFF // loaded in RAM, moved to the VRAM once drawn in CACHE_HOT_FRAMES frames
+#define CACHE_HOT_FRAMES 16
+#define CACHE_RAM_BUDGET  (16*1024*1024)
+#define CACHE_VRAM_BUDGET (3*1024*1024)
+
+typedef struct cache_entry {
+	char *key; // place, type, format and path
+	sf2d_texture *texture;
+	u8 place; // requested place, PLACE_AUTO or SF2D_PLACE_RAM/VRAM; the current one is texture->place
+	int refs; // texture objects using it
+	u32 drawnFrames; // frames it was drawn in, for PLACE_AUTO
+	u32 lastFrame; // value of lua_frameCount when it was last drawn
+	struct cache_entry *prev, *next; // most recently used first
+} cache_entry;
+
+static struct {
+	cache_entry *first, *last;
+	int entries;
+	u32 bytes[2]; // by SF2D_PLACE_RAM/VRAM
+	u32 budget[2];
+	u32 hits, misses, evictions, promotions;
+} cache = { .budget = { CACHE_RAM_BUDGET, CACHE_VRAM_BUDGET } };
+
+static void cacheUnlink(cache_entry *entry) {
+	if (entry->prev) entry->prev->next = entry->next;
+	else cache.first = entry->next;
+	if (entry->next) entry->next->prev = entry->prev;
+	else cache.last = entry->prev;
+}
+
+static void cachePushFront(cache_entry *entry) {
+	entry->prev = NULL;
+	entry->next = cache.first;
+	if (cache.first) cache.first->prev = entry;
+	else cache.last = entry;
+	cache.first = entry;
+}
+
+static void cacheFree(cache_entry *entry) {
+	cacheUnlink(entry);
+	cache.bytes[entry->texture->place] -= entry->texture->data_size;
+	cache.entries--;
+	sf2d_free_texture(entry->texture);
+	free(entry->key);
+	free(entry);
+}
+
+// Free the least recently used unreferenced textures of a place until it has room for `needed` more bytes in its budget.
+// The textures drawn in the frames the GPU may still read are kept.
+static void cacheEvict(u8 place, u32 needed) {
+	cache_entry *entry = cache.last;
+	while (entry != NULL && cache.bytes[place] + needed > cache.budget[place]) {
+		cache_entry *prev = entry->prev;
+		if (entry->refs == 0 && entry->texture->place == place && !gfxFrameInUse(entry->lastFrame)) {
+			cacheFree(entry);
+			cache.evictions++;
+		}
+		entry = prev;
+	}
+}
+
+static void cacheRelease(cache_entry *entry) {
+	entry->refs--;
+	cacheUnlink(entry);
+	cachePushFront(entry);
+	cacheEvict(entry->texture->place, 0);
+}
+
+// Move a texture from the RAM to the VRAM, if the VRAM budget allows it
+static void cachePromote(cache_entry *entry) {
+	sf2d_texture *texture = entry->texture;
+	u32 size = texture->data_size;
+
+	cacheEvict(SF2D_PLACE_VRAM, size);
+	void *data = NULL;
+	if (cache.bytes[SF2D_PLACE_VRAM] + size <= cache.budget[SF2D_PLACE_VRAM] && vramSpaceFree() >= size) {
+		data = vramMemAlign(size, 0x80);
+	}
+	if (data == NULL) {
+		entry->drawnFrames = 0; // try again later
+		return;
+	}
+
+	memcpy(data, texture->data, size);
+	GSPGPU_FlushDataCache(data, size);
+	sf2d_free_deferred(texture->data, SF2D_PLACE_RAM); // the previous frame may still read it
+	texture->data = data;
+	texture->place = SF2D_PLACE_VRAM;
+	cache.bytes[SF2D_PLACE_RAM] -= size;
+	cache.bytes[SF2D_PLACE_VRAM] += size;
+	cache.promotions++;
+}
+
+void cacheTextureDrawn(texture_userdata *texture) {
+	texture->lastFrame = lua_frameCount;
+	cache_entry *entry = texture->entry;
+	if (entry == NULL || entry->lastFrame == lua_frameCount) return;
+
+	// First draw in this frame: the current frame doesn't use its data yet, it can move
+	if (entry->place == PLACE_AUTO && entry->texture->place == SF2D_PLACE_RAM && ++entry->drawnFrames >= CACHE_HOT_FRAMES) {
+		cachePromote(entry);
+	}
+	entry->lastFrame = lua_frameCount;
+}
+
+void textureWaitUnused(texture_userdata *texture) {
+	// The texture of a render target is drawn through other objects too
+	if (texture->borrowed || gfxFrameInUse(texture->lastFrame) || (texture->entry != NULL && gfxFrameInUse(texture->entry->lastFrame))) {
+		sf2d_wait_gpu();
+	}
+}
+
+/***
+Load a texture through the texture cache: loading the same file with the same options again returns a texture object
+sharing the same texture, without reading the file. The texture stays in the cache after its last texture object is
+collected or unloaded, until the memory budget of its place (see `setCacheBudget`) needs room for other textures.
+Changing the pixels of a cached texture changes them for every texture object sharing it.
+@function loadCached
+@tparam string path path to the image file
+@tparam[opt=PLACE_AUTO] number place where to put the loaded texture: `PLACE_RAM`, `PLACE_VRAM`, or `PLACE_AUTO` to
+load it in RAM and move it to the VRAM once it's drawn often
+@tparam[opt=auto] number type type of the image, see `load`
+@tparam[opt=FORMAT_RGBA8] number format pixel format of the texture, see `load`
+@treturn[1] texture the loaded texture object
+@treturn[2] nil in case of error
+@treturn[2] string error message
+*/
+static int texture_loadCached(lua_State *L) {
+	const char *path = luaL_checkstring(L, 1);
+	u8 place = luaL_optinteger(L, 2, PLACE_AUTO);
+	u8 type = luaL_optinteger(L, 3, 3);
+	sf2d_texfmt format = checkFormat(L, 4);
+
+	if (place != PLACE_AUTO && place != SF2D_PLACE_RAM && place != SF2D_PLACE_VRAM) {
+		lua_pushnil(L);
+		lua_pushstring(L, "Only RAM and VRAM textures can be cached");
+		return 2;
+	}
 
+	lua_pushfstring(L, "%d:%d:%d:%s", place, type, format, path);
+	const char *key = lua_tostring(L, -1);
+
+	cache_entry *entry;
+	for (entry = cache.first; entry != NULL && strcmp(entry->key, key) != 0; entry = entry->next);
+
+	if (entry != NULL) {
+		cache.hits++;
+		cacheUnlink(entry);
+	} else {
+		cache.misses++;
+		u8 loadPlace = place == PLACE_AUTO ? SF2D_PLACE_RAM : place;
+		sf2d_texture *tex = loadFile(path, loadPlace, type, format, NULL);
+		if (tex == NULL) {
+			// Maybe out of memory: free every unreferenced texture of this place and try again
+			u32 budget = cache.budget[loadPlace];
+			cache.budget[loadPlace] = 0;
+			cacheEvict(loadPlace, 0);
+			cache.budget[loadPlace] = budget;
+			tex = loadFile(path, loadPlace, type, format, NULL);
+		}
+		if (tex == NULL || (entry = calloc(1, sizeof(*entry))) == NULL || (entry->key = strdup(key)) == NULL) {
+			free(entry);
+			sf2d_free_texture(tex);
+			lua_pushnil(L);
+			lua_pushstring(L, "No such file");
+			return 2;
+		}
+		entry->texture = tex;
+		entry->place = place;
+		entry->lastFrame = lua_frameCount - 1;
+		cache.entries++;
+		cache.bytes[tex->place] += tex->data_size;
+		cacheEvict(tex->place, 0);
+	}
+	entry->refs++;
+	cachePushFront(entry);
+
+	texture_userdata *texture = lua_newuserdata(L, sizeof(*texture));
+	luaL_getmetatable(L, "LTexture");
+	lua_setmetatable(L, -2);
+	texture->entry = entry;
+	texture->borrowed = false;
+	texture->lastFrame = 0;
+	texture->texture = entry->texture;
 	texture->scaleX = 1.0f;
 	texture->scaleY = 1.0f;
 	texture->blendColor = 0xffffffff;
@@ -119,6 +476,440 @@ static int texture_new(lua_State *L) {
 	return 1;
 }
 
+/***
+Set the memory budgets of the texture cache. When the textures of a place use more memory than its budget, the least
+recently used textures that no texture object uses are freed; the textures still in use are never freed, and may go
+over the budget.
+@function setCacheBudget
+@tparam number ram budget of the RAM textures in bytes (default 16 MiB)
+@tparam number vram budget of the VRAM textures in bytes (default 3 MiB)
+*/
+static int texture_setCacheBudget(lua_State *L) {
+	cache.budget[SF2D_PLACE_RAM] = luaL_checkinteger(L, 1);
+	cache.budget[SF2D_PLACE_VRAM] = luaL_checkinteger(L, 2);
+
+	cacheEvict(SF2D_PLACE_RAM, 0);
+	cacheEvict(SF2D_PLACE_VRAM, 0);
+
+	return 0;
+}
+
+/***
+Return the statistics of the texture cache.
+@function cacheStats
+@treturn table `hits`, `misses` (loads that read the file), `evictions` (textures freed for the budgets), `promotions`
+(textures moved to the VRAM), `textures` (number of cached textures), `ramBytes`, `vramBytes` (memory used by the cached
+textures of each place), `ramBudget` and `vramBudget`
+*/
+static int texture_cacheStats(lua_State *L) {
+	lua_createtable(L, 0, 9);
+	lua_pushinteger(L, cache.hits);
+	lua_setfield(L, -2, "hits");
+	lua_pushinteger(L, cache.misses);
+	lua_setfield(L, -2, "misses");
+	lua_pushinteger(L, cache.evictions);
+	lua_setfield(L, -2, "evictions");
+	lua_pushinteger(L, cache.promotions);
+	lua_setfield(L, -2, "promotions");
+	lua_pushinteger(L, cache.entries);
+	lua_setfield(L, -2, "textures");
+	lua_pushinteger(L, cache.bytes[SF2D_PLACE_RAM]);
+	lua_setfield(L, -2, "ramBytes");
+	lua_pushinteger(L, cache.bytes[SF2D_PLACE_VRAM]);
+	lua_setfield(L, -2, "vramBytes");
+	lua_pushinteger(L, cache.budget[SF2D_PLACE_RAM]);
+	lua_setfield(L, -2, "ramBudget");
+	lua_pushinteger(L, cache.budget[SF2D_PLACE_VRAM]);
+	lua_setfield(L, -2, "vramBudget");
+
+	return 1;
+}
+
+// Background thread: reads and decodes the files of loadAsync, and encodes the images of saveAsync and gfx.screenshot.
+// The main thread creates the textures and snapshots the images to encode, since sf2d isn't thread-safe.
+
+#define ASYNC_QUEUE_SIZE 16
+#define ASYNC_STACK_SIZE 0x20000
+
+typedef enum {
+	JOB_LOAD,
+	JOB_SAVE,
+} job_kind;
+
+typedef enum {
+	JOB_PENDING,
+	JOB_DONE,
+	JOB_FAILED,
+} job_state;
+
+typedef struct {
+	job_kind kind;
+	char *path;
+	job_state state;
+	bool abandoned; // the handle was collected before the end of the job, the worker frees it
+	u8 *pixels; // decoded image, or image to encode, in RGBA bytes
+	int width, height;
+	u8 place; // loads: where to create the texture
+	u8 type; // saves: TYPE_PNG or TYPE_BMP
+	int level, filters; // saves: PNG compression level and filters
+} async_job;
+
+typedef struct {
+	async_job *job; // NULL once the result (texture or error message) is in the user value
+} load_userdata;
+
+typedef struct {
+	async_job *job; // NULL once the result is known
+	bool saved;
+} save_userdata;
+
+static Thread asyncThread = NULL;
+static LightLock asyncLock;
+static Handle asyncWork, asyncDone; // jobs added to the queue, jobs finished
+static async_job *asyncQueue[ASYNC_QUEUE_SIZE];
+static int asyncFirst = 0, asyncCount = 0;
+
+static void freeJob(async_job *job) {
+	if (job->kind == JOB_LOAD) stbi_image_free(job->pixels);
+	else free(job->pixels);
+	free(job->path);
+	free(job);
+}
+
+// Write RGBA pixels to a PNG file, with a zlib compression level (0-9) and a set of PNG_FILTER_* flags
+static bool writePNG(const char *path, const u8 *pixels, int w, int h, int level, int filters) {
+	FILE *file = fopen(path, "wb");
+	if (file == NULL) return false;
+
+	png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+	png_infop infos = png ? png_create_info_struct(png) : NULL;
+	if (infos == NULL || setjmp(png_jmpbuf(png))) {
+		png_destroy_write_struct(&png, &infos);
+		fclose(file);
+		return false;
+	}
+	png_init_io(png, file);
+	png_set_compression_level(png, level);
+	png_set_filter(png, PNG_FILTER_TYPE_BASE, filters);
+
+	png_set_IHDR(png, infos, w, h, 8, PNG_COLOR_TYPE_RGB_ALPHA, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+	png_write_info(png, infos);
+	for (int y = 0; y < h; y++) {
+		png_write_row(png, (png_const_bytep)(pixels + y * w * 4));
+	}
+	png_write_end(png, NULL);
+
+	png_destroy_write_struct(&png, &infos);
+	return fclose(file) == 0;
+}
+
+static bool writeImage(const char *path, u8 type, const u8 *pixels, int w, int h, int level, int filters) {
+	if (type == TYPE_BMP) return stbi_write_bmp(path, w, h, 4, pixels) != 0;
+	return writePNG(path, pixels, w, h, level, filters);
+}
+
+static void asyncWorker(void *arg) {
+	while (true) {
+		svcWaitSynchronization(asyncWork, U64_MAX);
+
+		while (true) {
+			LightLock_Lock(&asyncLock);
+			if (asyncCount == 0) {
+				LightLock_Unlock(&asyncLock);
+				break;
+			}
+			async_job *job = asyncQueue[asyncFirst];
+			asyncFirst = (asyncFirst + 1) % ASYNC_QUEUE_SIZE;
+			asyncCount--;
+			bool abandoned = job->abandoned;
+			LightLock_Unlock(&asyncLock);
+
+			// The images are saved even if nobody waits for them
+			bool success;
+			int w = 0, h = 0;
+			u8 *pixels = NULL;
+			if (job->kind == JOB_SAVE) {
+				success = writeImage(job->path, job->type, job->pixels, job->width, job->height, job->level, job->filters);
+			} else {
+				pixels = abandoned ? NULL : stbi_load(job->path, &w, &h, NULL, 4);
+				success = pixels != NULL;
+			}
+
+			LightLock_Lock(&asyncLock);
+			if (job->kind == JOB_LOAD) {
+				job->pixels = pixels;
+				job->width = w;
+				job->height = h;
+			}
+			job->state = success ? JOB_DONE : JOB_FAILED;
+			abandoned = job->abandoned;
+			LightLock_Unlock(&asyncLock);
+
+			if (abandoned) freeJob(job);
+			svcSignalEvent(asyncDone);
+		}
+	}
+}
+
+static bool startAsync() {
+	s32 priority = 0x30;
+
+	LightLock_Init(&asyncLock);
+	if (svcCreateEvent(&asyncWork, RESET_ONESHOT) != 0) return false;
+	if (svcCreateEvent(&asyncDone, RESET_ONESHOT) != 0) {
+		svcCloseHandle(asyncWork);
+		return false;
+	}
+
+	// Below the main thread, so it only works while the main thread waits (e.g. for the VBlank)
+	svcGetThreadPriority(&priority, CUR_THREAD_HANDLE);
+	asyncThread = threadCreate(asyncWorker, NULL, ASYNC_STACK_SIZE, priority + 1, -2, true);
+	if (asyncThread == NULL) {
+		svcCloseHandle(asyncWork);
+		svcCloseHandle(asyncDone);
+		return false;
+	}
+	return true;
+}
+
+// Queue a job for the background thread; returns an error message (and frees the job) if it can't
+static const char *queueJob(async_job *job) {
+	if (asyncThread == NULL && !startAsync()) {
+		freeJob(job);
+		return "Can't start the background thread";
+	}
+
+	LightLock_Lock(&asyncLock);
+	if (asyncCount == ASYNC_QUEUE_SIZE) {
+		LightLock_Unlock(&asyncLock);
+		const char *error = job->kind == JOB_LOAD ? "Too many pending loads" : "Too many pending saves";
+		freeJob(job);
+		return error;
+	}
+	asyncQueue[(asyncFirst + asyncCount) % ASYNC_QUEUE_SIZE] = job;
+	asyncCount++;
+	LightLock_Unlock(&asyncLock);
+	svcSignalEvent(asyncWork);
+
+	return NULL;
+}
+
+int saveAsync(lua_State *L, u8 *pixels, int width, int height, const char *path, u8 type, int level, int filters) {
+	async_job *job = calloc(1, sizeof(*job));
+	if (job == NULL || (job->path = strdup(path)) == NULL) {
+		free(job);
+		free(pixels);
+		lua_pushnil(L);
+		lua_pushstring(L, "Failed to allocate the save");
+		return 2;
+	}
+	job->kind = JOB_SAVE;
+	job->state = JOB_PENDING;
+	job->pixels = pixels;
+	job->width = width;
+	job->height = height;
+	job->type = type;
+	job->level = level;
+	job->filters = filters;
+
+	const char *error = queueJob(job);
+	if (error != NULL) {
+		lua_pushnil(L);
+		lua_pushstring(L, error);
+		return 2;
+	}
+
+	save_userdata *save = lua_newuserdata(L, sizeof(*save));
+	luaL_getmetatable(L, "LTextureSave");
+	lua_setmetatable(L, -2);
+	save->job = job;
+	save->saved = false;
+
+	return 1;
+}
+
+/***
+Load a texture from a file without blocking: the file is read and decoded by a background thread, and the texture is
+created when the returned object is asked for it. Supports the same formats as `load`, always decoded with stbi.
+At most 16 loads and saves can be waiting for the thread at the same time.
+@function loadAsync
+@tparam string path path to the image file
+@tparam[opt=PLACE_RAM] number place where to put the loaded texture
+@treturn[1] textureLoad the object to get the texture from
+@treturn[2] nil in case of error
+@treturn[2] string error message
+*/
+static int texture_loadAsync(lua_State *L) {
+	const char *path = luaL_checkstring(L, 1);
+	u8 place = luaL_optinteger(L, 2, SF2D_PLACE_RAM);
+
+	async_job *job = calloc(1, sizeof(*job));
+	if (job == NULL || (job->path = strdup(path)) == NULL) {
+		free(job);
+		lua_pushnil(L);
+		lua_pushstring(L, "Failed to allocate the load");
+		return 2;
+	}
+	job->kind = JOB_LOAD;
+	job->place = place;
+	job->state = JOB_PENDING;
+
+	const char *error = queueJob(job);
+	if (error != NULL) {
+		lua_pushnil(L);
+		lua_pushstring(L, error);
+		return 2;
+	}
+
+	load_userdata *load = lua_newuserdata(L, sizeof(*load));
+	luaL_getmetatable(L, "LTextureLoad");
+	lua_setmetatable(L, -2);
+	load->job = job;
+
+	return 1;
+}
+
+// Atlas file header, followed by the name offset of each page (u32), the regions (atlas_region) sorted by name, then
+// their names and the paths of the pages (NUL-terminated, relative to the atlas file). All the values are little-endian.
+typedef struct {
+	char magic[4]; // ATLAS_FILE_MAGIC
+	u16 version; // ATLAS_FILE_VERSION
+	u16 pages;
+	u32 regions;
+	u32 namesSize; // in bytes
+} atlas_file_header;
+
+typedef struct {
+	u16 page;
+	u16 x, y; // in pixels
+	u16 w, h;
+	u16 reserved;
+	u32 name; // offset in the names
+} atlas_region;
+
+#define ATLAS_FILE_MAGIC "LATL"
+#define ATLAS_FILE_VERSION 1
+
+typedef struct {
+	sf2d_texture **pages;
+	int pageCount;
+	atlas_region *regions;
+	int regionCount;
+	char *names;
+	float scaleX;
+	float scaleY;
+	u32 blendColor;
+} atlas_userdata;
+
+static void freeAtlas(atlas_userdata *atlas) {
+	for (int i = 0; i < atlas->pageCount; i++) {
+		sf2d_free_texture(atlas->pages[i]);
+	}
+	free(atlas->pages);
+	free(atlas->regions);
+	free(atlas->names);
+	atlas->pages = NULL;
+	atlas->pageCount = 0;
+	atlas->regions = NULL;
+	atlas->regionCount = 0;
+	atlas->names = NULL;
+}
+
+// Read an atlas file and load its pages; returns NULL on success or an error message
+static const char *readAtlas(atlas_userdata *atlas, FILE *file, const char *path, u8 place) {
+	atlas_file_header header;
+	if (fread(&header, 1, sizeof(header), file) != sizeof(header) || memcmp(header.magic, ATLAS_FILE_MAGIC, 4) != 0) return "not an atlas file";
+	if (header.version != ATLAS_FILE_VERSION) return "unsupported atlas file version";
+	if (header.pages == 0 || header.regions > 0xFFFFFF || header.namesSize == 0) return "invalid atlas file";
+
+	u32 *pageNames = malloc(header.pages * sizeof(u32));
+	atlas->pages = calloc(header.pages, sizeof(sf2d_texture *));
+	atlas->regions = malloc(header.regions * sizeof(atlas_region) + 1);
+	atlas->names = malloc(header.namesSize);
+	const char *error = NULL;
+	if (pageNames == NULL || atlas->pages == NULL || atlas->regions == NULL || atlas->names == NULL) {
+		error = "not enough memory";
+	} else if (fread(pageNames, sizeof(u32), header.pages, file) != header.pages
+		|| fread(atlas->regions, sizeof(atlas_region), header.regions, file) != header.regions
+		|| fread(atlas->names, 1, header.namesSize, file) != header.namesSize) {
+		error = "truncated atlas file";
+	} else if (atlas->names[header.namesSize - 1] != '\0') {
+		error = "invalid atlas file";
+	}
+	for (u32 i = 0; error == NULL && i < header.regions; i++) {
+		atlas_region *region = &atlas->regions[i];
+		if (region->page >= header.pages || region->name >= header.namesSize) error = "invalid atlas file";
+	}
+
+	// The paths of the pages are relative to the atlas file
+	const char *slash = strrchr(path, '/');
+	int dirLength = slash ? slash - path + 1 : 0;
+	for (int i = 0; error == NULL && i < header.pages; i++) {
+		if (pageNames[i] >= header.namesSize) {
+			error = "invalid atlas file";
+			break;
+		}
+		const char *name = atlas->names + pageNames[i];
+		char *pagePath = malloc(dirLength + strlen(name) + 1);
+		if (pagePath == NULL) {
+			error = "not enough memory";
+			break;
+		}
+		memcpy(pagePath, path, dirLength);
+		strcpy(pagePath + dirLength, name);
+		atlas->pages[i] = loadFile(pagePath, place, 3, TEXFMT_RGBA8, NULL);
+		atlas->pageCount = i + 1;
+		free(pagePath);
+		if (atlas->pages[i] == NULL) error = "can't load an atlas page";
+	}
+	atlas->regionCount = header.regions;
+	free(pageNames);
+
+	return error;
+}
+
+/***
+Load a texture atlas: a few textures (the pages) holding many images (the regions), drawn by name or by index. Drawing
+regions of the same page one after the other is as fast as drawing a single texture, since they are batched together.
+The atlas files are made from a directory of images by `host/atlasconv.lua`.
+@function loadAtlas
+@tparam string path path to the atlas file; its pages are in the same directory
+@tparam[opt=PLACE_RAM] number place where to put the pages
+@treturn[1] atlas the loaded atlas object
+@treturn[2] nil in case of error
+@treturn[2] string error message
+*/
+static int texture_loadAtlas(lua_State *L) {
+	const char *path = luaL_checkstring(L, 1);
+	u8 place = luaL_optinteger(L, 2, SF2D_PLACE_RAM);
+
+	FILE *file = fopen(path, "rb");
+	if (file == NULL) {
+		lua_pushnil(L);
+		lua_pushstring(L, "No such file");
+		return 2;
+	}
+
+	atlas_userdata *atlas = lua_newuserdata(L, sizeof(*atlas));
+	memset(atlas, 0, sizeof(*atlas));
+	luaL_getmetatable(L, "LAtlas");
+	lua_setmetatable(L, -2);
+	atlas->scaleX = 1.0f;
+	atlas->scaleY = 1.0f;
+	atlas->blendColor = 0xffffffff;
+
+	const char *error = readAtlas(atlas, file, path, place);
+	fclose(file);
+	if (error != NULL) {
+		freeAtlas(atlas);
+		lua_pushnil(L);
+		lua_pushstring(L, error);
+		return 2;
+	}
+
+	return 1;
+}
+
 /***
 Texture object
 @section Methods
@@ -141,6 +932,7 @@ static int texture_draw(lua_State *L) {
 	float hotspotX = luaL_optnumber(L, 5, 0.0f);
 	float hotspotY = luaL_optnumber(L, 6, 0.0f);
 
+	cacheTextureDrawn(texture);
 	if (rad == 0.0f && texture->scaleX == 1.0f && texture->scaleY == 1.0f && texture->blendColor == 0xffffffff) {
 		sf2d_draw_texture(texture->texture, x - hotspotX, y - hotspotY);
 	} else {
@@ -175,6 +967,7 @@ static int texture_drawPart(lua_State *L) {
 	float hotspotX = luaL_optnumber(L, 9, 0.0f);
 	float hotspotY = luaL_optnumber(L, 10, 0.0f);
 
+	cacheTextureDrawn(texture);
 	sf2d_draw_texture_part_rotate_scale_hotspot_blend(texture->texture, x, y, rad, sx, sy, w, h, texture->scaleX, texture->scaleY, hotspotX, hotspotY, texture->blendColor);
 
 	return 0;
@@ -195,6 +988,19 @@ static int texture_getSize(lua_State *L) {
 	return 2;
 }
 
+/***
+Return the pixel format of the texture.
+@function :getFormat
+@treturn number the format (`FORMAT_*`)
+*/
+static int texture_getFormat(lua_State *L) {
+	texture_userdata *texture = luaL_checkudata(L, 1, "LTexture");
+
+	lua_pushinteger(L, texture->texture->pixel_format);
+
+	return 1;
+}
+
 /***
 Unload a texture.
 @function :unload
@@ -204,7 +1010,12 @@ static int texture_unload(lua_State *L) {
 
 	if (texture->texture == NULL) return 0;
 
-	sf2d_free_texture(texture->texture);
+	if (texture->entry != NULL) {
+		cacheRelease(texture->entry);
+		texture->entry = NULL;
+	} else if (!texture->borrowed) {
+		sf2d_free_texture(texture->texture);
+	}
 	texture->texture = NULL;
 
 	return 0;
@@ -239,6 +1050,7 @@ static int texture_getPixel(lua_State *L) {
 	int x = luaL_checkinteger(L, 2);
 	int y = luaL_checkinteger(L, 3);
 
+	if (texture->borrowed) sf2d_wait_gpu(); // a render target may still be rendered
 	lua_pushinteger(L, sf2d_get_pixel(texture->texture, x, y));
 
 	return 1;
@@ -257,6 +1069,7 @@ static int texture_setPixel(lua_State *L) {
 	int y = luaL_checkinteger(L, 3);
 	u32 color = luaL_checkinteger(L, 4);
 
+	textureWaitUnused(texture);
 	sf2d_set_pixel(texture->texture, x, y, color);
 
 	return 0;
@@ -289,11 +1102,40 @@ static int texture_getBlendColor(lua_State *L) {
 	return 1;
 }
 
+// Read h rows of the texture starting at y, in RGBA bytes
+static void readRows(sf2d_texture *texture, int y, int h, u32 *dst) {
+	if (sf2d_tile_bytes_per_texel(texture->pixel_format) > 0 && (texture->tiled || texture->pixel_format != TEXFMT_RGBA8)) {
+		sf2d_untile_rect(texture->data, texture->pow2_w, texture->pow2_h, texture->pixel_format, 0, y, texture->width, h, dst, texture->width * 4, SF2D_TILE_CONVERT_RGBA8);
+		return;
+	}
+	if (texture->pixel_format == TEXFMT_RGBA8) { // linear, from the bottom row
+		const u32 *row = (const u32 *)texture->data + (texture->pow2_h - 1 - y) * texture->pow2_w;
+		sf2d_convert_rect(dst, texture->width * 4, SF2D_PIXEL_RGBA8, row, -texture->pow2_w * 4, SF2D_PIXEL_ABGR8, texture->width, h);
+		return;
+	}
+	for (int j=0;j<h;j++) {
+		for (int x=0;x<texture->width;x++) {
+			dst[x+(j*texture->width)] = __builtin_bswap32(sf2d_get_pixel(texture, x, y+j));
+		}
+	}
+}
+
+// Copy the texture in RGBA bytes, in a new buffer
+static u8 *snapshot(sf2d_texture *texture) {
+	u32 *pixels = malloc(texture->width * texture->height * 4);
+	if (pixels != NULL) readRows(texture, 0, texture->height, pixels);
+	return (u8 *)pixels;
+}
+
 /***
 Save a texture to a file.
 @function :save
 @tparam string filename path to the file to save the texture to
-@tparam[opt=TYPE_PNG] number type type of the image to save. Can be TYPE_PNG or TYPE_BMP
+@tparam[opt=TYPE_PNG] number type type of the image to save. Can be TYPE_PNG, TYPE_BMP, or TYPE_TEX for a texture file:
+the texture as it is in memory, in its format, which `load` reads straight into the texture
+@tparam[opt=6] integer level PNG compression level, from 0 (fastest, biggest) to 9 (slowest, smallest)
+@tparam[opt=FILTER_ALL] integer filters PNG filters to choose from for each row, `FILTER_*` constants combined with `|`;
+`FILTER_NONE` is the fastest
 @treturn[1] boolean true on success
 @treturn[2] boolean `false` in case of error
 @treturn[2] string error message
@@ -301,57 +1143,38 @@ Save a texture to a file.
 static int texture_save(lua_State *L) {
 	texture_userdata *texture = luaL_checkudata(L, 1, "LTexture");
 	const char* path = luaL_checkstring(L, 2);
-	u8 type = luaL_optinteger(L, 3, 0);
+	u8 type = luaL_optinteger(L, 3, TYPE_PNG);
+	int level = luaL_optinteger(L, 4, PNG_DEFAULT_LEVEL);
+	int filters = luaL_optinteger(L, 5, PNG_ALL_FILTERS);
+	luaL_argcheck(L, level >= 0 && level <= 9, 4, "invalid compression level");
 
+	if (texture->borrowed) sf2d_wait_gpu(); // a render target may still be rendered
 	int result = 0;
-	if (type == 0) { // PNG
+	if (type == TYPE_TEX) {
+		sf2d_texture *tex = texture->texture;
+		if (!tex->tiled) textureWaitUnused(texture);
+		sf2d_texture_tile32(tex);
+		texture_file_header header = {
+			.magic = TEXTURE_FILE_MAGIC, .version = TEXTURE_FILE_VERSION, .format = tex->pixel_format,
+			.width = tex->width, .height = tex->height, .pow2_w = tex->pow2_w, .pow2_h = tex->pow2_h,
+			.dataSize = tex->data_size
+		};
 		FILE* file = fopen(path, "wb");
-		if (file == NULL) {
-			lua_pushboolean(L, false);
-			lua_pushstring(L, "Can open file");
-			return 2;
-		}
-		png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
-		png_infop infos = png_create_info_struct(png);
-		setjmp(png_jmpbuf(png));
-		png_init_io(png, file);
-
-		png_set_IHDR(png, infos, texture->texture->width, texture->texture->height, 8, PNG_COLOR_TYPE_RGB_ALPHA, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
-		png_write_info(png, infos);
-
-		png_bytep row = malloc(4 * texture->texture->width * sizeof(png_byte));
-
-		for(int y=0;y<texture->texture->height;y++) {
-			for (int x=0;x<texture->texture->width;x++) {
-				((u32*)row)[x] = __builtin_bswap32(sf2d_get_pixel(texture->texture, x, y));
-			}
-			png_write_row(png, row);
+		if (file != NULL) {
+			result = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(tex->data, 1, tex->data_size, file) == tex->data_size;
+			result = fclose(file) == 0 && result;
 		}
 
-		png_write_end(png, NULL);
-
-		fclose(file);
-		png_free_data(png, infos, PNG_FREE_ALL, -1);
-		png_destroy_write_struct(&png, &infos);
-		free(row);
-
-		result = 1;
-
-	} else if (type == 2) { // BMP
-		u32* buff = malloc(texture->texture->width * texture->texture->height * 4);
-		if (buff == NULL) {
+	} else if (type == TYPE_PNG || type == TYPE_BMP) {
+		u8 *pixels = snapshot(texture->texture);
+		if (pixels == NULL) {
 			lua_pushboolean(L, false);
 			lua_pushstring(L, "Failed to allocate buffer");
 			return 2;
 		}
-		for (int y=0;y<texture->texture->height;y++) {
-			for (int x=0;x<texture->texture->width;x++) {
-				buff[x+(y*texture->texture->width)] = __builtin_bswap32(sf2d_get_pixel(texture->texture, x, y));
-			}
-		}
-		result = stbi_write_bmp(path, texture->texture->width, texture->texture->height, 4, buff);
-		free(buff);
-	
+		result = writeImage(path, type, pixels, texture->texture->width, texture->texture->height, level, filters);
+		free(pixels);
+
 	} else {
 		lua_pushboolean(L, false);
 		lua_pushstring(L, "Not a valid type");
@@ -368,26 +1191,430 @@ static int texture_save(lua_State *L) {
 	return 1;
 }
 
+/***
+Save a texture to a file without blocking: the texture is copied right away, then encoded and written by a background
+thread, and the returned object tells when it's done. The file is written even if the object is collected before.
+At most 16 loads and saves can be waiting for the thread at the same time.
+@function :saveAsync
+@tparam string filename path to the file to save the texture to
+@tparam[opt=TYPE_PNG] number type type of the image to save: TYPE_PNG or TYPE_BMP
+@tparam[opt=6] integer level PNG compression level, see `save`
+@tparam[opt=FILTER_ALL] integer filters PNG filters, see `save`
+@treturn[1] textureSave the object to wait for the save with
+@treturn[2] nil in case of error
+@treturn[2] string error message
+*/
+static int texture_saveAsync(lua_State *L) {
+	texture_userdata *texture = luaL_checkudata(L, 1, "LTexture");
+	const char* path = luaL_checkstring(L, 2);
+	u8 type = luaL_optinteger(L, 3, TYPE_PNG);
+	int level = luaL_optinteger(L, 4, PNG_DEFAULT_LEVEL);
+	int filters = luaL_optinteger(L, 5, PNG_ALL_FILTERS);
+	luaL_argcheck(L, type == TYPE_PNG || type == TYPE_BMP, 3, "not a valid type");
+	luaL_argcheck(L, level >= 0 && level <= 9, 4, "invalid compression level");
+
+	if (texture->borrowed) sf2d_wait_gpu(); // a render target may still be rendered
+	u8 *pixels = snapshot(texture->texture);
+	if (pixels == NULL) {
+		lua_pushnil(L);
+		lua_pushstring(L, "Failed to allocate buffer");
+		return 2;
+	}
+
+	return saveAsync(L, pixels, texture->texture->width, texture->texture->height, path, type, level, filters);
+}
+
 // object
 static const struct luaL_Reg texture_methods[] = {
 	{ "draw",          texture_draw          },
 	{ "drawPart",      texture_drawPart      },
 	{ "scale",         texture_scale         },
 	{ "getSize",       texture_getSize       },
+	{ "getFormat",     texture_getFormat     },
 	{ "unload",        texture_unload        },
 	{ "getPixel",      texture_getPixel      },
 	{ "setPixel",      texture_setPixel      },
 	{ "setBlendColor", texture_setBlendColor },
 	{ "getBlendColor", texture_getBlendColor },
 	{ "save",          texture_save          },
+	{ "saveAsync",     texture_saveAsync     },
 	{ "__gc",          texture_unload        },
 	{NULL, NULL}
 };
 
+/***
+textureLoad object
+@section Load methods
+*/
+
+static job_state jobState(async_job *job) {
+	LightLock_Lock(&asyncLock);
+	job_state state = job->state;
+	LightLock_Unlock(&asyncLock);
+	return state;
+}
+
+// Create the texture of a finished job (on the main thread, like every sf2d call) and keep it in the user value
+static void finishLoad(lua_State *L, load_userdata *load) {
+	async_job *job = load->job;
+
+	if (job->state == JOB_FAILED) {
+		lua_pushstring(L, "Can't open file");
+	} else {
+		sf2d_texture *tex = createTexture(job->pixels, job->width, job->height, TEXFMT_RGBA8, job->place);
+		if (tex == NULL) {
+			lua_pushstring(L, "Not enough memory for the texture");
+		} else {
+			texture_userdata *texture = lua_newuserdata(L, sizeof(*texture));
+			luaL_getmetatable(L, "LTexture");
+			lua_setmetatable(L, -2);
+			texture->entry = NULL;
+			texture->borrowed = false;
+			texture->lastFrame = 0;
+			texture->texture = tex;
+			texture->scaleX = 1.0f;
+			texture->scaleY = 1.0f;
+			texture->blendColor = 0xffffffff;
+		}
+	}
+	lua_setuservalue(L, 1);
+
+	freeJob(job);
+	load->job = NULL;
+}
+
+/***
+Check if the texture is loaded, without waiting. Creates the texture once the file is decoded.
+@function :ready
+@treturn boolean true if `get` will return without waiting
+*/
+static int textureLoad_ready(lua_State *L) {
+	load_userdata *load = luaL_checkudata(L, 1, "LTextureLoad");
+
+	if (load->job != NULL) {
+		if (jobState(load->job) == JOB_PENDING) {
+			lua_pushboolean(L, false);
+			return 1;
+		}
+		finishLoad(L, load);
+	}
+
+	lua_pushboolean(L, true);
+	return 1;
+}
+
+/***
+Return the loaded texture, waiting for the end of the decoding if needed.
+@function :get
+@treturn[1] texture the loaded texture object; the same one on each call
+@treturn[2] nil in case of error
+@treturn[2] string error message
+*/
+static int textureLoad_get(lua_State *L) {
+	load_userdata *load = luaL_checkudata(L, 1, "LTextureLoad");
+
+	if (load->job != NULL) {
+		while (jobState(load->job) == JOB_PENDING) {
+			svcWaitSynchronization(asyncDone, U64_MAX);
+		}
+		finishLoad(L, load);
+	}
+
+	lua_getuservalue(L, 1);
+	if (lua_type(L, -1) == LUA_TSTRING) {
+		lua_pushnil(L);
+		lua_insert(L, -2);
+		return 2;
+	}
+	return 1;
+}
+
+static int textureLoad_gc(lua_State *L) {
+	load_userdata *load = luaL_checkudata(L, 1, "LTextureLoad");
+
+	if (load->job != NULL) {
+		LightLock_Lock(&asyncLock);
+		bool pending = load->job->state == JOB_PENDING;
+		load->job->abandoned = true;
+		LightLock_Unlock(&asyncLock);
+
+		if (!pending) freeJob(load->job);
+		load->job = NULL;
+	}
+
+	return 0;
+}
+
+static const struct luaL_Reg textureLoad_methods[] = {
+	{ "ready", textureLoad_ready },
+	{ "get",   textureLoad_get   },
+	{ "__gc",  textureLoad_gc    },
+	{NULL, NULL}
+};
+
+/***
+textureSave object
+@section Save methods
+*/
+
+// Keep the result of a finished save
+static void finishSave(save_userdata *save) {
+	save->saved = save->job->state == JOB_DONE;
+	freeJob(save->job);
+	save->job = NULL;
+}
+
+/***
+Check if the file is written, without waiting.
+@function :ready
+@treturn boolean true if `wait` will return without waiting
+*/
+static int textureSave_ready(lua_State *L) {
+	save_userdata *save = luaL_checkudata(L, 1, "LTextureSave");
+
+	if (save->job != NULL) {
+		if (jobState(save->job) == JOB_PENDING) {
+			lua_pushboolean(L, false);
+			return 1;
+		}
+		finishSave(save);
+	}
+
+	lua_pushboolean(L, true);
+	return 1;
+}
+
+/***
+Wait for the end of the save.
+@function :wait
+@treturn[1] boolean true if the file was written
+@treturn[2] boolean `false` in case of error
+@treturn[2] string error message
+*/
+static int textureSave_wait(lua_State *L) {
+	save_userdata *save = luaL_checkudata(L, 1, "LTextureSave");
+
+	if (save->job != NULL) {
+		while (jobState(save->job) == JOB_PENDING) {
+			svcWaitSynchronization(asyncDone, U64_MAX);
+		}
+		finishSave(save);
+	}
+
+	lua_pushboolean(L, save->saved);
+	if (!save->saved) {
+		lua_pushstring(L, "Failed to save the image");
+		return 2;
+	}
+	return 1;
+}
+
+static int textureSave_gc(lua_State *L) {
+	save_userdata *save = luaL_checkudata(L, 1, "LTextureSave");
+
+	if (save->job != NULL) {
+		LightLock_Lock(&asyncLock);
+		bool pending = save->job->state == JOB_PENDING;
+		save->job->abandoned = true;
+		LightLock_Unlock(&asyncLock);
+
+		if (!pending) freeJob(save->job);
+		save->job = NULL;
+	}
+
+	return 0;
+}
+
+static const struct luaL_Reg textureSave_methods[] = {
+	{ "ready", textureSave_ready },
+	{ "wait",  textureSave_wait  },
+	{ "__gc",  textureSave_gc    },
+	{NULL, NULL}
+};
+
+/***
+Atlas object
+@section Atlas methods
+*/
+
+// Index of the region with a name, or -1; the regions are sorted by name
+static int findRegion(atlas_userdata *atlas, const char *name) {
+	int first = 0, last = atlas->regionCount - 1;
+	while (first <= last) {
+		int middle = (first + last) / 2;
+		int cmp = strcmp(name, atlas->names + atlas->regions[middle].name);
+		if (cmp == 0) return middle;
+		if (cmp < 0) last = middle - 1;
+		else first = middle + 1;
+	}
+	return -1;
+}
+
+// Index of a region given by its index (from 1) or its name, or raise an error
+static int checkRegion(lua_State *L, atlas_userdata *atlas, int arg) {
+	int index;
+	if (lua_type(L, arg) == LUA_TNUMBER) {
+		index = luaL_checkinteger(L, arg) - 1;
+		luaL_argcheck(L, index >= 0 && index < atlas->regionCount, arg, "no such region");
+	} else {
+		index = findRegion(atlas, luaL_checkstring(L, arg));
+		luaL_argcheck(L, index >= 0, arg, "no such region");
+	}
+	return index;
+}
+
+/***
+Draw a region of the atlas.
+@function :draw
+@tparam string|integer region name or index of the region; indexes (see `getIndex`) avoid looking the name up on each draw
+@tparam integer x X position
+@tparam integer y Y position
+@tparam[opt=0.0] number rad rotation of the region around the hotspot (in radians)
+@tparam[opt=0.0] number hotspotX the hostpot X coordinate
+@tparam[opt=0.0] number hotspotY the hostpot Y coordinate
+*/
+static int atlas_draw(lua_State *L) {
+	atlas_userdata *atlas = luaL_checkudata(L, 1, "LAtlas");
+	int index = checkRegion(L, atlas, 2);
+	int x = luaL_checkinteger(L, 3);
+	int y = luaL_checkinteger(L, 4);
+	float rad = luaL_optnumber(L, 5, 0.0f);
+	float hotspotX = luaL_optnumber(L, 6, 0.0f);
+	float hotspotY = luaL_optnumber(L, 7, 0.0f);
+
+	atlas_region *region = &atlas->regions[index];
+	sf2d_draw_texture_part_rotate_scale_hotspot_blend(atlas->pages[region->page], x, y, rad, region->x, region->y, region->w, region->h, atlas->scaleX, atlas->scaleY, hotspotX, hotspotY, atlas->blendColor);
+
+	return 0;
+}
+
+/***
+Return the index of a region, to draw it without looking its name up.
+@function :getIndex
+@tparam string name name of the region: the name of its image file, without the extension
+@treturn[1] integer the index of the region
+@treturn[2] nil if there's no such region
+*/
+static int atlas_getIndex(lua_State *L) {
+	atlas_userdata *atlas = luaL_checkudata(L, 1, "LAtlas");
+	int index = findRegion(atlas, luaL_checkstring(L, 2));
+
+	if (index < 0) lua_pushnil(L);
+	else lua_pushinteger(L, index + 1);
+
+	return 1;
+}
+
+/***
+Return the number of regions of the atlas; their indexes go from 1 to this number.
+@function :getRegionCount
+@treturn integer the number of regions
+*/
+static int atlas_getRegionCount(lua_State *L) {
+	atlas_userdata *atlas = luaL_checkudata(L, 1, "LAtlas");
+
+	lua_pushinteger(L, atlas->regionCount);
+
+	return 1;
+}
+
+/***
+Return the name of a region.
+@function :getName
+@tparam integer index index of the region
+@treturn string the name of the region
+*/
+static int atlas_getName(lua_State *L) {
+	atlas_userdata *atlas = luaL_checkudata(L, 1, "LAtlas");
+	int index = luaL_checkinteger(L, 2);
+	luaL_argcheck(L, index >= 1 && index <= atlas->regionCount, 2, "no such region");
+
+	lua_pushstring(L, atlas->names + atlas->regions[index - 1].name);
+
+	return 1;
+}
+
+/***
+Return the size of a region.
+@function :getSize
+@tparam string|integer region name or index of the region
+@treturn number width of the region
+@treturn number height of the region
+*/
+static int atlas_getSize(lua_State *L) {
+	atlas_userdata *atlas = luaL_checkudata(L, 1, "LAtlas");
+	atlas_region *region = &atlas->regions[checkRegion(L, atlas, 2)];
+
+	lua_pushinteger(L, region->w);
+	lua_pushinteger(L, region->h);
+
+	return 2;
+}
+
+/***
+Rescale the regions drawn. The default scale is `1.0`.
+@function :scale
+@tparam number scaleX new scale of the width
+@tparam[opt=scaleX] number scaleY new scale of the height
+*/
+static int atlas_scale(lua_State *L) {
+	atlas_userdata *atlas = luaL_checkudata(L, 1, "LAtlas");
+	float sx = luaL_checknumber(L, 2);
+	float sy = luaL_optnumber(L, 3, sx);
+
+	atlas->scaleX = sx;
+	atlas->scaleY = sy;
+
+	return 0;
+}
+
+/***
+Set the blend color of the regions drawn.
+@function :setBlendColor
+@tparam number color new blend color
+*/
+static int atlas_setBlendColor(lua_State *L) {
+	atlas_userdata *atlas = luaL_checkudata(L, 1, "LAtlas");
+
+	atlas->blendColor = luaL_checkinteger(L, 2);
+
+	return 0;
+}
+
+/***
+Unload the atlas and its pages.
+@function :unload
+*/
+static int atlas_unload(lua_State *L) {
+	atlas_userdata *atlas = luaL_checkudata(L, 1, "LAtlas");
+
+	freeAtlas(atlas);
+
+	return 0;
+}
+
+static const struct luaL_Reg atlas_methods[] = {
+	{ "draw",           atlas_draw           },
+	{ "getIndex",       atlas_getIndex       },
+	{ "getRegionCount", atlas_getRegionCount },
+	{ "getName",        atlas_getName        },
+	{ "getSize",        atlas_getSize        },
+	{ "scale",          atlas_scale          },
+	{ "setBlendColor",  atlas_setBlendColor  },
+	{ "unload",         atlas_unload         },
+	{ "__gc",           atlas_unload         },
+	{NULL, NULL}
+};
+
 // module
 static const struct luaL_Reg texture_functions[] = {
-	{"load", texture_load},
-	{"new",  texture_new },
+	{"load",           texture_load          },
+	{"loadAsync",      texture_loadAsync     },
+	{"loadCached",     texture_loadCached    },
+	{"loadAtlas",      texture_loadAtlas     },
+	{"setCacheBudget", texture_setCacheBudget},
+	{"cacheStats",     texture_cacheStats    },
+	{"new",            texture_new           },
 	{NULL, NULL}
 };
 
@@ -414,20 +1641,115 @@ struct { char *name; int value; } texture_constants[] = {
 	*/
 	{"PLACE_TEMP", SF2D_PLACE_TEMP},
 	/***
+	Constant used to let the texture cache choose the place: RAM, then VRAM once the texture is drawn often. Only for `loadCached`.
+	@field PLACE_AUTO
+	*/
+	{"PLACE_AUTO", PLACE_AUTO     },
+	/***
 	Constant used to select the PNG type.
 	@field TYPE_PNG
 	*/
-	{"TYPE_PNG",   0              },
+	{"TYPE_PNG",   TYPE_PNG       },
 	/***
 	Constant used to select the JPEG type.
 	@field TYPE_JPEG
 	*/
-	{"TYPE_JPEG",  1              },
+	{"TYPE_JPEG",  TYPE_JPEG      },
 	/***
 	Constant used to select the BMP type.
 	@field TYPE_BMP
 	*/
-	{"TYPE_BMP",   2              },
+	{"TYPE_BMP",   TYPE_BMP       },
+	/***
+	Constant used to select the texture file type, see `:save`.
+	@field TYPE_TEX
+	*/
+	{"TYPE_TEX",   TYPE_TEX       },
+	/***
+	Constant used to select the RGBA8 format: 32 bits per pixel. The default format.
+	@field FORMAT_RGBA8
+	*/
+	{"FORMAT_RGBA8",  TEXFMT_RGBA8 },
+	/***
+	Constant used to select the RGB8 format: 24 bits per pixel, without alpha.
+	@field FORMAT_RGB8
+	*/
+	{"FORMAT_RGB8",   TEXFMT_RGB8  },
+	/***
+	Constant used to select the RGB5A1 format: 16 bits per pixel, 5 bits per color and 1 bit of alpha.
+	@field FORMAT_RGB5A1
+	*/
+	{"FORMAT_RGB5A1", TEXFMT_RGB5A1},
+	/***
+	Constant used to select the RGB565 format: 16 bits per pixel, without alpha.
+	@field FORMAT_RGB565
+	*/
+	{"FORMAT_RGB565", TEXFMT_RGB565},
+	/***
+	Constant used to select the RGBA4 format: 16 bits per pixel, 4 bits per channel.
+	@field FORMAT_RGBA4
+	*/
+	{"FORMAT_RGBA4",  TEXFMT_RGBA4 },
+	/***
+	Constant used to select the IA8 format: 16 bits per pixel, 8 bits of luminance (grayscale) and 8 bits of alpha.
+	@field FORMAT_IA8
+	*/
+	{"FORMAT_IA8",    TEXFMT_IA8   },
+	/***
+	Constant used to select the I8 format: 8 bits of luminance per pixel, without alpha.
+	@field FORMAT_I8
+	*/
+	{"FORMAT_I8",     TEXFMT_I8    },
+	/***
+	Constant used to select the A8 format: 8 bits of alpha per pixel, black.
+	@field FORMAT_A8
+	*/
+	{"FORMAT_A8",     TEXFMT_A8    },
+	/***
+	Constant used to select the IA4 format: 8 bits per pixel, 4 bits of luminance and 4 bits of alpha.
+	@field FORMAT_IA4
+	*/
+	{"FORMAT_IA4",    TEXFMT_IA4   },
+	/***
+	Constant used to select the ETC1 format: compressed, 4 bits per pixel, without alpha.
+	@field FORMAT_ETC1
+	*/
+	{"FORMAT_ETC1",   TEXFMT_ETC1  },
+	/***
+	Constant used to select the ETC1A4 format: compressed, 8 bits per pixel with 4 bits of alpha.
+	@field FORMAT_ETC1A4
+	*/
+	{"FORMAT_ETC1A4", TEXFMT_ETC1A4},
+	/***
+	PNG filter used by `:save`: none, the fastest to encode.
+	@field FILTER_NONE
+	*/
+	{"FILTER_NONE",    PNG_FILTER_NONE },
+	/***
+	PNG filter used by `:save`: difference with the pixel on the left.
+	@field FILTER_SUB
+	*/
+	{"FILTER_SUB",     PNG_FILTER_SUB  },
+	/***
+	PNG filter used by `:save`: difference with the pixel above.
+	@field FILTER_UP
+	*/
+	{"FILTER_UP",      PNG_FILTER_UP   },
+	/***
+	PNG filter used by `:save`: difference with the average of the pixels on the left and above.
+	@field FILTER_AVERAGE
+	*/
+	{"FILTER_AVERAGE", PNG_FILTER_AVG  },
+	/***
+	PNG filter used by `:save`: difference with the Paeth predictor of the pixels on the left, above and above left.
+	@field FILTER_PAETH
+	*/
+	{"FILTER_PAETH",   PNG_FILTER_PAETH},
+	/***
+	PNG filters used by `:save`: all of them, the best one chosen for each row. The default; the smallest files.
+	@field FILTER_ALL
+	*/
+	{"FILTER_ALL",     PNG_ALL_FILTERS },
 	{NULL, 0}
 };
 
@@ -436,6 +1758,21 @@ int luaopen_texture_lib(lua_State *L) {
 	lua_pushvalue(L, -1);
 	lua_setfield(L, -2, "__index");
 	luaL_setfuncs(L, texture_methods, 0);
+
+	luaL_newmetatable(L, "LTextureLoad");
+	lua_pushvalue(L, -1);
+	lua_setfield(L, -2, "__index");
+	luaL_setfuncs(L, textureLoad_methods, 0);
+
+	luaL_newmetatable(L, "LTextureSave");
+	lua_pushvalue(L, -1);
+	lua_setfield(L, -2, "__index");
+	luaL_setfuncs(L, textureSave_methods, 0);
+
+	luaL_newmetatable(L, "LAtlas");
+	lua_pushvalue(L, -1);
+	lua_setfield(L, -2, "__index");
+	luaL_setfuncs(L, atlas_methods, 0);
 	
 	luaL_newlib(L, texture_functions);
 	
@@ -1,11 +1,32 @@
 #ifndef TEXTURE_H
 #define TEXTURE_H
 
+// Image types of load and save
+#define TYPE_PNG 0
+#define TYPE_JPEG 1
+#define TYPE_BMP 2
+#define TYPE_TEX 4 // texture file, or any image format of stbi
+
+#define PNG_DEFAULT_LEVEL 6 // zlib compression level of the saved PNG files
+
 typedef struct {
 	sf2d_texture *texture;
 	float scaleX;
 	float scaleY;
 	u32 blendColor;
+	struct cache_entry *entry; // shared texture of the cache, or NULL if the texture is owned by this object
+	bool borrowed; // texture owned by another object (the texture of a render target), not freed with this one
+	u32 lastFrame; // value of lua_frameCount when it was last drawn through this object, 0 if never
 } texture_userdata;
 
+// Called before drawing a texture; lets the cache move the textures drawn often to the VRAM
+void cacheTextureDrawn(texture_userdata *texture);
+
+// Called before the CPU changes the texels of a texture: waits for the GPU if a frame it's rendering may read them
+void textureWaitUnused(texture_userdata *texture);
+
+// Encode RGBA pixels to an image file (TYPE_PNG or TYPE_BMP) on the background thread. Takes the malloc'd pixels over,
+// pushes a textureSave object or nil and an error message, and returns the number of values pushed.
+int saveAsync(lua_State *L, u8 *pixels, int width, int height, const char *path, u8 type, int level, int filters);
+
 #endif